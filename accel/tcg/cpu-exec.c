@@ -45,6 +45,7 @@
 #include "tb-hash.h"
 #include "tb-context.h"
 #include "tb-internal.h"
+#include "tb-async.h"
 #include "internal-common.h"
 
 /* -icount align implementation. */
@@ -233,8 +234,8 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, TCGTBCPUState s)
     /* we should never be trying to look up an INVALID tb */
     tcg_debug_assert(!(s.cflags & CF_INVALID));
 
-    hash = tb_jmp_cache_hash_func(s.pc);
     jc = cpu->tb_jmp_cache;
+    hash = tb_jmp_cache_hash_func(jc, s.pc);
 
     tb = qatomic_read(&jc->array[hash].tb);
     if (likely(tb &&
@@ -242,9 +243,18 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, TCGTBCPUState s)
                tb->cs_base == s.cs_base &&
                tb->flags == s.flags &&
                tb_cflags(tb) == s.cflags)) {
+        qatomic_set(&jc->hits, jc->hits + 1);
         goto hit;
     }
 
+    qatomic_set(&jc->misses, jc->misses + 1);
+    if (unlikely(jc->misses - jc->window_misses >=
+                 TB_JMP_CACHE_WINDOW_MISSES) &&
+        tb_jmp_cache_resize(cpu)) {
+        jc = cpu->tb_jmp_cache;
+        hash = tb_jmp_cache_hash_func(jc, s.pc);
+    }
+
     tb = tb_htable_lookup(cpu, s);
     if (tb == NULL) {
         return NULL;
@@ -904,8 +914,15 @@ static inline void cpu_loop_exec_tb(CPUState *cpu, TranslationBlock *tb,
         return;
     }
 
+    if (!icount_enabled()) {
+        /* The execution counter of the TB ran out.  */
+        mmap_lock();
+        tb_tier_up(cpu, tb);
+        mmap_unlock();
+        return;
+    }
+
     /* Instruction counter expired.  */
-    assert(icount_enabled());
 #ifndef CONFIG_USER_ONLY
     /* Ensure global icount has gone forward */
     icount_update(cpu);
@@ -974,8 +991,8 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
                  * We add the TB in the virtual pc hash table
                  * for the fast lookup
                  */
-                h = tb_jmp_cache_hash_func(s.pc);
                 jc = cpu->tb_jmp_cache;
+                h = tb_jmp_cache_hash_func(jc, s.pc);
                 jc->array[h].pc = s.pc;
                 qatomic_set(&jc->array[h].tb, tb);
             }
@@ -1065,7 +1082,7 @@ bool tcg_exec_realizefn(CPUState *cpu, Error **errp)
         tcg_target_initialized = true;
     }
 
-    cpu->tb_jmp_cache = g_new0(CPUJumpCache, 1);
+    cpu->tb_jmp_cache = tb_jmp_cache_new(TB_JMP_CACHE_MIN_BITS);
     tlb_init(cpu);
 #ifndef CONFIG_USER_ONLY
     tcg_iommu_init_notifier_list(cpu);
@@ -1082,6 +1099,7 @@ void tcg_exec_unrealizefn(CPUState *cpu)
     tcg_iommu_free_notifier_list(cpu);
 #endif /* !CONFIG_USER_ONLY */
 
+    tb_async_cpu_unrealize(cpu);
     tlb_destroy(cpu);
     g_free_rcu(cpu->tb_jmp_cache, rcu);
 }
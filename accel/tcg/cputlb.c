@@ -46,6 +46,7 @@
 #include "tb-hash.h"
 #include "tb-internal.h"
 #include "tlb-bounds.h"
+#include "tb-async.h"
 #include "internal-common.h"
 #ifdef CONFIG_PLUGIN
 #include "qemu/plugin-memory.h"
@@ -155,8 +156,8 @@ static void tb_jmp_cache_clear_page(CPUState *cpu, vaddr page_addr)
         return;
     }
 
-    i0 = tb_jmp_cache_hash_page(page_addr);
-    for (i = 0; i < TB_JMP_PAGE_SIZE; i++) {
+    i0 = tb_jmp_cache_hash_page(jc, page_addr);
+    for (i = 0; i < tb_jmp_page_size(jc); i++) {
         qatomic_set(&jc->array[i0 + i].tb, NULL);
     }
 }
@@ -276,6 +277,23 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
     }
 }
 
+static inline size_t tlb_vtable_size(const CPUTLBDesc *desc)
+{
+    return CPU_VTLB_WAYS << desc->vbits;
+}
+
+/*
+ * Return the first entry of the victim tlb set for @page.  Pages that
+ * evict each other from the main tlb differ only in their high bits,
+ * so spread them with a multiplicative hash.
+ */
+static inline size_t tlb_vtable_set(const CPUTLBDesc *desc, vaddr page)
+{
+    uint64_t h = (uint64_t)(page >> TARGET_PAGE_BITS) * 0x9e3779b97f4a7c15ull;
+
+    return desc->vbits ? (h >> (64 - desc->vbits)) * CPU_VTLB_WAYS : 0;
+}
+
 static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
 {
     desc->n_used_entries = 0;
@@ -283,7 +301,7 @@ static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
     desc->large_page_mask = -1;
     desc->vindex = 0;
     memset(fast->table, -1, sizeof_tlb(fast));
-    memset(desc->vtable, -1, sizeof(desc->vtable));
+    memset(desc->vtable, -1, sizeof(CPUTLBEntry) * tlb_vtable_size(desc));
 }
 
 static void tlb_flush_one_mmuidx_locked(CPUState *cpu, int mmu_idx,
@@ -305,6 +323,9 @@ static void tlb_mmu_init(CPUTLBDesc *desc, CPUTLBDescFast *fast, int64_t now)
     fast->mask = (n_entries - 1) << CPU_TLB_ENTRY_BITS;
     fast->table = g_new(CPUTLBEntry, n_entries);
     desc->fulltlb = g_new(CPUTLBEntryFull, n_entries);
+    desc->vbits = ctz32(tlb_victim_size / CPU_VTLB_WAYS);
+    desc->vtable = g_new(CPUTLBEntry, tlb_vtable_size(desc));
+    desc->vfulltlb = g_new(CPUTLBEntryFull, tlb_vtable_size(desc));
     tlb_mmu_flush_locked(desc, fast);
 }
 
@@ -344,6 +365,8 @@ void tlb_destroy(CPUState *cpu)
 
         g_free(fast->table);
         g_free(desc->fulltlb);
+        g_free(desc->vtable);
+        g_free(desc->vfulltlb);
     }
 }
 
@@ -460,6 +483,17 @@ static inline bool tlb_entry_is_empty(const CPUTLBEntry *te)
     return te->addr_read == -1 && te->addr_write == -1 && te->addr_code == -1;
 }
 
+/* Return the page of a tlb entry that is not empty.  */
+static inline vaddr tlb_entry_page(const CPUTLBEntry *te)
+{
+    uint64_t addr = te->addr_read;
+
+    if (addr == -1) {
+        addr = te->addr_write != -1 ? te->addr_write : te->addr_code;
+    }
+    return addr & TARGET_PAGE_MASK;
+}
+
 /* Called with tlb_c.lock held */
 static bool tlb_flush_entry_mask_locked(CPUTLBEntry *tlb_entry,
                                         vaddr page,
@@ -483,10 +517,10 @@ static void tlb_flush_vtlb_page_mask_locked(CPUState *cpu, int mmu_idx,
                                             vaddr mask)
 {
     CPUTLBDesc *d = &cpu->neg.tlb.d[mmu_idx];
-    int k;
+    size_t k;
 
     assert_cpu_is_self(cpu);
-    for (k = 0; k < CPU_VTLB_SIZE; k++) {
+    for (k = 0; k < tlb_vtable_size(d); k++) {
         if (tlb_flush_entry_mask_locked(&d->vtable[k], page, mask)) {
             tlb_n_used_entries_dec(cpu, mmu_idx);
         }
@@ -739,7 +773,7 @@ static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
      * If the length is larger than the jump cache size, then it will take
      * longer to clear each entry individually than it will to clear it all.
      */
-    if (d.len >= (TARGET_PAGE_SIZE * TB_JMP_CACHE_SIZE)) {
+    if (d.len >= TARGET_PAGE_SIZE * tb_jmp_cache_size(cpu->tb_jmp_cache)) {
         tcg_flush_jmp_cache(cpu);
         return;
     }
@@ -931,7 +965,7 @@ void tlb_reset_dirty(CPUState *cpu, uintptr_t start, uintptr_t length)
                                          start, length);
         }
 
-        for (i = 0; i < CPU_VTLB_SIZE; i++) {
+        for (i = 0; i < tlb_vtable_size(desc); i++) {
             tlb_reset_dirty_range_locked(&desc->vfulltlb[i], &desc->vtable[i],
                                          start, length);
         }
@@ -963,9 +997,12 @@ static void tlb_set_dirty(CPUState *cpu, vaddr addr)
     }
 
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-        int k;
-        for (k = 0; k < CPU_VTLB_SIZE; k++) {
-            tlb_set_dirty1_locked(&cpu->neg.tlb.d[mmu_idx].vtable[k], addr);
+        CPUTLBDesc *desc = &cpu->neg.tlb.d[mmu_idx];
+        size_t k = tlb_vtable_set(desc, addr);
+        size_t end = k + CPU_VTLB_WAYS;
+
+        for (; k < end; k++) {
+            tlb_set_dirty1_locked(&desc->vtable[k], addr);
         }
     }
     qemu_spin_unlock(&cpu->neg.tlb.c.lock);
@@ -1128,7 +1165,8 @@ void tlb_set_page_full(CPUState *cpu, int mmu_idx,
      * different page; otherwise just overwrite the stale data.
      */
     if (!tlb_hit_page_anyprot(te, addr_page) && !tlb_entry_is_empty(te)) {
-        unsigned vidx = desc->vindex++ % CPU_VTLB_SIZE;
+        size_t vidx = tlb_vtable_set(desc, tlb_entry_page(te)) +
+                      desc->vindex++ % CPU_VTLB_WAYS;
         CPUTLBEntry *tv = &desc->vtable[vidx];
 
         /* Evict the old entry into the victim tlb.  */
@@ -1306,30 +1344,52 @@ static void io_failed(CPUState *cpu, CPUTLBEntryFull *full, vaddr addr,
 static bool victim_tlb_hit(CPUState *cpu, size_t mmu_idx, size_t index,
                            MMUAccessType access_type, vaddr page)
 {
+    CPUTLBDesc *desc = &cpu->neg.tlb.d[mmu_idx];
+    size_t set = tlb_vtable_set(desc, page);
     size_t vidx;
 
     assert_cpu_is_self(cpu);
-    for (vidx = 0; vidx < CPU_VTLB_SIZE; ++vidx) {
-        CPUTLBEntry *vtlb = &cpu->neg.tlb.d[mmu_idx].vtable[vidx];
+    for (vidx = set; vidx < set + CPU_VTLB_WAYS; ++vidx) {
+        CPUTLBEntry *vtlb = &desc->vtable[vidx];
         uint64_t cmp = tlb_read_idx(vtlb, access_type);
 
         if (cmp == page) {
             /* Found entry in victim tlb, swap tlb and iotlb.  */
             CPUTLBEntry tmptlb, *tlb = &cpu_tlb_fast(cpu, mmu_idx)->table[index];
+            CPUTLBEntryFull tmpf;
+            size_t oidx = vidx;
+
+            /*
+             * The entry leaving the main tlb goes to the set of its own
+             * page, which need not be the set of @page.
+             */
+            if (!tlb_entry_is_empty(tlb)) {
+                size_t oset = tlb_vtable_set(desc, tlb_entry_page(tlb));
+
+                if (oset != set) {
+                    oidx = oset + desc->vindex++ % CPU_VTLB_WAYS;
+                }
+            }
 
             qemu_spin_lock(&cpu->neg.tlb.c.lock);
             copy_tlb_helper_locked(&tmptlb, tlb);
             copy_tlb_helper_locked(tlb, vtlb);
-            copy_tlb_helper_locked(vtlb, &tmptlb);
+            if (oidx != vidx) {
+                memset(vtlb, -1, sizeof(*vtlb));
+            }
+            copy_tlb_helper_locked(&desc->vtable[oidx], &tmptlb);
             qemu_spin_unlock(&cpu->neg.tlb.c.lock);
 
-            CPUTLBEntryFull *f1 = &cpu->neg.tlb.d[mmu_idx].fulltlb[index];
-            CPUTLBEntryFull *f2 = &cpu->neg.tlb.d[mmu_idx].vfulltlb[vidx];
-            CPUTLBEntryFull tmpf;
-            tmpf = *f1; *f1 = *f2; *f2 = tmpf;
+            tmpf = desc->fulltlb[index];
+            desc->fulltlb[index] = desc->vfulltlb[vidx];
+            desc->vfulltlb[oidx] = tmpf;
+            qatomic_set(&cpu->neg.tlb.c.victim_hit_count,
+                        cpu->neg.tlb.c.victim_hit_count + 1);
             return true;
         }
     }
+    qatomic_set(&cpu->neg.tlb.c.victim_miss_count,
+                cpu->neg.tlb.c.victim_miss_count + 1);
     return false;
 }
 
@@ -2860,24 +2920,28 @@ static void do_st16_mmu(CPUState *cpu, vaddr addr, Int128 val,
 uint8_t cpu_ldb_code_mmu(CPUArchState *env, vaddr addr,
                          MemOpIdx oi, uintptr_t retaddr)
 {
+    tb_async_check();
     return do_ld1_mmu(env_cpu(env), addr, oi, retaddr, MMU_INST_FETCH);
 }
 
 uint16_t cpu_ldw_code_mmu(CPUArchState *env, vaddr addr,
                           MemOpIdx oi, uintptr_t retaddr)
 {
+    tb_async_check();
     return do_ld2_mmu(env_cpu(env), addr, oi, retaddr, MMU_INST_FETCH);
 }
 
 uint32_t cpu_ldl_code_mmu(CPUArchState *env, vaddr addr,
                           MemOpIdx oi, uintptr_t retaddr)
 {
+    tb_async_check();
     return do_ld4_mmu(env_cpu(env), addr, oi, retaddr, MMU_INST_FETCH);
 }
 
 uint64_t cpu_ldq_code_mmu(CPUArchState *env, vaddr addr,
                           MemOpIdx oi, uintptr_t retaddr)
 {
+    tb_async_check();
     return do_ld8_mmu(env_cpu(env), addr, oi, retaddr, MMU_INST_FETCH);
 }
 
@@ -19,6 +19,17 @@ extern int64_t max_advance;
 
 extern bool one_insn_per_tb;
 
+/* Executions after which a TB is re-translated, or 0 to never do so.  */
+extern uint32_t tb_tier_threshold;
+
+/* log2 of the size up to which the jump cache of a CPU may grow.  */
+extern unsigned tb_jmp_cache_max_bits;
+
+#ifndef CONFIG_USER_ONLY
+/* Number of entries in the victim tlb of each MMU mode.  */
+extern unsigned tlb_victim_size;
+#endif
+
 extern bool icount_align_option;
 
 /*
@@ -48,6 +59,17 @@ static inline bool cpu_plugin_mem_cbs_enabled(const CPUState *cpu)
 }
 
 TranslationBlock *tb_gen_code(CPUState *cpu, TCGTBCPUState s);
+
+/**
+ * tb_tier_up:
+ * @cpu: CPU that left @tb because its execution counter ran out
+ * @tb: the hot TB
+ *
+ * Replace @tb with a translation that does not count its executions,
+ * and that includes the code of a direct successor if there is one
+ * worth folding in.
+ */
+void tb_tier_up(CPUState *cpu, TranslationBlock *tb);
 void page_init(void);
 void tb_htable_init(void);
 void tb_reset_jump(TranslationBlock *tb, int n);
@@ -0,0 +1,360 @@
+/*
+ * Translation of translation blocks on helper threads
+ *
+ * When a vCPU translates a TB, the destinations of the direct jumps out
+ * of it are queued for a pool of helper threads, which translate them
+ * with a copy of the vCPU state and publish them in the TB hash table.
+ * If the guess was right, the vCPU finds the TB there instead of having
+ * to stop and translate it.  A guess with the wrong flags produces a TB
+ * that is never looked up, and is thrown away on the next flush.
+ *
+ * Helper threads only read guest code through the host mapping of the
+ * page of the TB that queued them, and give up on anything that would
+ * require the TLB of the vCPU.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include "qemu/memalign.h"
+#include "qemu/plugin.h"
+#include "qemu/qht.h"
+#include "qemu/queue.h"
+#include "qemu/rcu.h"
+#include "qemu/thread.h"
+#include "qom/object.h"
+#include "hw/core/cpu.h"
+#include "exec/target_page.h"
+#include "system/ramblock.h"
+#include "tcg/startup.h"
+#include "tb-hash.h"
+#include "tb-context.h"
+#include "internal-common.h"
+#include "tb-async.h"
+
+/* Jobs waiting for a helper thread, per helper thread.  */
+#define TB_ASYNC_JOBS_PER_THREAD 16
+
+/*
+ * A copy of a vCPU, taken for the TB flags in @s.  Copying the whole CPU
+ * object means an allocation and a memcpy of the size of the CPU object
+ * on the vCPU thread, so the vCPU keeps its last copy in cpu->tb_async_cpu
+ * and reuses it for every job with the same flags.  That is as safe as
+ * reusing a TB translated for these flags: a TB only depends on the CPU
+ * state that its flags and cs_base are derived from.
+ *
+ * The copy shares the heap objects of the vCPU, such as its address
+ * spaces, so tb_async_cpu_unrealize() gets rid of all copies before the
+ * vCPU goes away.
+ */
+typedef struct TBAsyncCPU {
+    CPUState *origin;
+    TCGTBCPUState s;
+    unsigned refcnt;
+    CPUState *cpu;
+} TBAsyncCPU;
+
+typedef struct TBAsyncJob {
+    QSIMPLEQ_ENTRY(TBAsyncJob) next;
+    TBAsyncCPU *snapshot;
+    TCGTBCPUState s;
+    tb_page_addr_t page;
+    void *host_page;
+    int nb_pc;
+    vaddr pc[2];
+} TBAsyncJob;
+
+static struct {
+    unsigned nr_threads;
+    QemuThread *threads;
+    /*
+     * Held by each helper thread while it takes a job and translates it.
+     * Nests outside lock.
+     */
+    QemuMutex *gen_lock;
+
+    QemuMutex lock;
+    QemuCond cond;
+    QSIMPLEQ_HEAD(, TBAsyncJob) jobs;
+    unsigned nb_jobs;
+
+    uint64_t queued;
+    uint64_t dropped;
+    uint64_t translated;
+    uint64_t failed;
+} tb_async;
+
+struct tb_async_desc {
+    TCGTBCPUState s;
+    tb_page_addr_t page_addr0;
+};
+
+static bool tb_async_cmp(const void *p, const void *d)
+{
+    const TranslationBlock *tb = p;
+    const struct tb_async_desc *desc = d;
+
+    /* Unlike tb_lookup_cmp, accept any second page.  */
+    return (tb_cflags(tb) & CF_PCREL || tb->pc == desc->s.pc) &&
+           tb_page_addr0(tb) == desc->page_addr0 &&
+           tb->cs_base == desc->s.cs_base &&
+           tb->flags == desc->s.flags &&
+           tb_cflags(tb) == desc->s.cflags;
+}
+
+static bool tb_async_present(TCGTBCPUState s, tb_page_addr_t phys_pc)
+{
+    struct tb_async_desc desc = { .s = s, .page_addr0 = phys_pc };
+    uint32_t h;
+
+    h = tb_hash_func(phys_pc, (s.cflags & CF_PCREL ? 0 : s.pc),
+                     s.flags, s.cs_base, s.cflags);
+    return qht_lookup_custom(&tb_ctx.htable, &desc, h, tb_async_cmp);
+}
+
+static void tb_async_cpu_unref(TBAsyncCPU *snapshot)
+{
+    if (qatomic_fetch_dec(&snapshot->refcnt) == 1) {
+        qemu_vfree(snapshot->cpu);
+        g_free(snapshot);
+    }
+}
+
+/* Return a reference to a copy of @cpu for @s.  */
+static TBAsyncCPU *tb_async_cpu_get(CPUState *cpu, TCGTBCPUState s)
+{
+    TBAsyncCPU *snapshot = cpu->tb_async_cpu;
+    ObjectClass *oc;
+    size_t size, align;
+
+    if (snapshot && snapshot->s.flags == s.flags &&
+        snapshot->s.cs_base == s.cs_base &&
+        snapshot->s.cflags == s.cflags) {
+        qatomic_inc(&snapshot->refcnt);
+        return snapshot;
+    }
+
+    if (snapshot) {
+        tb_async_cpu_unref(snapshot);
+    }
+
+    oc = object_get_class(OBJECT(cpu));
+    size = object_class_get_instance_size(oc);
+    align = MAX(object_class_get_instance_align(oc), __alignof__(max_align_t));
+
+    /* One reference for cpu->tb_async_cpu, one for the caller.  */
+    snapshot = g_new(TBAsyncCPU, 1);
+    snapshot->origin = cpu;
+    snapshot->s = s;
+    snapshot->refcnt = 2;
+    snapshot->cpu = qemu_memalign(align, size);
+    memcpy(snapshot->cpu, cpu, size);
+
+    cpu->tb_async_cpu = snapshot;
+    return snapshot;
+}
+
+static void tb_async_job_free(TBAsyncJob *job)
+{
+    tb_async_cpu_unref(job->snapshot);
+    g_free(job);
+}
+
+void tb_async_queue(CPUState *cpu, TCGTBCPUState s,
+                    tb_page_addr_t phys_pc, void *host_pc)
+{
+    tb_page_addr_t page = phys_pc & TARGET_PAGE_MASK;
+    TBAsyncJob *job;
+    vaddr pc[2];
+    int i, n;
+
+    if (!tb_async.nr_threads || s.cflags != curr_cflags(cpu)) {
+        return;
+    }
+#ifdef CONFIG_PLUGIN
+    /* Plugins must see translations happen on the vCPU.  */
+    if (test_bit(QEMU_PLUGIN_EV_VCPU_TB_TRANS,
+                 cpu->plugin_state->event_mask)) {
+        return;
+    }
+#endif
+
+    for (i = n = 0; i < tcg_ctx->nb_gen_succ; i++) {
+        TCGTBCPUState succ = s;
+
+        succ.pc = tcg_ctx->gen_succ[i];
+        if (!tb_async_present(succ, page | (succ.pc & ~TARGET_PAGE_MASK))) {
+            pc[n++] = succ.pc;
+        }
+    }
+    if (n == 0) {
+        return;
+    }
+    if (qatomic_read(&tb_async.nb_jobs) >=
+        tb_async.nr_threads * TB_ASYNC_JOBS_PER_THREAD) {
+        qatomic_inc(&tb_async.dropped);
+        return;
+    }
+
+    /*
+     * The translator may look at any part of the CPU state that the TB
+     * flags are derived from, so it works on a copy of the whole object.
+     */
+    job = g_new(TBAsyncJob, 1);
+    job->snapshot = tb_async_cpu_get(cpu, s);
+    job->s = s;
+    job->page = page;
+    job->host_page = host_pc - (phys_pc & ~TARGET_PAGE_MASK);
+    job->nb_pc = n;
+    memcpy(job->pc, pc, sizeof(pc));
+
+    qemu_mutex_lock(&tb_async.lock);
+    QSIMPLEQ_INSERT_TAIL(&tb_async.jobs, job, next);
+    tb_async.nb_jobs++;
+    qemu_cond_signal(&tb_async.cond);
+    qemu_mutex_unlock(&tb_async.lock);
+    qatomic_add(&tb_async.queued, n);
+}
+
+static void tb_async_run(TBAsyncJob *job)
+{
+    RCU_READ_LOCK_GUARD();
+
+    /* The RAM block may have gone away since the job was queued.  */
+    if (qemu_ram_addr_from_host(job->host_page) != job->page) {
+        qatomic_add(&tb_async.failed, job->nb_pc);
+        return;
+    }
+
+    for (int i = 0; i < job->nb_pc; i++) {
+        vaddr offset = job->pc[i] & ~TARGET_PAGE_MASK;
+        TCGTBCPUState s = job->s;
+
+        s.pc = job->pc[i];
+        if (tb_async_present(s, job->page + offset)) {
+            continue;
+        }
+        if (tb_gen_code_async(job->snapshot->cpu, s, job->page + offset,
+                              job->host_page + offset)) {
+            qatomic_inc(&tb_async.translated);
+        } else {
+            qatomic_inc(&tb_async.failed);
+        }
+    }
+}
+
+static void *tb_async_thread(void *opaque)
+{
+    QemuMutex *gen_lock = opaque;
+
+    rcu_register_thread();
+    tcg_register_thread();
+
+    while (true) {
+        TBAsyncJob *job;
+
+        qemu_mutex_lock(&tb_async.lock);
+        while (QSIMPLEQ_EMPTY(&tb_async.jobs)) {
+            qemu_cond_wait(&tb_async.cond, &tb_async.lock);
+        }
+        qemu_mutex_unlock(&tb_async.lock);
+
+        /*
+         * Only take a job with gen_lock held, so that tb_async_pause()
+         * also waits for jobs that have just been taken off the queue.
+         */
+        qemu_mutex_lock(gen_lock);
+        qemu_mutex_lock(&tb_async.lock);
+        job = QSIMPLEQ_FIRST(&tb_async.jobs);
+        if (job) {
+            QSIMPLEQ_REMOVE_HEAD(&tb_async.jobs, next);
+            tb_async.nb_jobs--;
+        }
+        qemu_mutex_unlock(&tb_async.lock);
+
+        if (job) {
+            tb_async_run(job);
+            tb_async_job_free(job);
+        }
+        qemu_mutex_unlock(gen_lock);
+    }
+    return NULL;
+}
+
+void tb_async_pause(void)
+{
+    for (unsigned i = 0; i < tb_async.nr_threads; i++) {
+        qemu_mutex_lock(&tb_async.gen_lock[i]);
+    }
+}
+
+void tb_async_resume(void)
+{
+    for (unsigned i = 0; i < tb_async.nr_threads; i++) {
+        qemu_mutex_unlock(&tb_async.gen_lock[i]);
+    }
+}
+
+void tb_async_cpu_unrealize(CPUState *cpu)
+{
+    TBAsyncJob *job, *next_job;
+
+    if (!tb_async.nr_threads) {
+        return;
+    }
+
+    qemu_mutex_lock(&tb_async.lock);
+    QSIMPLEQ_FOREACH_SAFE(job, &tb_async.jobs, next, next_job) {
+        if (job->snapshot->origin == cpu) {
+            QSIMPLEQ_REMOVE(&tb_async.jobs, job, TBAsyncJob, next);
+            tb_async.nb_jobs--;
+            tb_async_job_free(job);
+        }
+    }
+    qemu_mutex_unlock(&tb_async.lock);
+
+    /* Wait for the jobs of @cpu that helper threads are running.  */
+    tb_async_pause();
+    tb_async_resume();
+
+    if (cpu->tb_async_cpu) {
+        tb_async_cpu_unref(cpu->tb_async_cpu);
+        cpu->tb_async_cpu = NULL;
+    }
+}
+
+void tb_async_init(unsigned nr_threads)
+{
+    char name[16];
+
+    qemu_mutex_init(&tb_async.lock);
+    qemu_cond_init(&tb_async.cond);
+    QSIMPLEQ_INIT(&tb_async.jobs);
+
+    tb_async.threads = g_new0(QemuThread, nr_threads);
+    tb_async.gen_lock = g_new(QemuMutex, nr_threads);
+    for (unsigned i = 0; i < nr_threads; i++) {
+        qemu_mutex_init(&tb_async.gen_lock[i]);
+        snprintf(name, sizeof(name), "TCG translate %u", i);
+        qemu_thread_create(&tb_async.threads[i], name, tb_async_thread,
+                           &tb_async.gen_lock[i], QEMU_THREAD_DETACHED);
+    }
+    tb_async.nr_threads = nr_threads;
+}
+
+void tb_async_dump_info(GString *buf)
+{
+    if (!tb_async.nr_threads) {
+        return;
+    }
+
+    g_string_append_printf(buf, "TB async queued     %" PRIu64
+                           " (%" PRIu64 " dropped)\n",
+                           qatomic_read(&tb_async.queued),
+                           qatomic_read(&tb_async.dropped));
+    g_string_append_printf(buf, "TB async translated %" PRIu64
+                           " (%" PRIu64 " given up)\n",
+                           qatomic_read(&tb_async.translated),
+                           qatomic_read(&tb_async.failed));
+}
@@ -0,0 +1,108 @@
+/*
+ * Translation of translation blocks on helper threads
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef ACCEL_TCG_TB_ASYNC_H
+#define ACCEL_TCG_TB_ASYNC_H
+
+#include "exec/translation-block.h"
+#include "accel/tcg/tb-cpu-state.h"
+#include "tcg/tcg.h"
+
+/*
+ * Abandon the translation in progress if it is running on a helper
+ * thread.  Called before anything that would use the TLB of the CPU.
+ */
+static inline void tb_async_check(void)
+{
+    if (unlikely(tcg_ctx && tcg_ctx->gen_async)) {
+        siglongjmp(tcg_ctx->jmp_trans, -4);
+    }
+}
+
+#ifdef CONFIG_USER_ONLY
+static inline void tb_async_queue(CPUState *cpu, TCGTBCPUState s,
+                                  tb_page_addr_t phys_pc, void *host_pc)
+{
+}
+
+static inline void tb_async_pause(void)
+{
+}
+
+static inline void tb_async_resume(void)
+{
+}
+
+static inline void tb_async_cpu_unrealize(CPUState *cpu)
+{
+}
+
+static inline void tb_async_dump_info(GString *buf)
+{
+}
+#else
+/**
+ * tb_async_init:
+ * @nr_threads: number of helper threads to start
+ *
+ * Start the helper threads.  Each of them needs a TCG context of its
+ * own, so @nr_threads must have been included in the max_threads
+ * argument of tcg_init().
+ */
+void tb_async_init(unsigned nr_threads);
+
+/**
+ * tb_async_queue:
+ * @cpu: CPU that has just translated a TB for @s
+ * @s: the state the TB was translated for
+ * @phys_pc: physical address of the TB
+ * @host_pc: host address of the TB
+ *
+ * Ask the helper threads to translate the destinations of the direct
+ * jumps out of the TB, so that they are ready by the time @cpu gets
+ * there.
+ */
+void tb_async_queue(CPUState *cpu, TCGTBCPUState s,
+                    tb_page_addr_t phys_pc, void *host_pc);
+
+/**
+ * tb_async_pause:
+ *
+ * Wait for the helper threads to finish the TB they are translating,
+ * and keep them from starting another one until tb_async_resume().
+ */
+void tb_async_pause(void);
+void tb_async_resume(void);
+
+/**
+ * tb_async_cpu_unrealize:
+ * @cpu: CPU that is going away
+ *
+ * Drop the jobs queued by @cpu, wait for those that are running and free
+ * the copies of @cpu that they used.
+ */
+void tb_async_cpu_unrealize(CPUState *cpu);
+
+/**
+ * tb_gen_code_async:
+ * @cpu: copy of the CPU state to translate for
+ * @s: the state to translate for
+ * @phys_pc: physical address of @s.pc
+ * @host_pc: host address of @s.pc
+ *
+ * Translate and publish a TB on a helper thread.  The translation is
+ * given up, rather than flushing the code buffer or looking at the
+ * TLB, if it runs out of space or crosses into another page.
+ *
+ * Returns: true if a new TB was added.
+ */
+bool tb_gen_code_async(CPUState *cpu, TCGTBCPUState s,
+                       tb_page_addr_t phys_pc, void *host_pc);
+
+void tb_async_dump_info(GString *buf);
+#endif
+
+#endif
@@ -0,0 +1,685 @@
+/*
+ * Persistent translation block cache
+ *
+ * Translated code is saved to a file together with the guest code it
+ * was generated from, and reloaded into the code_gen_buffer by later
+ * runs of the same QEMU binary with the same CPU configuration.  The
+ * backend records every host address embedded in a TB, so that calls
+ * into QEMU and jumps into the prologue can be relocated.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "qemu/osdep.h"
+#ifdef CONFIG_LINUX
+#include <link.h>
+#endif
+#include "qemu/bswap.h"
+#include "qemu/cacheflush.h"
+#include "qemu/cacheinfo.h"
+#include "qemu/cutils.h"
+#include "qemu/error-report.h"
+#include "qemu/lockable.h"
+#include "qemu/notify.h"
+#include "qemu/plugin.h"
+#include "qemu/xxhash.h"
+#include "qapi/error.h"
+#include "qom/object.h"
+#include "hw/core/cpu.h"
+#include "exec/target_page.h"
+#include "host/cpuinfo.h"
+#include "system/system.h"
+#include "tcg/tcg.h"
+#include "tb-cache.h"
+#include "trace.h"
+
+#define TB_CACHE_MAGIC      "QEMUTBC"
+#define TB_CACHE_VERSION    1
+#define TB_CACHE_HASH_SIZE  32
+
+typedef struct TBCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nb_entries;
+    uint8_t fingerprint[TB_CACHE_HASH_SIZE];
+} TBCacheHeader;
+
+/*
+ * Each entry is followed by the guest code, the host code and search
+ * data, padding to 8 bytes, and the relocations.
+ */
+typedef struct TBCacheEntry {
+    uint64_t phys_pc;
+    uint64_t pc;
+    uint64_t cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+    uint16_t size;
+    uint16_t icount;
+    uint16_t jmp_reset_offset[2];
+    uint16_t jmp_insn_offset[2];
+    uint32_t code_size;
+    uint32_t search_size;
+    uint32_t nb_relocs;
+} TBCacheEntry;
+
+static struct {
+    char *path;
+    uint8_t build_id[64];
+    size_t build_id_len;
+    uint8_t fingerprint[TB_CACHE_HASH_SIZE];
+    size_t max_size;
+    bool enabled;
+    bool recording;
+
+    /* Entries loaded from the file; immutable once enabled is set. */
+    gchar *data;
+    GHashTable *table;
+    unsigned nb_loaded;
+    size_t loaded_size;
+
+    /* Entries translated during this run. */
+    QemuMutex lock;
+    GPtrArray *recorded;
+    size_t recorded_size;
+
+    uint64_t lookups;
+    uint64_t hits;
+
+    Notifier machine_init_done;
+    Notifier exit;
+} tb_cache;
+
+/* Guest code at the start of the current translation. */
+static __thread uint8_t *tb_cache_guest;
+static __thread size_t tb_cache_guest_len;
+
+static inline const uint8_t *entry_guest(const TBCacheEntry *e)
+{
+    return (const uint8_t *)(e + 1);
+}
+
+static inline const uint8_t *entry_code(const TBCacheEntry *e)
+{
+    return entry_guest(e) + e->size;
+}
+
+static inline size_t entry_data_len(const TBCacheEntry *e)
+{
+    return ROUND_UP((size_t)e->size + e->code_size + e->search_size, 8);
+}
+
+static inline const TCGCacheReloc *entry_relocs(const TBCacheEntry *e)
+{
+    return (const TCGCacheReloc *)(entry_guest(e) + entry_data_len(e));
+}
+
+static inline size_t entry_len(const TBCacheEntry *e)
+{
+    return sizeof(*e) + entry_data_len(e) +
+           (size_t)e->nb_relocs * sizeof(TCGCacheReloc);
+}
+
+static guint tb_cache_key_hash(gconstpointer p)
+{
+    const TBCacheEntry *e = p;
+
+    return qemu_xxhash8(e->phys_pc, e->pc, e->cs_base, e->flags, e->cflags);
+}
+
+static gboolean tb_cache_key_equal(gconstpointer a, gconstpointer b)
+{
+    const TBCacheEntry *ea = a, *eb = b;
+
+    return ea->phys_pc == eb->phys_pc && ea->pc == eb->pc &&
+           ea->cs_base == eb->cs_base && ea->flags == eb->flags &&
+           ea->cflags == eb->cflags;
+}
+
+static gboolean tb_cache_content_equal(gconstpointer a, gconstpointer b)
+{
+    const TBCacheEntry *ea = a, *eb = b;
+
+    return tb_cache_key_equal(a, b) && ea->size == eb->size &&
+           !memcmp(entry_guest(ea), entry_guest(eb), ea->size);
+}
+
+bool tb_cache_eligible(CPUState *cpu, tb_page_addr_t phys_pc,
+                       uint32_t cflags)
+{
+    if (!qatomic_load_acquire(&tb_cache.enabled) ||
+        phys_pc == -1 || (cflags & CF_BP_PAGE)) {
+        return false;
+    }
+#ifdef CONFIG_PLUGIN
+    /* Instrumented code embeds pointers to plugin data.  */
+    if (test_bit(QEMU_PLUGIN_EV_VCPU_TB_TRANS,
+                 cpu->plugin_state->event_mask)) {
+        return false;
+    }
+#endif
+    return true;
+}
+
+static bool tb_cache_relocate(void *rw, uintptr_t rx,
+                              const TCGCacheReloc *r)
+{
+    uintptr_t target = r->addend;
+    int64_t disp;
+
+    switch (r->base) {
+    case TCG_CACHE_BASE_TEXT:
+        target += tcg_cache_text_start;
+        break;
+    case TCG_CACHE_BASE_PROLOGUE:
+        target += (uintptr_t)tcg_qemu_tb_exec;
+        break;
+    default:
+        g_assert_not_reached();
+    }
+
+    switch (r->type) {
+    case TCG_CACHE_RELOC_PC32:
+        disp = target - (rx + r->offset + 4);
+        if (disp != (int32_t)disp) {
+            return false;
+        }
+        stl_he_p(rw + r->offset, disp);
+        break;
+    case TCG_CACHE_RELOC_ABS64:
+        stq_he_p(rw + r->offset, target);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+    return true;
+}
+
+int tb_cache_lookup(TranslationBlock *tb, const void *host_pc,
+                    int *search_size)
+{
+    TBCacheEntry key = {
+        .phys_pc = tb_page_addr0(tb),
+        .pc = tb->cflags & CF_PCREL ? 0 : tb->pc,
+        .cs_base = tb->cs_base,
+        .flags = tb->flags,
+        .cflags = tb->cflags,
+    };
+    void *buf = tcg_splitwx_to_rw(tb->tc.ptr);
+    GPtrArray *chain;
+    unsigned i, j;
+
+    qatomic_inc(&tb_cache.lookups);
+    chain = g_hash_table_lookup(tb_cache.table, &key);
+    if (!chain) {
+        return -1;
+    }
+
+    for (i = 0; i < chain->len; i++) {
+        const TBCacheEntry *e = g_ptr_array_index(chain, i);
+        const TCGCacheReloc *r = entry_relocs(e);
+        size_t len = e->code_size + e->search_size;
+
+        if (memcmp(entry_guest(e), host_pc, e->size)) {
+            continue;
+        }
+        if (buf + len > tcg_ctx->code_gen_highwater) {
+            return -1;
+        }
+
+        memcpy(buf, entry_code(e), len);
+        for (j = 0; j < e->nb_relocs; j++) {
+            if (!tb_cache_relocate(buf, (uintptr_t)tb->tc.ptr, &r[j])) {
+                return -1;
+            }
+        }
+
+        tb->size = e->size;
+        tb->icount = e->icount;
+        tb->tc.size = e->code_size;
+        tb->jmp_reset_offset[0] = e->jmp_reset_offset[0];
+        tb->jmp_reset_offset[1] = e->jmp_reset_offset[1];
+        tb->jmp_insn_offset[0] = e->jmp_insn_offset[0];
+        tb->jmp_insn_offset[1] = e->jmp_insn_offset[1];
+        flush_idcache_range((uintptr_t)tb->tc.ptr, (uintptr_t)buf,
+                            e->code_size);
+
+        qatomic_inc(&tb_cache.hits);
+        *search_size = e->search_size;
+        return e->code_size;
+    }
+    return -1;
+}
+
+bool tb_cache_snapshot(tb_page_addr_t phys_pc, const void *host_pc)
+{
+    size_t page_size = qemu_target_page_size();
+
+    if (!qatomic_read(&tb_cache.recording)) {
+        return false;
+    }
+    if (!tb_cache_guest) {
+        tb_cache_guest = g_malloc(page_size);
+    }
+    tb_cache_guest_len = page_size - (phys_pc & (page_size - 1));
+    memcpy(tb_cache_guest, host_pc, tb_cache_guest_len);
+    return true;
+}
+
+void tb_cache_record(const TranslationBlock *tb, const void *host_pc,
+                     int search_size)
+{
+    TCGContext *s = tcg_ctx;
+    TBCacheEntry *e;
+    size_t len;
+
+    if (s->cache_tainted || tb_page_addr1(tb) != -1 ||
+        tb->size == 0 || tb->size > tb_cache_guest_len ||
+        memcmp(tb_cache_guest, host_pc, tb->size)) {
+        return;
+    }
+
+    len = sizeof(*e) + ROUND_UP(tb->size + tb->tc.size + search_size, 8) +
+          s->nb_cache_relocs * sizeof(TCGCacheReloc);
+    e = g_malloc0(len);
+    e->phys_pc = tb_page_addr0(tb);
+    e->pc = tb->cflags & CF_PCREL ? 0 : tb->pc;
+    e->cs_base = tb->cs_base;
+    e->flags = tb->flags;
+    e->cflags = tb->cflags;
+    e->size = tb->size;
+    e->icount = tb->icount;
+    e->jmp_reset_offset[0] = tb->jmp_reset_offset[0];
+    e->jmp_reset_offset[1] = tb->jmp_reset_offset[1];
+    e->jmp_insn_offset[0] = tb->jmp_insn_offset[0];
+    e->jmp_insn_offset[1] = tb->jmp_insn_offset[1];
+    e->code_size = tb->tc.size;
+    e->search_size = search_size;
+    e->nb_relocs = s->nb_cache_relocs;
+    memcpy((void *)entry_guest(e), tb_cache_guest, tb->size);
+    memcpy((void *)entry_code(e), tb->tc.ptr, tb->tc.size + search_size);
+    memcpy((void *)entry_relocs(e), s->cache_relocs,
+           s->nb_cache_relocs * sizeof(TCGCacheReloc));
+
+    QEMU_LOCK_GUARD(&tb_cache.lock);
+    if (tb_cache.loaded_size + tb_cache.recorded_size + len >
+        tb_cache.max_size) {
+        qatomic_set(&tb_cache.recording, false);
+        g_free(e);
+        return;
+    }
+    g_ptr_array_add(tb_cache.recorded, e);
+    tb_cache.recorded_size += len;
+}
+
+static bool tb_cache_entry_valid(const TBCacheEntry *e)
+{
+    size_t page_size = qemu_target_page_size();
+    const TCGCacheReloc *r = entry_relocs(e);
+    unsigned i;
+
+    if (e->size == 0 ||
+        (e->phys_pc & (page_size - 1)) + e->size > page_size ||
+        e->icount == 0 || e->icount > TCG_MAX_INSNS ||
+        e->code_size == 0 || e->code_size > UINT16_MAX ||
+        e->nb_relocs > TCG_MAX_CACHE_RELOCS) {
+        return false;
+    }
+    for (i = 0; i < 2; i++) {
+        if ((e->jmp_reset_offset[i] != TB_JMP_OFFSET_INVALID &&
+             e->jmp_reset_offset[i] > e->code_size) ||
+            (e->jmp_insn_offset[i] != TB_JMP_OFFSET_INVALID &&
+             e->jmp_insn_offset[i] + 4 > e->code_size)) {
+            return false;
+        }
+    }
+    for (i = 0; i < e->nb_relocs; i++) {
+        size_t width;
+
+        switch (r[i].type) {
+        case TCG_CACHE_RELOC_PC32:
+            width = 4;
+            break;
+        case TCG_CACHE_RELOC_ABS64:
+            width = 8;
+            break;
+        default:
+            return false;
+        }
+        if (r[i].base > TCG_CACHE_BASE_PROLOGUE ||
+            r[i].offset + width > e->code_size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * The file holds host code that is run as is, so it must not be
+ * writable by anybody but the user running QEMU.
+ */
+static bool tb_cache_read(int fd, gsize *len)
+{
+    struct stat st;
+    ssize_t n;
+    size_t off;
+
+    if (fstat(fd, &st) < 0) {
+        warn_report("tb-cache: cannot stat %s: %s", tb_cache.path,
+                    strerror(errno));
+        return false;
+    }
+    if (!S_ISREG(st.st_mode) || st.st_uid != geteuid() ||
+        (st.st_mode & (S_IWGRP | S_IWOTH))) {
+        warn_report("tb-cache: %s is not a regular file owned and only "
+                    "writable by the current user, ignoring it",
+                    tb_cache.path);
+        return false;
+    }
+
+    *len = st.st_size;
+    tb_cache.data = g_malloc(*len);
+    for (off = 0; off < *len; off += n) {
+        n = RETRY_ON_EINTR(read(fd, tb_cache.data + off, *len - off));
+        if (n <= 0) {
+            warn_report("tb-cache: cannot read %s: %s", tb_cache.path,
+                        n < 0 ? strerror(errno) : "unexpected end of file");
+            g_clear_pointer(&tb_cache.data, g_free);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void tb_cache_load(void)
+{
+    const TBCacheHeader *hdr;
+    gsize len;
+    size_t off;
+    unsigned i;
+    bool ok;
+    int fd;
+
+    fd = qemu_open_old(tb_cache.path, O_RDONLY);
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            warn_report("tb-cache: cannot open %s: %s", tb_cache.path,
+                        strerror(errno));
+        }
+        return;
+    }
+    ok = tb_cache_read(fd, &len);
+    close(fd);
+    if (!ok) {
+        return;
+    }
+
+    hdr = (const TBCacheHeader *)tb_cache.data;
+    if (len < sizeof(*hdr) ||
+        memcmp(hdr->magic, TB_CACHE_MAGIC, sizeof(hdr->magic)) ||
+        hdr->version != TB_CACHE_VERSION) {
+        warn_report("tb-cache: %s is not a TB cache file", tb_cache.path);
+        goto fail;
+    }
+    if (memcmp(hdr->fingerprint, tb_cache.fingerprint,
+               sizeof(hdr->fingerprint))) {
+        warn_report("tb-cache: %s was created by a different QEMU binary "
+                    "or CPU configuration, ignoring it", tb_cache.path);
+        goto fail;
+    }
+
+    off = sizeof(*hdr);
+    for (i = 0; i < hdr->nb_entries; i++) {
+        const TBCacheEntry *e = (const void *)tb_cache.data + off;
+        GPtrArray *chain;
+
+        if (len - off < sizeof(*e) || len - off < entry_len(e) ||
+            !tb_cache_entry_valid(e)) {
+            warn_report("tb-cache: %s is corrupt, ignoring it",
+                        tb_cache.path);
+            goto fail;
+        }
+        off += entry_len(e);
+
+        chain = g_hash_table_lookup(tb_cache.table, e);
+        if (!chain) {
+            chain = g_ptr_array_new();
+            g_hash_table_insert(tb_cache.table, (gpointer)e, chain);
+        }
+        g_ptr_array_add(chain, (gpointer)e);
+    }
+    tb_cache.nb_loaded = hdr->nb_entries;
+    tb_cache.loaded_size = off;
+    trace_tb_cache_load(tb_cache.path, tb_cache.nb_loaded);
+    return;
+
+ fail:
+    g_hash_table_remove_all(tb_cache.table);
+    g_clear_pointer(&tb_cache.data, g_free);
+}
+
+static void tb_cache_add_unique(GByteArray *out, GHashTable *seen,
+                                const TBCacheEntry *e)
+{
+    if (g_hash_table_add(seen, (gpointer)e)) {
+        g_byte_array_append(out, (const guint8 *)e, entry_len(e));
+    }
+}
+
+static void tb_cache_save(Notifier *n, void *opaque)
+{
+    g_autoptr(GByteArray) out = g_byte_array_new();
+    g_autoptr(GHashTable) seen =
+        g_hash_table_new(tb_cache_key_hash, tb_cache_content_equal);
+    g_autoptr(GError) err = NULL;
+    TBCacheHeader hdr = {
+        .magic = TB_CACHE_MAGIC,
+        .version = TB_CACHE_VERSION,
+    };
+    GHashTableIter iter;
+    GPtrArray *chain;
+    unsigned i;
+
+    qatomic_set(&tb_cache.recording, false);
+
+    QEMU_LOCK_GUARD(&tb_cache.lock);
+    if (!tb_cache.recorded->len) {
+        return;
+    }
+
+    g_byte_array_append(out, (const guint8 *)&hdr, sizeof(hdr));
+    g_hash_table_iter_init(&iter, tb_cache.table);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&chain)) {
+        for (i = 0; i < chain->len; i++) {
+            tb_cache_add_unique(out, seen, g_ptr_array_index(chain, i));
+        }
+    }
+    for (i = 0; i < tb_cache.recorded->len; i++) {
+        tb_cache_add_unique(out, seen, g_ptr_array_index(tb_cache.recorded, i));
+    }
+
+    hdr.nb_entries = g_hash_table_size(seen);
+    memcpy(hdr.fingerprint, tb_cache.fingerprint, sizeof(hdr.fingerprint));
+    memcpy(out->data, &hdr, sizeof(hdr));
+
+    if (!g_file_set_contents_full(tb_cache.path, (const gchar *)out->data,
+                                  out->len, G_FILE_SET_CONTENTS_CONSISTENT,
+                                  0600, &err)) {
+        warn_report("tb-cache: %s", err->message);
+        return;
+    }
+    trace_tb_cache_save(tb_cache.path, hdr.nb_entries);
+}
+
+static gint tb_cache_strcmp(gconstpointer a, gconstpointer b)
+{
+    return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+/*
+ * Hash everything that the generated code depends on, besides the
+ * TB key and the guest code: the QEMU binary, the host CPU features
+ * and cache line size, and the configuration of the guest CPUs.
+ */
+static void tb_cache_fingerprint(uint8_t *out)
+{
+    g_autoptr(GChecksum) sum = g_checksum_new(G_CHECKSUM_SHA256);
+    uint32_t page_bits = qemu_target_page_bits();
+    gsize len = TB_CACHE_HASH_SIZE;
+    CPUState *cpu;
+
+    g_checksum_update(sum, tb_cache.build_id, tb_cache.build_id_len);
+#ifdef CPUINFO_ALWAYS
+    g_checksum_update(sum, (const guchar *)&cpuinfo, sizeof(cpuinfo));
+#endif
+    g_checksum_update(sum, (const guchar *)&qemu_icache_linesize,
+                      sizeof(qemu_icache_linesize));
+    g_checksum_update(sum, (const guchar *)&page_bits, sizeof(page_bits));
+    g_checksum_update(sum, (const guchar *)tcg_qemu_tb_exec,
+                      tcg_prologue_size);
+
+    CPU_FOREACH(cpu) {
+        g_autoptr(GPtrArray) props = g_ptr_array_new_with_free_func(g_free);
+        ObjectPropertyIterator iter;
+        ObjectProperty *prop;
+        unsigned i;
+
+        object_property_iter_init(&iter, OBJECT(cpu));
+        while ((prop = object_property_iter_next(&iter))) {
+            char *value;
+
+            if (!prop->get || strstart(prop->type, "link<", NULL) ||
+                strstart(prop->type, "child<", NULL)) {
+                continue;
+            }
+            value = object_property_print(OBJECT(cpu), prop->name,
+                                          false, NULL);
+            if (value) {
+                g_ptr_array_add(props,
+                                g_strdup_printf("%s=%s", prop->name, value));
+                g_free(value);
+            }
+        }
+        g_ptr_array_sort(props, tb_cache_strcmp);
+
+        g_checksum_update(sum, (const guchar *)object_get_typename(OBJECT(cpu)),
+                          -1);
+        for (i = 0; i < props->len; i++) {
+            g_checksum_update(sum, g_ptr_array_index(props, i), -1);
+        }
+    }
+
+    g_checksum_get_digest(sum, out, &len);
+}
+
+static void tb_cache_machine_init_done(Notifier *n, void *opaque)
+{
+    tb_cache_fingerprint(tb_cache.fingerprint);
+    tb_cache_load();
+
+    qatomic_set(&tb_cache.recording, true);
+    qatomic_store_release(&tb_cache.enabled, true);
+}
+
+void tb_cache_dump_info(GString *buf)
+{
+    if (!qatomic_read(&tb_cache.enabled)) {
+        return;
+    }
+
+    QEMU_LOCK_GUARD(&tb_cache.lock);
+    g_string_append_printf(buf, "TB cache hits       %" PRIu64 "/%" PRIu64
+                           " lookups\n",
+                           qatomic_read(&tb_cache.hits),
+                           qatomic_read(&tb_cache.lookups));
+    g_string_append_printf(buf, "TB cache entries    %u loaded, %u recorded "
+                           "(%zu/%zu bytes)\n",
+                           tb_cache.nb_loaded, tb_cache.recorded->len,
+                           tb_cache.loaded_size + tb_cache.recorded_size,
+                           tb_cache.max_size);
+}
+
+#ifdef CONFIG_LINUX
+/*
+ * Find the object that contains QEMU's helpers, which calls from
+ * translated code are relocated against, and its GNU build ID.
+ */
+static int tb_cache_find_text(struct dl_phdr_info *info, size_t size,
+                              void *opaque)
+{
+    uintptr_t addr = (uintptr_t)tb_cache_find_text;
+    uintptr_t start = UINTPTR_MAX, end = 0;
+    int i;
+
+    for (i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr) *ph = &info->dlpi_phdr[i];
+
+        if (ph->p_type == PT_LOAD) {
+            start = MIN(start, info->dlpi_addr + ph->p_vaddr);
+            end = MAX(end, info->dlpi_addr + ph->p_vaddr + ph->p_memsz);
+        }
+    }
+    if (addr < start || addr >= end) {
+        return 0;
+    }
+    tcg_cache_text_start = start;
+    tcg_cache_text_end = end;
+
+    for (i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr) *ph = &info->dlpi_phdr[i];
+        const uint8_t *p, *note_end;
+
+        if (ph->p_type != PT_NOTE) {
+            continue;
+        }
+        p = (const uint8_t *)(info->dlpi_addr + ph->p_vaddr);
+        note_end = p + ph->p_memsz;
+        while (p + sizeof(ElfW(Nhdr)) <= note_end) {
+            const ElfW(Nhdr) *nh = (const ElfW(Nhdr) *)p;
+            const uint8_t *name = p + sizeof(*nh);
+            const uint8_t *desc = name + ROUND_UP(nh->n_namesz, 4);
+
+            if (nh->n_type == NT_GNU_BUILD_ID && nh->n_namesz == 4 &&
+                !memcmp(name, "GNU", 4) &&
+                nh->n_descsz <= sizeof(tb_cache.build_id)) {
+                memcpy(tb_cache.build_id, desc, nh->n_descsz);
+                tb_cache.build_id_len = nh->n_descsz;
+                return 1;
+            }
+            p = desc + ROUND_UP(nh->n_descsz, 4);
+        }
+    }
+    return 1;
+}
+#endif
+
+bool tb_cache_init(const char *path, Error **errp)
+{
+    if (!tcg_cache_supported()) {
+        error_setg(errp, "tb-cache is not supported by this TCG backend "
+                   "or with split-wx");
+        return false;
+    }
+#ifdef CONFIG_LINUX
+    dl_iterate_phdr(tb_cache_find_text, NULL);
+#endif
+    if (!tb_cache.build_id_len) {
+        error_setg(errp, "tb-cache could not find the build ID "
+                   "of the QEMU binary");
+        return false;
+    }
+
+    tb_cache.path = g_strdup(path);
+    tb_cache.max_size = tcg_code_capacity();
+    tb_cache.table = g_hash_table_new_full(tb_cache_key_hash,
+                                           tb_cache_key_equal, NULL,
+                                           (GDestroyNotify)g_ptr_array_unref);
+    qemu_mutex_init(&tb_cache.lock);
+    tb_cache.recorded = g_ptr_array_new_with_free_func(g_free);
+
+    tb_cache.machine_init_done.notify = tb_cache_machine_init_done;
+    qemu_add_machine_init_done_notifier(&tb_cache.machine_init_done);
+    tb_cache.exit.notify = tb_cache_save;
+    qemu_add_exit_notifier(&tb_cache.exit);
+    return true;
+}
@@ -0,0 +1,92 @@
+/*
+ * Persistent translation block cache
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef ACCEL_TCG_TB_CACHE_H
+#define ACCEL_TCG_TB_CACHE_H
+
+#include "exec/translation-block.h"
+
+#ifdef CONFIG_USER_ONLY
+static inline bool tb_cache_eligible(CPUState *cpu, tb_page_addr_t phys_pc,
+                                     uint32_t cflags)
+{
+    return false;
+}
+
+static inline int tb_cache_lookup(TranslationBlock *tb, const void *host_pc,
+                                  int *search_size)
+{
+    return -1;
+}
+
+static inline bool tb_cache_snapshot(tb_page_addr_t phys_pc,
+                                     const void *host_pc)
+{
+    return false;
+}
+
+static inline void tb_cache_record(const TranslationBlock *tb,
+                                   const void *host_pc, int search_size)
+{
+}
+
+static inline void tb_cache_dump_info(GString *buf)
+{
+}
+#else
+/**
+ * tb_cache_init:
+ * @path: file holding the cache
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Enable the persistent TB cache.  The file is loaded once the machine
+ * has been created and saved again when QEMU exits.
+ */
+bool tb_cache_init(const char *path, Error **errp);
+
+/**
+ * tb_cache_eligible:
+ *
+ * Return true if a TB for @phys_pc and @cflags may be loaded from,
+ * or recorded into, the TB cache.
+ */
+bool tb_cache_eligible(CPUState *cpu, tb_page_addr_t phys_pc,
+                       uint32_t cflags);
+
+/**
+ * tb_cache_lookup:
+ * @tb: TB initialized by tb_gen_code, with code buffer at tb->tc.ptr
+ * @host_pc: host address of the guest code
+ * @search_size: set to the size of the search data on success
+ *
+ * Look for a cached translation of @tb whose guest code matches the
+ * bytes at @host_pc, and copy it into the code buffer.  Return the
+ * size of the host code, or -1 if there was no usable entry.
+ */
+int tb_cache_lookup(TranslationBlock *tb, const void *host_pc,
+                    int *search_size);
+
+/**
+ * tb_cache_snapshot:
+ *
+ * Take a copy of the guest code at @host_pc before translating it.
+ * Return true if the TB should be recorded with tb_cache_record.
+ */
+bool tb_cache_snapshot(tb_page_addr_t phys_pc, const void *host_pc);
+
+/**
+ * tb_cache_record:
+ *
+ * Record the freshly generated @tb, unless the backend found it not
+ * to be relocatable or the guest code changed during translation.
+ */
+void tb_cache_record(const TranslationBlock *tb, const void *host_pc,
+                     int search_size);
+
+void tb_cache_dump_info(GString *buf);
+#endif
+
+#endif
@@ -35,6 +35,8 @@ struct TBContext {
     /* statistics */
     unsigned tb_flush_count;
     unsigned tb_phys_invalidate_count;
+    unsigned tb_tier_up_count;
+    unsigned tb_trace_count;
 };
 
 extern TBContext tb_ctx;
@@ -28,35 +28,49 @@
 
 #ifdef CONFIG_SOFTMMU
 
-/* Only the bottom TB_JMP_PAGE_BITS of the jump cache hash bits vary for
-   addresses on the same page.  The top bits are the same.  This allows
-   TLB invalidation to quickly clear a subset of the hash table.  */
-#define TB_JMP_PAGE_BITS (TB_JMP_CACHE_BITS / 2)
-#define TB_JMP_PAGE_SIZE (1 << TB_JMP_PAGE_BITS)
-#define TB_JMP_ADDR_MASK (TB_JMP_PAGE_SIZE - 1)
-#define TB_JMP_PAGE_MASK (TB_JMP_CACHE_SIZE - TB_JMP_PAGE_SIZE)
+/*
+ * Only the bottom half of the jump cache hash bits vary for addresses
+ * on the same page.  The top bits are the same.  This allows TLB
+ * invalidation to quickly clear a subset of the hash table.
+ */
+static inline unsigned int tb_jmp_page_bits(const CPUJumpCache *jc)
+{
+    return jc->bits / 2;
+}
 
-static inline unsigned int tb_jmp_cache_hash_page(vaddr pc)
+static inline unsigned int tb_jmp_page_size(const CPUJumpCache *jc)
 {
+    return 1 << tb_jmp_page_bits(jc);
+}
+
+static inline unsigned int tb_jmp_cache_hash_page(const CPUJumpCache *jc,
+                                                  vaddr pc)
+{
+    unsigned int shift = TARGET_PAGE_BITS - tb_jmp_page_bits(jc);
     vaddr tmp;
-    tmp = pc ^ (pc >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS));
-    return (tmp >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS)) & TB_JMP_PAGE_MASK;
+
+    tmp = pc ^ (pc >> shift);
+    return (tmp >> shift) & (tb_jmp_cache_size(jc) - tb_jmp_page_size(jc));
 }
 
-static inline unsigned int tb_jmp_cache_hash_func(vaddr pc)
+static inline unsigned int tb_jmp_cache_hash_func(const CPUJumpCache *jc,
+                                                  vaddr pc)
 {
+    unsigned int shift = TARGET_PAGE_BITS - tb_jmp_page_bits(jc);
     vaddr tmp;
-    tmp = pc ^ (pc >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS));
-    return (((tmp >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS)) & TB_JMP_PAGE_MASK)
-           | (tmp & TB_JMP_ADDR_MASK));
+
+    tmp = pc ^ (pc >> shift);
+    return (((tmp >> shift) & (tb_jmp_cache_size(jc) - tb_jmp_page_size(jc)))
+           | (tmp & (tb_jmp_page_size(jc) - 1)));
 }
 
 #else
 
 /* In user-mode we can get better hashing because we do not have a TLB */
-static inline unsigned int tb_jmp_cache_hash_func(vaddr pc)
+static inline unsigned int tb_jmp_cache_hash_func(const CPUJumpCache *jc,
+                                                  vaddr pc)
 {
-    return (pc ^ (pc >> TB_JMP_CACHE_BITS)) & (TB_JMP_CACHE_SIZE - 1);
+    return (pc ^ (pc >> jc->bits)) & (tb_jmp_cache_size(jc) - 1);
 }
 
 #endif /* CONFIG_SOFTMMU */
@@ -12,8 +12,9 @@
 #include "qemu/rcu.h"
 #include "exec/cpu-common.h"
 
-#define TB_JMP_CACHE_BITS 12
-#define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
+/* The cache starts at the minimum size and grows with its miss rate.  */
+#define TB_JMP_CACHE_MIN_BITS 12
+#define TB_JMP_CACHE_MAX_BITS 16
 
 /*
  * Invalidated in parallel; all accesses to 'tb' must be atomic.
@@ -21,13 +22,52 @@
  * no need for qatomic_rcu_read() and pc is always consistent with a
  * non-NULL value of 'tb'.  Strictly speaking pc is only needed for
  * CF_PCREL, but it's used always for simplicity.
+ *
+ * Only the owning CPU replaces the cache with one of a different size,
+ * so other threads must look at it within an RCU read-side critical
+ * section.  The counters are also written by the owning CPU only.
  */
 typedef struct CPUJumpCache {
     struct rcu_head rcu;
+    unsigned bits;
+    uint64_t hits;
+    uint64_t misses;
+    /* Counters and time at the start of the current resize window.  */
+    uint64_t window_hits;
+    uint64_t window_misses;
+    int64_t window_begin_ns;
     struct {
         TranslationBlock *tb;
         vaddr pc;
-    } array[TB_JMP_CACHE_SIZE];
+    } array[];
 } CPUJumpCache;
 
+static inline size_t tb_jmp_cache_size(const CPUJumpCache *jc)
+{
+    return (size_t)1 << jc->bits;
+}
+
+/* Misses after which tb_lookup() considers resizing the cache.  */
+#define TB_JMP_CACHE_WINDOW_MISSES 1024
+
+/**
+ * tb_jmp_cache_new:
+ * @bits: log2 of the number of entries
+ *
+ * Allocate an empty jump cache.
+ */
+CPUJumpCache *tb_jmp_cache_new(unsigned bits);
+
+/**
+ * tb_jmp_cache_resize:
+ * @cpu: CPU whose jump cache to resize; must be the current CPU
+ *
+ * Close the current window of statistics if it is over, and replace the
+ * jump cache of @cpu with an empty one of another size if its miss rate
+ * calls for it.
+ *
+ * Returns: true if the cache was replaced.
+ */
+bool tb_jmp_cache_resize(CPUState *cpu);
+
 #endif /* ACCEL_TCG_TB_JMP_CACHE_H */
@@ -34,6 +34,7 @@
 #include "tb-context.h"
 #include "tb-internal.h"
 #include "internal-common.h"
+#include "tb-async.h"
 #ifdef CONFIG_USER_ONLY
 #include "user/page-protection.h"
 #define runstate_is_running()  true
@@ -781,10 +782,13 @@ void tb_flush__exclusive_or_serial(void)
         tcg_flush_jmp_cache(cpu);
     }
 
+    /* Helper threads are not stopped by exclusive sections.  */
+    tb_async_pause();
     qht_reset_size(&tb_ctx.htable, CODE_GEN_HTABLE_SIZE);
     tb_remove_all();
 
     tcg_region_reset_all();
+    tb_async_resume();
     /* XXX: flush processor icache at this point if cache flush is expensive */
     qatomic_inc(&tb_ctx.tb_flush_count);
     qemu_plugin_flush_cb();
@@ -895,16 +899,18 @@ static void tb_jmp_cache_inval_tb(TranslationBlock *tb)
 {
     CPUState *cpu;
 
+    /* The owning CPU may replace its cache at any time.  */
+    RCU_READ_LOCK_GUARD();
+
     if (tb_cflags(tb) & CF_PCREL) {
         /* A TB may be at any virtual address */
         CPU_FOREACH(cpu) {
             tcg_flush_jmp_cache(cpu);
         }
     } else {
-        uint32_t h = tb_jmp_cache_hash_func(tb->pc);
-
         CPU_FOREACH(cpu) {
-            CPUJumpCache *jc = cpu->tb_jmp_cache;
+            CPUJumpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+            uint32_t h = tb_jmp_cache_hash_func(jc, tb->pc);
 
             if (qatomic_read(&jc->array[h].tb) == tb) {
                 qatomic_set(&jc->array[h].tb, NULL);
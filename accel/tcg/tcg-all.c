@@ -32,6 +32,7 @@
 #include "qemu/error-report.h"
 #include "qemu/accel.h"
 #include "qemu/atomic.h"
+#include "qemu/host-utils.h"
 #include "qapi/qapi-types-common.h"
 #include "qapi/qapi-builtin-visit.h"
 #include "qemu/units.h"
@@ -40,11 +41,14 @@
 #include "hw/core/boards.h"
 #include "exec/tb-flush.h"
 #include "system/runstate.h"
+#include "tb-cache.h"
+#include "tb-async.h"
 #endif
 #include "accel/accel-ops.h"
 #include "accel/accel-cpu-ops.h"
 #include "accel/tcg/cpu-ops.h"
 #include "internal-common.h"
+#include "tb-jmp-cache.h"
 
 
 struct TCGState {
@@ -54,11 +58,18 @@ struct TCGState {
     bool one_insn_per_tb;
     int splitwx_enabled;
     unsigned long tb_size;
+    char *tb_cache;
+    uint32_t translate_threads;
+    uint32_t tier_threshold;
+    uint32_t jmp_cache_size;
+    uint32_t victim_tlb_size;
 };
 typedef struct TCGState TCGState;
 
 #define TYPE_TCG_ACCEL ACCEL_CLASS_NAME("tcg")
 
+#define TCG_MAX_TRANSLATE_THREADS 64
+
 DECLARE_INSTANCE_CHECKER(TCGState, TCG_STATE,
                          TYPE_TCG_ACCEL)
 
@@ -79,10 +90,19 @@ static void tcg_accel_instance_init(Object *obj)
     s->splitwx_enabled = -1;
 #else
     s->splitwx_enabled = 0;
+#endif
+    s->jmp_cache_size = 1 << TB_JMP_CACHE_MAX_BITS;
+#ifndef CONFIG_USER_ONLY
+    s->victim_tlb_size = CPU_VTLB_SIZE;
 #endif
 }
 
 bool one_insn_per_tb;
+uint32_t tb_tier_threshold;
+unsigned tb_jmp_cache_max_bits = TB_JMP_CACHE_MAX_BITS;
+#ifndef CONFIG_USER_ONLY
+unsigned tlb_victim_size = CPU_VTLB_SIZE;
+#endif
 
 #ifndef CONFIG_USER_ONLY
 static void tcg_vm_change_state(void *opaque, bool running, RunState state)
@@ -145,6 +165,9 @@ static int tcg_init_machine(AccelState *as, MachineState *ms)
     }
 
     qemu_add_vm_change_state_handler(tcg_vm_change_state, NULL);
+
+    /* Each translation helper thread has a TCG context of its own.  */
+    max_threads += s->translate_threads;
 #endif
 
     tcg_allowed = true;
@@ -161,6 +184,21 @@ static int tcg_init_machine(AccelState *as, MachineState *ms)
     tcg_prologue_init();
 #endif
 
+#ifndef CONFIG_USER_ONLY
+    if (s->tb_cache) {
+        Error *local_err = NULL;
+
+        if (!tb_cache_init(s->tb_cache, &local_err)) {
+            error_report_err(local_err);
+            return -EINVAL;
+        }
+    }
+
+    if (s->translate_threads) {
+        tb_async_init(s->translate_threads);
+    }
+#endif
+
 #ifdef CONFIG_USER_ONLY
     qdev_create_fake_machine();
 #endif
@@ -216,6 +254,145 @@ static void tcg_set_tb_size(Object *obj, Visitor *v,
     s->tb_size = value;
 }
 
+#ifndef CONFIG_USER_ONLY
+static char *tcg_get_tb_cache(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return g_strdup(s->tb_cache);
+}
+
+static void tcg_set_tb_cache(Object *obj, const char *value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    g_free(s->tb_cache);
+    s->tb_cache = g_strdup(value);
+}
+
+static void tcg_get_translate_threads(Object *obj, Visitor *v,
+                                      const char *name, void *opaque,
+                                      Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->translate_threads;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_translate_threads(Object *obj, Visitor *v,
+                                      const char *name, void *opaque,
+                                      Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value > TCG_MAX_TRANSLATE_THREADS) {
+        error_setg(errp, "translate-threads must not exceed %d",
+                   TCG_MAX_TRANSLATE_THREADS);
+        return;
+    }
+
+    s->translate_threads = value;
+}
+
+static void tcg_get_victim_tlb_size(Object *obj, Visitor *v,
+                                    const char *name, void *opaque,
+                                    Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->victim_tlb_size;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_victim_tlb_size(Object *obj, Visitor *v,
+                                    const char *name, void *opaque,
+                                    Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (!is_power_of_2(value) ||
+        value < CPU_VTLB_WAYS || value > CPU_VTLB_MAX_SIZE) {
+        error_setg(errp, "victim-tlb-size must be a power of 2 "
+                   "between %d and %d", CPU_VTLB_WAYS, CPU_VTLB_MAX_SIZE);
+        return;
+    }
+
+    s->victim_tlb_size = value;
+    tlb_victim_size = value;
+}
+#endif
+
+static void tcg_get_tier_threshold(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->tier_threshold;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_tier_threshold(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value > INT32_MAX) {
+        error_setg(errp, "tier-threshold must not exceed %d", INT32_MAX);
+        return;
+    }
+
+    s->tier_threshold = value;
+    qatomic_set(&tb_tier_threshold, value);
+}
+
+static void tcg_get_jmp_cache_size(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->jmp_cache_size;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_jmp_cache_size(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (!is_power_of_2(value) ||
+        value < 1 << TB_JMP_CACHE_MIN_BITS ||
+        value > 1 << TB_JMP_CACHE_MAX_BITS) {
+        error_setg(errp, "jmp-cache-size must be a power of 2 "
+                   "between %d and %d", 1 << TB_JMP_CACHE_MIN_BITS,
+                   1 << TB_JMP_CACHE_MAX_BITS);
+        return;
+    }
+
+    s->jmp_cache_size = value;
+    qatomic_set(&tb_jmp_cache_max_bits, ctz32(value));
+}
+
 static bool tcg_get_splitwx(Object *obj, Error **errp)
 {
     TCGState *s = TCG_STATE(obj);
@@ -278,6 +455,38 @@ static void tcg_accel_class_init(ObjectClass *oc, const void *data)
     object_class_property_set_description(oc, "tb-size",
         "TCG translation block cache size");
 
+#ifndef CONFIG_USER_ONLY
+    object_class_property_add_str(oc, "tb-cache",
+                                  tcg_get_tb_cache,
+                                  tcg_set_tb_cache);
+    object_class_property_set_description(oc, "tb-cache",
+        "File to load and save translated code across runs");
+
+    object_class_property_add(oc, "translate-threads", "uint32",
+        tcg_get_translate_threads, tcg_set_translate_threads,
+        NULL, NULL);
+    object_class_property_set_description(oc, "translate-threads",
+        "Number of threads translating code ahead of the vCPUs");
+
+    object_class_property_add(oc, "victim-tlb-size", "uint32",
+        tcg_get_victim_tlb_size, tcg_set_victim_tlb_size,
+        NULL, NULL);
+    object_class_property_set_description(oc, "victim-tlb-size",
+        "Number of entries in the victim TLB of each MMU mode");
+#endif
+
+    object_class_property_add(oc, "tier-threshold", "uint32",
+        tcg_get_tier_threshold, tcg_set_tier_threshold,
+        NULL, NULL);
+    object_class_property_set_description(oc, "tier-threshold",
+        "Executions after which hot code is translated again");
+
+    object_class_property_add(oc, "jmp-cache-size", "uint32",
+        tcg_get_jmp_cache_size, tcg_set_jmp_cache_size,
+        NULL, NULL);
+    object_class_property_set_description(oc, "jmp-cache-size",
+        "Maximum number of entries in the jump cache of each vCPU");
+
     object_class_property_add_bool(oc, "split-wx",
         tcg_get_splitwx, tcg_set_splitwx);
     object_class_property_set_description(oc, "split-wx",
@@ -16,6 +16,9 @@
 #include "tcg/tcg.h"
 #include "internal-common.h"
 #include "tb-context.h"
+#include "tb-jmp-cache.h"
+#include "tb-cache.h"
+#include "tb-async.h"
 #include <math.h>
 
 static void dump_drift_info(GString *buf)
@@ -147,19 +150,77 @@ static void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
     *pelide = elide;
 }
 
+static void tlb_victim_counts(size_t *phits, size_t *pmisses)
+{
+    CPUState *cpu;
+    size_t hits = 0, misses = 0;
+
+    CPU_FOREACH(cpu) {
+        hits += qatomic_read(&cpu->neg.tlb.c.victim_hit_count);
+        misses += qatomic_read(&cpu->neg.tlb.c.victim_miss_count);
+    }
+    *phits = hits;
+    *pmisses = misses;
+}
+
+static void tb_jmp_cache_counts(uint64_t *phits, uint64_t *pmisses,
+                                size_t *psize)
+{
+    CPUState *cpu;
+    uint64_t hits = 0, misses = 0;
+    size_t size = 0;
+
+    RCU_READ_LOCK_GUARD();
+    CPU_FOREACH(cpu) {
+        CPUJumpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+
+        if (jc) {
+            hits += qatomic_read(&jc->hits);
+            misses += qatomic_read(&jc->misses);
+            size += tb_jmp_cache_size(jc);
+        }
+    }
+    *phits = hits;
+    *pmisses = misses;
+    *psize = size;
+}
+
 static void tcg_dump_flush_info(GString *buf)
 {
     size_t flush_full, flush_part, flush_elide;
+    size_t victim_hits, victim_misses;
+    uint64_t jc_hits, jc_misses;
+    size_t jc_size;
 
     g_string_append_printf(buf, "TB flush count      %u\n",
                            qatomic_read(&tb_ctx.tb_flush_count));
     g_string_append_printf(buf, "TB invalidate count %u\n",
                            qatomic_read(&tb_ctx.tb_phys_invalidate_count));
+    g_string_append_printf(buf, "TB tier-up count    %u (%u traces)\n",
+                           qatomic_read(&tb_ctx.tb_tier_up_count),
+                           qatomic_read(&tb_ctx.tb_trace_count));
 
     tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
     g_string_append_printf(buf, "TLB partial flushes %zu\n", flush_part);
     g_string_append_printf(buf, "TLB elided flushes  %zu\n", flush_elide);
+
+    tlb_victim_counts(&victim_hits, &victim_misses);
+    g_string_append_printf(buf, "TLB victim hits     %zu (%zu%%)\n",
+                           victim_hits, victim_hits + victim_misses ?
+                           victim_hits * 100 / (victim_hits + victim_misses) :
+                           0);
+    g_string_append_printf(buf, "TLB victim misses   %zu\n", victim_misses);
+
+    tb_jmp_cache_counts(&jc_hits, &jc_misses, &jc_size);
+    g_string_append_printf(buf, "TB jmp cache hits   %" PRIu64 "\n", jc_hits);
+    g_string_append_printf(buf, "TB jmp cache misses %" PRIu64 " (%" PRIu64
+                           "%%)\n", jc_misses,
+                           jc_hits + jc_misses ?
+                           jc_misses * 100 / (jc_hits + jc_misses) : 0);
+    g_string_append_printf(buf, "TB jmp cache size   %zu entries\n", jc_size);
+    tb_cache_dump_info(buf);
+    tb_async_dump_info(buf);
 }
 
 static void dump_exec_info(GString *buf)
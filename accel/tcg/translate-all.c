@@ -25,8 +25,11 @@
 #include "exec/mmap-lock.h"
 #include "tb-internal.h"
 #include "exec/tb-flush.h"
+#include "exec/target_page.h"
 #include "qemu/cacheinfo.h"
+#include "qemu/plugin.h"
 #include "qemu/target-info.h"
+#include "qemu/timer.h"
 #include "exec/log.h"
 #include "exec/icount.h"
 #include "accel/tcg/cpu-ops.h"
@@ -37,6 +40,8 @@
 #include "internal-common.h"
 #include "tcg/perf.h"
 #include "tcg/insn-start-words.h"
+#include "tb-cache.h"
+#include "tb-async.h"
 
 TBContext tb_ctx;
 
@@ -231,13 +236,94 @@ void page_init(void)
     page_table_config_init();
 }
 
+/*
+ * Execution counters of the TBs that may be re-translated once hot.
+ * They are kept out of the TB itself because the code buffer may not
+ * be writable while generated code runs; TBs may share a counter.
+ */
+#define TB_TIER_COUNT_BITS 14
+
+static int32_t tb_tier_counts[1 << TB_TIER_COUNT_BITS];
+
+static int32_t *tb_tier_count(const TranslationBlock *tb)
+{
+    /* TBs are aligned to the icache line size.  */
+    uintptr_t i = (uintptr_t)tb >> 6;
+
+    return &tb_tier_counts[i & ((1 << TB_TIER_COUNT_BITS) - 1)];
+}
+
+static bool tb_tier_eligible(CPUState *cpu, tb_page_addr_t phys_pc,
+                             uint32_t cflags)
+{
+    if (!tb_tier_threshold || phys_pc == -1 ||
+        cflags != curr_cflags(cpu) ||
+        (cflags & (CF_USE_ICOUNT | CF_COUNT_MASK))) {
+        return false;
+    }
+#ifdef CONFIG_PLUGIN
+    /* Plugins expect each TB to be translated once.  */
+    if (test_bit(QEMU_PLUGIN_EV_VCPU_TB_TRANS,
+                 cpu->plugin_state->event_mask)) {
+        return false;
+    }
+#endif
+    return true;
+}
+
+/*
+ * Translate the code at @trace_pc in place of the goto_tb that was left
+ * out at tcg_ctx->trace_op.  The two parts form a single extended basic
+ * block, so the optimizer and liveness analysis work across the jump.
+ * Return 0, or -5 if the trace had to be given up.
+ */
+static int gen_trace_tail(CPUState *cs, TranslationBlock *tb,
+                          vaddr pc, void *host_pc, vaddr trace_pc)
+{
+    TCGOp *last = tcg_last_op();
+    TCGOp *insn = tcg_ctx->trace_op;
+    TCGOp *op;
+    int size = tb->size;
+    int icount = tb->icount;
+    int max_insns = TCG_MAX_INSNS - icount - 1;
+
+    while (insn && insn->opc != INDEX_op_insn_start) {
+        insn = QTAILQ_PREV(insn, link);
+    }
+    if (!insn || max_insns < 1) {
+        return -5;
+    }
+
+    tcg_ctx->goto_tb_skip = tcg_ctx->goto_tb_used;
+    cs->cc->tcg_ops->translate_code(cs, tb, &max_insns, trace_pc,
+                                    host_pc + (trace_pc - pc));
+    if (tb_page_addr1(tb) != -1) {
+        return -5;
+    }
+
+    /*
+     * Whatever follows the jump in the first part still belongs to the
+     * insn that made it, as far as unwinding is concerned.
+     */
+    op = tcg_emit_op(INDEX_op_insn_start, INSN_START_WORDS);
+    for (int i = 0; i < INSN_START_WORDS; i++) {
+        tcg_set_insn_start_param(op, i, tcg_get_insn_start_param(insn, i));
+    }
+    tcg_move_ops_after(tcg_ctx->trace_op, last);
+
+    tb->size = MAX(size, (int)(trace_pc - pc) + tb->size);
+    tb->icount = icount + tb->icount + 1;
+    return 0;
+}
+
 /*
  * Isolate the portion of code gen which can setjmp/longjmp.
  * Return the size of the generated code, or negative on error.
  */
 static int setjmp_gen_code(CPUArchState *env, TranslationBlock *tb,
                            vaddr pc, void *host_pc,
-                           int *max_insns, int64_t *ti)
+                           int *max_insns, int64_t *ti,
+                           int trace_slot, vaddr trace_pc)
 {
     int ret = sigsetjmp(tcg_ctx->jmp_trans, 0);
     if (unlikely(ret != 0)) {
@@ -245,20 +331,107 @@ static int setjmp_gen_code(CPUArchState *env, TranslationBlock *tb,
     }
 
     tcg_func_start(tcg_ctx);
+    tcg_ctx->trace_slot = trace_slot;
+    tcg_ctx->trace_pc = trace_pc;
 
     CPUState *cs = env_cpu(env);
     tcg_ctx->cpu = cs;
     cs->cc->tcg_ops->translate_code(cs, tb, max_insns, pc, host_pc);
 
     assert(tb->size != 0);
+    if (tcg_ctx->trace_op) {
+        ret = gen_trace_tail(cs, tb, pc, host_pc, trace_pc);
+        if (ret) {
+            tcg_ctx->cpu = NULL;
+            return ret;
+        }
+    }
     tcg_ctx->cpu = NULL;
     *max_insns = tb->icount;
 
     return tcg_gen_code(tcg_ctx, tb, pc);
 }
 
-/* Called with mmap_lock held for user mode emulation.  */
-TranslationBlock *tb_gen_code(CPUState *cpu, TCGTBCPUState s)
+/*
+ * Make the TB just generated at @gen_code_buf visible to lookups.
+ * Return @tb, or the TB that another thread generated for the same
+ * code in the meantime, in which case @tb is discarded.
+ */
+static TranslationBlock *tb_publish(TranslationBlock *tb,
+                                    tcg_insn_unit *gen_code_buf)
+{
+    TranslationBlock *existing_tb;
+
+    /* init jump list */
+    qemu_spin_init(&tb->jmp_lock);
+    tb->jmp_list_head = (uintptr_t)NULL;
+    tb->jmp_list_next[0] = (uintptr_t)NULL;
+    tb->jmp_list_next[1] = (uintptr_t)NULL;
+    tb->jmp_dest[0] = (uintptr_t)NULL;
+    tb->jmp_dest[1] = (uintptr_t)NULL;
+
+    /* init original jump addresses which have been set during tcg_gen_code() */
+    if (tb->jmp_reset_offset[0] != TB_JMP_OFFSET_INVALID) {
+        tb_reset_jump(tb, 0);
+    }
+    if (tb->jmp_reset_offset[1] != TB_JMP_OFFSET_INVALID) {
+        tb_reset_jump(tb, 1);
+    }
+
+    /*
+     * Insert TB into the corresponding region tree before publishing it
+     * through QHT. Otherwise rewinding happened in the TB might fail to
+     * lookup itself using host PC.
+     */
+    tcg_tb_insert(tb);
+
+    /*
+     * If the TB is not associated with a physical RAM page then it must be
+     * a temporary one-insn TB.
+     *
+     * Such TBs must be added to region trees in order to make sure that
+     * restore_state_to_opc() - which on some architectures is not limited to
+     * rewinding, but also affects exception handling! - is called when such a
+     * TB causes an exception.
+     *
+     * At the same time, temporary one-insn TBs must be executed at most once,
+     * because subsequent reads from, e.g., I/O memory may return different
+     * values. So return early before attempting to link to other TBs or add
+     * to the QHT.
+     */
+    if (tb_page_addr0(tb) == -1) {
+        assert_no_pages_locked();
+        return tb;
+    }
+
+    /*
+     * No explicit memory barrier is required -- tb_link_page() makes the
+     * TB visible in a consistent state.
+     */
+    existing_tb = tb_link_page(tb);
+    assert_no_pages_locked();
+
+    /* if the TB already exists, discard what we just translated */
+    if (unlikely(existing_tb != tb)) {
+        uintptr_t orig_aligned = (uintptr_t)gen_code_buf;
+
+        orig_aligned -= ROUND_UP(sizeof(*tb), qemu_icache_linesize);
+        qatomic_set(&tcg_ctx->code_gen_ptr, (void *)orig_aligned);
+        tcg_tb_remove(tb);
+        return existing_tb;
+    }
+    return tb;
+}
+
+/*
+ * Translate a TB for @s.  A TB for tier 2 is translated without an
+ * execution counter and, if @trace_slot is not -1, as a trace through
+ * the direct jump with that index to @trace_pc.
+ * Called with mmap_lock held for user mode emulation.
+ */
+static TranslationBlock *do_tb_gen_code(CPUState *cpu, TCGTBCPUState s,
+                                        bool tier2, int trace_slot,
+                                        vaddr trace_pc)
 {
     CPUArchState *env = cpu_env(cpu);
     TranslationBlock *tb, *existing_tb;
@@ -267,6 +440,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu, TCGTBCPUState s)
     int gen_code_size, search_size, max_insns;
     int64_t ti;
     void *host_pc;
+    bool cache_record;
 
     assert_memory_lock();
     qemu_thread_jit_write();
@@ -315,15 +489,37 @@ TranslationBlock *tb_gen_code(CPUState *cpu, TCGTBCPUState s)
         tb_lock_page0(phys_pc);
     }
 
+    tcg_ctx->nb_gen_succ = 0;
+    cache_record = false;
+    if (!tier2 && tb_cache_eligible(cpu, phys_pc, s.cflags)) {
+        gen_code_size = tb_cache_lookup(tb, host_pc, &search_size);
+        if (gen_code_size >= 0) {
+            goto cached;
+        }
+        cache_record = tb_cache_snapshot(phys_pc, host_pc);
+    }
+
     tcg_ctx->gen_tb = tb;
     tcg_ctx->addr_type = target_long_bits() == 32 ? TCG_TYPE_I32 : TCG_TYPE_I64;
     tcg_ctx->guest_mo = cpu->cc->tcg_ops->guest_default_memory_order;
+    tcg_ctx->cache_record = cache_record;
+    tcg_ctx->tier_count = NULL;
+    if (!tier2 && !cache_record &&
+        tb_tier_eligible(cpu, phys_pc, s.cflags)) {
+        tcg_ctx->tier_count = tb_tier_count(tb);
+        qatomic_set(tcg_ctx->tier_count, tb_tier_threshold);
+    }
 
  restart_translate:
     trace_translate_block(tb, s.pc, tb->tc.ptr);
 
-    gen_code_size = setjmp_gen_code(env, tb, s.pc, host_pc, &max_insns, &ti);
+    gen_code_size = setjmp_gen_code(env, tb, s.pc, host_pc, &max_insns, &ti,
+                                    trace_slot, trace_pc);
     if (unlikely(gen_code_size < 0)) {
+        /* Give up a trace before making the TB any smaller.  */
+        if (gen_code_size == -2 && trace_slot != -1) {
+            gen_code_size = -5;
+        }
         switch (gen_code_size) {
         case -1:
             trace_tb_gen_code_buffer_overflow("setjmp_gen_code");
@@ -383,11 +579,34 @@ TranslationBlock *tb_gen_code(CPUState *cpu, TCGTBCPUState s)
                           "Restarting code generation with re-locked pages");
             goto restart_translate;
 
+        case -5:
+            /*
+             * The trace would have crossed a page or grown too large:
+             * translate the TB on its own.
+             */
+            qemu_log_mask(CPU_LOG_TB_OP | CPU_LOG_TB_OP_OPT,
+                          "Restarting code generation without trace\n");
+            phys_p2 = tb_page_addr1(tb);
+            if (unlikely(phys_p2 != -1)) {
+                tb_unlock_page1(phys_pc, phys_p2);
+                tb_set_page_addr1(tb, -1);
+            }
+            trace_slot = -1;
+            goto restart_translate;
+
         default:
             g_assert_not_reached();
         }
     }
     tcg_ctx->gen_tb = NULL;
+    tcg_ctx->cache_record = false;
+    tcg_ctx->tier_count = NULL;
+    if (tier2) {
+        qatomic_inc(&tb_ctx.tb_tier_up_count);
+        if (tcg_ctx->trace_op) {
+            qatomic_inc(&tb_ctx.tb_trace_count);
+        }
+    }
 
     search_size = encode_search(tb, (void *)gen_code_buf + gen_code_size);
     if (unlikely(search_size < 0)) {
@@ -397,6 +616,10 @@ TranslationBlock *tb_gen_code(CPUState *cpu, TCGTBCPUState s)
     }
     tb->tc.size = gen_code_size;
 
+    if (cache_record) {
+        tb_cache_record(tb, host_pc, search_size);
+    }
+
     /*
      * For CF_PCREL, attribute all executions of the generated code
      * to its first mapping.
@@ -476,70 +699,207 @@ TranslationBlock *tb_gen_code(CPUState *cpu, TCGTBCPUState s)
         }
     }
 
+ cached:
     qatomic_set(&tcg_ctx->code_gen_ptr, (void *)
         ROUND_UP((uintptr_t)gen_code_buf + gen_code_size + search_size,
                  CODE_GEN_ALIGN));
 
-    /* init jump list */
-    qemu_spin_init(&tb->jmp_lock);
-    tb->jmp_list_head = (uintptr_t)NULL;
-    tb->jmp_list_next[0] = (uintptr_t)NULL;
-    tb->jmp_list_next[1] = (uintptr_t)NULL;
-    tb->jmp_dest[0] = (uintptr_t)NULL;
-    tb->jmp_dest[1] = (uintptr_t)NULL;
+    existing_tb = tb_publish(tb, gen_code_buf);
+    if (existing_tb == tb && phys_pc != -1) {
+        tb_async_queue(cpu, s, phys_pc, host_pc);
+    }
+    return existing_tb;
+}
 
-    /* init original jump addresses which have been set during tcg_gen_code() */
-    if (tb->jmp_reset_offset[0] != TB_JMP_OFFSET_INVALID) {
-        tb_reset_jump(tb, 0);
+/* Called with mmap_lock held for user mode emulation.  */
+TranslationBlock *tb_gen_code(CPUState *cpu, TCGTBCPUState s)
+{
+    return do_tb_gen_code(cpu, s, false, -1, 0);
+}
+
+static void do_tb_tier_up(CPUState *cpu, TranslationBlock *tb)
+{
+    TranslationBlock *dst = NULL;
+    tb_page_addr_t page;
+    TCGTBCPUState s;
+    int slot = -1;
+
+    /* The exit left the CPU at the start of the TB; re-translate it.  */
+    s = cpu->cc->tcg_ops->get_tb_cpu_state(cpu);
+    s.cflags = curr_cflags(cpu);
+    if (cpu->cflags_next_tb != -1 ||
+        tb_cflags(tb) != s.cflags ||
+        tb->flags != s.flags ||
+        tb->cs_base != s.cs_base ||
+        (!(s.cflags & CF_PCREL) && tb->pc != s.pc) ||
+        tb_page_addr1(tb) != -1) {
+        return;
     }
-    if (tb->jmp_reset_offset[1] != TB_JMP_OFFSET_INVALID) {
-        tb_reset_jump(tb, 1);
+    page = get_page_addr_code(cpu_env(cpu), s.pc);
+    if (page != tb_page_addr0(tb)) {
+        return;
     }
 
     /*
-     * Insert TB into the corresponding region tree before publishing it
-     * through QHT. Otherwise rewinding happened in the TB might fail to
-     * lookup itself using host PC.
+     * Pick the chained successor to fold into the TB: it must run with
+     * the same flags and lie further down the same page, so that the
+     * trace can be unwound and invalidated as a single TB.
      */
-    tcg_tb_insert(tb);
+    for (int n = 0; n < 2; n++) {
+        uintptr_t jmp_dest = qatomic_read(&tb->jmp_dest[n]);
+        TranslationBlock *t = (TranslationBlock *)(jmp_dest & ~1);
+
+        if (!t || (jmp_dest & 1) ||
+            tb_cflags(t) != s.cflags ||
+            t->flags != s.flags ||
+            t->cs_base != s.cs_base ||
+            tb_page_addr1(t) != -1 ||
+            tb_page_addr0(t) <= page ||
+            ((tb_page_addr0(t) ^ page) & TARGET_PAGE_MASK) ||
+            tb->icount + t->icount >= TCG_MAX_INSNS) {
+            continue;
+        }
+        if (!dst || qatomic_read(tb_tier_count(t)) <
+                    qatomic_read(tb_tier_count(dst))) {
+            dst = t;
+            slot = n;
+        }
+    }
+
+    tb_phys_invalidate(tb, -1);
+    if (dst) {
+        do_tb_gen_code(cpu, s, true, slot,
+                       (s.pc & TARGET_PAGE_MASK) |
+                       (tb_page_addr0(dst) & ~TARGET_PAGE_MASK));
+    } else {
+        do_tb_gen_code(cpu, s, true, -1, 0);
+    }
+}
+
+/* Called with mmap_lock held for user mode emulation.  */
+void tb_tier_up(CPUState *cpu, TranslationBlock *tb)
+{
+    int32_t *count = tb_tier_count(tb);
+    int32_t old = qatomic_read(count);
 
     /*
-     * If the TB is not associated with a physical RAM page then it must be
-     * a temporary one-insn TB.
-     *
-     * Such TBs must be added to region trees in order to make sure that
-     * restore_state_to_opc() - which on some architectures is not limited to
-     * rewinding, but also affects exception handling! - is called when such a
-     * TB causes an exception.
-     *
-     * At the same time, temporary one-insn TBs must be executed at most once,
-     * because subsequent reads from, e.g., I/O memory may return different
-     * values. So return early before attempting to link to other TBs or add
-     * to the QHT.
+     * Let only one vCPU act on the counter running out.  The others must
+     * not write it, or they could park a counter that was just reset.
      */
-    if (tb_page_addr0(tb) == -1) {
-        assert_no_pages_locked();
-        return tb;
+    if (old >= 0 || qatomic_cmpxchg(count, old, INT32_MAX) != old) {
+        return;
     }
 
+    do_tb_tier_up(cpu, tb);
+
     /*
-     * No explicit memory barrier is required -- tb_link_page() makes the
-     * TB visible in a consistent state.
+     * Other TBs may share the counter, and @tb itself is still in use if
+     * it could not be re-translated, so start counting again for them.
      */
-    existing_tb = tb_link_page(tb);
-    assert_no_pages_locked();
+    qatomic_set(count, tb_tier_threshold);
+}
 
-    /* if the TB already exists, discard what we just translated */
-    if (unlikely(existing_tb != tb)) {
+#ifndef CONFIG_USER_ONLY
+bool tb_gen_code_async(CPUState *cpu, TCGTBCPUState s,
+                       tb_page_addr_t phys_pc, void *host_pc)
+{
+    CPUArchState *env = cpu_env(cpu);
+    TranslationBlock *tb;
+    tcg_insn_unit *gen_code_buf;
+    int gen_code_size, search_size, max_insns;
+    g_autofree void *code = NULL;
+    int64_t ti;
+
+    max_insns = s.cflags & CF_COUNT_MASK;
+    if (max_insns == 0) {
+        max_insns = TCG_MAX_INSNS;
+    }
+
+    qemu_thread_jit_write();
+    tb = tcg_tb_alloc(tcg_ctx);
+    if (unlikely(!tb)) {
+        /* Leave the flush to the vCPUs.  */
+        return false;
+    }
+
+    gen_code_buf = tcg_ctx->code_gen_ptr;
+    tb->tc.ptr = tcg_splitwx_to_rx(gen_code_buf);
+    if (!(s.cflags & CF_PCREL)) {
+        tb->pc = s.pc;
+    }
+    tb->cs_base = s.cs_base;
+    tb->flags = s.flags;
+    tb->cflags = s.cflags;
+    tb_set_page_addr0(tb, phys_pc);
+    tb_set_page_addr1(tb, -1);
+    tb_lock_page0(phys_pc);
+
+    /*
+     * Nothing stops the guest from writing to the page until the TB is
+     * linked to it, so keep a copy of the code to check against then.
+     */
+    code = g_memdup2(host_pc, TARGET_PAGE_SIZE - (s.pc & ~TARGET_PAGE_MASK));
+
+    tcg_ctx->gen_tb = tb;
+    tcg_ctx->addr_type = target_long_bits() == 32 ? TCG_TYPE_I32 : TCG_TYPE_I64;
+    tcg_ctx->guest_mo = cpu->cc->tcg_ops->guest_default_memory_order;
+    tcg_ctx->gen_async = true;
+    tcg_ctx->nb_gen_succ = 0;
+    tcg_ctx->tier_count = NULL;
+    if (tb_tier_eligible(cpu, phys_pc, s.cflags)) {
+        tcg_ctx->tier_count = tb_tier_count(tb);
+        qatomic_set(tcg_ctx->tier_count, tb_tier_threshold);
+    }
+
+ restart_translate:
+    trace_translate_block(tb, s.pc, tb->tc.ptr);
+
+    gen_code_size = setjmp_gen_code(env, tb, s.pc, host_pc, &max_insns, &ti,
+                                    -1, 0);
+    if (gen_code_size == -2 && max_insns > 1) {
+        max_insns /= 2;
+        goto restart_translate;
+    }
+    tcg_ctx->gen_tb = NULL;
+    tcg_ctx->gen_async = false;
+    tcg_ctx->tier_count = NULL;
+
+    search_size = -1;
+    if (likely(gen_code_size >= 0)) {
+        search_size = encode_search(tb, (void *)gen_code_buf + gen_code_size);
+    }
+    if (unlikely(search_size < 0)) {
+        /*
+         * Out of space, or the TB needs the TLB to cross a page boundary:
+         * give the memory back and leave the TB to the vCPU.
+         */
         uintptr_t orig_aligned = (uintptr_t)gen_code_buf;
 
+        tb_unlock_pages(tb);
         orig_aligned -= ROUND_UP(sizeof(*tb), qemu_icache_linesize);
         qatomic_set(&tcg_ctx->code_gen_ptr, (void *)orig_aligned);
-        tcg_tb_remove(tb);
-        return existing_tb;
+        return false;
     }
-    return tb;
+    tb->tc.size = gen_code_size;
+
+    perf_report_code(s.pc, tb, tcg_splitwx_to_rx(gen_code_buf));
+
+    qatomic_set(&tcg_ctx->code_gen_ptr, (void *)
+        ROUND_UP((uintptr_t)gen_code_buf + gen_code_size + search_size,
+                 CODE_GEN_ALIGN));
+
+    if (tb_publish(tb, gen_code_buf) != tb) {
+        return false;
+    }
+
+    /* Linking the TB write-protected the page; catch earlier writes.  */
+    if (memcmp(code, host_pc, tb->size) != 0) {
+        tb_phys_invalidate(tb, -1);
+        return false;
+    }
+    return true;
 }
+#endif
 
 /* user-mode: call with mmap_lock held */
 void tb_check_watchpoint(CPUState *cpu, uintptr_t retaddr)
@@ -627,14 +987,73 @@ void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr)
  */
 void tcg_flush_jmp_cache(CPUState *cpu)
 {
-    CPUJumpCache *jc = cpu->tb_jmp_cache;
+    CPUJumpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
 
     /* During early initialization, the cache may not yet be allocated. */
     if (unlikely(jc == NULL)) {
         return;
     }
 
-    for (int i = 0; i < TB_JMP_CACHE_SIZE; i++) {
+    /* A resize leaves an empty cache, so do it now if it is due.  */
+    if (cpu == current_cpu && tb_jmp_cache_resize(cpu)) {
+        return;
+    }
+
+    for (size_t i = 0; i < tb_jmp_cache_size(jc); i++) {
         qatomic_set(&jc->array[i].tb, NULL);
     }
 }
+
+CPUJumpCache *tb_jmp_cache_new(unsigned bits)
+{
+    CPUJumpCache *jc;
+
+    jc = g_malloc0(sizeof(*jc) + (sizeof(jc->array[0]) << bits));
+    jc->bits = bits;
+    jc->window_begin_ns = get_clock_realtime();
+    return jc;
+}
+
+/*
+ * As with the softmmu TLB (see tlb_mmu_resize_locked), grow the jump
+ * cache as soon as it misses too often, but only shrink it once a whole
+ * window of time has gone by with hardly any misses: a larger cache
+ * costs memory and makes flushes slower.
+ */
+bool tb_jmp_cache_resize(CPUState *cpu)
+{
+    CPUJumpCache *jc = cpu->tb_jmp_cache;
+    CPUJumpCache *new_jc;
+    uint64_t misses = jc->misses - jc->window_misses;
+    uint64_t lookups = misses + jc->hits - jc->window_hits;
+    int64_t now = get_clock_realtime();
+    unsigned bits = jc->bits;
+
+    if (misses >= TB_JMP_CACHE_WINDOW_MISSES) {
+        /* More than one lookup in ten missed.  */
+        if (misses * 10 > lookups) {
+            bits = MIN(bits + 1, qatomic_read(&tb_jmp_cache_max_bits));
+        }
+    } else if (now > jc->window_begin_ns + 100 * SCALE_MS) {
+        /* Less than one lookup in a hundred missed.  */
+        if (misses * 100 < lookups) {
+            bits = MAX(bits - 1, TB_JMP_CACHE_MIN_BITS);
+        }
+    } else {
+        return false;
+    }
+
+    if (bits == jc->bits) {
+        jc->window_hits = jc->hits;
+        jc->window_misses = jc->misses;
+        jc->window_begin_ns = now;
+        return false;
+    }
+
+    new_jc = tb_jmp_cache_new(bits);
+    new_jc->hits = new_jc->window_hits = jc->hits;
+    new_jc->misses = new_jc->window_misses = jc->misses;
+    qatomic_rcu_set(&cpu->tb_jmp_cache, new_jc);
+    g_free_rcu(jc, rcu);
+    return true;
+}
@@ -20,6 +20,7 @@
 #include "internal-common.h"
 #include "disas/disas.h"
 #include "tb-internal.h"
+#include "tb-async.h"
 
 static void set_can_do_io(DisasContextBase *db, bool val)
 {
@@ -45,6 +46,12 @@ static TCGOp *gen_tb_start(DisasContextBase *db, uint32_t cflags)
     TCGv_i32 count = NULL;
     TCGOp *icount_start_insn = NULL;
 
+    /* The second part of a trace continues the first one.  */
+    if (tcg_ctx->trace_op) {
+        tcg_ctx->exitreq_label = NULL;
+        return NULL;
+    }
+
     if ((cflags & CF_USE_ICOUNT) || !(cflags & CF_NOIRQ)) {
         count = tcg_temp_new_i32();
         tcg_gen_ld_i32(count, tcg_env,
@@ -74,6 +81,17 @@ static TCGOp *gen_tb_start(DisasContextBase *db, uint32_t cflags)
     } else {
         tcg_ctx->exitreq_label = gen_new_label();
         tcg_gen_brcondi_i32(TCG_COND_LT, count, 0, tcg_ctx->exitreq_label);
+
+        /* Count executions, and leave once the TB is found to be hot.  */
+        if (tcg_ctx->tier_count) {
+            TCGv_ptr ptr = tcg_constant_ptr(tcg_ctx->tier_count);
+            TCGv_i32 n = tcg_temp_new_i32();
+
+            tcg_gen_ld_i32(n, ptr, 0);
+            tcg_gen_subi_i32(n, n, 1);
+            tcg_gen_st_i32(n, ptr, 0);
+            tcg_gen_brcondi_i32(TCG_COND_LT, n, 0, tcg_ctx->exitreq_label);
+        }
     }
 
     if (cflags & CF_USE_ICOUNT) {
@@ -116,7 +134,22 @@ bool translator_use_goto_tb(DisasContextBase *db, vaddr dest)
     }
 
     /* Check for the dest on the same page as the start of the TB.  */
-    return translator_is_same_page(db, dest);
+    if (!translator_is_same_page(db, dest)) {
+        return false;
+    }
+
+    tcg_ctx->trace_dest = dest == tcg_ctx->trace_pc;
+
+    /* Remember the successor, for translation ahead of time.  */
+    for (int i = 0; i < tcg_ctx->nb_gen_succ; i++) {
+        if (tcg_ctx->gen_succ[i] == dest) {
+            return true;
+        }
+    }
+    if (tcg_ctx->nb_gen_succ < ARRAY_SIZE(tcg_ctx->gen_succ)) {
+        tcg_ctx->gen_succ[tcg_ctx->nb_gen_succ++] = dest;
+    }
+    return true;
 }
 
 void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
@@ -298,6 +331,9 @@ static bool translator_ld(CPUArchState *env, DisasContextBase *db,
     if (host == NULL) {
         tb_page_addr_t page0, old_page1, new_page1;
 
+        /* Helper threads cannot walk the TLB of the vCPU.  */
+        tb_async_check();
+
         new_page1 = get_page_addr_code_hostp(env, base, &db->host_addr[1]);
 
         /*
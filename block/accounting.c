@@ -27,14 +27,48 @@
 #include "block/accounting.h"
 #include "block/block_int.h"
 #include "qemu/timer.h"
+#include "qemu/memalign.h"
+#include "qemu/coroutine-tls.h"
 #include "system/qtest.h"
 #include "qapi/error.h"
 
 static QEMUClockType clock_type = QEMU_CLOCK_REALTIME;
 static const int qtest_latency_ns = NANOSECONDS_PER_SECOND / 1000;
 
+/*
+ * Each thread updates the counters of one shard.  If there are more
+ * threads than shards, some of them share a shard; the counters are
+ * updated atomically, so this only costs some cache line bouncing.
+ */
+#define BLOCK_ACCT_SHARDS       16
+#define BLOCK_ACCT_SHARD_ALIGN  64
+
+struct BlockAcctShard {
+    BlockAcctCounters counters;
+} QEMU_ALIGNED(BLOCK_ACCT_SHARD_ALIGN);
+
+static unsigned next_shard_id;
+
+/* Shard index of the current thread plus one, or 0 if not assigned yet */
+QEMU_DEFINE_STATIC_CO_TLS(unsigned, acct_shard_id)
+
+static BlockAcctCounters *block_acct_counters(BlockAcctStats *stats)
+{
+    unsigned id = get_acct_shard_id();
+
+    if (!id) {
+        id = qatomic_fetch_inc(&next_shard_id) % BLOCK_ACCT_SHARDS + 1;
+        set_acct_shard_id(id);
+    }
+    return &stats->shards[id - 1].counters;
+}
+
 void block_acct_init(BlockAcctStats *stats)
 {
+    size_t shards_size = BLOCK_ACCT_SHARDS * sizeof(BlockAcctShard);
+
+    stats->shards = qemu_memalign(BLOCK_ACCT_SHARD_ALIGN, shards_size);
+    memset(stats->shards, 0, shards_size);
     qemu_mutex_init(&stats->lock);
     if (qtest_enabled()) {
         clock_type = QEMU_CLOCK_VIRTUAL;
@@ -84,6 +118,19 @@ void block_acct_cleanup(BlockAcctStats *stats)
         g_free(s);
     }
     qemu_mutex_destroy(&stats->lock);
+    qemu_vfree(stats->shards);
+}
+
+/* Called with stats->lock held */
+static void block_acct_update_latency_stats(BlockAcctStats *stats)
+{
+    bool enabled = !QSLIST_EMPTY(&stats->intervals);
+    int i;
+
+    for (i = 0; i < BLOCK_MAX_IOTYPE; i++) {
+        enabled |= stats->latency_histogram[i].bins != NULL;
+    }
+    qatomic_set(&stats->latency_stats, enabled);
 }
 
 void block_acct_add_interval(BlockAcctStats *stats, unsigned interval_length)
@@ -101,6 +148,7 @@ void block_acct_add_interval(BlockAcctStats *stats, unsigned interval_length)
         timed_average_init(&s->latency[i], clock_type,
                            (uint64_t) interval_length * NANOSECONDS_PER_SECOND);
     }
+    block_acct_update_latency_stats(stats);
     qemu_mutex_unlock(&stats->lock);
 }
 
@@ -177,6 +225,8 @@ int block_latency_histogram_set(BlockAcctStats *stats, enum BlockAcctType type,
     uint64_t prev = 0;
     int new_nbins = 1;
 
+    QEMU_LOCK_GUARD(&stats->lock);
+
     for (entry = boundaries; entry; entry = entry->next) {
         if (entry->value <= prev) {
             return -EINVAL;
@@ -196,6 +246,7 @@ int block_latency_histogram_set(BlockAcctStats *stats, enum BlockAcctType type,
 
     g_free(hist->bins);
     hist->bins = g_new0(uint64_t, hist->nbins);
+    block_acct_update_latency_stats(stats);
 
     return 0;
 }
@@ -204,18 +255,22 @@ void block_latency_histograms_clear(BlockAcctStats *stats)
 {
     int i;
 
+    QEMU_LOCK_GUARD(&stats->lock);
+
     for (i = 0; i < BLOCK_MAX_IOTYPE; i++) {
         BlockLatencyHistogram *hist = &stats->latency_histogram[i];
         g_free(hist->bins);
         g_free(hist->boundaries);
         memset(hist, 0, sizeof(*hist));
     }
+    block_acct_update_latency_stats(stats);
 }
 
 static void block_account_one_io(BlockAcctStats *stats, BlockAcctCookie *cookie,
                                  bool failed)
 {
     BlockAcctTimedStats *s;
+    BlockAcctCounters *c;
     int64_t time_ns = qemu_clock_get_ns(clock_type);
     int64_t latency_ns = time_ns - cookie->start_time_ns;
 
@@ -229,21 +284,27 @@ static void block_account_one_io(BlockAcctStats *stats, BlockAcctCookie *cookie,
         return;
     }
 
-    WITH_QEMU_LOCK_GUARD(&stats->lock) {
-        if (failed) {
-            stats->failed_ops[cookie->type]++;
-        } else {
-            stats->nr_bytes[cookie->type] += cookie->bytes;
-            stats->nr_ops[cookie->type]++;
-        }
+    c = block_acct_counters(stats);
+    if (failed) {
+        qatomic_inc(&c->failed_ops[cookie->type]);
+    } else {
+        qatomic_add(&c->nr_bytes[cookie->type], cookie->bytes);
+        qatomic_inc(&c->nr_ops[cookie->type]);
+    }
+
+    if (!failed || stats->account_failed) {
+        qatomic_add(&c->total_time_ns[cookie->type], latency_ns);
+        qatomic_set(&c->last_access_time_ns, time_ns);
+    }
+
+    /* The lock is only taken if timed averages or histograms are in use */
+    if (qatomic_read(&stats->latency_stats)) {
+        QEMU_LOCK_GUARD(&stats->lock);
 
         block_latency_histogram_account(&stats->latency_histogram[cookie->type],
                                         latency_ns);
 
         if (!failed || stats->account_failed) {
-            stats->total_time_ns[cookie->type] += latency_ns;
-            stats->last_access_time_ns = time_ns;
-
             QSLIST_FOREACH(s, &stats->intervals, entries) {
                 timed_average_account(&s->latency[cookie->type], latency_ns);
             }
@@ -265,19 +326,20 @@ void block_acct_failed(BlockAcctStats *stats, BlockAcctCookie *cookie)
 
 void block_acct_invalid(BlockAcctStats *stats, enum BlockAcctType type)
 {
+    BlockAcctCounters *c;
+
     assert(type < BLOCK_MAX_IOTYPE);
 
     /* block_account_one_io() updates total_time_ns[], but this one does
      * not.  The reason is that invalid requests are accounted during their
      * submission, therefore there's no actual I/O involved.
      */
-    qemu_mutex_lock(&stats->lock);
-    stats->invalid_ops[type]++;
+    c = block_acct_counters(stats);
+    qatomic_inc(&c->invalid_ops[type]);
 
     if (stats->account_invalid) {
-        stats->last_access_time_ns = qemu_clock_get_ns(clock_type);
+        qatomic_set(&c->last_access_time_ns, qemu_clock_get_ns(clock_type));
     }
-    qemu_mutex_unlock(&stats->lock);
 }
 
 void block_acct_merge_done(BlockAcctStats *stats, enum BlockAcctType type,
@@ -285,14 +347,45 @@ void block_acct_merge_done(BlockAcctStats *stats, enum BlockAcctType type,
 {
     assert(type < BLOCK_MAX_IOTYPE);
 
-    qemu_mutex_lock(&stats->lock);
-    stats->merged[type] += num_requests;
-    qemu_mutex_unlock(&stats->lock);
+    qatomic_add(&block_acct_counters(stats)->merged[type], num_requests);
+}
+
+/*
+ * Sum up the counters of all threads.  Requests that complete concurrently
+ * may or may not be included, and the counters may not be consistent with
+ * each other while requests are in flight.
+ */
+void block_acct_get_counters(BlockAcctStats *stats,
+                             BlockAcctCounters *counters)
+{
+    int i, type;
+
+    memset(counters, 0, sizeof(*counters));
+
+    for (i = 0; i < BLOCK_ACCT_SHARDS; i++) {
+        BlockAcctCounters *c = &stats->shards[i].counters;
+
+        for (type = 0; type < BLOCK_MAX_IOTYPE; type++) {
+            counters->nr_bytes[type] += qatomic_read(&c->nr_bytes[type]);
+            counters->nr_ops[type] += qatomic_read(&c->nr_ops[type]);
+            counters->invalid_ops[type] += qatomic_read(&c->invalid_ops[type]);
+            counters->failed_ops[type] += qatomic_read(&c->failed_ops[type]);
+            counters->total_time_ns[type] +=
+                qatomic_read(&c->total_time_ns[type]);
+            counters->merged[type] += qatomic_read(&c->merged[type]);
+        }
+        counters->last_access_time_ns =
+            MAX(counters->last_access_time_ns,
+                qatomic_read(&c->last_access_time_ns));
+    }
 }
 
 int64_t block_acct_idle_time_ns(BlockAcctStats *stats)
 {
-    return qemu_clock_get_ns(clock_type) - stats->last_access_time_ns;
+    BlockAcctCounters counters;
+
+    block_acct_get_counters(stats, &counters);
+    return qemu_clock_get_ns(clock_type) - counters.last_access_time_ns;
 }
 
 double block_acct_queue_depth(BlockAcctTimedStats *stats,
@@ -40,6 +40,8 @@
 #include "qobject/qstring.h"
 
 #include "scsi/pr-manager.h"
+#include "system/memory.h" /* for ram_block_discard_disable() */
+#include "migration/blocker.h"
 #include "scsi/constants.h"
 #include "scsi/utils.h"
 
@@ -184,12 +186,17 @@ typedef struct BDRVRawState {
     bool has_laio_fdsync:1;
     bool use_linux_io_uring:1;
     bool use_mpath:1;
+    int io_uring_fixed_fd; /* index of fd in io_uring file table, or -1 */
+    bool aio_fixed_buffers;
+    GHashTable *io_uring_fixed_bufs; /* host address -> size */
+    Error *postcopy_blocker;
     int page_cache_inconsistent; /* errno from fdatasync failure */
     bool has_fallocate;
     bool needs_alignment;
     bool force_alignment;
     bool drop_cache;
     bool check_cache_dropped;
+    /* Updated from the AioContexts of all IOThreads that submit requests */
     struct {
         uint64_t discard_nb_ok;
         uint64_t discard_nb_failed;
@@ -585,6 +592,14 @@ static QemuOptsList raw_runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "AIO max batch size (0 = auto handled by AIO backend, default: 0)",
         },
+#ifdef CONFIG_LINUX_IO_URING
+        {
+            .name = "aio-fixed-buffers",
+            .type = QEMU_OPT_BOOL,
+            .help = "register guest RAM with io_uring, disables RAM discard "
+                    "(default: off)",
+        },
+#endif
         {
             .name = "locking",
             .type = QEMU_OPT_STRING,
@@ -704,6 +719,9 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
         }
     }
 
+#ifdef CONFIG_LINUX_IO_URING
+    s->aio_fixed_buffers = qemu_opt_get_bool(opts, "aio-fixed-buffers", false);
+#endif
     s->drop_cache = qemu_opt_get_bool(opts, "drop-cache", true);
     s->check_cache_dropped = qemu_opt_get_bool(opts, "x-check-cache-dropped",
                                                false);
@@ -712,6 +730,7 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
     raw_parse_flags(bdrv_flags, &s->open_flags, false);
 
     s->fd = -1;
+    s->io_uring_fixed_fd = -1;
     fd = qemu_open(filename, s->open_flags, errp);
     ret = fd < 0 ? -errno : 0;
 
@@ -838,6 +857,12 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
         /* When extending regular files, we get zeros from the OS */
         bs->supported_truncate_flags = BDRV_REQ_ZERO_WRITE;
     }
+
+#ifdef CONFIG_LINUX_IO_URING
+    if (s->use_linux_io_uring) {
+        s->io_uring_fixed_fd = aio_register_fixed_file(s->fd);
+    }
+#endif
     ret = 0;
 fail:
     if (ret < 0 && s->fd != -1) {
@@ -2557,11 +2582,18 @@ static inline bool raw_check_linux_aio(BDRVRawState *s)
         return false;
     }
 
+    /*
+     * Every AioContext submits to its own Linux AIO context, so that requests
+     * from several IOThreads to this node don't share a submission queue. If
+     * one of them can't be set up (e.g. because fs.aio-max-nr is exhausted),
+     * only that AioContext falls back to the thread pool.
+     */
     ctx = qemu_get_current_aio_context();
     if (unlikely(!aio_setup_linux_aio(ctx, &local_err))) {
-        error_reportf_err(local_err, "Unable to use Linux AIO, "
-                                     "falling back to thread pool: ");
-        s->use_linux_aio = false;
+        if (local_err) {
+            error_reportf_err(local_err, "Unable to use Linux AIO, "
+                                         "falling back to thread pool: ");
+        }
         return false;
     }
     return true;
@@ -2601,7 +2633,8 @@ raw_co_prw(BlockDriverState *bs, int64_t *offset_ptr, uint64_t bytes,
 #ifdef CONFIG_LINUX_IO_URING
     } else if (s->use_linux_io_uring) {
         assert(qiov->size == bytes);
-        ret = luring_co_submit(bs, s->fd, offset, qiov, type, flags);
+        ret = luring_co_submit(bs, s->fd, s->io_uring_fixed_fd, offset, qiov,
+                               type, flags);
         goto out;
 #endif
 #ifdef CONFIG_LINUX_AIO
@@ -2697,7 +2730,8 @@ static int coroutine_fn raw_co_flush_to_disk(BlockDriverState *bs)
 
 #ifdef CONFIG_LINUX_IO_URING
     if (s->use_linux_io_uring) {
-        return luring_co_submit(bs, s->fd, 0, NULL, QEMU_AIO_FLUSH, 0);
+        return luring_co_submit(bs, s->fd, s->io_uring_fixed_fd, 0, NULL,
+                                QEMU_AIO_FLUSH, 0);
     }
 #endif
 #ifdef CONFIG_LINUX_AIO
@@ -2708,6 +2742,81 @@ static int coroutine_fn raw_co_flush_to_disk(BlockDriverState *bs)
     return raw_thread_pool_submit(handle_aiocb_flush, &acb);
 }
 
+#ifdef CONFIG_LINUX_IO_URING
+/*
+ * With aio-fixed-buffers=on, guest RAM is registered with io_uring so that
+ * requests on it can use fixed-buffer operations, which saves pinning the
+ * pages for each request.  The registration keeps the pages pinned, so a
+ * discarded page would stay behind and I/O would use stale memory.  Discards
+ * are disabled for as long as anything is registered.  Postcopy and
+ * release-ram discard guest RAM regardless, so they are blocked as well.
+ */
+static bool raw_register_buf(BlockDriverState *bs, void *host, size_t size,
+                             Error **errp)
+{
+    BDRVRawState *s = bs->opaque;
+    int ret;
+
+    if (!s->use_linux_io_uring || !s->aio_fixed_buffers) {
+        return true;
+    }
+
+    if (!s->io_uring_fixed_bufs) {
+        ret = ram_block_discard_disable(true);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "aio-fixed-buffers=on is not "
+                             "compatible with discarding guest RAM");
+            return false;
+        }
+        error_setg(&s->postcopy_blocker, "Node '%s' has guest RAM registered "
+                   "with aio-fixed-buffers=on",
+                   bdrv_get_node_name(bs));
+        if (migrate_add_postcopy_blocker(&s->postcopy_blocker, errp) < 0) {
+            ram_block_discard_disable(false);
+            return false;
+        }
+        s->io_uring_fixed_bufs = g_hash_table_new(NULL, NULL);
+    }
+    if (g_hash_table_insert(s->io_uring_fixed_bufs, host,
+                            GSIZE_TO_POINTER(size))) {
+        aio_register_fixed_buf(host, size);
+    }
+    return true;
+}
+
+static void raw_unregister_all_bufs(BDRVRawState *s)
+{
+    GHashTableIter iter;
+    gpointer host, size;
+
+    if (!s->io_uring_fixed_bufs) {
+        return;
+    }
+
+    g_hash_table_iter_init(&iter, s->io_uring_fixed_bufs);
+    while (g_hash_table_iter_next(&iter, &host, &size)) {
+        aio_unregister_fixed_buf(host, GPOINTER_TO_SIZE(size));
+    }
+    g_clear_pointer(&s->io_uring_fixed_bufs, g_hash_table_destroy);
+    migrate_del_postcopy_blocker(&s->postcopy_blocker);
+    ram_block_discard_disable(false);
+}
+
+/* Nodes added to the graph later may not have seen the registration */
+static void raw_unregister_buf(BlockDriverState *bs, void *host, size_t size)
+{
+    BDRVRawState *s = bs->opaque;
+
+    if (s->io_uring_fixed_bufs &&
+        g_hash_table_remove(s->io_uring_fixed_bufs, host)) {
+        aio_unregister_fixed_buf(host, size);
+        if (g_hash_table_size(s->io_uring_fixed_bufs) == 0) {
+            raw_unregister_all_bufs(s);
+        }
+    }
+}
+#endif
+
 static void raw_close(BlockDriverState *bs)
 {
     BDRVRawState *s = bs->opaque;
@@ -2715,6 +2824,11 @@ static void raw_close(BlockDriverState *bs)
     if (s->fd >= 0) {
 #if defined(CONFIG_BLKZONED)
         g_free(bs->wps);
+#endif
+#ifdef CONFIG_LINUX_IO_URING
+        raw_unregister_all_bufs(s);
+        aio_unregister_fixed_file(s->io_uring_fixed_fd);
+        s->io_uring_fixed_fd = -1;
 #endif
         qemu_close(s->fd);
         s->fd = -1;
@@ -3472,10 +3586,10 @@ raw_co_invalidate_cache(BlockDriverState *bs, Error **errp)
 static void raw_account_discard(BDRVRawState *s, uint64_t nbytes, int ret)
 {
     if (ret) {
-        s->stats.discard_nb_failed++;
+        qatomic_inc(&s->stats.discard_nb_failed);
     } else {
-        s->stats.discard_nb_ok++;
-        s->stats.discard_bytes_ok += nbytes;
+        qatomic_inc(&s->stats.discard_nb_ok);
+        qatomic_add(&s->stats.discard_bytes_ok, nbytes);
     }
 }
 
@@ -3786,9 +3900,9 @@ static BlockStatsSpecificFile get_blockstats_specific_file(BlockDriverState *bs)
 {
     BDRVRawState *s = bs->opaque;
     return (BlockStatsSpecificFile) {
-        .discard_nb_ok = s->stats.discard_nb_ok,
-        .discard_nb_failed = s->stats.discard_nb_failed,
-        .discard_bytes_ok = s->stats.discard_bytes_ok,
+        .discard_nb_ok = qatomic_read(&s->stats.discard_nb_ok),
+        .discard_nb_failed = qatomic_read(&s->stats.discard_nb_failed),
+        .discard_bytes_ok = qatomic_read(&s->stats.discard_bytes_ok),
     };
 }
 
@@ -3908,6 +4022,14 @@ static void raw_set_perm(BlockDriverState *bs, uint64_t perm, uint64_t shared)
     /* For reopen, we have already switched to the new fd (.bdrv_set_perm is
      * called after .bdrv_reopen_commit) */
     if (s->perm_change_fd && s->fd != s->perm_change_fd) {
+#ifdef CONFIG_LINUX_IO_URING
+        /* The registration would keep the old file (and its locks) open */
+        aio_unregister_fixed_file(s->io_uring_fixed_fd);
+        s->io_uring_fixed_fd = -1;
+        if (s->use_linux_io_uring) {
+            s->io_uring_fixed_fd = aio_register_fixed_file(s->perm_change_fd);
+        }
+#endif
         qemu_close(s->fd);
         s->fd = s->perm_change_fd;
         s->open_flags = s->perm_change_flags;
@@ -4005,6 +4127,10 @@ BlockDriver bdrv_file = {
     .bdrv_co_copy_range_from = raw_co_copy_range_from,
     .bdrv_co_copy_range_to  = raw_co_copy_range_to,
     .bdrv_refresh_limits = raw_refresh_limits,
+#ifdef CONFIG_LINUX_IO_URING
+    .bdrv_register_buf      = raw_register_buf,
+    .bdrv_unregister_buf    = raw_unregister_buf,
+#endif
 
     .bdrv_co_truncate                   = raw_co_truncate,
     .bdrv_co_getlength                  = raw_co_getlength,
@@ -4475,6 +4601,10 @@ static BlockDriver bdrv_host_device = {
     .bdrv_co_copy_range_from = raw_co_copy_range_from,
     .bdrv_co_copy_range_to  = raw_co_copy_range_to,
     .bdrv_refresh_limits = raw_refresh_limits,
+#ifdef CONFIG_LINUX_IO_URING
+    .bdrv_register_buf      = raw_register_buf,
+    .bdrv_unregister_buf    = raw_unregister_buf,
+#endif
 
     .bdrv_co_truncate                   = raw_co_truncate,
     .bdrv_co_getlength                  = raw_co_getlength,
@@ -24,6 +24,7 @@ typedef struct {
     ssize_t ret;
     int type;
     int fd;
+    int fixed_fd; /* index in the registered file table or -1 */
     BdrvRequestFlags flags;
 
     /*
@@ -41,8 +42,13 @@ static void luring_prep_sqe(struct io_uring_sqe *sqe, void *opaque)
     LuringRequest *req = opaque;
     QEMUIOVector *qiov = req->qiov;
     uint64_t offset = req->offset;
-    int fd = req->fd;
+    /* The io_uring of this AioContext may have no registered file table */
+    bool fixed_file = req->fixed_fd >= 0 &&
+                      qemu_get_current_aio_context()->io_uring_fixed;
+    int fd = fixed_file ? req->fixed_fd : req->fd;
     BdrvRequestFlags flags = req->flags;
+    struct iovec *iov;
+    int buf_index;
 
     switch (req->type) {
     case QEMU_AIO_WRITE:
@@ -63,8 +69,15 @@ static void luring_prep_sqe(struct io_uring_sqe *sqe, void *opaque)
 #endif
         } else {
             /* The man page says non-vectored is faster than vectored */
-            struct iovec *iov = qiov->iov;
-            io_uring_prep_write(sqe, fd, iov->iov_base, iov->iov_len, offset);
+            iov = qiov->iov;
+            buf_index = aio_fixed_buf_index(iov->iov_base, iov->iov_len);
+            if (buf_index >= 0) {
+                io_uring_prep_write_fixed(sqe, fd, iov->iov_base, iov->iov_len,
+                                          offset, buf_index);
+            } else {
+                io_uring_prep_write(sqe, fd, iov->iov_base, iov->iov_len,
+                                    offset);
+            }
         }
         break;
     }
@@ -81,9 +94,15 @@ static void luring_prep_sqe(struct io_uring_sqe *sqe, void *opaque)
                                 offset + req->total_read);
         } else {
             /* The man page says non-vectored is faster than vectored */
-            struct iovec *iov = qiov->iov;
-            io_uring_prep_read(sqe, fd, iov->iov_base, iov->iov_len,
-                               offset + req->total_read);
+            iov = qiov->iov;
+            buf_index = aio_fixed_buf_index(iov->iov_base, iov->iov_len);
+            if (buf_index >= 0) {
+                io_uring_prep_read_fixed(sqe, fd, iov->iov_base, iov->iov_len,
+                                         offset + req->total_read, buf_index);
+            } else {
+                io_uring_prep_read(sqe, fd, iov->iov_base, iov->iov_len,
+                                   offset + req->total_read);
+            }
         }
         break;
     }
@@ -95,6 +114,10 @@ static void luring_prep_sqe(struct io_uring_sqe *sqe, void *opaque)
                         __func__, req->type);
         abort();
     }
+
+    if (fixed_file) {
+        io_uring_sqe_set_flags(sqe, IOSQE_FIXED_FILE);
+    }
 }
 
 /**
@@ -189,7 +212,7 @@ static void luring_cqe_handler(CqeHandler *cqe_handler)
     }
 }
 
-int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd,
+int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, int fixed_fd,
                                   uint64_t offset, QEMUIOVector *qiov,
                                   int type, BdrvRequestFlags flags)
 {
@@ -199,6 +222,7 @@ int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd,
         .ret        = -EINPROGRESS,
         .type       = type,
         .fd         = fd,
+        .fixed_fd   = fixed_fd,
         .offset     = offset,
         .flags      = flags,
     };
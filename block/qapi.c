@@ -534,44 +534,47 @@ static void bdrv_query_blk_stats(BlockDeviceStats *ds, BlockBackend *blk)
     BlockAcctStats *stats = blk_get_stats(blk);
     BlockAcctTimedStats *ts = NULL;
     BlockLatencyHistogram *hgram;
+    BlockAcctCounters c;
 
-    ds->rd_bytes = stats->nr_bytes[BLOCK_ACCT_READ];
-    ds->wr_bytes = stats->nr_bytes[BLOCK_ACCT_WRITE];
-    ds->zone_append_bytes = stats->nr_bytes[BLOCK_ACCT_ZONE_APPEND];
-    ds->unmap_bytes = stats->nr_bytes[BLOCK_ACCT_UNMAP];
-    ds->rd_operations = stats->nr_ops[BLOCK_ACCT_READ];
-    ds->wr_operations = stats->nr_ops[BLOCK_ACCT_WRITE];
-    ds->zone_append_operations = stats->nr_ops[BLOCK_ACCT_ZONE_APPEND];
-    ds->unmap_operations = stats->nr_ops[BLOCK_ACCT_UNMAP];
-
-    ds->failed_rd_operations = stats->failed_ops[BLOCK_ACCT_READ];
-    ds->failed_wr_operations = stats->failed_ops[BLOCK_ACCT_WRITE];
+    block_acct_get_counters(stats, &c);
+
+    ds->rd_bytes = c.nr_bytes[BLOCK_ACCT_READ];
+    ds->wr_bytes = c.nr_bytes[BLOCK_ACCT_WRITE];
+    ds->zone_append_bytes = c.nr_bytes[BLOCK_ACCT_ZONE_APPEND];
+    ds->unmap_bytes = c.nr_bytes[BLOCK_ACCT_UNMAP];
+    ds->rd_operations = c.nr_ops[BLOCK_ACCT_READ];
+    ds->wr_operations = c.nr_ops[BLOCK_ACCT_WRITE];
+    ds->zone_append_operations = c.nr_ops[BLOCK_ACCT_ZONE_APPEND];
+    ds->unmap_operations = c.nr_ops[BLOCK_ACCT_UNMAP];
+
+    ds->failed_rd_operations = c.failed_ops[BLOCK_ACCT_READ];
+    ds->failed_wr_operations = c.failed_ops[BLOCK_ACCT_WRITE];
     ds->failed_zone_append_operations =
-        stats->failed_ops[BLOCK_ACCT_ZONE_APPEND];
-    ds->failed_flush_operations = stats->failed_ops[BLOCK_ACCT_FLUSH];
-    ds->failed_unmap_operations = stats->failed_ops[BLOCK_ACCT_UNMAP];
+        c.failed_ops[BLOCK_ACCT_ZONE_APPEND];
+    ds->failed_flush_operations = c.failed_ops[BLOCK_ACCT_FLUSH];
+    ds->failed_unmap_operations = c.failed_ops[BLOCK_ACCT_UNMAP];
 
-    ds->invalid_rd_operations = stats->invalid_ops[BLOCK_ACCT_READ];
-    ds->invalid_wr_operations = stats->invalid_ops[BLOCK_ACCT_WRITE];
+    ds->invalid_rd_operations = c.invalid_ops[BLOCK_ACCT_READ];
+    ds->invalid_wr_operations = c.invalid_ops[BLOCK_ACCT_WRITE];
     ds->invalid_zone_append_operations =
-        stats->invalid_ops[BLOCK_ACCT_ZONE_APPEND];
+        c.invalid_ops[BLOCK_ACCT_ZONE_APPEND];
     ds->invalid_flush_operations =
-        stats->invalid_ops[BLOCK_ACCT_FLUSH];
-    ds->invalid_unmap_operations = stats->invalid_ops[BLOCK_ACCT_UNMAP];
-
-    ds->rd_merged = stats->merged[BLOCK_ACCT_READ];
-    ds->wr_merged = stats->merged[BLOCK_ACCT_WRITE];
-    ds->zone_append_merged = stats->merged[BLOCK_ACCT_ZONE_APPEND];
-    ds->unmap_merged = stats->merged[BLOCK_ACCT_UNMAP];
-    ds->flush_operations = stats->nr_ops[BLOCK_ACCT_FLUSH];
-    ds->wr_total_time_ns = stats->total_time_ns[BLOCK_ACCT_WRITE];
+        c.invalid_ops[BLOCK_ACCT_FLUSH];
+    ds->invalid_unmap_operations = c.invalid_ops[BLOCK_ACCT_UNMAP];
+
+    ds->rd_merged = c.merged[BLOCK_ACCT_READ];
+    ds->wr_merged = c.merged[BLOCK_ACCT_WRITE];
+    ds->zone_append_merged = c.merged[BLOCK_ACCT_ZONE_APPEND];
+    ds->unmap_merged = c.merged[BLOCK_ACCT_UNMAP];
+    ds->flush_operations = c.nr_ops[BLOCK_ACCT_FLUSH];
+    ds->wr_total_time_ns = c.total_time_ns[BLOCK_ACCT_WRITE];
     ds->zone_append_total_time_ns =
-        stats->total_time_ns[BLOCK_ACCT_ZONE_APPEND];
-    ds->rd_total_time_ns = stats->total_time_ns[BLOCK_ACCT_READ];
-    ds->flush_total_time_ns = stats->total_time_ns[BLOCK_ACCT_FLUSH];
-    ds->unmap_total_time_ns = stats->total_time_ns[BLOCK_ACCT_UNMAP];
+        c.total_time_ns[BLOCK_ACCT_ZONE_APPEND];
+    ds->rd_total_time_ns = c.total_time_ns[BLOCK_ACCT_READ];
+    ds->flush_total_time_ns = c.total_time_ns[BLOCK_ACCT_FLUSH];
+    ds->unmap_total_time_ns = c.total_time_ns[BLOCK_ACCT_UNMAP];
 
-    ds->has_idle_time_ns = stats->last_access_time_ns > 0;
+    ds->has_idle_time_ns = c.last_access_time_ns > 0;
     if (ds->has_idle_time_ns) {
         ds->idle_time_ns = block_acct_idle_time_ns(stats);
     }
@@ -615,6 +618,7 @@ static void bdrv_query_blk_stats(BlockDeviceStats *ds, BlockBackend *blk)
         QAPI_LIST_PREPEND(ds->timed_stats, dev_stats);
     }
 
+    QEMU_LOCK_GUARD(&stats->lock);
     hgram = stats->latency_histogram;
     ds->rd_latency_histogram
         = bdrv_latency_histogram_stats(&hgram[BLOCK_ACCT_READ]);
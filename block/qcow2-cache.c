@@ -25,25 +25,58 @@
 #include "qemu/osdep.h"
 #include "block/block-io.h"
 #include "qemu/memalign.h"
+#include "qemu/queue.h"
 #include "qcow2.h"
 #include "trace.h"
 
+/*
+ * Cached tables are found through a hash table keyed by their offset.  The
+ * hash table is split into shards, each with its own buckets and its own LRU
+ * list of unreferenced tables, so that neither a lookup nor picking a victim
+ * has to look at the entries of the whole cache.
+ *
+ * All accesses are serialized by the BDRVQcow2State lock, which every caller
+ * already holds; a shard is the unit that finer grained locking would
+ * protect.
+ */
+#define QCOW2_CACHE_MAX_SHARDS          16
+#define QCOW2_CACHE_MIN_SHARD_ENTRIES   32
+
 typedef struct Qcow2CachedTable {
     int64_t  offset;
     uint64_t lru_counter;
     int      ref;
     bool     dirty;
+    /* Next entry in the same hash bucket, or -1 */
+    int      hash_next;
+    /* Free list while offset == 0, else shard LRU list while ref == 0 */
+    QTAILQ_ENTRY(Qcow2CachedTable) lru_entry;
 } Qcow2CachedTable;
 
+typedef QTAILQ_HEAD(, Qcow2CachedTable) Qcow2CachedTableList;
+
+typedef struct Qcow2CacheShard {
+    /* Heads of the hash chains of this shard, -1 if empty */
+    int                    *buckets;
+    /* Unreferenced tables, least recently used first */
+    Qcow2CachedTableList    lru;
+} Qcow2CacheShard;
+
 struct Qcow2Cache {
     Qcow2CachedTable       *entries;
     struct Qcow2Cache      *depends;
     int                     size;
     int                     table_size;
+    int                     table_bits;
     bool                    depends_on_flush;
     void                   *table_array;
     uint64_t                lru_counter;
     uint64_t                cache_clean_lru_counter;
+    Qcow2CacheShard        *shards;
+    int                     shard_bits;
+    int                     bucket_bits;
+    /* Entries that do not hold any table */
+    Qcow2CachedTableList    free_list;
 };
 
 static inline void *qcow2_cache_get_table_addr(Qcow2Cache *c, int table)
@@ -59,6 +92,75 @@ static inline int qcow2_cache_get_table_idx(Qcow2Cache *c, void *table)
     return idx;
 }
 
+static inline int qcow2_cache_entry_idx(Qcow2Cache *c, Qcow2CachedTable *t)
+{
+    return t - c->entries;
+}
+
+static inline Qcow2CacheShard *qcow2_cache_shard(Qcow2Cache *c,
+                                                 uint64_t offset)
+{
+    uint64_t idx = offset >> c->table_bits;
+
+    return &c->shards[idx & ((1 << c->shard_bits) - 1)];
+}
+
+static inline int *qcow2_cache_bucket(Qcow2Cache *c, uint64_t offset)
+{
+    uint64_t idx = offset >> (c->table_bits + c->shard_bits);
+
+    return &qcow2_cache_shard(c, offset)->buckets[
+        idx & ((1 << c->bucket_bits) - 1)];
+}
+
+static int qcow2_cache_lookup(Qcow2Cache *c, uint64_t offset)
+{
+    int i = *qcow2_cache_bucket(c, offset);
+
+    while (i >= 0 && c->entries[i].offset != offset) {
+        i = c->entries[i].hash_next;
+    }
+    return i;
+}
+
+static void qcow2_cache_hash_insert(Qcow2Cache *c, int i)
+{
+    int *bucket = qcow2_cache_bucket(c, c->entries[i].offset);
+
+    c->entries[i].hash_next = *bucket;
+    *bucket = i;
+}
+
+static void qcow2_cache_hash_remove(Qcow2Cache *c, int i)
+{
+    int *link = qcow2_cache_bucket(c, c->entries[i].offset);
+
+    while (*link != i) {
+        assert(*link >= 0);
+        link = &c->entries[*link].hash_next;
+    }
+    *link = c->entries[i].hash_next;
+    c->entries[i].hash_next = -1;
+}
+
+/*
+ * Drop the table held by entry @i, which must not be referenced, and put the
+ * entry on the free list.
+ */
+static void qcow2_cache_entry_invalidate(Qcow2Cache *c, int i)
+{
+    Qcow2CachedTable *t = &c->entries[i];
+
+    assert(t->ref == 0);
+    if (t->offset) {
+        QTAILQ_REMOVE(&qcow2_cache_shard(c, t->offset)->lru, t, lru_entry);
+        qcow2_cache_hash_remove(c, i);
+        QTAILQ_INSERT_TAIL(&c->free_list, t, lru_entry);
+    }
+    t->offset = 0;
+    t->lru_counter = 0;
+}
+
 static inline const char *qcow2_cache_get_name(BDRVQcow2State *s, Qcow2Cache *c)
 {
     if (c == s->refcount_block_cache) {
@@ -106,8 +208,7 @@ void qcow2_cache_clean_unused(Qcow2Cache *c)
 
         /* And count how many we can clean in a row */
         while (i < c->size && can_clean_entry(c, i)) {
-            c->entries[i].offset = 0;
-            c->entries[i].lru_counter = 0;
+            qcow2_cache_entry_invalidate(c, i);
             i++;
             to_clean++;
         }
@@ -125,24 +226,48 @@ Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
 {
     BDRVQcow2State *s = bs->opaque;
     Qcow2Cache *c;
+    int num_shards, num_buckets, i;
 
     assert(num_tables > 0);
     assert(is_power_of_2(table_size));
     assert(table_size >= (1 << MIN_CLUSTER_BITS));
     assert(table_size <= s->cluster_size);
 
+    /* Small caches keep a single shard, i.e. a global LRU */
+    num_shards = MIN(num_tables / QCOW2_CACHE_MIN_SHARD_ENTRIES,
+                     QCOW2_CACHE_MAX_SHARDS);
+    num_shards = MAX(pow2floor(num_shards), 1);
+    num_buckets = pow2ceil(DIV_ROUND_UP(num_tables, num_shards));
+
     c = g_new0(Qcow2Cache, 1);
     c->size = num_tables;
     c->table_size = table_size;
+    c->table_bits = ctz32(table_size);
+    c->shard_bits = ctz32(num_shards);
+    c->bucket_bits = ctz32(num_buckets);
     c->entries = g_try_new0(Qcow2CachedTable, num_tables);
+    c->shards = g_new0(Qcow2CacheShard, num_shards);
     c->table_array = qemu_try_blockalign(bs->file->bs,
                                          (size_t) num_tables * c->table_size);
 
     if (!c->entries || !c->table_array) {
         qemu_vfree(c->table_array);
+        g_free(c->shards);
         g_free(c->entries);
         g_free(c);
-        c = NULL;
+        return NULL;
+    }
+
+    for (i = 0; i < num_shards; i++) {
+        c->shards[i].buckets = g_new(int, num_buckets);
+        memset(c->shards[i].buckets, -1, num_buckets * sizeof(int));
+        QTAILQ_INIT(&c->shards[i].lru);
+    }
+
+    QTAILQ_INIT(&c->free_list);
+    for (i = 0; i < num_tables; i++) {
+        c->entries[i].hash_next = -1;
+        QTAILQ_INSERT_TAIL(&c->free_list, &c->entries[i], lru_entry);
     }
 
     return c;
@@ -156,7 +281,12 @@ int qcow2_cache_destroy(Qcow2Cache *c)
         assert(c->entries[i].ref == 0);
     }
 
+    for (i = 0; i < (1 << c->shard_bits); i++) {
+        g_free(c->shards[i].buckets);
+    }
+
     qemu_vfree(c->table_array);
+    g_free(c->shards);
     g_free(c->entries);
     g_free(c);
 
@@ -308,9 +438,7 @@ int qcow2_cache_empty(BlockDriverState *bs, Qcow2Cache *c)
     }
 
     for (i = 0; i < c->size; i++) {
-        assert(c->entries[i].ref == 0);
-        c->entries[i].offset = 0;
-        c->entries[i].lru_counter = 0;
+        qcow2_cache_entry_invalidate(c, i);
     }
 
     qcow2_cache_table_release(c, 0, c->size);
@@ -320,16 +448,35 @@ int qcow2_cache_empty(BlockDriverState *bs, Qcow2Cache *c)
     return 0;
 }
 
+/*
+ * Pick the entry to hold a new table at @offset: a free one if there is any,
+ * else the least recently used table of the shard of @offset, else the least
+ * recently used table of any other shard.
+ */
+static Qcow2CachedTable *qcow2_cache_get_victim(Qcow2Cache *c, uint64_t offset)
+{
+    Qcow2CachedTable *t;
+    int i;
+
+    t = QTAILQ_FIRST(&c->free_list);
+    if (!t) {
+        t = QTAILQ_FIRST(&qcow2_cache_shard(c, offset)->lru);
+    }
+    for (i = 0; !t && i < (1 << c->shard_bits); i++) {
+        t = QTAILQ_FIRST(&c->shards[i].lru);
+    }
+
+    return t;
+}
+
 static int GRAPH_RDLOCK
 qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
                    void **table, bool read_from_disk)
 {
     BDRVQcow2State *s = bs->opaque;
+    Qcow2CachedTable *t;
     int i;
     int ret;
-    int lookup_index;
-    uint64_t min_lru_counter = UINT64_MAX;
-    int min_lru_index = -1;
 
     assert(offset != 0);
 
@@ -344,29 +491,25 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     }
 
     /* Check if the table is already cached */
-    i = lookup_index = (offset / c->table_size * 4) % c->size;
-    do {
-        const Qcow2CachedTable *t = &c->entries[i];
-        if (t->offset == offset) {
-            goto found;
-        }
-        if (t->ref == 0 && t->lru_counter < min_lru_counter) {
-            min_lru_counter = t->lru_counter;
-            min_lru_index = i;
+    i = qcow2_cache_lookup(c, offset);
+    if (i >= 0) {
+        t = &c->entries[i];
+        if (t->ref == 0) {
+            QTAILQ_REMOVE(&qcow2_cache_shard(c, offset)->lru, t, lru_entry);
         }
-        if (++i == c->size) {
-            i = 0;
-        }
-    } while (i != lookup_index);
+        t->ref++;
+        goto found;
+    }
 
-    if (min_lru_index == -1) {
+    t = qcow2_cache_get_victim(c, offset);
+    if (!t) {
         /* This can't happen in current synchronous code, but leave the check
          * here as a reminder for whoever starts using AIO with the cache */
         abort();
     }
 
     /* Cache miss: write a table back and replace it */
-    i = min_lru_index;
+    i = qcow2_cache_entry_idx(c, t);
     trace_qcow2_cache_get_replace_entry(qemu_coroutine_self(),
                                         c == s->l2_table_cache, i);
 
@@ -377,7 +520,12 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
 
     trace_qcow2_cache_get_read(qemu_coroutine_self(),
                                c == s->l2_table_cache, i);
-    c->entries[i].offset = 0;
+
+    /* Unlink the entry and keep it referenced while the table is read */
+    qcow2_cache_entry_invalidate(c, i);
+    QTAILQ_REMOVE(&c->free_list, t, lru_entry);
+    t->ref = 1;
+
     if (read_from_disk) {
         if (c == s->l2_table_cache) {
             BLKDBG_EVENT(bs->file, BLKDBG_L2_LOAD);
@@ -386,15 +534,17 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
         ret = bdrv_pread(bs->file, offset, c->table_size,
                          qcow2_cache_get_table_addr(c, i), 0);
         if (ret < 0) {
+            t->ref = 0;
+            QTAILQ_INSERT_HEAD(&c->free_list, t, lru_entry);
             return ret;
         }
     }
 
-    c->entries[i].offset = offset;
+    t->offset = offset;
+    qcow2_cache_hash_insert(c, i);
 
     /* And return the right table */
 found:
-    c->entries[i].ref++;
     *table = qcow2_cache_get_table_addr(c, i);
 
     trace_qcow2_cache_get_done(qemu_coroutine_self(),
@@ -418,15 +568,18 @@ int qcow2_cache_get_empty(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
 void qcow2_cache_put(Qcow2Cache *c, void **table)
 {
     int i = qcow2_cache_get_table_idx(c, *table);
+    Qcow2CachedTable *t = &c->entries[i];
 
-    c->entries[i].ref--;
+    t->ref--;
     *table = NULL;
 
-    if (c->entries[i].ref == 0) {
-        c->entries[i].lru_counter = ++c->lru_counter;
+    if (t->ref == 0) {
+        t->lru_counter = ++c->lru_counter;
+        QTAILQ_INSERT_TAIL(&qcow2_cache_shard(c, t->offset)->lru, t,
+                           lru_entry);
     }
 
-    assert(c->entries[i].ref >= 0);
+    assert(t->ref >= 0);
 }
 
 void qcow2_cache_entry_mark_dirty(Qcow2Cache *c, void *table)
@@ -438,24 +591,16 @@ void qcow2_cache_entry_mark_dirty(Qcow2Cache *c, void *table)
 
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset)
 {
-    int i;
+    int i = qcow2_cache_lookup(c, offset);
 
-    for (i = 0; i < c->size; i++) {
-        if (c->entries[i].offset == offset) {
-            return qcow2_cache_get_table_addr(c, i);
-        }
-    }
-    return NULL;
+    return i >= 0 ? qcow2_cache_get_table_addr(c, i) : NULL;
 }
 
 void qcow2_cache_discard(Qcow2Cache *c, void *table)
 {
     int i = qcow2_cache_get_table_idx(c, table);
 
-    assert(c->entries[i].ref == 0);
-
-    c->entries[i].offset = 0;
-    c->entries[i].lru_counter = 0;
+    qcow2_cache_entry_invalidate(c, i);
     c->entries[i].dirty = false;
 
     qcow2_cache_table_release(c, i, 1);
@@ -742,6 +742,116 @@ fail:
     return ret;
 }
 
+typedef struct Qcow2L2Readahead {
+    BlockDriverState *bs;
+    uint64_t offset;
+    uint64_t end;
+} Qcow2L2Readahead;
+
+/*
+ * Load the L2 slices that map the guest range [ra->offset, ra->end) into the
+ * cache.  Errors are ignored: the request that eventually needs the slice
+ * will run into them again and report them.
+ */
+static void coroutine_fn qcow2_l2_readahead_entry(void *opaque)
+{
+    Qcow2L2Readahead *ra = opaque;
+    BlockDriverState *bs = ra->bs;
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t slice_bytes = (uint64_t) s->l2_slice_size << s->cluster_bits;
+    uint64_t offset;
+
+    GRAPH_RDLOCK_GUARD();
+
+    for (offset = ra->offset; offset < ra->end; offset += slice_bytes) {
+        uint64_t l1_index, l2_offset, slice_offset, *l2_slice;
+        int ret;
+
+        /* Take the lock for each slice so that requests can get in between */
+        qemu_co_mutex_lock(&s->lock);
+
+        l1_index = offset_to_l1_index(s, offset);
+        if (l1_index >= s->l1_size) {
+            qemu_co_mutex_unlock(&s->lock);
+            break;
+        }
+
+        l2_offset = s->l1_table[l1_index] & L1E_OFFSET_MASK;
+        slice_offset = l2_offset + l2_entry_size(s) *
+            (offset_to_l2_index(s, offset) -
+             offset_to_l2_slice_index(s, offset));
+        if (!l2_offset || offset_into_cluster(s, l2_offset) ||
+            qcow2_cache_is_table_offset(s->l2_table_cache, slice_offset)) {
+            qemu_co_mutex_unlock(&s->lock);
+            continue;
+        }
+
+        ret = l2_load(bs, offset, l2_offset, &l2_slice);
+        if (ret == 0) {
+            qcow2_cache_put(s->l2_table_cache, (void **) &l2_slice);
+        }
+        qemu_co_mutex_unlock(&s->lock);
+        if (ret < 0) {
+            break;
+        }
+    }
+
+    bdrv_dec_in_flight(bs);
+    g_free(ra);
+}
+
+/*
+ * Detect sequential reads and, when the read at @offset continues the
+ * previous one, prefetch the L2 slices of the next s->l2_readahead slices
+ * after it in a background coroutine.
+ *
+ * The window slides by one slice whenever a sequential reader crosses into a
+ * new slice, so a streaming reader finds its L2 slices already cached.
+ */
+void coroutine_fn GRAPH_RDLOCK
+qcow2_co_l2_readahead(BlockDriverState *bs, uint64_t offset, uint64_t bytes)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t slice_bytes = (uint64_t) s->l2_slice_size << s->cluster_bits;
+    uint64_t start, end;
+    Qcow2L2Readahead *ra;
+    bool sequential;
+
+    qemu_co_mutex_lock(&s->lock);
+
+    sequential = offset == s->l2_readahead_next;
+    s->l2_readahead_next = offset + bytes;
+
+    start = QEMU_ALIGN_UP(offset + bytes, slice_bytes);
+    end = start + s->l2_readahead * slice_bytes;
+    if (s->l2_readahead_end > start && s->l2_readahead_end <= end) {
+        /* Only the part of the window that was not prefetched yet */
+        start = s->l2_readahead_end;
+    }
+
+    if (!sequential || start >= end) {
+        qemu_co_mutex_unlock(&s->lock);
+        return;
+    }
+
+    s->l2_readahead_end = end;
+    qemu_co_mutex_unlock(&s->lock);
+
+    trace_qcow2_l2_readahead(bs, start, end);
+
+    ra = g_new(Qcow2L2Readahead, 1);
+    *ra = (Qcow2L2Readahead) {
+        .bs = bs,
+        .offset = start,
+        .end = end,
+    };
+
+    /* Drained sections wait for the prefetch */
+    bdrv_inc_in_flight(bs);
+    aio_co_enter(qemu_get_current_aio_context(),
+                 qemu_coroutine_create(qcow2_l2_readahead_entry, ra));
+}
+
 /*
  * get_cluster_table
  *
@@ -1582,6 +1692,129 @@ out:
     return ret;
 }
 
+static void GRAPH_RDLOCK
+cluster_reservation_release(BlockDriverState *bs, Qcow2ClusterReservation *r)
+{
+    BDRVQcow2State *s = bs->opaque;
+
+    if (r->nb_clusters) {
+        qcow2_free_clusters(bs, r->offset, r->nb_clusters << s->cluster_bits,
+                            QCOW2_DISCARD_NEVER);
+    }
+    *r = (Qcow2ClusterReservation) {};
+}
+
+/*
+ * Frees the clusters that are reserved for allocating writes but have not
+ * been used yet. This must be done before anything that treats allocated but
+ * unreferenced clusters as leaked, and before the image is closed.
+ */
+void qcow2_release_cluster_reservations(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+    int i;
+
+    for (i = 0; i < QCOW2_MAX_CLUSTER_RESERVATIONS; i++) {
+        cluster_reservation_release(bs, &s->reservations[i]);
+    }
+}
+
+/*
+ * Returns the cluster reservation of the current AioContext, evicting the
+ * reservation of another AioContext if necessary.
+ */
+static Qcow2ClusterReservation * GRAPH_RDLOCK
+cluster_reservation_get(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+    AioContext *ctx = qemu_get_current_aio_context();
+    Qcow2ClusterReservation *r, *unused = NULL;
+    int i;
+
+    for (i = 0; i < QCOW2_MAX_CLUSTER_RESERVATIONS; i++) {
+        r = &s->reservations[i];
+        if (r->ctx == ctx) {
+            return r;
+        } else if (!unused && !r->nb_clusters) {
+            unused = r;
+        }
+    }
+
+    if (!unused) {
+        unused = &s->reservations[s->reservation_victim];
+        s->reservation_victim =
+            (s->reservation_victim + 1) % QCOW2_MAX_CLUSTER_RESERVATIONS;
+        cluster_reservation_release(bs, unused);
+    }
+
+    unused->ctx = ctx;
+    return unused;
+}
+
+/*
+ * Takes clusters for an allocating write from the cluster reservation of the
+ * current AioContext, refilling it if it is empty. The parameters are the same
+ * as for do_alloc_cluster_offset().
+ *
+ * Returns 1 if the allocation has been served from the reservation (possibly
+ * with fewer clusters than requested), 0 if it has to be done the usual way
+ * and -errno on error.
+ */
+static int coroutine_fn GRAPH_RDLOCK
+alloc_reserved_clusters(BlockDriverState *bs, uint64_t *host_offset,
+                        uint64_t *nb_clusters)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2ClusterReservation *r;
+    int64_t ret;
+
+    /* Large writes are contiguous anyway */
+    if (*nb_clusters >= s->cluster_reservation) {
+        return 0;
+    }
+
+    r = cluster_reservation_get(bs);
+
+    if (*host_offset == INV_OFFSET) {
+        if (!r->nb_clusters) {
+            uint64_t size = s->cluster_reservation << s->cluster_bits;
+
+            ret = qcow2_alloc_clusters(bs, size);
+            if (ret < 0) {
+                return ret;
+            }
+            r->offset = ret;
+            r->nb_clusters = s->cluster_reservation;
+            trace_qcow2_cluster_reserve(qemu_coroutine_self(), r->offset,
+                                        r->nb_clusters);
+        }
+    } else if (*host_offset != r->offset || !r->nb_clusters) {
+        if (r->nb_clusters) {
+            return 0;
+        }
+
+        /* Extend the previous reservation if possible */
+        ret = qcow2_alloc_clusters_at(bs, *host_offset, s->cluster_reservation);
+        if (ret < 0) {
+            return ret;
+        } else if (ret == 0) {
+            *nb_clusters = 0;
+            return 1;
+        }
+        r->offset = *host_offset;
+        r->nb_clusters = ret;
+        trace_qcow2_cluster_reserve(qemu_coroutine_self(), r->offset,
+                                    r->nb_clusters);
+    }
+
+    *host_offset = r->offset;
+    *nb_clusters = MIN(*nb_clusters, r->nb_clusters);
+    r->offset += *nb_clusters << s->cluster_bits;
+    r->nb_clusters -= *nb_clusters;
+
+    return 1;
+}
+
 /*
  * Allocates new clusters for the given guest_offset.
  *
@@ -1619,6 +1852,13 @@ do_alloc_cluster_offset(BlockDriverState *bs, uint64_t guest_offset,
 
     /* Allocate new clusters */
     trace_qcow2_cluster_alloc_phys(qemu_coroutine_self());
+    if (s->cluster_reservation) {
+        int ret = alloc_reserved_clusters(bs, host_offset, nb_clusters);
+        if (ret != 0) {
+            return ret < 0 ? ret : 0;
+        }
+    }
+
     if (*host_offset == INV_OFFSET) {
         int64_t cluster_offset =
             qcow2_alloc_clusters(bs, *nb_clusters * s->cluster_size);
@@ -76,7 +76,7 @@ typedef struct {
 
 static int coroutine_fn
 qcow2_co_preadv_compressed(BlockDriverState *bs,
-                           uint64_t l2_entry,
+                           const uint64_t *l2_entries,
                            uint64_t offset,
                            uint64_t bytes,
                            QEMUIOVector *qiov,
@@ -529,13 +529,20 @@ int qcow2_mark_dirty(BlockDriverState *bs)
 
     /* Only treat image as dirty if the header was updated successfully */
     s->incompatible_features |= QCOW2_INCOMPAT_DIRTY;
+    s->dirty_time = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
     return 0;
 }
 
 /*
- * Clears the dirty bit and flushes before if necessary.  Only call this
- * function when there are no pending requests, it does not guard against
- * concurrent requests dirtying the image.
+ * Clears the dirty bit and flushes before if necessary.
+ *
+ * Callers that do not hold s->lock must make sure that there are no pending
+ * requests.  With s->lock held, requests may be in flight: with lazy
+ * refcounts, qcow2_alloc_cluster_link_l2() calls qcow2_mark_dirty() under
+ * s->lock right before it updates an L2 table, so an allocating write that
+ * was started before this sets the dirty bit again before it relies on it.
+ * The refcounts it already took are flushed here, so at worst its clusters
+ * leak if QEMU crashes before they are linked.
  */
 static int GRAPH_RDLOCK qcow2_mark_clean(BlockDriverState *bs)
 {
@@ -614,6 +621,9 @@ qcow2_co_check_locked(BlockDriverState *bs, BdrvCheckResult *result,
 
     memset(result, 0, sizeof(*result));
 
+    /* Reserved clusters would be counted as leaked */
+    qcow2_release_cluster_reservations(bs);
+
     ret = qcow2_check_read_snapshot_table(bs, &snapshot_res, fix);
     if (ret < 0) {
         qcow2_add_check_result(result, &snapshot_res, false);
@@ -681,6 +691,7 @@ int qcow2_validate_table(BlockDriverState *bs, uint64_t offset,
 
 static const char *const mutable_opts[] = {
     QCOW2_OPT_LAZY_REFCOUNTS,
+    QCOW2_OPT_LAZY_REFCOUNTS_COMMIT_INTERVAL,
     QCOW2_OPT_DISCARD_REQUEST,
     QCOW2_OPT_DISCARD_SNAPSHOT,
     QCOW2_OPT_DISCARD_OTHER,
@@ -701,6 +712,8 @@ static const char *const mutable_opts[] = {
     QCOW2_OPT_L2_CACHE_ENTRY_SIZE,
     QCOW2_OPT_REFCOUNT_CACHE_SIZE,
     QCOW2_OPT_CACHE_CLEAN_INTERVAL,
+    QCOW2_OPT_L2_READAHEAD,
+    QCOW2_OPT_CLUSTER_RESERVATION,
     NULL
 };
 
@@ -713,6 +726,12 @@ static QemuOptsList qcow2_runtime_opts = {
             .type = QEMU_OPT_BOOL,
             .help = "Postpone refcount updates",
         },
+        {
+            .name = QCOW2_OPT_LAZY_REFCOUNTS_COMMIT_INTERVAL,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Write postponed refcount updates on flush after this "
+                    "time (in seconds)",
+        },
         {
             .name = QCOW2_OPT_DISCARD_REQUEST,
             .type = QEMU_OPT_BOOL,
@@ -817,6 +836,18 @@ static QemuOptsList qcow2_runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "Clean unused cache entries after this time (in seconds)",
         },
+        {
+            .name = QCOW2_OPT_L2_READAHEAD,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Number of L2 cache entries to prefetch ahead of "
+                    "sequential reads",
+        },
+        {
+            .name = QCOW2_OPT_CLUSTER_RESERVATION,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Number of host clusters to reserve at once for the "
+                    "allocating writes of each I/O thread",
+        },
         BLOCK_CRYPTO_OPT_DEF_KEY_SECRET("encrypt.",
             "ID of secret providing qcow2 AES key or LUKS passphrase"),
         { /* end of list */ }
@@ -1047,10 +1078,13 @@ typedef struct Qcow2ReopenState {
     Qcow2Cache *refcount_block_cache;
     int l2_slice_size; /* Number of entries in a slice of the L2 table */
     bool use_lazy_refcounts;
+    uint64_t lazy_refcounts_commit_interval;
     int overlap_check;
     bool discard_passthrough[QCOW2_DISCARD_MAX];
     bool discard_no_unref;
     uint64_t cache_clean_interval;
+    uint64_t l2_readahead;
+    uint64_t cluster_reservation;
     QCryptoBlockOpenOptions *crypto_opts; /* Disk encryption runtime options */
 } Qcow2ReopenState;
 
@@ -1104,6 +1138,9 @@ qcow2_update_options_prepare(BlockDriverState *bs, Qcow2ReopenState *r,
         goto fail;
     }
 
+    /* Reserved clusters are freed through the old refcount block cache */
+    qcow2_release_cluster_reservations(bs);
+
     /* alloc new L2 table/refcount block cache, flush old one */
     if (s->l2_table_cache) {
         ret = qcow2_cache_flush(bs, s->l2_table_cache);
@@ -1151,6 +1188,27 @@ qcow2_update_options_prepare(BlockDriverState *bs, Qcow2ReopenState *r,
         goto fail;
     }
 
+    /*
+     * Prefetched slices must not push each other (and the slice that is
+     * being read) out of the cache
+     */
+    r->l2_readahead = qemu_opt_get_number(opts, QCOW2_OPT_L2_READAHEAD, 0);
+    if (r->l2_readahead > l2_cache_size / 2) {
+        error_setg(errp, QCOW2_OPT_L2_READAHEAD " must not exceed half the "
+                   "number of L2 cache entries (%" PRIu64 ")",
+                   l2_cache_size / 2);
+        ret = -EINVAL;
+        goto fail;
+    }
+
+    r->cluster_reservation =
+        qemu_opt_get_number(opts, QCOW2_OPT_CLUSTER_RESERVATION, 0);
+    if (r->cluster_reservation > QCOW_MAX_CLUSTER_OFFSET >> s->cluster_bits) {
+        error_setg(errp, "Cluster reservation too big");
+        ret = -EINVAL;
+        goto fail;
+    }
+
     /* lazy-refcounts; flush if going from enabled to disabled */
     r->use_lazy_refcounts = qemu_opt_get_bool(opts, QCOW2_OPT_LAZY_REFCOUNTS,
         (s->compatible_features & QCOW2_COMPAT_LAZY_REFCOUNTS));
@@ -1161,6 +1219,14 @@ qcow2_update_options_prepare(BlockDriverState *bs, Qcow2ReopenState *r,
         goto fail;
     }
 
+    r->lazy_refcounts_commit_interval =
+        qemu_opt_get_number(opts, QCOW2_OPT_LAZY_REFCOUNTS_COMMIT_INTERVAL, 0);
+    if (r->lazy_refcounts_commit_interval > UINT_MAX) {
+        error_setg(errp, "Lazy refcounts commit interval too big");
+        ret = -EINVAL;
+        goto fail;
+    }
+
     if (s->use_lazy_refcounts && !r->use_lazy_refcounts) {
         ret = qcow2_mark_clean(bs);
         if (ret < 0) {
@@ -1317,6 +1383,7 @@ static void qcow2_update_options_commit(BlockDriverState *bs,
 
     s->overlap_check = r->overlap_check;
     s->use_lazy_refcounts = r->use_lazy_refcounts;
+    s->lazy_refcounts_commit_interval = r->lazy_refcounts_commit_interval;
 
     for (i = 0; i < QCOW2_DISCARD_MAX; i++) {
         s->discard_passthrough[i] = r->discard_passthrough[i];
@@ -1327,6 +1394,12 @@ static void qcow2_update_options_commit(BlockDriverState *bs,
     s->cache_clean_interval = r->cache_clean_interval;
     cache_clean_timer_init(bs, bdrv_get_aio_context(bs));
 
+    s->l2_readahead = r->l2_readahead;
+    s->l2_readahead_next = 0;
+    s->l2_readahead_end = 0;
+
+    s->cluster_reservation = r->cluster_reservation;
+
     qapi_free_QCryptoBlockOpenOptions(s->crypto_opts);
     s->crypto_opts = r->crypto_opts;
 }
@@ -2363,12 +2436,13 @@ typedef struct Qcow2AioTask {
 
     BlockDriverState *bs;
     QCow2SubclusterType subcluster_type; /* only for read */
-    uint64_t host_offset; /* or l2_entry for compressed read */
+    uint64_t host_offset;
     uint64_t offset;
     uint64_t bytes;
     QEMUIOVector *qiov;
     uint64_t qiov_offset;
     QCowL2Meta *l2meta; /* only for write */
+    uint64_t *l2_entries; /* only for compressed read, one per cluster */
 } Qcow2AioTask;
 
 static coroutine_fn int qcow2_co_preadv_task_entry(AioTask *task);
@@ -2412,6 +2486,102 @@ static coroutine_fn int qcow2_add_task(BlockDriverState *bs,
     return 0;
 }
 
+/*
+ * Like qcow2_add_task() for a read of compressed clusters.  The task takes
+ * ownership of @l2_entries, which holds the L2 entries of the clusters
+ * covering @offset and @bytes.
+ */
+static coroutine_fn int qcow2_add_compressed_read_task(BlockDriverState *bs,
+                                                       AioTaskPool *pool,
+                                                       uint64_t *l2_entries,
+                                                       uint64_t offset,
+                                                       uint64_t bytes,
+                                                       QEMUIOVector *qiov,
+                                                       size_t qiov_offset)
+{
+    Qcow2AioTask local_task;
+    Qcow2AioTask *task = pool ? g_new(Qcow2AioTask, 1) : &local_task;
+
+    *task = (Qcow2AioTask) {
+        .task.func = qcow2_co_preadv_task_entry,
+        .bs = bs,
+        .subcluster_type = QCOW2_SUBCLUSTER_COMPRESSED,
+        .qiov = qiov,
+        .offset = offset,
+        .bytes = bytes,
+        .qiov_offset = qiov_offset,
+        .l2_entries = l2_entries,
+    };
+
+    trace_qcow2_add_task(qemu_coroutine_self(), bs, pool, "read",
+                         QCOW2_SUBCLUSTER_COMPRESSED, l2_entries[0], offset,
+                         bytes, qiov, qiov_offset);
+
+    if (!pool) {
+        return qcow2_co_preadv_task_entry(&task->task);
+    }
+
+    aio_task_pool_start_task(pool, &task->task);
+
+    return 0;
+}
+
+/*
+ * Extend the read of the compressed cluster at @offset, whose L2 entry is
+ * @l2_entry and of which *@cur_bytes are requested, with the following
+ * clusters of the request that are compressed too and stored right after it
+ * in the image file, so that their compressed data can be read at once.
+ *
+ * Returns the L2 entries of the clusters and updates *@cur_bytes to the
+ * number of bytes that they cover.  Must be called with s->lock held.
+ */
+static uint64_t * GRAPH_RDLOCK
+qcow2_get_compressed_batch(BlockDriverState *bs, uint64_t offset,
+                           uint64_t bytes, uint64_t l2_entry,
+                           unsigned int *cur_bytes)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t *l2_entries = g_new(uint64_t, QCOW2_MAX_COMPRESSED_BATCH);
+    uint64_t coffset, end;
+    int csize, n = 1;
+
+    l2_entries[0] = l2_entry;
+    qcow2_parse_compressed_l2_entry(bs, l2_entry, &coffset, &csize);
+    end = coffset + csize;
+
+    while (n < QCOW2_MAX_COMPRESSED_BATCH && *cur_bytes < bytes) {
+        unsigned int next_bytes = MIN(bytes - *cur_bytes, s->cluster_size);
+        uint64_t next_coffset, next_l2_entry;
+        QCow2SubclusterType type;
+        int next_csize;
+
+        /* Errors are left for the next round of qcow2_co_preadv_part() */
+        if (qcow2_get_host_offset(bs, offset + *cur_bytes, &next_bytes,
+                                  &next_l2_entry, &type) < 0 ||
+            type != QCOW2_SUBCLUSTER_COMPRESSED) {
+            break;
+        }
+
+        /*
+         * The size in the L2 entry is rounded up to whole sectors, so the
+         * data of the next cluster may start before @end.
+         */
+        qcow2_parse_compressed_l2_entry(bs, next_l2_entry, &next_coffset,
+                                        &next_csize);
+        if (next_coffset < coffset ||
+            next_coffset > QEMU_ALIGN_UP(end, QCOW2_COMPRESSED_SECTOR_SIZE)) {
+            break;
+        }
+
+        coffset = next_coffset;
+        end = MAX(end, next_coffset + next_csize);
+        l2_entries[n++] = next_l2_entry;
+        *cur_bytes += next_bytes;
+    }
+
+    return l2_entries;
+}
+
 static int coroutine_fn GRAPH_RDLOCK
 qcow2_co_preadv_task(BlockDriverState *bs, QCow2SubclusterType subc_type,
                      uint64_t host_offset, uint64_t offset, uint64_t bytes,
@@ -2434,8 +2604,8 @@ qcow2_co_preadv_task(BlockDriverState *bs, QCow2SubclusterType subc_type,
                                    qiov, qiov_offset, 0);
 
     case QCOW2_SUBCLUSTER_COMPRESSED:
-        return qcow2_co_preadv_compressed(bs, host_offset,
-                                          offset, bytes, qiov, qiov_offset);
+        /* Handled in qcow2_co_preadv_task_entry() */
+        g_assert_not_reached();
 
     case QCOW2_SUBCLUSTER_NORMAL:
         if (bs->encrypted) {
@@ -2461,9 +2631,17 @@ qcow2_co_preadv_task(BlockDriverState *bs, QCow2SubclusterType subc_type,
 static int coroutine_fn GRAPH_RDLOCK qcow2_co_preadv_task_entry(AioTask *task)
 {
     Qcow2AioTask *t = container_of(task, Qcow2AioTask, task);
+    int ret;
 
     assert(!t->l2meta);
 
+    if (t->subcluster_type == QCOW2_SUBCLUSTER_COMPRESSED) {
+        ret = qcow2_co_preadv_compressed(t->bs, t->l2_entries, t->offset,
+                                         t->bytes, t->qiov, t->qiov_offset);
+        g_free(t->l2_entries);
+        return ret;
+    }
+
     return qcow2_co_preadv_task(t->bs, t->subcluster_type,
                                 t->host_offset, t->offset, t->bytes,
                                 t->qiov, t->qiov_offset);
@@ -2478,9 +2656,14 @@ qcow2_co_preadv_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
     int ret = 0;
     unsigned int cur_bytes; /* number of bytes in current iteration */
     uint64_t host_offset = 0;
+    uint64_t *l2_entries = NULL;
     QCow2SubclusterType type;
     AioTaskPool *aio = NULL;
 
+    if (s->l2_readahead) {
+        qcow2_co_l2_readahead(bs, offset, bytes);
+    }
+
     while (bytes != 0 && aio_task_pool_status(aio) == 0) {
         /* prepare next request */
         cur_bytes = MIN(bytes, INT_MAX);
@@ -2492,12 +2675,25 @@ qcow2_co_preadv_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
         qemu_co_mutex_lock(&s->lock);
         ret = qcow2_get_host_offset(bs, offset, &cur_bytes,
                                     &host_offset, &type);
+        if (ret == 0 && type == QCOW2_SUBCLUSTER_COMPRESSED) {
+            l2_entries = qcow2_get_compressed_batch(bs, offset, bytes,
+                                                    host_offset, &cur_bytes);
+        }
         qemu_co_mutex_unlock(&s->lock);
         if (ret < 0) {
             goto out;
         }
 
-        if (type == QCOW2_SUBCLUSTER_ZERO_PLAIN ||
+        if (type == QCOW2_SUBCLUSTER_COMPRESSED) {
+            if (!aio && cur_bytes != bytes) {
+                aio = aio_task_pool_new(QCOW2_MAX_WORKERS);
+            }
+            ret = qcow2_add_compressed_read_task(bs, aio, l2_entries, offset,
+                                                 cur_bytes, qiov, qiov_offset);
+            if (ret < 0) {
+                goto out;
+            }
+        } else if (type == QCOW2_SUBCLUSTER_ZERO_PLAIN ||
             type == QCOW2_SUBCLUSTER_ZERO_ALLOC ||
             (type == QCOW2_SUBCLUSTER_UNALLOCATED_PLAIN && !bs->backing) ||
             (type == QCOW2_SUBCLUSTER_UNALLOCATED_ALLOC && !bs->backing))
@@ -2848,6 +3044,8 @@ static int GRAPH_RDLOCK qcow2_inactivate(BlockDriverState *bs)
     int ret, result = 0;
     Error *local_err = NULL;
 
+    qcow2_release_cluster_reservations(bs);
+
     qcow2_store_persistent_dirty_bitmaps(bs, true, &local_err);
     if (local_err != NULL) {
         result = -EINVAL;
@@ -4438,6 +4636,9 @@ qcow2_co_truncate(BlockDriverState *bs, int64_t offset, bool exact,
             goto fail;
         }
 
+        /* Don't keep reserved clusters at the end of the image file */
+        qcow2_release_cluster_reservations(bs);
+
         ret = qcow2_cluster_discard(bs, ROUND_UP(offset, s->cluster_size),
                                     old_length - ROUND_UP(offset,
                                                           s->cluster_size),
@@ -4907,44 +5108,121 @@ qcow2_co_pwritev_compressed_part(BlockDriverState *bs,
     return ret;
 }
 
+typedef struct Qcow2DecompressTask {
+    AioTask task;
+
+    BlockDriverState *bs;
+    const uint8_t *src;
+    int csize;
+    int offset_in_cluster;
+    uint64_t bytes;
+    QEMUIOVector *qiov;
+    size_t qiov_offset;
+} Qcow2DecompressTask;
+
+static int coroutine_fn qcow2_co_decompress_task_entry(AioTask *task)
+{
+    Qcow2DecompressTask *t = container_of(task, Qcow2DecompressTask, task);
+    BDRVQcow2State *s = t->bs->opaque;
+    uint8_t *out_buf = qemu_blockalign(t->bs, s->cluster_size);
+    int ret = 0;
+
+    if (qcow2_co_decompress(t->bs, out_buf, s->cluster_size,
+                            t->src, t->csize) < 0) {
+        ret = -EIO;
+    } else {
+        qemu_iovec_from_buf(t->qiov, t->qiov_offset,
+                            out_buf + t->offset_in_cluster, t->bytes);
+    }
+
+    qemu_vfree(out_buf);
+    return ret;
+}
+
+/*
+ * Read the compressed clusters whose L2 entries are in @l2_entries, one for
+ * each cluster touched by @offset and @bytes.  Their compressed data must be
+ * stored in ascending order without gaps, as checked by
+ * qcow2_get_compressed_batch(), so that it can be fetched with a single read;
+ * the clusters are then decompressed in parallel.
+ */
 static int coroutine_fn GRAPH_RDLOCK
 qcow2_co_preadv_compressed(BlockDriverState *bs,
-                           uint64_t l2_entry,
+                           const uint64_t *l2_entries,
                            uint64_t offset,
                            uint64_t bytes,
                            QEMUIOVector *qiov,
                            size_t qiov_offset)
 {
     BDRVQcow2State *s = bs->opaque;
-    int ret = 0, csize;
-    uint64_t coffset;
-    uint8_t *buf, *out_buf;
     int offset_in_cluster = offset_into_cluster(s, offset);
+    int nb_clusters = size_to_clusters(s, offset_in_cluster + bytes);
+    uint64_t coffset[QCOW2_MAX_COMPRESSED_BATCH];
+    int csize[QCOW2_MAX_COMPRESSED_BATCH];
+    uint64_t start, end = 0;
+    AioTaskPool *aio = NULL;
+    uint8_t *buf;
+    int ret = 0, i;
 
-    qcow2_parse_compressed_l2_entry(bs, l2_entry, &coffset, &csize);
+    assert(nb_clusters <= QCOW2_MAX_COMPRESSED_BATCH);
+
+    for (i = 0; i < nb_clusters; i++) {
+        qcow2_parse_compressed_l2_entry(bs, l2_entries[i], &coffset[i],
+                                        &csize[i]);
+        end = MAX(end, coffset[i] + csize[i]);
+    }
+    start = coffset[0];
 
-    buf = g_try_malloc(csize);
+    buf = g_try_malloc(end - start);
     if (!buf) {
         return -ENOMEM;
     }
 
-    out_buf = qemu_blockalign(bs, s->cluster_size);
-
     BLKDBG_CO_EVENT(bs->file, BLKDBG_READ_COMPRESSED);
-    ret = bdrv_co_pread(bs->file, coffset, csize, buf, 0);
+    ret = bdrv_co_pread(bs->file, start, end - start, buf, 0);
     if (ret < 0) {
         goto fail;
     }
 
-    if (qcow2_co_decompress(bs, out_buf, s->cluster_size, buf, csize) < 0) {
-        ret = -EIO;
-        goto fail;
+    if (nb_clusters > 1) {
+        aio = aio_task_pool_new(QCOW2_MAX_THREADS);
     }
 
-    qemu_iovec_from_buf(qiov, qiov_offset, out_buf + offset_in_cluster, bytes);
+    for (i = 0; i < nb_clusters && aio_task_pool_status(aio) == 0; i++) {
+        Qcow2DecompressTask local_task;
+        Qcow2DecompressTask *task = aio ? g_new(Qcow2DecompressTask, 1) :
+                                          &local_task;
+        uint64_t cur_bytes = MIN(bytes, s->cluster_size - offset_in_cluster);
+
+        *task = (Qcow2DecompressTask) {
+            .task.func = qcow2_co_decompress_task_entry,
+            .bs = bs,
+            .src = buf + (coffset[i] - start),
+            .csize = csize[i],
+            .offset_in_cluster = offset_in_cluster,
+            .bytes = cur_bytes,
+            .qiov = qiov,
+            .qiov_offset = qiov_offset,
+        };
+
+        if (aio) {
+            aio_task_pool_start_task(aio, &task->task);
+        } else {
+            ret = qcow2_co_decompress_task_entry(&task->task);
+        }
+
+        bytes -= cur_bytes;
+        qiov_offset += cur_bytes;
+        offset_in_cluster = 0;
+    }
+
+    if (aio) {
+        aio_task_pool_wait_all(aio);
+        ret = aio_task_pool_status(aio);
+        g_free(aio);
+    }
 
 fail:
-    qemu_vfree(out_buf);
     g_free(buf);
 
     return ret;
@@ -4964,6 +5242,12 @@ static int GRAPH_RDLOCK make_completely_empty(BlockDriverState *bs)
         uint32_t reftable_clusters;
     } QEMU_PACKED l1_ofs_rt_ofs_cls;
 
+    /*
+     * Reserved clusters lie in the area that is about to be truncated, and
+     * their refcounts are going away with everything else
+     */
+    qcow2_release_cluster_reservations(bs);
+
     ret = qcow2_cache_empty(bs, s->l2_table_cache);
     if (ret < 0) {
         goto fail;
@@ -5145,13 +5429,34 @@ static int GRAPH_RDLOCK qcow2_make_empty(BlockDriverState *bs)
     return ret;
 }
 
+static bool qcow2_lazy_refcounts_commit_due(BDRVQcow2State *s)
+{
+    int64_t interval_ns = s->lazy_refcounts_commit_interval *
+                          NANOSECONDS_PER_SECOND;
+
+    return s->use_lazy_refcounts && s->lazy_refcounts_commit_interval &&
+           (s->incompatible_features & QCOW2_INCOMPAT_DIRTY) &&
+           qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - s->dirty_time >=
+           interval_ns;
+}
+
 static coroutine_fn GRAPH_RDLOCK int qcow2_co_flush_to_os(BlockDriverState *bs)
 {
     BDRVQcow2State *s = bs->opaque;
     int ret;
 
     qemu_co_mutex_lock(&s->lock);
-    ret = qcow2_write_caches(bs);
+    if (qcow2_lazy_refcounts_commit_due(s)) {
+        /*
+         * Write back the refcount updates that lazy refcounts have batched
+         * up in the refcount cache, and clear the dirty bit so that a crash
+         * does not require a repair.  Requests may be in flight, which
+         * qcow2_mark_clean() allows because we hold s->lock.
+         */
+        ret = qcow2_mark_clean(bs);
+    } else {
+        ret = qcow2_write_caches(bs);
+    }
     qemu_co_mutex_unlock(&s->lock);
 
     return ret;
@@ -72,6 +72,9 @@
 /* Maximum of parallel sub-request per guest request */
 #define QCOW2_MAX_WORKERS 8
 
+/* Maximum number of compressed clusters read by a single sub-request */
+#define QCOW2_MAX_COMPRESSED_BATCH 16
+
 /* indicate that the refcount of the referenced cluster is exactly one. */
 #define QCOW_OFLAG_COPIED     (1ULL << 63)
 /* indicate that the cluster is compressed (they never have the copied flag) */
@@ -131,6 +134,8 @@
 
 #define QCOW2_OPT_DATA_FILE "data-file"
 #define QCOW2_OPT_LAZY_REFCOUNTS "lazy-refcounts"
+#define QCOW2_OPT_LAZY_REFCOUNTS_COMMIT_INTERVAL \
+    "lazy-refcounts-commit-interval"
 #define QCOW2_OPT_DISCARD_REQUEST "pass-discard-request"
 #define QCOW2_OPT_DISCARD_SNAPSHOT "pass-discard-snapshot"
 #define QCOW2_OPT_DISCARD_OTHER "pass-discard-other"
@@ -151,6 +156,8 @@
 #define QCOW2_OPT_L2_CACHE_ENTRY_SIZE "l2-cache-entry-size"
 #define QCOW2_OPT_REFCOUNT_CACHE_SIZE "refcount-cache-size"
 #define QCOW2_OPT_CACHE_CLEAN_INTERVAL "cache-clean-interval"
+#define QCOW2_OPT_L2_READAHEAD "l2-readahead"
+#define QCOW2_OPT_CLUSTER_RESERVATION "cluster-reservation"
 
 typedef struct QCowHeader {
     uint32_t magic;
@@ -325,6 +332,24 @@ typedef struct Qcow2BitmapHeaderExt {
 
 #define QCOW2_MAX_THREADS 4
 
+/*
+ * Number of AioContexts that can hold a host cluster reservation at the same
+ * time
+ */
+#define QCOW2_MAX_CLUSTER_RESERVATIONS 8
+
+/*
+ * A run of host clusters that has been allocated (refcount 1) but is not
+ * referenced yet. Allocating writes from @ctx take their data clusters from
+ * the start of the run, so that they are laid out contiguously in the image
+ * file even if writes from other AioContexts allocate clusters in between.
+ */
+typedef struct Qcow2ClusterReservation {
+    AioContext *ctx;
+    uint64_t offset;
+    uint64_t nb_clusters;
+} Qcow2ClusterReservation;
+
 typedef struct BDRVQcow2State {
     int cluster_bits;
     int cluster_size;
@@ -352,6 +377,19 @@ typedef struct BDRVQcow2State {
     QemuCoSleep cache_clean_timer_wake;
     CoQueue cache_clean_timer_exit;
 
+    /* Number of L2 slices to prefetch ahead of sequential reads, or 0 */
+    unsigned l2_readahead;
+    /* Guest offset at which the next read would be sequential */
+    uint64_t l2_readahead_next;
+    /* End of the guest range whose L2 slices have been prefetched */
+    uint64_t l2_readahead_end;
+
+    /* Number of clusters to reserve at once for allocating writes, or 0 */
+    uint64_t cluster_reservation;
+    Qcow2ClusterReservation reservations[QCOW2_MAX_CLUSTER_RESERVATIONS];
+    /* Reservation to evict next if all of them are in use */
+    unsigned reservation_victim;
+
     QLIST_HEAD(, QCowL2Meta) cluster_allocs;
 
     uint64_t *refcount_table;
@@ -381,6 +419,14 @@ typedef struct BDRVQcow2State {
     int flags;
     int qcow_version;
     bool use_lazy_refcounts;
+    /*
+     * With lazy refcounts, a flush writes back the refcount cache and marks
+     * the image clean once it has been dirty for this long (seconds), or
+     * never if 0
+     */
+    unsigned lazy_refcounts_commit_interval;
+    /* QEMU_CLOCK_REALTIME time (ns) when the image was last marked dirty */
+    int64_t dirty_time;
     int refcount_order;
     int refcount_bits;
     uint64_t refcount_max;
@@ -939,6 +985,9 @@ int GRAPH_RDLOCK
 qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
                       unsigned int *bytes, uint64_t *host_offset,
                       QCow2SubclusterType *subcluster_type);
+void coroutine_fn GRAPH_RDLOCK
+qcow2_co_l2_readahead(BlockDriverState *bs, uint64_t offset, uint64_t bytes);
+void GRAPH_RDLOCK qcow2_release_cluster_reservations(BlockDriverState *bs);
 
 int coroutine_fn GRAPH_RDLOCK
 qcow2_alloc_host_offset(BlockDriverState *bs, uint64_t offset,
@@ -17,6 +17,7 @@
 #include "qemu/log.h"
 #include "qemu/main-loop.h"
 #include "qemu/module.h"
+#include "qemu/aio-wait.h"
 #include "hw/virtio/virtio.h"
 #include "net/net.h"
 #include "net/checksum.h"
@@ -31,6 +32,7 @@
 #include "net/vhost_net.h"
 #include "net/announce.h"
 #include "hw/virtio/virtio-bus.h"
+#include "hw/virtio/iothread-vq-mapping.h"
 #include "qapi/error.h"
 #include "qapi/qapi-events-net.h"
 #include "hw/core/qdev-properties.h"
@@ -143,6 +145,92 @@ static int vq2q(int queue_index)
     return queue_index / 2;
 }
 
+/* Returns NULL if queue pair @index is processed in the main loop */
+static AioContext *virtio_net_queue_aio_context(VirtIONet *n, int index)
+{
+    return n->vq_aio_context ? n->vq_aio_context[index] : NULL;
+}
+
+/*
+ * Once ioeventfd has started, a queue pair that is mapped to an IOThread and
+ * its backend may only be touched from that IOThread.  Run @cb there, or
+ * directly if the queue pair is processed in the main loop.
+ *
+ * Context: BQL held
+ */
+static void virtio_net_queue_run(VirtIONet *n, int index,
+                                 QEMUBHFunc *cb, void *opaque)
+{
+    AioContext *ctx = virtio_net_queue_aio_context(n, index);
+
+    if (ctx && n->ioeventfd_started) {
+        aio_wait_bh_oneshot(ctx, cb, opaque);
+    } else {
+        cb(opaque);
+    }
+}
+
+static void virtio_net_flush_queued_packets_bh(void *opaque)
+{
+    qemu_flush_queued_packets(opaque);
+}
+
+/*
+ * Returns the AioContext that currently processes queue pair @index.  Only
+ * stable when called from that AioContext.
+ */
+static AioContext *virtio_net_queue_owner(VirtIONet *n, int index)
+{
+    AioContext *ctx = qatomic_read(&n->vqs[index].ctx);
+
+    return ctx ? ctx : qemu_get_aio_context();
+}
+
+/*
+ * Publish the current receive filters and RSS configuration to the receive
+ * path, see VirtIONetRxFilter.  Called after anything that changes them.
+ *
+ * Context: BQL held
+ */
+static void virtio_net_update_rx_filter(VirtIONet *n)
+{
+    VirtIONetRxFilter *f = g_new0(VirtIONetRxFilter, 1);
+    VirtIONetRxFilter *old = n->rx_filter;
+    uint16_t len = n->rss_data.indirections_len;
+
+    memcpy(f->mac, n->mac, ETH_ALEN);
+    f->promisc = n->promisc;
+    f->allmulti = n->allmulti;
+    f->alluni = n->alluni;
+    f->nomulti = n->nomulti;
+    f->nouni = n->nouni;
+    f->nobcast = n->nobcast;
+    f->mac_table_in_use = n->mac_table.in_use;
+    f->mac_table_first_multi = n->mac_table.first_multi;
+    f->mac_table_multi_overflow = n->mac_table.multi_overflow;
+    f->mac_table_uni_overflow = n->mac_table.uni_overflow;
+    memcpy(f->mac_table_macs, n->mac_table.macs, sizeof(f->mac_table_macs));
+    memcpy(f->vlans, n->vlans, sizeof(f->vlans));
+    f->curr_queue_pairs = n->curr_queue_pairs;
+
+    f->rss = n->rss_data;
+    /* The receive path masks the hash with indirections_len - 1 */
+    if (!n->rss_data.indirections_table || !is_power_of_2(len) ||
+        len > VIRTIO_NET_RSS_MAX_TABLE_LEN) {
+        len = 1;
+    } else {
+        memcpy(f->indirections_table, n->rss_data.indirections_table,
+               len * sizeof(uint16_t));
+    }
+    f->rss.indirections_len = len;
+    f->rss.indirections_table = f->indirections_table;
+
+    qatomic_rcu_set(&n->rx_filter, f);
+    if (old) {
+        g_free_rcu(old, rcu);
+    }
+}
+
 static void flush_or_purge_queued_packets(NetClientState *nc)
 {
     if (!nc->peer) {
@@ -221,6 +309,7 @@ static void virtio_net_set_config(VirtIODevice *vdev, const uint8_t *config)
         memcmp(netcfg.mac, n->mac, ETH_ALEN)) {
         memcpy(n->mac, netcfg.mac, ETH_ALEN);
         qemu_format_nic_info_str(qemu_get_queue(n->nic), n->mac);
+        virtio_net_update_rx_filter(n);
     }
 
     /*
@@ -425,7 +514,7 @@ static int virtio_net_set_status(struct VirtIODevice *vdev, uint8_t status)
             virtio_net_started(n, queue_status) && !n->vhost_started;
 
         if (queue_started) {
-            qemu_flush_queued_packets(ncs);
+            virtio_net_queue_run(n, i, virtio_net_flush_queued_packets_bh, ncs);
         }
 
         if (!q->tx_waiting) {
@@ -570,6 +659,11 @@ static RxFilterInfo *virtio_net_query_rxfilter(NetClientState *nc)
     return info;
 }
 
+static void virtio_net_flush_or_purge_queued_packets_bh(void *opaque)
+{
+    flush_or_purge_queued_packets(opaque);
+}
+
 static void virtio_net_queue_reset(VirtIODevice *vdev, uint32_t queue_index)
 {
     VirtIONet *n = VIRTIO_NET(vdev);
@@ -591,7 +685,8 @@ static void virtio_net_queue_reset(VirtIODevice *vdev, uint32_t queue_index)
         vhost_net_virtqueue_reset(vdev, nc, queue_index);
     }
 
-    flush_or_purge_queued_packets(nc);
+    virtio_net_queue_run(n, vq2q(queue_index),
+                         virtio_net_flush_or_purge_queued_packets_bh, nc);
 }
 
 static void virtio_net_queue_enable(VirtIODevice *vdev, uint32_t queue_index)
@@ -765,22 +860,39 @@ static int peer_detach(VirtIONet *n, int index)
     return tap_disable(nc->peer);
 }
 
+static void virtio_net_peer_attach_bh(void *opaque)
+{
+    NetClientState *nc = opaque;
+    int r;
+
+    r = peer_attach(qemu_get_nic_opaque(nc), nc->queue_index);
+    assert(!r);
+}
+
+static void virtio_net_peer_detach_bh(void *opaque)
+{
+    NetClientState *nc = opaque;
+    int r;
+
+    r = peer_detach(qemu_get_nic_opaque(nc), nc->queue_index);
+    assert(!r);
+}
+
 static void virtio_net_set_queue_pairs(VirtIONet *n)
 {
     int i;
-    int r;
 
     if (n->nic->peer_deleted) {
         return;
     }
 
     for (i = 0; i < n->max_queue_pairs; i++) {
+        NetClientState *nc = qemu_get_subqueue(n->nic, i);
+
         if (i < n->curr_queue_pairs) {
-            r = peer_attach(n, i);
-            assert(!r);
+            virtio_net_queue_run(n, i, virtio_net_peer_attach_bh, nc);
         } else {
-            r = peer_detach(n, i);
-            assert(!r);
+            virtio_net_queue_run(n, i, virtio_net_peer_detach_bh, nc);
         }
     }
 }
@@ -988,6 +1100,7 @@ static void virtio_net_set_features(VirtIODevice *vdev,
         bool vlan = virtio_has_feature_ex(features, VIRTIO_NET_F_CTRL_VLAN);
         memset(n->vlans, vlan ? 0 : 0xff, MAX_VLAN >> 3);
     }
+    virtio_net_update_rx_filter(n);
 
     if (virtio_has_feature_ex(features, VIRTIO_NET_F_STANDBY)) {
         qapi_event_send_failover_negotiated(n->netclient_name);
@@ -1583,6 +1696,7 @@ size_t virtio_net_handle_ctrl_iov(VirtIODevice *vdev,
     } else if (ctrl.class == VIRTIO_NET_CTRL_GUEST_OFFLOADS) {
         status = virtio_net_handle_offloads(n, ctrl.cmd, iov, out_num);
     }
+    virtio_net_update_rx_filter(n);
 
     s = iov_from_buf(in_sg, in_num, 0, &status, sizeof(status));
     assert(s == sizeof(status));
@@ -1735,49 +1849,52 @@ static void receive_header(VirtIONet *n, const struct iovec *iov, int iov_cnt,
     }
 }
 
-static int receive_filter(VirtIONet *n, const uint8_t *buf, int size)
+static int receive_filter(VirtIONet *n, const VirtIONetRxFilter *f,
+                          const uint8_t *buf, int size)
 {
     static const uint8_t bcast[] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
     static const uint8_t vlan[] = {0x81, 0x00};
     uint8_t *ptr = (uint8_t *)buf;
     int i;
 
-    if (n->promisc)
+    if (f->promisc) {
         return 1;
+    }
 
     ptr += n->host_hdr_len;
 
     if (!memcmp(&ptr[12], vlan, sizeof(vlan))) {
         int vid = lduw_be_p(ptr + 14) & 0xfff;
-        if (!(n->vlans[vid >> 5] & (1U << (vid & 0x1f))))
+        if (!(f->vlans[vid >> 5] & (1U << (vid & 0x1f)))) {
             return 0;
+        }
     }
 
     if (ptr[0] & 1) { // multicast
         if (!memcmp(ptr, bcast, sizeof(bcast))) {
-            return !n->nobcast;
-        } else if (n->nomulti) {
+            return !f->nobcast;
+        } else if (f->nomulti) {
             return 0;
-        } else if (n->allmulti || n->mac_table.multi_overflow) {
+        } else if (f->allmulti || f->mac_table_multi_overflow) {
             return 1;
         }
 
-        for (i = n->mac_table.first_multi; i < n->mac_table.in_use; i++) {
-            if (!memcmp(ptr, &n->mac_table.macs[i * ETH_ALEN], ETH_ALEN)) {
+        for (i = f->mac_table_first_multi; i < f->mac_table_in_use; i++) {
+            if (!memcmp(ptr, &f->mac_table_macs[i * ETH_ALEN], ETH_ALEN)) {
                 return 1;
             }
         }
     } else { // unicast
-        if (n->nouni) {
+        if (f->nouni) {
             return 0;
-        } else if (n->alluni || n->mac_table.uni_overflow) {
+        } else if (f->alluni || f->mac_table_uni_overflow) {
             return 1;
-        } else if (!memcmp(ptr, n->mac, ETH_ALEN)) {
+        } else if (!memcmp(ptr, f->mac, ETH_ALEN)) {
             return 1;
         }
 
-        for (i = 0; i < n->mac_table.first_multi; i++) {
-            if (!memcmp(ptr, &n->mac_table.macs[i * ETH_ALEN], ETH_ALEN)) {
+        for (i = 0; i < f->mac_table_first_multi; i++) {
+            if (!memcmp(ptr, &f->mac_table_macs[i * ETH_ALEN], ETH_ALEN)) {
                 return 1;
             }
         }
@@ -1846,13 +1963,14 @@ static uint8_t virtio_net_get_hash_type(bool hasip4,
     return 0xff;
 }
 
-static int virtio_net_process_rss(NetClientState *nc, const uint8_t *buf,
-                                  size_t size,
+static int virtio_net_process_rss(NetClientState *nc, VirtIONetRxFilter *f,
+                                  const uint8_t *buf, size_t size,
                                   struct virtio_net_hdr_v1_hash *hdr)
 {
     VirtIONet *n = qemu_get_nic_opaque(nc);
+    VirtioNetRssData *rss = &f->rss;
     unsigned int index = nc->queue_index, new_index = index;
-    struct NetRxPkt *pkt = n->rx_pkt;
+    struct NetRxPkt *pkt = virtio_net_get_subqueue(nc)->rx_pkt;
     uint8_t net_hash_type;
     uint32_t hash;
     bool hasip4, hasip6;
@@ -1876,34 +1994,37 @@ static int virtio_net_process_rss(NetClientState *nc, const uint8_t *buf,
     net_rx_pkt_set_protocols(pkt, &iov, 1, n->host_hdr_len);
     net_rx_pkt_get_protocols(pkt, &hasip4, &hasip6, &l4hdr_proto);
     net_hash_type = virtio_net_get_hash_type(hasip4, hasip6, l4hdr_proto,
-                                             n->rss_data.runtime_hash_types);
+                                             rss->runtime_hash_types);
     if (net_hash_type > NetPktRssIpV6UdpEx) {
-        if (n->rss_data.populate_hash) {
+        if (rss->populate_hash) {
             hdr->hash_value_lo = VIRTIO_NET_HASH_REPORT_NONE;
             hdr->hash_value_hi = VIRTIO_NET_HASH_REPORT_NONE;
             hdr->hash_report = 0;
         }
-        return n->rss_data.redirect ? n->rss_data.default_queue : -1;
+        return rss->redirect ? rss->default_queue : -1;
     }
 
-    hash = net_rx_pkt_calc_rss_hash(pkt, net_hash_type, n->rss_data.key);
+    hash = net_rx_pkt_calc_rss_hash(pkt, net_hash_type, rss->key);
 
-    if (n->rss_data.populate_hash) {
+    if (rss->populate_hash) {
         hdr->hash_value_lo = cpu_to_le16(hash & 0xffff);
         hdr->hash_value_hi = cpu_to_le16((hash >> 16) & 0xffff);
         hdr->hash_report = reports[net_hash_type];
     }
 
-    if (n->rss_data.redirect) {
-        new_index = hash & (n->rss_data.indirections_len - 1);
-        new_index = n->rss_data.indirections_table[new_index];
+    if (rss->redirect) {
+        new_index = hash & (rss->indirections_len - 1);
+        new_index = rss->indirections_table[new_index];
     }
 
     return (index == new_index) ? -1 : new_index;
 }
 
-static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
-                                      size_t size)
+/* Receive a packet on @nc after software RSS has been applied */
+static ssize_t
+virtio_net_receive_queue(NetClientState *nc, VirtIONetRxFilter *f,
+                         const uint8_t *buf, size_t size,
+                         struct virtio_net_hdr_v1_hash *extra_hdr)
 {
     VirtIONet *n = qemu_get_nic_opaque(nc);
     VirtIONetQueue *q;
@@ -1911,20 +2032,10 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
     QEMU_UNINITIALIZED VirtQueueElement *elems[VIRTQUEUE_MAX_SIZE];
     QEMU_UNINITIALIZED size_t lens[VIRTQUEUE_MAX_SIZE];
     QEMU_UNINITIALIZED struct iovec mhdr_sg[VIRTQUEUE_MAX_SIZE];
-    struct virtio_net_hdr_v1_hash extra_hdr;
     unsigned mhdr_cnt = 0;
     size_t offset, i, guest_offset, j;
     ssize_t err;
 
-    memset(&extra_hdr, 0, sizeof(extra_hdr));
-
-    if (n->rss_data.enabled && n->rss_data.enabled_software_rss) {
-        int index = virtio_net_process_rss(nc, buf, size, &extra_hdr);
-        if (index >= 0) {
-            nc = qemu_get_subqueue(n->nic, index % n->curr_queue_pairs);
-        }
-    }
-
     if (!virtio_net_can_receive(nc)) {
         return -1;
     }
@@ -1936,8 +2047,9 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
         return 0;
     }
 
-    if (!receive_filter(n, buf, size))
+    if (!receive_filter(n, f, buf, size)) {
         return size;
+    }
 
     offset = i = 0;
 
@@ -1984,20 +2096,21 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
             if (n->mergeable_rx_bufs) {
                 mhdr_cnt = iov_copy(mhdr_sg, ARRAY_SIZE(mhdr_sg),
                                     sg, elem->in_num,
-                                    offsetof(typeof(extra_hdr), hdr.num_buffers),
-                                    sizeof(extra_hdr.hdr.num_buffers));
+                                    offsetof(typeof(*extra_hdr),
+                                             hdr.num_buffers),
+                                    sizeof(extra_hdr->hdr.num_buffers));
             } else {
-                extra_hdr.hdr.num_buffers = cpu_to_le16(1);
+                extra_hdr->hdr.num_buffers = cpu_to_le16(1);
             }
 
             receive_header(n, sg, elem->in_num, buf, size);
-            if (n->rss_data.populate_hash) {
-                offset = offsetof(typeof(extra_hdr), hash_value_lo);
+            if (f->rss.populate_hash) {
+                offset = offsetof(typeof(*extra_hdr), hash_value_lo);
                 iov_from_buf(sg, elem->in_num, offset,
-                             (char *)&extra_hdr + offset,
-                             sizeof(extra_hdr.hash_value_lo) +
-                             sizeof(extra_hdr.hash_value_hi) +
-                             sizeof(extra_hdr.hash_report));
+                             (char *)extra_hdr + offset,
+                             sizeof(extra_hdr->hash_value_lo) +
+                             sizeof(extra_hdr->hash_value_hi) +
+                             sizeof(extra_hdr->hash_report));
             }
             offset = n->host_hdr_len;
             total += n->guest_hdr_len;
@@ -2027,11 +2140,11 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
     }
 
     if (mhdr_cnt) {
-        virtio_stw_p(vdev, &extra_hdr.hdr.num_buffers, i);
+        virtio_stw_p(vdev, &extra_hdr->hdr.num_buffers, i);
         iov_from_buf(mhdr_sg, mhdr_cnt,
                      0,
-                     &extra_hdr.hdr.num_buffers,
-                     sizeof extra_hdr.hdr.num_buffers);
+                     &extra_hdr->hdr.num_buffers,
+                     sizeof extra_hdr->hdr.num_buffers);
     }
 
     for (j = 0; j < i; j++) {
@@ -2054,6 +2167,97 @@ err:
     return err;
 }
 
+/* Packets handed over to another thread that have not been delivered yet */
+#define VIRTIO_NET_RX_FORWARD_MAX 1024
+
+typedef struct VirtIONetRxForward {
+    VirtIONet *n;
+    int index;
+    struct virtio_net_hdr_v1_hash extra_hdr;
+    size_t size;
+    uint8_t buf[];
+} VirtIONetRxForward;
+
+/*
+ * Deliver a packet that software RSS steered to this queue pair from a queue
+ * pair in another thread.  If the queue pair cannot take it right away, it
+ * is dropped like a full receive queue would drop it.
+ *
+ * Context: BH in the AioContext that the packet was sent to
+ */
+static void virtio_net_rx_forward_bh(void *opaque)
+{
+    VirtIONetRxForward *fwd = opaque;
+    VirtIONet *n = fwd->n;
+
+    /* The queue pair may have moved to another thread in the meantime */
+    if (virtio_net_queue_owner(n, fwd->index) ==
+        qemu_get_current_aio_context()) {
+        RCU_READ_LOCK_GUARD();
+
+        virtio_net_receive_queue(qemu_get_subqueue(n->nic, fwd->index),
+                                 qatomic_rcu_read(&n->rx_filter),
+                                 fwd->buf, fwd->size, &fwd->extra_hdr);
+    }
+
+    g_free(fwd);
+    qatomic_dec(&n->rx_forward_pending);
+    aio_wait_kick();
+}
+
+/*
+ * Only the thread that processes a queue pair may touch its virtqueues, so
+ * packets that software RSS steers to a queue pair in another thread are
+ * copied and delivered there.
+ */
+static void virtio_net_rx_forward(VirtIONet *n, AioContext *ctx, int index,
+                                  const uint8_t *buf, size_t size,
+                                  struct virtio_net_hdr_v1_hash *extra_hdr)
+{
+    VirtIONetRxForward *fwd;
+
+    if (qatomic_read(&n->rx_forward_pending) >= VIRTIO_NET_RX_FORWARD_MAX) {
+        return;
+    }
+
+    fwd = g_malloc(sizeof(*fwd) + size);
+    fwd->n = n;
+    fwd->index = index;
+    fwd->extra_hdr = *extra_hdr;
+    fwd->size = size;
+    memcpy(fwd->buf, buf, size);
+
+    qatomic_inc(&n->rx_forward_pending);
+    aio_bh_schedule_oneshot(ctx, virtio_net_rx_forward_bh, fwd);
+}
+
+static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
+                                      size_t size)
+{
+    VirtIONet *n = qemu_get_nic_opaque(nc);
+    VirtIONetRxFilter *f = qatomic_rcu_read(&n->rx_filter);
+    struct virtio_net_hdr_v1_hash extra_hdr;
+
+    memset(&extra_hdr, 0, sizeof(extra_hdr));
+
+    if (f->rss.enabled && f->rss.enabled_software_rss) {
+        int index = virtio_net_process_rss(nc, f, buf, size, &extra_hdr);
+        if (index >= 0) {
+            AioContext *ctx;
+
+            index %= f->curr_queue_pairs;
+            ctx = virtio_net_queue_owner(n, index);
+            if (ctx != qemu_get_current_aio_context()) {
+                virtio_net_rx_forward(n, ctx, index, buf, size, &extra_hdr);
+                return size;
+            }
+            nc = qemu_get_subqueue(n->nic, index);
+        }
+    }
+
+    return virtio_net_receive_queue(nc, f, buf, size, &extra_hdr);
+}
+
 static ssize_t virtio_net_do_receive(NetClientState *nc, const uint8_t *buf,
                                   size_t size)
 {
@@ -2977,6 +3181,7 @@ static void virtio_net_tx_bh(void *opaque)
 static void virtio_net_add_queue(VirtIONet *n, int index)
 {
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    AioContext *ctx = virtio_net_queue_aio_context(n, index);
 
     n->vqs[index].rx_vq = virtio_add_queue(vdev, n->net_conf.rx_queue_size,
                                            virtio_net_handle_rx);
@@ -2985,15 +3190,29 @@ static void virtio_net_add_queue(VirtIONet *n, int index)
         n->vqs[index].tx_vq =
             virtio_add_queue(vdev, n->net_conf.tx_queue_size,
                              virtio_net_handle_tx_timer);
-        n->vqs[index].tx_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
-                                              virtio_net_tx_timer,
-                                              &n->vqs[index]);
+        if (ctx) {
+            n->vqs[index].tx_timer = aio_timer_new(ctx, QEMU_CLOCK_VIRTUAL,
+                                                   SCALE_NS,
+                                                   virtio_net_tx_timer,
+                                                   &n->vqs[index]);
+        } else {
+            n->vqs[index].tx_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                                  virtio_net_tx_timer,
+                                                  &n->vqs[index]);
+        }
     } else {
         n->vqs[index].tx_vq =
             virtio_add_queue(vdev, n->net_conf.tx_queue_size,
                              virtio_net_handle_tx_bh);
-        n->vqs[index].tx_bh = qemu_bh_new_guarded(virtio_net_tx_bh, &n->vqs[index],
-                                                  &DEVICE(vdev)->mem_reentrancy_guard);
+        if (ctx) {
+            n->vqs[index].tx_bh =
+                aio_bh_new_guarded(ctx, virtio_net_tx_bh, &n->vqs[index],
+                                   &DEVICE(vdev)->mem_reentrancy_guard);
+        } else {
+            n->vqs[index].tx_bh =
+                qemu_bh_new_guarded(virtio_net_tx_bh, &n->vqs[index],
+                                    &DEVICE(vdev)->mem_reentrancy_guard);
+        }
     }
 
     n->vqs[index].tx_waiting = 0;
@@ -3244,6 +3463,7 @@ static int virtio_net_post_load_device(void *opaque, int version_id)
     }
 
     virtio_net_commit_rss_config(n);
+    virtio_net_update_rx_filter(n);
     return 0;
 }
 
@@ -3642,7 +3862,17 @@ static bool virtio_net_guest_notifier_pending(VirtIODevice *vdev, int idx)
 {
     VirtIONet *n = VIRTIO_NET(vdev);
     NetClientState *nc;
-    assert(n->vhost_started);
+
+    if (!n->vhost_started) {
+        /* Queue pairs processed in IOThreads interrupt through irqfd */
+        assert(n->vq_aio_context);
+        if (idx == VIRTIO_CONFIG_IRQ_IDX) {
+            return event_notifier_test_and_clear(
+                virtio_config_get_guest_notifier(vdev));
+        }
+        return event_notifier_test_and_clear(
+            virtio_queue_get_guest_notifier(virtio_get_queue(vdev, idx)));
+    }
     if (!n->multiqueue && idx == 2) {
         /* Must guard against invalid features and bogus queue index
          * from being set by malicious guest, or penetrated through
@@ -3866,6 +4096,245 @@ static bool failover_hide_primary_device(DeviceListener *listener,
     return qatomic_read(&n->failover_primary_hidden);
 }
 
+/* Returns NULL for virtqueues that are processed in the main loop */
+static AioContext *virtio_net_vq_aio_context(VirtIONet *n, int vq_index,
+                                             int nvqs)
+{
+    /* The control virtqueue always comes last */
+    if (vq_index == nvqs - 1) {
+        return NULL;
+    }
+
+    return virtio_net_queue_aio_context(n, vq2q(vq_index));
+}
+
+/* Context: BQL held */
+static int virtio_net_start_ioeventfd(VirtIODevice *vdev)
+{
+    VirtIONet *n = VIRTIO_NET(vdev);
+    BusState *qbus = BUS(qdev_get_parent_bus(DEVICE(vdev)));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    int nvqs = virtio_get_num_queues(vdev);
+    int i, r;
+
+    if (n->vq_aio_context) {
+        /* IOThreads raise interrupts through irqfd */
+        r = k->set_guest_notifiers(qbus->parent, nvqs, true);
+        if (r != 0) {
+            error_report("virtio-net failed to set guest notifier (%d), "
+                         "ensure -accel kvm is set.", r);
+            return r;
+        }
+    }
+
+    /*
+     * Batch all the host notifiers in a single transaction to avoid
+     * quadratic time complexity in address_space_update_ioeventfds().
+     */
+    memory_region_transaction_begin();
+    for (i = 0; i < nvqs; i++) {
+        r = virtio_bus_set_host_notifier(VIRTIO_BUS(qbus), i, true);
+        if (r < 0) {
+            int j = i;
+
+            while (i--) {
+                virtio_bus_set_host_notifier(VIRTIO_BUS(qbus), i, false);
+            }
+
+            /*
+             * The transaction expects the ioeventfds to be open when it
+             * commits. Do it now, before the cleanup loop.
+             */
+            memory_region_transaction_commit();
+
+            while (j--) {
+                virtio_bus_cleanup_host_notifier(VIRTIO_BUS(qbus), j);
+            }
+            if (n->vq_aio_context) {
+                k->set_guest_notifiers(qbus->parent, nvqs, false);
+            }
+            return r;
+        }
+    }
+    memory_region_transaction_commit();
+
+    n->ioeventfd_started = true;
+    smp_wmb(); /* paired with aio_notify_accept() on the read side */
+
+    for (i = 0; i < nvqs; i++) {
+        VirtQueue *vq = virtio_get_queue(vdev, i);
+        EventNotifier *host_notifier = virtio_queue_get_host_notifier(vq);
+        AioContext *ctx = virtio_net_vq_aio_context(n, i, nvqs);
+
+        if (!ctx) {
+            event_notifier_set_handler(host_notifier,
+                                       virtio_queue_host_notifier_read);
+            /* Kick right away to begin processing requests already in vring */
+            event_notifier_set(host_notifier);
+        } else if (i % 2 == 0) {
+            /* Poll the backend from the same thread as its queue pair */
+            qemu_set_aio_context(qemu_get_subqueue(n->nic, vq2q(i))->peer,
+                                 ctx);
+            qatomic_set(&n->vqs[vq2q(i)].ctx, ctx);
+            virtio_queue_aio_attach_host_notifier_no_poll(vq, ctx);
+        } else {
+            virtio_queue_aio_attach_host_notifier(vq, ctx);
+        }
+    }
+    return 0;
+}
+
+/*
+ * Stop notifications for new packets from the guest and hand the backend
+ * back to the main loop.
+ *
+ * Context: BH in IOThread
+ */
+static void virtio_net_ioeventfd_stop_queue_bh(void *opaque)
+{
+    VirtIONetQueue *q = opaque;
+    VirtIONet *n = q->n;
+    AioContext *ctx = qemu_get_current_aio_context();
+
+    virtio_queue_aio_detach_host_notifier(q->rx_vq, ctx);
+    virtio_queue_aio_detach_host_notifier(q->tx_vq, ctx);
+
+    /*
+     * Test and clear notifiers after disabling events, in case poll callback
+     * didn't have time to run.
+     */
+    virtio_queue_host_notifier_read(virtio_queue_get_host_notifier(q->rx_vq));
+    virtio_queue_host_notifier_read(virtio_queue_get_host_notifier(q->tx_vq));
+
+    qemu_set_aio_context(qemu_get_subqueue(n->nic, q - n->vqs)->peer, NULL);
+    qatomic_set(&q->ctx, NULL);
+}
+
+/* Context: BQL held */
+static void virtio_net_stop_ioeventfd(VirtIODevice *vdev)
+{
+    VirtIONet *n = VIRTIO_NET(vdev);
+    BusState *qbus = qdev_get_parent_bus(DEVICE(vdev));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    int nvqs = virtio_get_num_queues(vdev);
+    int i;
+
+    for (i = 0; i < nvqs; i++) {
+        VirtQueue *vq = virtio_get_queue(vdev, i);
+        AioContext *ctx = virtio_net_vq_aio_context(n, i, nvqs);
+
+        if (!ctx) {
+            event_notifier_set_handler(virtio_queue_get_host_notifier(vq),
+                                       NULL);
+        } else if (i % 2 == 0) {
+            aio_wait_bh_oneshot(ctx, virtio_net_ioeventfd_stop_queue_bh,
+                                &n->vqs[vq2q(i)]);
+        }
+    }
+
+    /*
+     * Batch all the host notifiers in a single transaction to avoid
+     * quadratic time complexity in address_space_update_ioeventfds().
+     */
+    memory_region_transaction_begin();
+    for (i = 0; i < nvqs; i++) {
+        virtio_bus_set_host_notifier(VIRTIO_BUS(qbus), i, false);
+    }
+
+    /*
+     * The transaction expects the ioeventfds to be open when it
+     * commits. Do it now, before the cleanup loop.
+     */
+    memory_region_transaction_commit();
+
+    for (i = 0; i < nvqs; i++) {
+        virtio_bus_cleanup_host_notifier(VIRTIO_BUS(qbus), i);
+    }
+
+    n->ioeventfd_started = false;
+
+    if (n->vq_aio_context) {
+        k->set_guest_notifiers(qbus->parent, nvqs, false);
+    }
+}
+
+/* Context: BQL held */
+static bool virtio_net_vq_aio_context_init(VirtIONet *n, Error **errp)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    BusState *qbus = BUS(qdev_get_parent_bus(DEVICE(vdev)));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    int i;
+
+    if (!n->iothread_vq_mapping_list) {
+        return true;
+    }
+
+    if (!k->set_guest_notifiers || !k->ioeventfd_assign) {
+        error_setg(errp,
+                   "device is incompatible with iothread-vq-mapping "
+                   "(transport does not support notifiers)");
+        return false;
+    }
+    if (!virtio_device_ioeventfd_enabled(vdev)) {
+        error_setg(errp, "ioeventfd is required for iothread-vq-mapping");
+        return false;
+    }
+    if (virtio_has_feature(n->host_features, VIRTIO_NET_F_RSC_EXT)) {
+        error_setg(errp, "iothread-vq-mapping is incompatible with "
+                   "guest_rsc_ext");
+        return false;
+    }
+
+    /* Queue pairs and their backends must be able to move together */
+    for (i = 0; i < n->max_queue_pairs; i++) {
+        NetClientState *peer = n->nic_conf.peers.ncs[i];
+
+        if (!qemu_can_set_aio_context(peer)) {
+            error_setg(errp, "iothread-vq-mapping requires a netdev that can "
+                       "be polled from an IOThread, such as tap or "
+                       "socket");
+            return false;
+        }
+        if (get_vhost_net(peer)) {
+            error_setg(errp, "iothread-vq-mapping is only supported with the "
+                       "userspace datapath (vhost=off)");
+            return false;
+        }
+    }
+
+    /* vqs in the mapping are queue pair indices */
+    n->vq_aio_context = g_new(AioContext *, n->max_queue_pairs);
+    if (!iothread_vq_mapping_apply(n->iothread_vq_mapping_list,
+                                   n->vq_aio_context, n->max_queue_pairs,
+                                   errp)) {
+        g_free(n->vq_aio_context);
+        n->vq_aio_context = NULL;
+        return false;
+    }
+
+    /*
+     * Without vhost there is nothing to mask in the backend, let the
+     * transport mask the irqfds instead.
+     */
+    vdev->use_guest_notifier_mask = false;
+
+    return true;
+}
+
+/* Context: BQL held */
+static void virtio_net_vq_aio_context_cleanup(VirtIONet *n)
+{
+    assert(!n->ioeventfd_started);
+
+    if (n->iothread_vq_mapping_list) {
+        iothread_vq_mapping_cleanup(n->iothread_vq_mapping_list);
+    }
+
+    g_free(n->vq_aio_context);
+    n->vq_aio_context = NULL;
+}
+
 static void virtio_net_device_realize(DeviceState *dev, Error **errp)
 {
     VirtIODevice *vdev = VIRTIO_DEVICE(dev);
@@ -3960,6 +4429,12 @@ static void virtio_net_device_realize(DeviceState *dev, Error **errp)
         virtio_cleanup(vdev);
         return;
     }
+
+    if (!virtio_net_vq_aio_context_init(n, errp)) {
+        virtio_cleanup(vdev);
+        return;
+    }
+
     n->vqs = g_new0(VirtIONetQueue, n->max_queue_pairs);
     n->curr_queue_pairs = 1;
     n->tx_timeout = n->net_conf.txtimer;
@@ -4034,7 +4509,10 @@ static void virtio_net_device_realize(DeviceState *dev, Error **errp)
     QTAILQ_INIT(&n->rsc_chains);
     n->qdev = dev;
 
-    net_rx_pkt_init(&n->rx_pkt);
+    /* Queue pairs in different IOThreads parse packets at the same time */
+    for (i = 0; i < n->max_queue_pairs; i++) {
+        net_rx_pkt_init(&n->vqs[i].rx_pkt);
+    }
 
     if (qemu_get_vnet_hash_supported_types(qemu_get_queue(n->nic)->peer,
                                            &n->rss_data.peer_hash_types)) {
@@ -4048,6 +4526,8 @@ static void virtio_net_device_realize(DeviceState *dev, Error **errp)
             n->rss_data.specified_hash_types.on_bits |
             n->rss_data.specified_hash_types.auto_bits;
     }
+
+    virtio_net_update_rx_filter(n);
 }
 
 static void virtio_net_device_unrealize(DeviceState *dev)
@@ -4063,6 +4543,9 @@ static void virtio_net_device_unrealize(DeviceState *dev)
     /* This will stop vhost backend if appropriate. */
     virtio_net_set_status(vdev, 0);
 
+    /* Packets handed over between queue pairs still refer to the device */
+    AIO_WAIT_WHILE(NULL, qatomic_read(&n->rx_forward_pending) > 0);
+
     g_free(n->netclient_name);
     n->netclient_name = NULL;
     g_free(n->netclient_type);
@@ -4083,14 +4566,19 @@ static void virtio_net_device_unrealize(DeviceState *dev)
     for (i = 0; i < max_queue_pairs; i++) {
         virtio_net_del_queue(n, i);
     }
+    for (i = 0; i < n->max_queue_pairs; i++) {
+        net_rx_pkt_uninit(n->vqs[i].rx_pkt);
+    }
     /* delete also control vq */
     virtio_del_queue(vdev, max_queue_pairs * 2);
+    virtio_net_vq_aio_context_cleanup(n);
     qemu_announce_timer_del(&n->announce_timer, false);
     g_free(n->vqs);
     qemu_del_nic(n->nic);
     virtio_net_rsc_cleanup(n);
     g_free(n->rss_data.indirections_table);
-    net_rx_pkt_uninit(n->rx_pkt);
+    g_free_rcu(n->rx_filter, rcu);
+    n->rx_filter = NULL;
     virtio_cleanup(vdev);
 }
 
@@ -4127,6 +4615,7 @@ static void virtio_net_reset(VirtIODevice *vdev)
     }
 
     virtio_net_disable_rss(n);
+    virtio_net_update_rx_filter(n);
 }
 
 static void virtio_net_instance_init(Object *obj)
@@ -4314,6 +4803,8 @@ static const Property virtio_net_properties[] = {
                                host_features_ex,
                                VIRTIO_NET_F_GUEST_UDP_TUNNEL_GSO_CSUM,
                                true),
+    DEFINE_PROP_IOTHREAD_VQ_MAPPING_LIST("iothread-vq-mapping", VirtIONet,
+                                         iothread_vq_mapping_list),
 };
 
 static void virtio_net_class_init(ObjectClass *klass, const void *data)
@@ -4335,6 +4826,8 @@ static void virtio_net_class_init(ObjectClass *klass, const void *data)
     vdc->queue_reset = virtio_net_queue_reset;
     vdc->queue_enable = virtio_net_queue_enable;
     vdc->set_status = virtio_net_set_status;
+    vdc->start_ioeventfd = virtio_net_start_ioeventfd;
+    vdc->stop_ioeventfd = virtio_net_stop_ioeventfd;
     vdc->guest_notifier_mask = virtio_net_guest_notifier_mask;
     vdc->guest_notifier_pending = virtio_net_guest_notifier_pending;
     vdc->legacy_features |= (0x1 << VIRTIO_NET_F_GSO);
@@ -43,6 +43,7 @@
  *              atomic.dn=<on|off[optional]>, \
  *              atomic.awun<N[optional]>, \
  *              atomic.awupf<N[optional]>, \
+ *              iothread-vq-mapping=<mapping[optional]>, \
  *              subsys=<subsys_id>
  *      -device nvme-ns,drive=<drive_id>,bus=<bus_name>,nsid=<nsid>,\
  *              zoned=<true|false[optional]>, \
@@ -150,6 +151,14 @@
  *   a secondary controller. The default 0 resolves to
  *   `(sriov_vq_flexible / sriov_max_vfs)`.
  *
+ * - `iothread-vq-mapping`
+ *   Process I/O queue pairs in IOThreads instead of the main loop. The `vqs`
+ *   of each mapping are zero-based I/O completion queue indices (i.e. the
+ *   completion queue identifier minus one); submission queues are processed
+ *   in the IOThread of the completion queue they are bound to. The admin
+ *   queue is always processed in the main loop. This is incompatible with
+ *   the `atomic.*` parameters, Zoned namespaces and Flexible Data Placement.
+ *
  * nvme namespace device parameters
  * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
  * - `shared`
@@ -199,6 +208,8 @@
 #include "qemu/log.h"
 #include "qemu/units.h"
 #include "qemu/range.h"
+#include "qemu/aio-wait.h"
+#include "qemu/aiocb.h"
 #include "qapi/error.h"
 #include "qapi/visitor.h"
 #include "system/system.h"
@@ -208,6 +219,7 @@
 #include "hw/pci/pcie_sriov.h"
 #include "system/spdm-socket.h"
 #include "migration/vmstate.h"
+#include "hw/virtio/iothread-vq-mapping.h"
 
 #include "nvme.h"
 #include "dif.h"
@@ -626,13 +638,25 @@ static int nvme_check_cqid(NvmeCtrl *n, uint16_t cqid)
     return cqid < n->conf_ioqpairs + 1 && n->cq[cqid] != NULL ? 0 : -1;
 }
 
+/* Returns NULL if the completion queue is processed in the main loop */
+static AioContext *nvme_cq_aio_context(NvmeCtrl *n, uint16_t cqid)
+{
+    if (!cqid || !n->cq_aio_context) {
+        return NULL;
+    }
+
+    return n->cq_aio_context[cqid - 1];
+}
+
 static void nvme_inc_cq_tail(NvmeCQueue *cq)
 {
-    cq->tail++;
-    if (cq->tail >= cq->size) {
-        cq->tail = 0;
+    uint32_t tail = cq->tail + 1;
+
+    if (tail >= cq->size) {
+        tail = 0;
         cq->phase = !cq->phase;
     }
+    qatomic_set(&cq->tail, tail);
 }
 
 static void nvme_inc_sq_head(NvmeSQueue *sq)
@@ -642,7 +666,8 @@ static void nvme_inc_sq_head(NvmeSQueue *sq)
 
 static uint8_t nvme_cq_full(NvmeCQueue *cq)
 {
-    return (cq->tail + 1) % cq->size == cq->head;
+    return (qatomic_read(&cq->tail) + 1) % cq->size ==
+           qatomic_read(&cq->head);
 }
 
 static uint8_t nvme_sq_empty(NvmeSQueue *sq)
@@ -705,6 +730,26 @@ static void nvme_irq_deassert(NvmeCtrl *n, NvmeCQueue *cq)
     }
 }
 
+static void nvme_cq_irq_assert(NvmeCtrl *n, NvmeCQueue *cq)
+{
+    if (cq->irq_enabled && !cq->irq_pending) {
+        cq->irq_pending = true;
+        n->cq_pending++;
+    }
+
+    nvme_irq_assert(n, cq);
+}
+
+static void nvme_cq_irq_deassert(NvmeCtrl *n, NvmeCQueue *cq)
+{
+    if (cq->irq_pending) {
+        cq->irq_pending = false;
+        n->cq_pending--;
+    }
+
+    nvme_irq_deassert(n, cq);
+}
+
 static void nvme_req_clear(NvmeRequest *req)
 {
     req->ns = NULL;
@@ -1479,20 +1524,31 @@ static inline void nvme_blk_write(BlockBackend *blk, int64_t offset,
     }
 }
 
-static void nvme_update_cq_eventidx(const NvmeCQueue *cq)
+static void nvme_update_cq_eventidx(NvmeCQueue *cq)
 {
-    trace_pci_nvme_update_cq_eventidx(cq->cqid, cq->head);
+    uint32_t head = qatomic_read(&cq->head);
+
+    trace_pci_nvme_update_cq_eventidx(cq->cqid, head);
 
-    stl_le_pci_dma(PCI_DEVICE(cq->ctrl), cq->ei_addr, cq->head,
+    stl_le_pci_dma(PCI_DEVICE(cq->ctrl), cq->ei_addr, head,
                    MEMTXATTRS_UNSPECIFIED);
 }
 
+/*
+ * With shadow doorbells the head is written both here and by MMIO doorbell
+ * writes in nvme_process_db(), possibly from different threads when the
+ * queue is processed in an IOThread.  Both store a value written by the
+ * guest, so it is enough that every access to it is atomic.
+ */
 static void nvme_update_cq_head(NvmeCQueue *cq)
 {
-    ldl_le_pci_dma(PCI_DEVICE(cq->ctrl), cq->db_addr, &cq->head,
+    uint32_t head;
+
+    ldl_le_pci_dma(PCI_DEVICE(cq->ctrl), cq->db_addr, &head,
                    MEMTXATTRS_UNSPECIFIED);
+    qatomic_set(&cq->head, head);
 
-    trace_pci_nvme_update_cq_head(cq->cqid, cq->head);
+    trace_pci_nvme_update_cq_head(cq->cqid, head);
 }
 
 static void nvme_post_cqes(void *opaque)
@@ -1500,7 +1556,6 @@ static void nvme_post_cqes(void *opaque)
     NvmeCQueue *cq = opaque;
     NvmeCtrl *n = cq->ctrl;
     NvmeRequest *req, *next;
-    bool pending = cq->head != cq->tail;
     int ret;
 
     QTAILQ_FOREACH_SAFE(req, &cq->req_list, entry, next) {
@@ -1513,7 +1568,15 @@ static void nvme_post_cqes(void *opaque)
         }
 
         if (nvme_cq_full(cq)) {
-            break;
+            /*
+             * Pairs with smp_mb() in nvme_process_db(): either the doorbell
+             * write sees the tail that made the queue full and schedules
+             * us again, or we see its new head here.
+             */
+            smp_mb();
+            if (nvme_cq_full(cq)) {
+                break;
+            }
         }
 
         sq = req->sq;
@@ -1541,12 +1604,25 @@ static void nvme_post_cqes(void *opaque)
 
         QTAILQ_INSERT_TAIL(&sq->req_list, req, entry);
     }
-    if (cq->tail != cq->head) {
-        if (cq->irq_enabled && !pending) {
-            n->cq_pending++;
+    if (cq->tail != qatomic_read(&cq->head)) {
+        if (cq->ctx) {
+            qemu_bh_schedule(cq->irq_bh);
+        } else {
+            nvme_cq_irq_assert(n, cq);
         }
+    }
+}
 
-        nvme_irq_assert(n, cq);
+/*
+ * Raising the interrupt requires the BQL, so completion queues processed in
+ * an IOThread defer it to this bottom half in the main loop.
+ */
+static void nvme_cq_irq_bh(void *opaque)
+{
+    NvmeCQueue *cq = opaque;
+
+    if (qatomic_read(&cq->tail) != qatomic_read(&cq->head)) {
+        nvme_cq_irq_assert(cq->ctrl, cq);
     }
 }
 
@@ -4733,12 +4809,8 @@ static void nvme_cq_notifier(EventNotifier *e)
 
     nvme_update_cq_head(cq);
 
-    if (cq->tail == cq->head) {
-        if (cq->irq_enabled) {
-            n->cq_pending--;
-        }
-
-        nvme_irq_deassert(n, cq);
+    if (qatomic_read(&cq->tail) == qatomic_read(&cq->head)) {
+        nvme_cq_irq_deassert(n, cq);
     }
 
     qemu_bh_schedule(cq->bh);
@@ -4773,6 +4845,16 @@ static void nvme_sq_notifier(EventNotifier *e)
     nvme_process_sq(sq);
 }
 
+static void nvme_sq_set_notifier_handler(NvmeSQueue *sq,
+                                         EventNotifierHandler *handler)
+{
+    if (sq->ctx) {
+        aio_set_event_notifier(sq->ctx, &sq->notifier, handler, NULL, NULL);
+    } else {
+        event_notifier_set_handler(&sq->notifier, handler);
+    }
+}
+
 static int nvme_init_sq_ioeventfd(NvmeSQueue *sq)
 {
     NvmeCtrl *n = sq->ctrl;
@@ -4784,23 +4866,48 @@ static int nvme_init_sq_ioeventfd(NvmeSQueue *sq)
         return ret;
     }
 
-    event_notifier_set_handler(&sq->notifier, nvme_sq_notifier);
+    nvme_sq_set_notifier_handler(sq, nvme_sq_notifier);
     memory_region_add_eventfd(&n->iomem,
                               0x1000 + offset, 4, false, 0, &sq->notifier);
 
     return 0;
 }
 
+static void nvme_sq_stop_bh(void *opaque)
+{
+    NvmeSQueue *sq = opaque;
+
+    if (!sq->bh) {
+        return;
+    }
+
+    qemu_bh_delete(sq->bh);
+    sq->bh = NULL;
+
+    if (sq->ioeventfd_enabled) {
+        nvme_sq_set_notifier_handler(sq, NULL);
+    }
+}
+
+/* Stop fetching commands from @sq, waiting for its IOThread if it has one */
+static void nvme_sq_stop(NvmeSQueue *sq)
+{
+    if (sq->ctx) {
+        aio_wait_bh_oneshot(sq->ctx, nvme_sq_stop_bh, sq);
+    } else {
+        nvme_sq_stop_bh(sq);
+    }
+}
+
 static void nvme_free_sq(NvmeSQueue *sq, NvmeCtrl *n)
 {
     uint16_t offset = sq->sqid << 3;
 
     n->sq[sq->sqid] = NULL;
-    qemu_bh_delete(sq->bh);
+    nvme_sq_stop(sq);
     if (sq->ioeventfd_enabled) {
         memory_region_del_eventfd(&n->iomem,
                                   0x1000 + offset, 4, false, 0, &sq->notifier);
-        event_notifier_set_handler(&sq->notifier, NULL);
         event_notifier_cleanup(&sq->notifier);
     }
     g_free(sq->io_req);
@@ -4809,27 +4916,39 @@ static void nvme_free_sq(NvmeSQueue *sq, NvmeCtrl *n)
     }
 }
 
-static uint16_t nvme_del_sq(NvmeCtrl *n, NvmeRequest *req)
+/*
+ * blk_aio_cancel() may only be called from the main loop, so requests of
+ * queues processed in an IOThread are canceled asynchronously and waited for
+ * in the IOThread instead.
+ */
+static void nvme_cancel_req(NvmeSQueue *sq, NvmeRequest *req)
 {
-    NvmeDeleteQ *c = (NvmeDeleteQ *)&req->cmd;
-    NvmeRequest *r, *next;
-    NvmeSQueue *sq;
-    NvmeCQueue *cq;
-    uint16_t qid = le16_to_cpu(c->qid);
+    BlockAIOCB *acb = req->aiocb;
 
-    if (unlikely(!qid || nvme_check_sqid(n, qid))) {
-        trace_pci_nvme_err_invalid_del_sq(qid);
-        return NVME_INVALID_QID | NVME_DNR;
+    if (!sq->ctx) {
+        blk_aio_cancel(acb);
+        return;
     }
 
-    trace_pci_nvme_del_sq(qid);
+    qemu_aio_ref(acb);
+    blk_aio_cancel_async(acb);
+    AIO_WAIT_WHILE_UNLOCKED(sq->ctx, acb->refcnt > 1);
+    qemu_aio_unref(acb);
+}
+
+/* Called in the AioContext of @sq */
+static void nvme_del_sq_bh(void *opaque)
+{
+    NvmeSQueue *sq = opaque;
+    NvmeCtrl *n = sq->ctrl;
+    NvmeRequest *r, *next;
+    NvmeCQueue *cq;
 
-    sq = n->sq[qid];
     while (!QTAILQ_EMPTY(&sq->out_req_list)) {
         r = QTAILQ_FIRST(&sq->out_req_list);
         assert(r->aiocb);
         r->status = NVME_CMD_ABORT_SQ_DEL;
-        blk_aio_cancel(r->aiocb);
+        nvme_cancel_req(sq, r);
     }
 
     assert(QTAILQ_EMPTY(&sq->out_req_list));
@@ -4846,6 +4965,27 @@ static uint16_t nvme_del_sq(NvmeCtrl *n, NvmeRequest *req)
             }
         }
     }
+}
+
+static uint16_t nvme_del_sq(NvmeCtrl *n, NvmeRequest *req)
+{
+    NvmeDeleteQ *c = (NvmeDeleteQ *)&req->cmd;
+    NvmeSQueue *sq;
+    uint16_t qid = le16_to_cpu(c->qid);
+
+    if (unlikely(!qid || nvme_check_sqid(n, qid))) {
+        trace_pci_nvme_err_invalid_del_sq(qid);
+        return NVME_INVALID_QID | NVME_DNR;
+    }
+
+    trace_pci_nvme_del_sq(qid);
+
+    sq = n->sq[qid];
+    if (sq->ctx) {
+        aio_wait_bh_oneshot(sq->ctx, nvme_del_sq_bh, sq);
+    } else {
+        nvme_del_sq_bh(sq);
+    }
 
     nvme_free_sq(sq, n);
     return NVME_SUCCESS;
@@ -4872,8 +5012,11 @@ static void nvme_init_sq(NvmeSQueue *sq, NvmeCtrl *n, uint64_t dma_addr,
         QTAILQ_INSERT_TAIL(&(sq->req_list), &sq->io_req[i], entry);
     }
 
-    sq->bh = qemu_bh_new_guarded(nvme_process_sq, sq,
-                                 &DEVICE(sq->ctrl)->mem_reentrancy_guard);
+    assert(n->cq[cqid]);
+    sq->ctx = n->cq[cqid]->ctx;
+    sq->bh = aio_bh_new_guarded(sq->ctx ?: qemu_get_aio_context(),
+                                nvme_process_sq, sq,
+                                &DEVICE(sq->ctrl)->mem_reentrancy_guard);
 
     if (n->dbbuf_enabled) {
         sq->db_addr = n->dbbuf_dbs + (sqid << 3);
@@ -4886,7 +5029,6 @@ static void nvme_init_sq(NvmeSQueue *sq, NvmeCtrl *n, uint64_t dma_addr,
         }
     }
 
-    assert(n->cq[cqid]);
     cq = n->cq[cqid];
     QTAILQ_INSERT_TAIL(&(cq->sq_list), sq, entry);
     n->sq[sqid] = sq;
@@ -4939,12 +5081,14 @@ struct nvme_stats {
 
 static void nvme_set_blk_stats(NvmeNamespace *ns, struct nvme_stats *stats)
 {
-    BlockAcctStats *s = blk_get_stats(ns->blkconf.blk);
+    BlockAcctCounters c;
 
-    stats->units_read += s->nr_bytes[BLOCK_ACCT_READ];
-    stats->units_written += s->nr_bytes[BLOCK_ACCT_WRITE];
-    stats->read_commands += s->nr_ops[BLOCK_ACCT_READ];
-    stats->write_commands += s->nr_ops[BLOCK_ACCT_WRITE];
+    block_acct_get_counters(blk_get_stats(ns->blkconf.blk), &c);
+
+    stats->units_read += c.nr_bytes[BLOCK_ACCT_READ];
+    stats->units_written += c.nr_bytes[BLOCK_ACCT_WRITE];
+    stats->read_commands += c.nr_ops[BLOCK_ACCT_READ];
+    stats->write_commands += c.nr_ops[BLOCK_ACCT_WRITE];
 }
 
 static uint16_t nvme_ocp_extended_smart_info(NvmeCtrl *n, uint8_t rae,
@@ -5504,13 +5648,39 @@ static uint16_t nvme_get_log(NvmeCtrl *n, NvmeRequest *req)
     }
 }
 
+static void nvme_cq_stop_bh(void *opaque)
+{
+    NvmeCQueue *cq = opaque;
+
+    if (!cq->bh) {
+        return;
+    }
+
+    qemu_bh_delete(cq->bh);
+    cq->bh = NULL;
+}
+
+/* Stop posting completions to @cq, waiting for its IOThread if it has one */
+static void nvme_cq_stop(NvmeCQueue *cq)
+{
+    if (cq->ctx) {
+        aio_wait_bh_oneshot(cq->ctx, nvme_cq_stop_bh, cq);
+    } else {
+        nvme_cq_stop_bh(cq);
+    }
+}
+
 static void nvme_free_cq(NvmeCQueue *cq, NvmeCtrl *n)
 {
     PCIDevice *pci = PCI_DEVICE(n);
     uint16_t offset = (cq->cqid << 3) + (1 << 2);
 
     n->cq[cq->cqid] = NULL;
-    qemu_bh_delete(cq->bh);
+    nvme_cq_stop(cq);
+    if (cq->irq_bh) {
+        qemu_bh_delete(cq->irq_bh);
+        cq->irq_bh = NULL;
+    }
     if (cq->ioeventfd_enabled) {
         memory_region_del_eventfd(&n->iomem,
                                   0x1000 + offset, 4, false, 0, &cq->notifier);
@@ -5542,11 +5712,7 @@ static uint16_t nvme_del_cq(NvmeCtrl *n, NvmeRequest *req)
         return NVME_INVALID_QUEUE_DEL;
     }
 
-    if (cq->irq_enabled && cq->tail != cq->head) {
-        n->cq_pending--;
-    }
-
-    nvme_irq_deassert(n, cq);
+    nvme_cq_irq_deassert(n, cq);
     trace_pci_nvme_del_cq(qid);
     nvme_free_cq(cq, n);
     return NVME_SUCCESS;
@@ -5568,8 +5734,10 @@ static void nvme_init_cq(NvmeCQueue *cq, NvmeCtrl *n, uint64_t dma_addr,
     cq->dma_addr = dma_addr;
     cq->phase = 1;
     cq->irq_enabled = irq_enabled;
+    cq->irq_pending = false;
     cq->vector = vector;
     cq->head = cq->tail = 0;
+    cq->ctx = nvme_cq_aio_context(n, cqid);
     QTAILQ_INIT(&cq->req_list);
     QTAILQ_INIT(&cq->sq_list);
     if (n->dbbuf_enabled) {
@@ -5583,8 +5751,13 @@ static void nvme_init_cq(NvmeCQueue *cq, NvmeCtrl *n, uint64_t dma_addr,
         }
     }
     n->cq[cqid] = cq;
-    cq->bh = qemu_bh_new_guarded(nvme_post_cqes, cq,
-                                 &DEVICE(cq->ctrl)->mem_reentrancy_guard);
+    cq->bh = aio_bh_new_guarded(cq->ctx ?: qemu_get_aio_context(),
+                                nvme_post_cqes, cq,
+                                &DEVICE(cq->ctrl)->mem_reentrancy_guard);
+    if (cq->ctx) {
+        cq->irq_bh = qemu_bh_new_guarded(nvme_cq_irq_bh, cq,
+                                    &DEVICE(cq->ctrl)->mem_reentrancy_guard);
+    }
 }
 
 static uint16_t nvme_create_cq(NvmeCtrl *n, NvmeRequest *req)
@@ -6107,12 +6280,34 @@ static uint16_t nvme_identify(NvmeCtrl *n, NvmeRequest *req)
     }
 }
 
+typedef struct NvmeAbortData {
+    NvmeSQueue *sq;
+    uint16_t cid;
+} NvmeAbortData;
+
+/* Called in the AioContext of the submission queue */
+static void nvme_abort_bh(void *opaque)
+{
+    NvmeAbortData *data = opaque;
+    NvmeRequest *r, *next;
+
+    QTAILQ_FOREACH_SAFE(r, &data->sq->out_req_list, entry, next) {
+        if (r->cqe.cid == data->cid) {
+            if (r->aiocb) {
+                r->status = NVME_CMD_ABORT_REQ;
+                blk_aio_cancel_async(r->aiocb);
+            }
+            break;
+        }
+    }
+}
+
 static uint16_t nvme_abort(NvmeCtrl *n, NvmeRequest *req)
 {
     uint16_t sqid = le32_to_cpu(req->cmd.cdw10) & 0xffff;
     uint16_t cid  = (le32_to_cpu(req->cmd.cdw10) >> 16) & 0xffff;
     NvmeSQueue *sq = n->sq[sqid];
-    NvmeRequest *r, *next;
+    NvmeAbortData data;
     int i;
 
     req->cqe.result = 1;
@@ -6135,14 +6330,15 @@ static uint16_t nvme_abort(NvmeCtrl *n, NvmeRequest *req)
         }
     }
 
-    QTAILQ_FOREACH_SAFE(r, &sq->out_req_list, entry, next) {
-        if (r->cqe.cid == cid) {
-            if (r->aiocb) {
-                r->status = NVME_CMD_ABORT_REQ;
-                blk_aio_cancel_async(r->aiocb);
-            }
-            break;
-        }
+    data = (NvmeAbortData) {
+        .sq = sq,
+        .cid = cid,
+    };
+
+    if (sq->ctx) {
+        aio_wait_bh_oneshot(sq->ctx, nvme_abort_bh, &data);
+    } else {
+        nvme_abort_bh(&data);
     }
 
     return NVME_SUCCESS;
@@ -6791,6 +6987,11 @@ static bool nvme_csi_supported(NvmeCtrl *n, uint8_t csi)
         return true;
 
     case NVME_CSI_ZONED:
+        /* zone state is not safe to update from several IOThreads */
+        if (n->iothread_vq_mapping_list) {
+            return false;
+        }
+
         cc = ldl_le_p(&n->bar.cc);
 
         return NVME_CC_CSS(cc) == NVME_CC_CSS_ALL;
@@ -7892,6 +8093,17 @@ static void nvme_ctrl_reset(NvmeCtrl *n, NvmeResetType rst)
     NvmeNamespace *ns;
     int i;
 
+    /*
+     * Queues processed in an IOThread keep running while the namespaces are
+     * drained, so stop them from fetching new commands first and only stop
+     * posting completions once all requests have completed.
+     */
+    for (i = 0; i < n->params.max_ioqpairs + 1; i++) {
+        if (n->sq[i] != NULL) {
+            nvme_sq_stop(n->sq[i]);
+        }
+    }
+
     for (i = 1; i <= NVME_MAX_NAMESPACES; i++) {
         ns = nvme_ns(n, i);
         if (!ns) {
@@ -7901,6 +8113,12 @@ static void nvme_ctrl_reset(NvmeCtrl *n, NvmeResetType rst)
         nvme_ns_drain(ns);
     }
 
+    for (i = 0; i < n->params.max_ioqpairs + 1; i++) {
+        if (n->cq[i] != NULL) {
+            nvme_cq_stop(n->cq[i]);
+        }
+    }
+
     for (i = 0; i < n->params.max_ioqpairs + 1; i++) {
         if (n->sq[i] != NULL) {
             nvme_free_sq(n->sq[i], n);
@@ -8382,6 +8600,7 @@ static void nvme_process_db(NvmeCtrl *n, hwaddr addr, int val)
         /* Completion queue doorbell write */
 
         uint16_t new_head = val & 0xffff;
+        uint32_t old_head;
         NvmeCQueue *cq;
 
         qid = (addr - (0x1000 + (1 << 2))) >> 3;
@@ -8432,22 +8651,27 @@ static void nvme_process_db(NvmeCtrl *n, hwaddr addr, int val)
 
         trace_pci_nvme_mmio_doorbell_cq(cq->cqid, new_head);
 
+        /*
+         * Publish the new head before scheduling deferred cqe posting, so
+         * that nvme_post_cqes() cannot run in between and find the queue
+         * still full.
+         */
+        old_head = qatomic_read(&cq->head);
+        qatomic_store_release(&cq->head, new_head);
+        /* Order the head store before the tail load, see nvme_post_cqes() */
+        smp_mb();
+
         /* scheduled deferred cqe posting if queue was previously full */
-        if (nvme_cq_full(cq)) {
+        if ((qatomic_read(&cq->tail) + 1) % cq->size == old_head) {
             qemu_bh_schedule(cq->bh);
         }
 
-        cq->head = new_head;
         if (!qid && n->dbbuf_enabled) {
-            stl_le_pci_dma(pci, cq->db_addr, cq->head, MEMTXATTRS_UNSPECIFIED);
+            stl_le_pci_dma(pci, cq->db_addr, new_head, MEMTXATTRS_UNSPECIFIED);
         }
 
-        if (cq->tail == cq->head) {
-            if (cq->irq_enabled) {
-                n->cq_pending--;
-            }
-
-            nvme_irq_deassert(n, cq);
+        if (qatomic_read(&cq->tail) == new_head) {
+            nvme_cq_irq_deassert(n, cq);
         }
     } else {
         /* Submission queue doorbell write */
@@ -9248,6 +9472,43 @@ static int nvme_init_subsys(NvmeCtrl *n, Error **errp)
     return 0;
 }
 
+static bool nvme_init_iothreads(NvmeCtrl *n, Error **errp)
+{
+    NvmeParams *params = &n->params;
+
+    if (!n->iothread_vq_mapping_list) {
+        return true;
+    }
+
+    /*
+     * Atomic write checks and Flexible Data Placement bookkeeping span all
+     * queues of the controller and cannot be done from several IOThreads.
+     */
+    if (params->atomic_awun || params->atomic_awupf) {
+        error_setg(errp, "iothread-vq-mapping is incompatible with "
+                   "atomic.awun and atomic.awupf");
+        return false;
+    }
+
+    if (n->subsys->endgrp.fdp.enabled) {
+        error_setg(errp, "iothread-vq-mapping is incompatible with "
+                   "flexible data placement");
+        return false;
+    }
+
+    n->cq_aio_context = g_new0(AioContext *, params->max_ioqpairs);
+
+    if (!iothread_vq_mapping_apply(n->iothread_vq_mapping_list,
+                                   n->cq_aio_context, params->max_ioqpairs,
+                                   errp)) {
+        g_free(n->cq_aio_context);
+        n->cq_aio_context = NULL;
+        return false;
+    }
+
+    return true;
+}
+
 void nvme_attach_ns(NvmeCtrl *n, NvmeNamespace *ns)
 {
     uint32_t nsid = ns->params.nsid;
@@ -9313,6 +9574,10 @@ static void nvme_realize(PCIDevice *pci_dev, Error **errp)
 
         n->subsys->namespaces[ns->params.nsid] = ns;
     }
+
+    if (!nvme_init_iothreads(n, errp)) {
+        return;
+    }
 }
 
 static void nvme_exit(PCIDevice *pci_dev)
@@ -9336,6 +9601,11 @@ static void nvme_exit(PCIDevice *pci_dev)
     g_free(n->sq);
     g_free(n->aer_reqs);
 
+    if (n->cq_aio_context) {
+        iothread_vq_mapping_cleanup(n->iothread_vq_mapping_list);
+        g_free(n->cq_aio_context);
+    }
+
     if (n->params.cmb_size_mb) {
         g_free(n->cmb.buf);
     }
@@ -9409,6 +9679,8 @@ static const Property nvme_props[] = {
     DEFINE_PROP_UINT16("atomic.awun", NvmeCtrl, params.atomic_awun, 0),
     DEFINE_PROP_UINT16("atomic.awupf", NvmeCtrl, params.atomic_awupf, 0),
     DEFINE_PROP_BOOL("ocp", NvmeCtrl, params.ocp, false),
+    DEFINE_PROP_IOTHREAD_VQ_MAPPING_LIST("iothread-vq-mapping", NvmeCtrl,
+                                         iothread_vq_mapping_list),
 };
 
 static void nvme_get_smart_warning(Object *obj, Visitor *v, const char *name,
@@ -807,6 +807,12 @@ static bool nvme_ns_set_nsabp(NvmeCtrl *n, NvmeNamespace *ns, Error **errp)
         return true;
     }
 
+    if (n->iothread_vq_mapping_list) {
+        error_setg(errp, "atomic.nawun and atomic.nawupf are incompatible "
+                   "with the controller's iothread-vq-mapping");
+        return false;
+    }
+
     if (nawun < awun) {
         error_setg(errp, "nawun must be greater than or equal to awun");
         return false;
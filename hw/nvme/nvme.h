@@ -21,6 +21,7 @@
 #include "qemu/uuid.h"
 #include "hw/pci/pci_device.h"
 #include "hw/block/block.h"
+#include "qapi/qapi-types-virtio.h"
 
 #include "block/nvme.h"
 
@@ -508,6 +509,7 @@ typedef struct NvmeSQueue {
     uint64_t    dma_addr;
     uint64_t    db_addr;
     uint64_t    ei_addr;
+    AioContext  *ctx;       /* NULL when processed in the main loop */
     QEMUBH      *bh;
     EventNotifier notifier;
     bool        ioeventfd_enabled;
@@ -529,7 +531,10 @@ typedef struct NvmeCQueue {
     uint64_t    dma_addr;
     uint64_t    db_addr;
     uint64_t    ei_addr;
+    AioContext  *ctx;       /* NULL when processed in the main loop */
     QEMUBH      *bh;
+    QEMUBH      *irq_bh;    /* raises the interrupt from the main loop */
+    bool        irq_pending;
     EventNotifier notifier;
     bool        ioeventfd_enabled;
     QTAILQ_HEAD(, NvmeSQueue) sq_list;
@@ -644,6 +649,10 @@ typedef struct NvmeCtrl {
     NvmeCQueue      admin_cq;
     NvmeIdCtrl      id_ctrl;
 
+    /* I/O queue pairs to IOThreads, indexed by completion queue id - 1 */
+    IOThreadVirtQueueMappingList *iothread_vq_mapping_list;
+    AioContext      **cq_aio_context;
+
     struct {
         struct {
             uint16_t temp_thresh_hi;
@@ -31,6 +31,7 @@
 
 typedef struct BlockAcctTimedStats BlockAcctTimedStats;
 typedef struct BlockAcctStats BlockAcctStats;
+typedef struct BlockAcctShard BlockAcctShard;
 
 enum BlockAcctType {
     BLOCK_ACCT_NONE = 0,
@@ -79,8 +80,8 @@ typedef struct BlockLatencyHistogram {
     uint64_t *bins;
 } BlockLatencyHistogram;
 
-struct BlockAcctStats {
-    QemuMutex lock;
+/* Request counters, summed over all threads by block_acct_get_counters() */
+typedef struct BlockAcctCounters {
     uint64_t nr_bytes[BLOCK_MAX_IOTYPE];
     uint64_t nr_ops[BLOCK_MAX_IOTYPE];
     uint64_t invalid_ops[BLOCK_MAX_IOTYPE];
@@ -88,6 +89,19 @@ struct BlockAcctStats {
     uint64_t total_time_ns[BLOCK_MAX_IOTYPE];
     uint64_t merged[BLOCK_MAX_IOTYPE];
     int64_t last_access_time_ns;
+} BlockAcctCounters;
+
+struct BlockAcctStats {
+    /*
+     * BlockAcctCounters for each thread that completes requests, so that
+     * IOThreads do not share a lock or a cache line on every completion.
+     */
+    BlockAcctShard *shards;
+
+    /* Protects @intervals and @latency_histogram */
+    QemuMutex lock;
+    /* Whether @intervals or @latency_histogram need to be updated */
+    bool latency_stats;
     QSLIST_HEAD(, BlockAcctTimedStats) intervals;
     bool account_invalid;
     bool account_failed;
@@ -115,6 +129,8 @@ void block_acct_failed(BlockAcctStats *stats, BlockAcctCookie *cookie);
 void block_acct_invalid(BlockAcctStats *stats, enum BlockAcctType type);
 void block_acct_merge_done(BlockAcctStats *stats, enum BlockAcctType type,
                            int num_requests);
+void block_acct_get_counters(BlockAcctStats *stats,
+                             BlockAcctCounters *counters);
 int64_t block_acct_idle_time_ns(BlockAcctStats *stats);
 double block_acct_queue_depth(BlockAcctTimedStats *stats,
                               enum BlockAcctType type);
@@ -75,10 +75,14 @@ static inline bool laio_has_fua(void)
 #endif
 /* io_uring.c - Linux io_uring implementation */
 #ifdef CONFIG_LINUX_IO_URING
-/* luring_co_submit: submit I/O requests in the thread's current AioContext. */
-int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
-                                  QEMUIOVector *qiov, int type,
-                                  BdrvRequestFlags flags);
+/*
+ * luring_co_submit: submit I/O requests in the thread's current AioContext.
+ * @fixed_fd is the index of @fd in the io_uring registered file table (see
+ * aio_register_fixed_file()), or -1 if it isn't registered.
+ */
+int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, int fixed_fd,
+                                  uint64_t offset, QEMUIOVector *qiov,
+                                  int type, BdrvRequestFlags flags);
 bool luring_has_fua(void);
 #else
 static inline bool luring_has_fua(void)
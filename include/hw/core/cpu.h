@@ -92,6 +92,9 @@ struct CPUAddressSpace;
 /* see accel/tcg/tb-jmp-cache.h */
 struct CPUJumpCache;
 
+/* see accel/tcg/tb-async.c */
+struct TBAsyncCPU;
+
 /* see accel-cpu.h */
 struct AccelCPUClass;
 
@@ -209,8 +212,13 @@ struct CPUClass {
 #define NB_MMU_MODES 22
 typedef uint32_t MMUIdxMap;
 
-/* Use a fully associative victim tlb of 8 entries. */
+/*
+ * Use a victim tlb made of sets of 8 entries, picked by a hash of the
+ * page.  By default there is a single, fully associative set.
+ */
+#define CPU_VTLB_WAYS 8
 #define CPU_VTLB_SIZE 8
+#define CPU_VTLB_MAX_SIZE 1024
 
 /*
  * The full TLB entry, which is not accessed by generated TCG code,
@@ -294,11 +302,13 @@ typedef struct CPUTLBDesc {
     /* maximum number of entries observed in the window */
     size_t window_max_entries;
     size_t n_used_entries;
-    /* The next index to use in the tlb victim table.  */
+    /* The next way to use in a set of the tlb victim table.  */
     size_t vindex;
+    /* log2 of the number of sets in the tlb victim table.  */
+    unsigned vbits;
     /* The tlb victim table, in two parts.  */
-    CPUTLBEntry vtable[CPU_VTLB_SIZE];
-    CPUTLBEntryFull vfulltlb[CPU_VTLB_SIZE];
+    CPUTLBEntry *vtable;
+    CPUTLBEntryFull *vfulltlb;
     CPUTLBEntryFull *fulltlb;
 } CPUTLBDesc;
 
@@ -322,6 +332,8 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    size_t victim_hit_count;
+    size_t victim_miss_count;
 } CPUTLBCommon;
 
 /*
@@ -525,6 +537,7 @@ struct CPUState {
     MemoryRegion *memory;
 
     struct CPUJumpCache *tb_jmp_cache;
+    struct TBAsyncCPU *tb_async_cpu;
 
     GArray *gdb_regs;
     int gdb_num_regs;
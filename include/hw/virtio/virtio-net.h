@@ -19,7 +19,9 @@
 #include "hw/virtio/virtio.h"
 #include "net/announce.h"
 #include "qemu/option_int.h"
+#include "qemu/rcu.h"
 #include "qom/object.h"
+#include "qapi/qapi-types-virtio.h"
 
 #include "ebpf/ebpf_rss.h"
 
@@ -155,6 +157,33 @@ typedef struct VirtioNetRssData {
     uint16_t default_queue;
 } VirtioNetRssData;
 
+/*
+ * The receive filters and the RSS configuration as seen by the receive path.
+ * Queue pairs may receive in IOThreads while the main loop processes the
+ * control virtqueue, so the main loop publishes a new copy through RCU after
+ * every change and the receive path never looks at the fields of VirtIONet.
+ */
+typedef struct VirtIONetRxFilter {
+    struct rcu_head rcu;
+    uint8_t mac[ETH_ALEN];
+    uint8_t promisc;
+    uint8_t allmulti;
+    uint8_t alluni;
+    uint8_t nomulti;
+    uint8_t nouni;
+    uint8_t nobcast;
+    uint32_t mac_table_in_use;
+    uint32_t mac_table_first_multi;
+    uint8_t mac_table_multi_overflow;
+    uint8_t mac_table_uni_overflow;
+    uint8_t mac_table_macs[MAC_TABLE_ENTRIES * ETH_ALEN];
+    uint32_t vlans[MAX_VLAN >> 5];
+    uint16_t curr_queue_pairs;
+    /* rss.indirections_table points to indirections_table below */
+    VirtioNetRssData rss;
+    uint16_t indirections_table[VIRTIO_NET_RSS_MAX_TABLE_LEN];
+} VirtIONetRxFilter;
+
 typedef struct VirtIONetQueue {
     VirtQueue *rx_vq;
     VirtQueue *tx_vq;
@@ -165,6 +194,9 @@ typedef struct VirtIONetQueue {
         VirtQueueElement *elem;
     } async_tx;
     struct VirtIONet *n;
+    /* AioContext the queue pair is processed in, NULL for the main loop */
+    AioContext *ctx;
+    struct NetRxPkt *rx_pkt;
 } VirtIONetQueue;
 
 struct VirtIONet {
@@ -227,10 +259,16 @@ struct VirtIONet {
     bool primary_opts_from_json;
     NotifierWithReturn migration_state;
     VirtioNetRssData rss_data;
-    struct NetRxPkt *rx_pkt;
+    VirtIONetRxFilter *rx_filter;
     struct EBPFRSSContext ebpf_rss;
     uint32_t nr_ebpf_rss_fds;
     char **ebpf_rss_fds;
+    IOThreadVirtQueueMappingList *iothread_vq_mapping_list;
+    /* Per queue pair AioContext, NULL unless iothread-vq-mapping is set */
+    AioContext **vq_aio_context;
+    bool ioeventfd_started;
+    /* Packets steered by software RSS to a queue pair in another thread */
+    unsigned rx_forward_pending;
 };
 
 size_t virtio_net_handle_ctrl_iov(VirtIODevice *vdev,
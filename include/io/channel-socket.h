@@ -281,4 +281,33 @@ int qio_channel_socket_set_send_buffer(QIOChannelSocket *ioc,
                                        size_t size,
                                        Error **errp);
 
+/**
+ * qio_channel_socket_set_zero_copy:
+ * @ioc: the socket channel object
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Enable MSG_ZEROCOPY on a connected socket, for example one
+ * returned by qio_channel_socket_accept(), so that it can be
+ * written with QIO_CHANNEL_WRITE_FLAG_ZERO_COPY.
+ *
+ * Returns: 0 on success, or -1 on error.
+ */
+int qio_channel_socket_set_zero_copy(QIOChannelSocket *ioc,
+                                     Error **errp);
+
+/**
+ * qio_channel_socket_poll_zero_copy:
+ * @ioc: the socket channel object
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Collect the zero copy completions that the kernel has already
+ * queued, without waiting for more.  Unlike qio_channel_flush(),
+ * this never blocks.  Afterwards, the kernel no longer references
+ * the buffers of the first @ioc->zero_copy_sent zero copy writes.
+ *
+ * Returns: 0 on success, or -1 on error.
+ */
+int qio_channel_socket_poll_zero_copy(QIOChannelSocket *ioc,
+                                      Error **errp);
+
 #endif /* QIO_CHANNEL_SOCKET_H */
@@ -91,4 +91,34 @@ int migrate_add_blocker_normal(Error **reasonp, Error **errp);
  */
 int migrate_add_blocker_modes(Error **reasonp, unsigned modes, Error **errp);
 
+/**
+ * @migrate_add_postcopy_blocker - prevent postcopy and release-ram from
+ *                                 proceeding
+ *
+ * @reasonp - address of an error to be returned whenever postcopy or
+ *            release-ram is attempted
+ *
+ * @errp - [out] The reason (if any) we cannot block postcopy right now.
+ *
+ * @returns - 0 on success, -EBUSY on failure, with errp set.
+ *
+ * Both postcopy and release-ram discard guest RAM, on the destination and on
+ * the source respectively, without checking ram_block_discard_disable().
+ * Users that rely on guest RAM not being discarded must add this blocker.
+ *
+ * *@reasonp is freed and set to NULL if failure is returned.
+ * On success, the caller must not free @reasonp, except by
+ *   calling migrate_del_postcopy_blocker.
+ */
+int migrate_add_postcopy_blocker(Error **reasonp, Error **errp);
+
+/**
+ * @migrate_del_postcopy_blocker - remove a postcopy blocker and free it.
+ *
+ * @reasonp - address of the error blocking postcopy
+ *
+ * This function frees *@reasonp and sets it to NULL.
+ */
+void migrate_del_postcopy_blocker(Error **reasonp);
+
 #endif
@@ -82,6 +82,7 @@ typedef void (NetAnnounce)(NetClientState *);
 typedef bool (SetSteeringEBPF)(NetClientState *, int);
 typedef bool (NetCheckPeerType)(NetClientState *, ObjectClass *, Error **);
 typedef struct vhost_net *(GetVHostNet)(NetClientState *nc);
+typedef void (NetSetAioContext)(NetClientState *, AioContext *);
 
 typedef struct NetClientInfo {
     NetClientDriver type;
@@ -110,6 +111,7 @@ typedef struct NetClientInfo {
     SetSteeringEBPF *set_steering_ebpf;
     NetCheckPeerType *check_peer_type;
     GetVHostNet *get_vhost_net;
+    NetSetAioContext *set_aio_context;
 } NetClientInfo;
 
 struct NetClientState {
@@ -131,6 +133,10 @@ struct NetClientState {
     bool do_not_pad; /* do not pad to the minimum ethernet frame length */
     bool is_datapath;
     QTAILQ_HEAD(, NetFilterState) filters;
+    /* Set with qemu_set_aio_context(), NULL for the main loop */
+    AioContext *ctx;
+    /* Packets from other threads waiting to be sent from @ctx */
+    unsigned int send_deferred;
 };
 
 typedef QTAILQ_HEAD(NetClientStateList, NetClientState) NetClientStateList;
@@ -210,6 +216,21 @@ void qemu_set_vnet_hdr_len(NetClientState *nc, int len);
 bool qemu_get_vnet_hash_supported_types(NetClientState *nc, uint32_t *types);
 int qemu_set_vnet_le(NetClientState *nc, bool is_le);
 int qemu_set_vnet_be(NetClientState *nc, bool is_be);
+bool qemu_can_set_aio_context(NetClientState *nc);
+/**
+ * qemu_set_aio_context: Move a net client's host I/O to an AioContext
+ * @nc: The net client, usually the peer of a NIC subqueue
+ * @ctx: The AioContext to poll the backend from, or %NULL for the main loop
+ *
+ * The caller must ensure that no packets are being delivered through @nc
+ * concurrently, e.g. by calling this from the old AioContext or while the
+ * device's datapath is stopped.
+ *
+ * Packets that are sent without a completion callback through @nc or its
+ * peer from another thread, such as self-announcements from the main loop,
+ * are then copied and sent from @ctx.
+ */
+void qemu_set_aio_context(NetClientState *nc, AioContext *ctx);
 void qemu_macaddr_default_if_unset(MACAddr *macaddr);
 /**
  * qemu_find_nic_info: Obtain NIC configuration information
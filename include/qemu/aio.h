@@ -286,6 +286,8 @@ struct AioContext {
 
 #ifdef CONFIG_LINUX_AIO
     struct LinuxAioState *linux_aio;
+    /* aio_setup_linux_aio() failed, don't retry */
+    bool linux_aio_failed;
 #endif
 #ifdef CONFIG_LINUX_IO_URING
     /* State for file descriptor monitoring using Linux io_uring */
@@ -295,6 +297,20 @@ struct AioContext {
 
     /* Pending callback state for cqe handlers */
     CqeHandlerSimpleQ cqe_handler_ready_list;
+
+    /* Registered buffers and files can be used with this io_uring */
+    bool io_uring_fixed;
+    QLIST_ENTRY(AioContext) io_uring_fixed_next;
+
+    /* SQPOLL configuration, see AioContextParams */
+    bool io_uring_sqpoll;
+    uint32_t io_uring_sqpoll_idle;
+    int io_uring_sqpoll_cpu;
+
+    /* SQPOLL statistics, see AioContextSqpollStats */
+    uint64_t io_uring_sqpoll_submissions;
+    uint64_t io_uring_sqpoll_syscalls_avoided;
+    uint64_t io_uring_sqpoll_wakeups;
 #endif /* CONFIG_LINUX_IO_URING */
 
     /* TimerLists for calling timers - one per clock type.  Has its own
@@ -336,6 +352,21 @@ struct AioContext {
     bool initialized;
 };
 
+/**
+ * AioContextParams: Parameters that are fixed when an AioContext is created
+ * @io_uring_sqpoll: let a kernel thread poll the io_uring submission queue, so
+ *                   that submitting requests does not need a system call
+ * @io_uring_sqpoll_idle: milliseconds after which the kernel thread goes to
+ *                        sleep when there is nothing to submit, 0 for the
+ *                        kernel default
+ * @io_uring_sqpoll_cpu: CPU to bind the kernel thread to, or -1
+ */
+typedef struct AioContextParams {
+    bool io_uring_sqpoll;
+    uint32_t io_uring_sqpoll_idle;
+    int io_uring_sqpoll_cpu;
+} AioContextParams;
+
 /**
  * aio_context_new: Allocate a new AioContext.
  *
@@ -345,6 +376,15 @@ struct AioContext {
  */
 AioContext *aio_context_new(Error **errp);
 
+/**
+ * aio_context_new_params: Allocate a new AioContext with @params.
+ *
+ * Like aio_context_new(), but @params may request features that must be set
+ * up when the AioContext is created.
+ */
+AioContext *aio_context_new_params(const AioContextParams *params,
+                                   Error **errp);
+
 /**
  * aio_context_ref:
  * @ctx: The AioContext to operate on.
@@ -585,7 +625,11 @@ GSource *aio_get_g_source(AioContext *ctx);
 /* Return the ThreadPoolAio bound to this AioContext */
 struct ThreadPoolAio *aio_get_thread_pool(AioContext *ctx);
 
-/* Setup the LinuxAioState bound to this AioContext */
+/*
+ * Setup the LinuxAioState bound to this AioContext. Returns NULL if Linux AIO
+ * cannot be used in this AioContext. Only the call that fails to set it up
+ * sets @errp, later calls return NULL without retrying.
+ */
 struct LinuxAioState *aio_setup_linux_aio(AioContext *ctx, Error **errp);
 
 /* Return the LinuxAioState bound to this AioContext */
@@ -847,6 +891,93 @@ static inline bool aio_has_io_uring(void)
  */
 void aio_add_sqe(void (*prep_sqe)(struct io_uring_sqe *sqe, void *opaque),
                  void *opaque, CqeHandler *cqe_handler);
+
+/**
+ * aio_register_fixed_buf: Register memory with io_uring
+ * @host: start of the memory area
+ * @size: size of the memory area in bytes
+ *
+ * Registers the memory area with the io_uring of every AioContext, so that
+ * requests whose buffer lies inside it can use fixed-buffer operations and
+ * the kernel does not have to pin the pages for each request.
+ *
+ * Registrations are reference counted and each call must be paired with a call
+ * to aio_unregister_fixed_buf() with the same arguments. Failing to register
+ * the memory (for example because of RLIMIT_MEMLOCK) is not an error,
+ * aio_fixed_buf_index() just does not find it then.
+ */
+void aio_register_fixed_buf(void *host, size_t size);
+
+/**
+ * aio_unregister_fixed_buf: Undo aio_register_fixed_buf()
+ * @host: start of the memory area
+ * @size: size of the memory area in bytes
+ *
+ * No requests on buffers inside the memory area may be in flight.
+ */
+void aio_unregister_fixed_buf(void *host, size_t size);
+
+/**
+ * aio_fixed_buf_index: Look up a buffer in registered memory
+ * @buf: start of the buffer
+ * @len: length of the buffer in bytes
+ *
+ * Returns: the index to use with io_uring_prep_read_fixed() and
+ * io_uring_prep_write_fixed() in the current AioContext, or -1 if the buffer
+ * does not lie inside registered memory.
+ */
+int aio_fixed_buf_index(const void *buf, size_t len);
+
+/**
+ * aio_register_fixed_file: Register a file descriptor with io_uring
+ * @fd: the file descriptor
+ *
+ * Registers @fd with the io_uring of every AioContext, so that requests on it
+ * can use IOSQE_FIXED_FILE and the kernel does not have to look up the file
+ * for each request. The registration holds a reference to the open file
+ * description until aio_unregister_fixed_file() is called.
+ *
+ * The index is only valid in AioContexts whose io_uring_fixed is true, requests
+ * in other AioContexts must keep using @fd.
+ *
+ * Returns: the index to use instead of @fd with IOSQE_FIXED_FILE, or -1 if @fd
+ * could not be registered, including when no io_uring has a registered file
+ * table.
+ */
+int aio_register_fixed_file(int fd);
+
+/**
+ * AioContextSqpollStats: io_uring SQPOLL statistics of an AioContext
+ * @submissions: number of times that requests were submitted
+ * @syscalls_avoided: submissions that did not need a system call because the
+ *                    kernel thread was polling the submission queue
+ * @wakeups: submissions that needed a system call to wake up the kernel thread
+ */
+typedef struct AioContextSqpollStats {
+    uint64_t submissions;
+    uint64_t syscalls_avoided;
+    uint64_t wakeups;
+} AioContextSqpollStats;
+
+/**
+ * aio_context_get_sqpoll_stats: Get io_uring SQPOLL statistics
+ * @ctx: the AioContext
+ * @stats: filled in with the statistics
+ *
+ * May be called from any thread.
+ *
+ * Returns: false if @ctx does not use io_uring SQPOLL, true otherwise
+ */
+bool aio_context_get_sqpoll_stats(AioContext *ctx,
+                                  AioContextSqpollStats *stats);
+
+/**
+ * aio_unregister_fixed_file: Undo aio_register_fixed_file()
+ * @index: the index returned by aio_register_fixed_file(), or -1
+ *
+ * No requests on the file may be in flight.
+ */
+void aio_unregister_fixed_file(int index);
 #endif /* CONFIG_LINUX_IO_URING */
 
 #endif
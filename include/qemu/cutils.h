@@ -195,6 +195,23 @@ bool buffer_is_zero_ool(const void *vbuf, size_t len);
 bool buffer_is_zero_ge256(const void *vbuf, size_t len);
 bool test_buffer_is_zero_next_accel(void);
 
+/**
+ * buffer_is_zero_batch:
+ * @bufs: the buffers to test
+ * @n: number of buffers
+ * @len: length of each buffer, at least 256 bytes
+ * @zero: set @zero[i] to whether @bufs[i] is all zeroes
+ *
+ * Equivalent to calling buffer_is_zero() on each buffer, but resolves the
+ * accelerated implementation once for the whole array and prefetches the
+ * next buffer while testing the current one.  Meant for arrays of guest
+ * pages.
+ *
+ * Returns: the number of buffers that are all zeroes.
+ */
+size_t buffer_is_zero_batch(const void * const *bufs, size_t n, size_t len,
+                            bool *zero);
+
 static inline bool buffer_is_zero_sample3(const char *buf, size_t len)
 {
     /*
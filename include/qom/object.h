@@ -988,6 +988,23 @@ ObjectClass *object_class_get_parent(ObjectClass *klass);
  */
 const char *object_class_get_name(ObjectClass *klass);
 
+/**
+ * object_class_get_instance_size:
+ * @klass: The class to obtain the instance size for.
+ *
+ * Returns: The size of an instance of @klass.
+ */
+size_t object_class_get_instance_size(ObjectClass *klass);
+
+/**
+ * object_class_get_instance_align:
+ * @klass: The class to obtain the instance alignment for.
+ *
+ * Returns: The alignment required by an instance of @klass, or 0 if
+ * the default alignment is sufficient.
+ */
+size_t object_class_get_instance_align(ObjectClass *klass);
+
 /**
  * object_class_is_abstract:
  * @klass: The class to obtain the abstractness for.
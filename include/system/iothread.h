@@ -38,6 +38,11 @@ struct IOThread {
     int64_t poll_max_ns;
     int64_t poll_grow;
     int64_t poll_shrink;
+
+    /* io_uring SQPOLL parameters, fixed once the AioContext is created */
+    bool io_uring_sqpoll;
+    int64_t io_uring_sqpoll_idle;
+    int64_t io_uring_sqpoll_cpu;
 };
 typedef struct IOThread IOThread;
 
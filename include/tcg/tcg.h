@@ -343,6 +343,30 @@ static inline TCGRegSet output_pref(const TCGOp *op, unsigned i)
     return i < ARRAY_SIZE(op->output_pref) ? op->output_pref[i] : 0;
 }
 
+/*
+ * Host addresses embedded in the code of a TB, recorded so that the
+ * persistent TB cache can reload the code into another process.
+ */
+typedef enum TCGCacheRelocType {
+    TCG_CACHE_RELOC_PC32,       /* 32-bit pc-relative displacement */
+    TCG_CACHE_RELOC_ABS64,      /* 64-bit absolute address */
+} TCGCacheRelocType;
+
+typedef enum TCGCacheRelocBase {
+    TCG_CACHE_BASE_TEXT,        /* offset from tcg_cache_text_start */
+    TCG_CACHE_BASE_PROLOGUE,    /* offset from tcg_qemu_tb_exec */
+} TCGCacheRelocBase;
+
+typedef struct TCGCacheReloc {
+    uint32_t offset;            /* from the start of the TB code */
+    uint8_t type;               /* TCGCacheRelocType */
+    uint8_t base;               /* TCGCacheRelocBase */
+    uint16_t pad;
+    int64_t addend;
+} TCGCacheReloc;
+
+#define TCG_MAX_CACHE_RELOCS 256
+
 struct TCGContext {
     uintptr_t pool_cur, pool_end;
     TCGPool *pool_first, *pool_current, *pool_first_large;
@@ -436,6 +460,46 @@ struct TCGContext {
     uint16_t gen_insn_end_off[TCG_MAX_INSNS];
     uint64_t *gen_insn_data;
 
+    /*
+     * When cache_record is set, the TB is being generated for the
+     * persistent TB cache: the backend reports every host address it
+     * embeds with tcg_cache_reloc(), or sets cache_tainted.
+     */
+    bool cache_record;
+    bool cache_tainted;
+    int nb_cache_relocs;
+    TCGCacheReloc cache_relocs[TCG_MAX_CACHE_RELOCS];
+
+    /*
+     * gen_async is set while a helper thread translates a TB ahead of
+     * time; the translation is abandoned if it needs the softmmu TLB.
+     * gen_succ records the destinations of direct jumps out of the TB.
+     */
+    bool gen_async;
+    int nb_gen_succ;
+    uint64_t gen_succ[2];
+
+    /*
+     * When tier_count is set, the TB decrements the counter at that
+     * address on entry and exits via exitreq_label once it goes negative.
+     */
+    int32_t *tier_count;
+
+    /*
+     * When trace_slot is set, the goto_tb with that index, which must jump
+     * to trace_pc, is left out and its position recorded in trace_op; the
+     * code for trace_pc is then translated there.  trace_dest tells whether
+     * the last translator_use_goto_tb was for trace_pc.  goto_tb_used and
+     * goto_tb_skip track which of the two chained exits each part of the
+     * trace may use.
+     */
+    int trace_slot;
+    uint64_t trace_pc;
+    bool trace_dest;
+    TCGOp *trace_op;
+    uint8_t goto_tb_used;
+    uint8_t goto_tb_skip;
+
     /* Exit to translator on overflow. */
     sigjmp_buf jmp_trans;
 };
@@ -456,8 +520,20 @@ extern const void *tcg_code_gen_epilogue;
 extern uintptr_t tcg_splitwx_diff;
 extern TCGv_env tcg_env;
 
+/* Range of host text that TB cache relocations may refer to. */
+extern uintptr_t tcg_cache_text_start, tcg_cache_text_end;
+extern size_t tcg_prologue_size;
+
 bool in_code_gen_buffer(const void *p);
 
+/**
+ * tcg_cache_supported:
+ *
+ * Return true if the backend records host relocations, so that TBs
+ * can be saved to and reloaded from the persistent TB cache.
+ */
+bool tcg_cache_supported(void);
+
 #ifdef CONFIG_DEBUG_TCG
 const void *tcg_splitwx_to_rx(void *rw);
 void *tcg_splitwx_to_rw(const void *rx);
@@ -802,6 +878,15 @@ void tcg_op_remove(TCGContext *s, TCGOp *op);
  */
 void tcg_remove_ops_after(TCGOp *op);
 
+/**
+ * tcg_move_ops_after:
+ * @at: target operation
+ * @op: last operation to leave in place
+ *
+ * Move the opcodes emitted since @op so that they follow @at.
+ */
+void tcg_move_ops_after(TCGOp *at, TCGOp *op);
+
 void tcg_optimize(TCGContext *s);
 
 TCGLabel *gen_new_label(void);
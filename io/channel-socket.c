@@ -98,6 +98,34 @@ int qio_channel_socket_set_send_buffer(QIOChannelSocket *ioc,
     return 0;
 }
 
+int qio_channel_socket_set_zero_copy(QIOChannelSocket *ioc, Error **errp)
+{
+#ifdef QEMU_MSG_ZEROCOPY
+    int v = 1;
+
+    if (setsockopt(ioc->fd, SOL_SOCKET, SO_ZEROCOPY, &v, sizeof(v)) < 0) {
+        error_setg_errno(errp, errno, "Unable to enable MSG_ZEROCOPY");
+        return -1;
+    }
+
+    qio_channel_set_feature(QIO_CHANNEL(ioc),
+                            QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY);
+    return 0;
+#else
+    error_setg(errp, "MSG_ZEROCOPY is not supported by this host");
+    return -1;
+#endif
+}
+
+int qio_channel_socket_poll_zero_copy(QIOChannelSocket *ioc, Error **errp)
+{
+#ifdef QEMU_MSG_ZEROCOPY
+    return qio_channel_socket_flush_internal(QIO_CHANNEL(ioc), false, errp);
+#else
+    return 0;
+#endif
+}
+
 static int
 qio_channel_socket_set_fd(QIOChannelSocket *sioc,
                           int fd,
@@ -688,6 +716,11 @@ static ssize_t qio_channel_socket_writev(QIOChannel *ioc,
                     }
                     zerocopy_flushed_once = true;
                     goto retry;
+                } else if (flags & QIO_CHANNEL_WRITE_FLAG_ZERO_COPY_FALLBACK) {
+                    /* RLIMIT_MEMLOCK is exhausted, copy this write instead */
+                    sflags &= ~MSG_ZEROCOPY;
+                    flags &= ~QIO_CHANNEL_WRITE_FLAG_ZERO_COPY;
+                    goto retry;
                 } else {
                     error_setg_errno(errp, errno,
                                      "Process can't lock enough memory for "
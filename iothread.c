@@ -103,6 +103,7 @@ static void iothread_instance_init(Object *obj)
     IOThread *iothread = IOTHREAD(obj);
 
     iothread->poll_max_ns = IOTHREAD_POLL_MAX_NS_DEFAULT;
+    iothread->io_uring_sqpoll_cpu = -1;
     iothread->thread_id = -1;
     qemu_sem_init(&iothread->init_done_sem, 0);
     /* By default, we don't run gcontext */
@@ -182,10 +183,26 @@ static void iothread_init(EventLoopBase *base, Error **errp)
     Error *local_error = NULL;
     IOThread *iothread = IOTHREAD(base);
     g_autofree char *thread_name = NULL;
+    AioContextParams params = {
+        .io_uring_sqpoll = iothread->io_uring_sqpoll,
+        .io_uring_sqpoll_idle = iothread->io_uring_sqpoll_idle,
+        .io_uring_sqpoll_cpu = iothread->io_uring_sqpoll_cpu,
+    };
+
+    if (iothread->io_uring_sqpoll_idle > UINT32_MAX) {
+        error_setg(errp, "io-uring-sqpoll-idle value must be in range "
+                   "[0, %" PRIu32 "]", UINT32_MAX);
+        return;
+    }
+    if (iothread->io_uring_sqpoll_cpu > INT_MAX) {
+        error_setg(errp, "io-uring-sqpoll-cpu value must be in range "
+                   "[0, %d]", INT_MAX);
+        return;
+    }
 
     iothread->stopping = false;
     iothread->running = true;
-    iothread->ctx = aio_context_new(errp);
+    iothread->ctx = aio_context_new_params(&params, errp);
     if (!iothread->ctx) {
         return;
     }
@@ -233,6 +250,12 @@ static IOThreadParamInfo poll_grow_info = {
 static IOThreadParamInfo poll_shrink_info = {
     "poll-shrink", offsetof(IOThread, poll_shrink),
 };
+static IOThreadParamInfo io_uring_sqpoll_idle_info = {
+    "io-uring-sqpoll-idle", offsetof(IOThread, io_uring_sqpoll_idle),
+};
+static IOThreadParamInfo io_uring_sqpoll_cpu_info = {
+    "io-uring-sqpoll-cpu", offsetof(IOThread, io_uring_sqpoll_cpu),
+};
 
 static void iothread_get_param(Object *obj, Visitor *v,
         const char *name, IOThreadParamInfo *info, Error **errp)
@@ -292,6 +315,43 @@ static void iothread_set_poll_param(Object *obj, Visitor *v,
     }
 }
 
+static bool iothread_check_not_started(IOThread *iothread, const char *name,
+                                       Error **errp)
+{
+    if (iothread->ctx) {
+        error_setg(errp, "%s can only be set when the iothread is created",
+                   name);
+        return false;
+    }
+    return true;
+}
+
+static void iothread_set_sqpoll_param(Object *obj, Visitor *v,
+        const char *name, void *opaque, Error **errp)
+{
+    IOThreadParamInfo *info = opaque;
+
+    if (!iothread_check_not_started(IOTHREAD(obj), info->name, errp)) {
+        return;
+    }
+    iothread_set_param(obj, v, name, info, errp);
+}
+
+static bool iothread_get_sqpoll(Object *obj, Error **errp)
+{
+    return IOTHREAD(obj)->io_uring_sqpoll;
+}
+
+static void iothread_set_sqpoll(Object *obj, bool value, Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+
+    if (!iothread_check_not_started(iothread, "io-uring-sqpoll", errp)) {
+        return;
+    }
+    iothread->io_uring_sqpoll = value;
+}
+
 static void iothread_class_init(ObjectClass *klass, const void *class_data)
 {
     EventLoopBaseClass *bc = EVENT_LOOP_BASE_CLASS(klass);
@@ -311,6 +371,16 @@ static void iothread_class_init(ObjectClass *klass, const void *class_data)
                               iothread_get_poll_param,
                               iothread_set_poll_param,
                               NULL, &poll_shrink_info);
+    object_class_property_add_bool(klass, "io-uring-sqpoll",
+                                   iothread_get_sqpoll, iothread_set_sqpoll);
+    object_class_property_add(klass, "io-uring-sqpoll-idle", "int",
+                              iothread_get_poll_param,
+                              iothread_set_sqpoll_param,
+                              NULL, &io_uring_sqpoll_idle_info);
+    object_class_property_add(klass, "io-uring-sqpoll-cpu", "int",
+                              iothread_get_poll_param,
+                              iothread_set_sqpoll_param,
+                              NULL, &io_uring_sqpoll_cpu_info);
 }
 
 static const TypeInfo iothread_info = {
@@ -358,6 +428,21 @@ static int query_one_iothread(Object *object, void *opaque)
     info->poll_shrink = iothread->poll_shrink;
     info->aio_max_batch = iothread->parent_obj.aio_max_batch;
 
+#ifdef CONFIG_LINUX_IO_URING
+    if (iothread->ctx) {
+        AioContextSqpollStats stats;
+
+        if (aio_context_get_sqpoll_stats(iothread->ctx, &stats)) {
+            info->io_uring_sqpoll = g_new(IOThreadSqpollStats, 1);
+            *info->io_uring_sqpoll = (IOThreadSqpollStats) {
+                .submissions = stats.submissions,
+                .syscalls_avoided = stats.syscalls_avoided,
+                .wakeups = stats.wakeups,
+            };
+        }
+    }
+#endif
+
     QAPI_LIST_APPEND(*tail, info);
     return 0;
 }
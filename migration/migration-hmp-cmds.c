@@ -132,6 +132,54 @@ static void migration_dump_blocktime(Monitor *mon, MigrationInfo *info)
     }
 }
 
+static void migration_dump_downtime(Monitor *mon, MigrationInfo *info)
+{
+    MigrationDowntimeStats *stats = info->downtime_breakdown;
+    MigrationDeviceDowntimeList *item;
+
+    if (info->ram && info->ram->dirty_sync_count) {
+        uint64List *bucket = info->ram->dirty_rate_dist;
+        int count = 0;
+
+        monitor_printf(mon, "Dirty Rate Distribution (MiB/s):\n");
+
+        for (; bucket; bucket = bucket->next, count++) {
+            if (!bucket->value) {
+                continue;
+            }
+            if (!count) {
+                monitor_printf(mon, "  [ %6s - %6d ]: %10" PRIu64 "\n",
+                               "0", 1, bucket->value);
+            } else if (!bucket->next) {
+                monitor_printf(mon, "  [ %6u - %6s ]: %10" PRIu64 "\n",
+                               1U << (count - 1), "", bucket->value);
+            } else {
+                monitor_printf(mon, "  [ %6u - %6u ]: %10" PRIu64 "\n",
+                               1U << (count - 1), 1U << count,
+                               bucket->value);
+            }
+        }
+    }
+
+    if (!stats) {
+        return;
+    }
+
+    monitor_printf(mon, "Downtime Breakdown (us):");
+    if (stats->has_stop) {
+        monitor_printf(mon, " stop=%" PRIu64 ",", stats->stop);
+    }
+    monitor_printf(mon, " iterable=%" PRIu64 ", non_iterable=%" PRIu64 "\n",
+                   stats->iterable, stats->non_iterable);
+
+    for (item = stats->devices; item; item = item->next) {
+        monitor_printf(mon, "  %-12s %s/%" PRIu32 ": %" PRIu64 "\n",
+                       MigrationDowntimeSection_str(item->value->section),
+                       item->value->id, item->value->instance_id,
+                       item->value->time);
+    }
+}
+
 void hmp_info_migrate(Monitor *mon, const QDict *qdict)
 {
     bool show_all = qdict_get_try_bool(qdict, "all", false);
@@ -221,6 +269,13 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "    Page Types: \tnormal=%" PRIu64
                        ", zero=%" PRIu64 "\n",
                        info->ram->normal, info->ram->duplicate);
+        if (info->ram->multifd_compressed_pages ||
+            info->ram->multifd_raw_pages) {
+            monitor_printf(mon, "    Compression: \tcompressed=%" PRIu64
+                           ", raw=%" PRIu64 "\n",
+                           info->ram->multifd_compressed_pages,
+                           info->ram->multifd_raw_pages);
+        }
         monitor_printf(mon, "  Page Rates (pps): \ttransfer=%" PRIu64,
                        info->ram->pages_per_second);
         if (info->ram->dirty_pages_rate) {
@@ -244,6 +299,12 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                            info->ram->dirty_sync_missed_zero_copy);
         }
         monitor_printf(mon, "\n");
+        if (info->ram->dirty_sync_count) {
+            monitor_printf(mon, "  Dirty Sync (us): \tlast=%" PRIu64
+                           ", total=%" PRIu64 "\n",
+                           info->ram->dirty_sync_time_last,
+                           info->ram->dirty_sync_time);
+        }
     }
 
     if (!show_all) {
@@ -259,14 +320,18 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        ", miss=%" PRIu64 "\n"
                        "  miss_rate=%0.2f"
                        ", encode_rate=%0.2f"
-                       ", overflow=%" PRIu64 "\n",
+                       ", overflow=%" PRIu64 "\n"
+                       "  cache_hit=%" PRIu64
+                       ", cache_eviction=%" PRIu64 "\n",
                        info->xbzrle_cache->cache_size,
                        info->xbzrle_cache->bytes,
                        info->xbzrle_cache->pages,
                        info->xbzrle_cache->cache_miss,
                        info->xbzrle_cache->cache_miss_rate,
                        info->xbzrle_cache->encoding_rate,
-                       info->xbzrle_cache->overflow);
+                       info->xbzrle_cache->overflow,
+                       info->xbzrle_cache->cache_hit,
+                       info->xbzrle_cache->cache_eviction);
     }
 
     if (info->has_cpu_throttle_percentage) {
@@ -284,6 +349,7 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        info->dirty_limit_ring_full_time);
     }
 
+    migration_dump_downtime(mon, info);
     migration_dump_blocktime(mon, info);
 out:
     qapi_free_MigrationInfo(info);
@@ -679,6 +745,19 @@ void hmp_migrate_set_parameter(Monitor *mon, const QDict *qdict)
         p->has_multifd_zstd_level = true;
         visit_type_uint8(v, param, &p->multifd_zstd_level, &err);
         break;
+    case MIGRATION_PARAMETER_MULTIFD_LZ4_ACCELERATION:
+        p->has_multifd_lz4_acceleration = true;
+        visit_type_uint32(v, param, &p->multifd_lz4_acceleration, &err);
+        break;
+    case MIGRATION_PARAMETER_MULTIFD_COMPRESSION_RAW_THRESHOLD:
+        p->has_multifd_compression_raw_threshold = true;
+        visit_type_uint8(v, param, &p->multifd_compression_raw_threshold,
+                         &err);
+        break;
+    case MIGRATION_PARAMETER_DIRTY_SYNC_THREADS:
+        p->has_dirty_sync_threads = true;
+        visit_type_uint8(v, param, &p->dirty_sync_threads, &err);
+        break;
     case MIGRATION_PARAMETER_ZERO_PAGE_DETECTION:
         p->has_zero_page_detection = true;
         visit_type_ZeroPageDetection(v, param, &p->zero_page_detection, &err);
@@ -25,6 +25,13 @@
  */
 #define RATE_LIMIT_DISABLED 0
 
+/*
+ * Number of buckets of the dirty rate distribution.  Bucket 0 counts
+ * rates below 1 MiB/s, bucket N covers [2^(N-1), 2^N) MiB/s and the
+ * last one also takes everything above it.
+ */
+#define DIRTY_RATE_DIST_BUCKETS 16
+
 /*
  * These are the ram migration statistic counters.  It is loosely
  * based on MigrationStats.
@@ -42,6 +49,11 @@ typedef struct {
      * Number of pages dirtied per second.
      */
     uint64_t dirty_pages_rate;
+    /*
+     * Histogram of the dirty rates measured at each bitmap
+     * synchronization, see DIRTY_RATE_DIST_BUCKETS.
+     */
+    uint64_t dirty_rate_dist[DIRTY_RATE_DIST_BUCKETS];
     /*
      * Number of times we have synchronized guest bitmaps.
      */
@@ -51,6 +63,15 @@ typedef struct {
      * copy.
      */
     uint64_t dirty_sync_missed_zero_copy;
+    /*
+     * Total time spent synchronizing guest bitmaps, in microseconds.
+     */
+    uint64_t dirty_sync_time;
+    /*
+     * Time taken by the last guest bitmap synchronization, in
+     * microseconds.
+     */
+    uint64_t dirty_sync_time_last;
     /*
      * Number of bytes sent at migration completion stage while the
      * guest is stopped.
@@ -60,6 +81,16 @@ typedef struct {
      * Number of bytes sent through multifd channels.
      */
     uint64_t multifd_bytes;
+    /*
+     * Number of non-zero pages that multifd handed to the compression
+     * method.
+     */
+    uint64_t multifd_compressed_pages;
+    /*
+     * Number of non-zero pages that multifd sent uncompressed because
+     * they looked incompressible.
+     */
+    uint64_t multifd_raw_pages;
     /*
      * Number of pages transferred that were not full of zeros.
      */
@@ -94,6 +94,7 @@ static MigrationState *current_migration;
 static MigrationIncomingState *current_incoming;
 
 static GSList *migration_blockers[MIG_MODE__MAX];
+static GSList *postcopy_blockers;
 
 static bool migration_object_check(MigrationState *ms, Error **errp);
 static bool migration_switchover_start(MigrationState *s, Error **errp);
@@ -274,8 +275,92 @@ static gint page_request_addr_cmp(gconstpointer ap, gconstpointer bp)
     return (a > b) - (a < b);
 }
 
+static MigrationDowntimeStats *
+migration_downtime_stats_get(MigrationDowntimeStats **stats)
+{
+    if (!*stats) {
+        *stats = g_new0(MigrationDowntimeStats, 1);
+    }
+    return *stats;
+}
+
+static void migration_downtime_record(MigrationDowntimeStats *stats,
+                                      MigrationDowntimeSection section,
+                                      const char *idstr,
+                                      uint32_t instance_id,
+                                      int64_t time_us)
+{
+    MigrationDeviceDowntime *dev = g_new0(MigrationDeviceDowntime, 1);
+
+    dev->id = g_strdup(idstr);
+    dev->instance_id = instance_id;
+    dev->section = section;
+    dev->time = time_us;
+    QAPI_LIST_PREPEND(stats->devices, dev);
+
+    if (section == MIGRATION_DOWNTIME_SECTION_ITERABLE) {
+        stats->iterable += time_us;
+    } else {
+        stats->non_iterable += time_us;
+    }
+}
+
+/*
+ * Only the switchover of a migration (or of a background snapshot) is
+ * accounted, not COLO checkpoints or savevm snapshots which share the
+ * same device save paths.
+ */
+static bool migration_downtime_recording(MigrationState *s)
+{
+    switch (s->state) {
+    case MIGRATION_STATUS_DEVICE:
+    case MIGRATION_STATUS_POSTCOPY_DEVICE:
+        return true;
+    case MIGRATION_STATUS_ACTIVE:
+        return migrate_background_snapshot();
+    default:
+        return false;
+    }
+}
+
+/* Must be called with the BQL held */
+void migration_downtime_record_save(MigrationDowntimeSection section,
+                                    const char *idstr, uint32_t instance_id,
+                                    int64_t time_us)
+{
+    MigrationState *s = migrate_get_current();
+
+    if (!migration_downtime_recording(s)) {
+        return;
+    }
+
+    migration_downtime_record(migration_downtime_stats_get(&s->downtime_stats),
+                              section, idstr, instance_id, time_us);
+}
+
+void migration_downtime_record_load(MigrationDowntimeSection section,
+                                    const char *idstr, uint32_t instance_id,
+                                    int64_t time_us)
+{
+    MigrationIncomingState *mis = migration_incoming_get_current();
+
+    /*
+     * Only the main load coroutine runs with the BQL; the postcopy
+     * listen thread and the COLO thread load outside of it.
+     */
+    if (!mis->loadvm_co || mis->loadvm_co != qemu_coroutine_self()) {
+        return;
+    }
+
+    migration_downtime_record(
+        migration_downtime_stats_get(&mis->downtime_stats),
+        section, idstr, instance_id, time_us);
+}
+
 static int migration_stop_vm(MigrationState *s, RunState state)
 {
+    MigrationDowntimeStats *stats;
+    int64_t start_us;
     int ret;
 
     migration_downtime_start(s);
@@ -283,7 +368,11 @@ static int migration_stop_vm(MigrationState *s, RunState state)
     s->vm_old_state = runstate_get();
     global_state_store();
 
+    start_us = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
     ret = vm_stop_force_state(state);
+    stats = migration_downtime_stats_get(&s->downtime_stats);
+    stats->has_stop = true;
+    stats->stop = qemu_clock_get_us(QEMU_CLOCK_REALTIME) - start_us;
 
     trace_vmstate_downtime_checkpoint("src-vm-stopped");
     trace_migration_completion_vm_stop(ret);
@@ -771,6 +860,7 @@ process_incoming_migration_co(void *opaque)
     assert(mis->from_src_file);
 
     mis->largest_page_size = qemu_ram_pagesize_largest();
+    g_clear_pointer(&mis->downtime_stats, qapi_free_MigrationDowntimeStats);
     postcopy_state_set(POSTCOPY_INCOMING_NONE);
     migrate_set_state(&mis->state, MIGRATION_STATUS_SETUP,
                       MIGRATION_STATUS_ACTIVE);
@@ -1064,6 +1154,7 @@ static void populate_time_info(MigrationInfo *info, MigrationState *s)
 static void populate_ram_info(MigrationInfo *info, MigrationState *s)
 {
     size_t page_size = qemu_target_page_size();
+    int i;
 
     info->ram = g_malloc0(sizeof(*info->ram));
     info->ram->transferred = migration_transferred_bytes();
@@ -1076,6 +1167,13 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
         qatomic_read(&mig_stats.dirty_sync_count);
     info->ram->dirty_sync_missed_zero_copy =
         qatomic_read(&mig_stats.dirty_sync_missed_zero_copy);
+    info->ram->dirty_sync_time = qatomic_read(&mig_stats.dirty_sync_time);
+    info->ram->dirty_sync_time_last =
+        qatomic_read(&mig_stats.dirty_sync_time_last);
+    for (i = DIRTY_RATE_DIST_BUCKETS - 1; i >= 0; i--) {
+        QAPI_LIST_PREPEND(info->ram->dirty_rate_dist,
+                          qatomic_read(&mig_stats.dirty_rate_dist[i]));
+    }
     info->ram->postcopy_requests =
         qatomic_read(&mig_stats.postcopy_requests);
     info->ram->page_size = page_size;
@@ -1084,6 +1182,9 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
     info->ram->precopy_bytes = qatomic_read(&mig_stats.precopy_bytes);
     info->ram->downtime_bytes = qatomic_read(&mig_stats.downtime_bytes);
     info->ram->postcopy_bytes = qatomic_read(&mig_stats.postcopy_bytes);
+    info->ram->multifd_compressed_pages =
+        qatomic_read(&mig_stats.multifd_compressed_pages);
+    info->ram->multifd_raw_pages = qatomic_read(&mig_stats.multifd_raw_pages);
 
     if (migrate_xbzrle()) {
         info->xbzrle_cache = g_malloc0(sizeof(*info->xbzrle_cache));
@@ -1094,6 +1195,8 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
         info->xbzrle_cache->cache_miss_rate = xbzrle_counters.cache_miss_rate;
         info->xbzrle_cache->encoding_rate = xbzrle_counters.encoding_rate;
         info->xbzrle_cache->overflow = xbzrle_counters.overflow;
+        xbzrle_cache_get_stats(&info->xbzrle_cache->cache_hit,
+                               &info->xbzrle_cache->cache_eviction);
     }
 
     if (cpu_throttle_active()) {
@@ -1117,6 +1220,14 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
     }
 }
 
+static void populate_downtime_info(MigrationInfo *info,
+                                   MigrationDowntimeStats *stats)
+{
+    if (stats) {
+        info->downtime_breakdown = QAPI_CLONE(MigrationDowntimeStats, stats);
+    }
+}
+
 static void fill_source_migration_info(MigrationInfo *info)
 {
     MigrationState *s = migrate_get_current();
@@ -1162,6 +1273,7 @@ static void fill_source_migration_info(MigrationInfo *info)
         populate_time_info(info, s);
         populate_ram_info(info, s);
         migration_populate_vfio_info(info);
+        populate_downtime_info(info, s->downtime_stats);
         break;
     case MIGRATION_STATUS_COLO:
         info->has_status = true;
@@ -1171,6 +1283,7 @@ static void fill_source_migration_info(MigrationInfo *info)
         populate_time_info(info, s);
         populate_ram_info(info, s);
         migration_populate_vfio_info(info);
+        populate_downtime_info(info, s->downtime_stats);
         break;
     case MIGRATION_STATUS_FAILED:
         info->has_status = true;
@@ -1216,6 +1329,7 @@ static void fill_destination_migration_info(MigrationInfo *info)
     case MIGRATION_STATUS_COMPLETED:
         info->has_status = true;
         fill_destination_postcopy_migration_info(info);
+        populate_downtime_info(info, mis->downtime_stats);
         break;
     default:
         return;
@@ -1632,6 +1746,7 @@ int migrate_init(MigrationState *s, Error **errp)
     s->pages_per_second = 0.0;
     s->downtime = 0;
     s->expected_downtime = 0;
+    g_clear_pointer(&s->downtime_stats, qapi_free_MigrationDowntimeStats);
     s->setup_time = 0;
     s->start_postcopy = false;
     s->migration_thread_running = false;
@@ -1745,6 +1860,37 @@ void migrate_del_blocker(Error **reasonp)
     }
 }
 
+int migrate_add_postcopy_blocker(Error **reasonp, Error **errp)
+{
+    ERRP_GUARD();
+
+    /*
+     * The destination discards RAM from the postcopy advise onwards, and the
+     * source from the start of the migration with release-ram.
+     */
+    if ((migration_is_running() &&
+         (migrate_postcopy_ram() || migrate_release_ram())) ||
+        postcopy_state_get() != POSTCOPY_INCOMING_NONE) {
+        error_propagate_prepend(errp, *reasonp,
+                                "disallowing postcopy blocker "
+                                "(postcopy migration in progress) for: ");
+        *reasonp = NULL;
+        return -EBUSY;
+    }
+
+    postcopy_blockers = g_slist_prepend(postcopy_blockers, *reasonp);
+    return 0;
+}
+
+void migrate_del_postcopy_blocker(Error **reasonp)
+{
+    if (*reasonp) {
+        postcopy_blockers = g_slist_remove(postcopy_blockers, *reasonp);
+        error_free(*reasonp);
+        *reasonp = NULL;
+    }
+}
+
 void qmp_migrate_incoming(const char *uri, bool has_channels,
                           MigrationChannelList *channels,
                           bool has_exit_on_error, bool exit_on_error,
@@ -1880,6 +2026,16 @@ bool migration_is_blocked(Error **errp)
     return false;
 }
 
+bool migration_postcopy_is_blocked(Error **errp)
+{
+    if (postcopy_blockers) {
+        error_propagate(errp, error_copy(postcopy_blockers->data));
+        return true;
+    }
+
+    return false;
+}
+
 /* Returns true if continue to migrate, or false if error detected */
 static bool migrate_prepare(MigrationState *s, bool resume, Error **errp)
 {
@@ -1954,6 +2110,11 @@ static bool migrate_prepare(MigrationState *s, bool resume, Error **errp)
         return false;
     }
 
+    if ((migrate_postcopy_ram() || migrate_release_ram()) &&
+        migration_postcopy_is_blocked(errp)) {
+        return false;
+    }
+
     if (migrate_mapped_ram()) {
         if (migrate_tls()) {
             error_setg(errp, "Cannot use TLS with mapped-ram");
@@ -3842,6 +4003,7 @@ static void migration_instance_finalize(Object *obj)
 
     qapi_free_BitmapMigrationNodeAliasList(ms->parameters.block_bitmap_mapping);
     qapi_free_strList(ms->parameters.cpr_exec_command);
+    qapi_free_MigrationDowntimeStats(ms->downtime_stats);
     qemu_mutex_destroy(&ms->error_mutex);
     qemu_mutex_destroy(&ms->qemu_file_lock);
     qemu_sem_destroy(&ms->wait_unplug_sem);
@@ -199,6 +199,13 @@ struct MigrationIncomingState {
      * */
     struct PostcopyBlocktimeContext *blocktime_ctx;
 
+    /*
+     * Per-device load times of the switchover, only updated from
+     * loadvm_co.  Kept after the migration completes so that it can
+     * be queried.
+     */
+    MigrationDowntimeStats *downtime_stats;
+
     /* notify PAUSED postcopy incoming migrations to try to continue */
     QemuSemaphore postcopy_pause_sem_dst;
     QemuSemaphore postcopy_pause_sem_fault;
@@ -360,6 +367,8 @@ struct MigrationState {
     int64_t downtime_start;
     int64_t downtime;
     int64_t expected_downtime;
+    /* Where the downtime was spent, protected by the BQL */
+    MigrationDowntimeStats *downtime_stats;
     bool capabilities[MIGRATION_CAPABILITY__MAX];
     int64_t setup_time;
 
@@ -542,6 +551,7 @@ int migration_call_notifiers(MigrationEventType type, Error **errp);
 
 int migrate_init(MigrationState *s, Error **errp);
 bool migration_is_blocked(Error **errp);
+bool migration_postcopy_is_blocked(Error **errp);
 /* True if outgoing migration has entered postcopy phase */
 bool migration_in_postcopy(void);
 bool migration_postcopy_is_alive(MigrationStatus state);
@@ -601,6 +611,13 @@ void migration_rp_kick(MigrationState *s);
 
 void migration_bitmap_sync_precopy(bool last_stage);
 
+void migration_downtime_record_save(MigrationDowntimeSection section,
+                                    const char *idstr, uint32_t instance_id,
+                                    int64_t time_us);
+void migration_downtime_record_load(MigrationDowntimeSection section,
+                                    const char *idstr, uint32_t instance_id,
+                                    int64_t time_us);
+
 /* migration/block-dirty-bitmap.c */
 void dirty_bitmap_mig_init(void);
 bool should_send_vmdesc(void);
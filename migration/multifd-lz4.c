@@ -0,0 +1,251 @@
+/*
+ * Multifd lz4 compression implementation
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include <lz4.h>
+#include "qemu/bswap.h"
+#include "system/ramblock.h"
+#include "qapi/error.h"
+#include "migration.h"
+#include "options.h"
+#include "multifd.h"
+
+/*
+ * Pages are compressed independently so that neither side needs to keep a
+ * stream state across packets.  The packet payload starts with one big
+ * endian 32-bit length per normal page, followed by the page data.  A length
+ * equal to the page size means the page is sent uncompressed because lz4
+ * could not shrink it.
+ */
+struct lz4_data {
+    /* lz4 compression state, see LZ4_sizeofState() */
+    void *state;
+    /* acceleration factor used by the sender */
+    int acceleration;
+    /* compressed pages */
+    uint8_t *buf;
+    /* size of buf */
+    uint32_t buf_len;
+    /* per-page lengths */
+    uint32_t *buf_hdr;
+};
+
+static struct lz4_data *multifd_lz4_data_new(bool compress)
+{
+    uint32_t page_size = multifd_ram_page_size();
+    uint32_t page_count = multifd_ram_page_count();
+    struct lz4_data *z = g_new0(struct lz4_data, 1);
+
+    if (compress) {
+        z->state = g_malloc(LZ4_sizeofState());
+        z->acceleration = migrate_multifd_lz4_acceleration();
+    }
+    /* Pages that do not compress are sent raw, so this is the worst case */
+    z->buf_len = page_count * page_size;
+    z->buf = g_try_malloc(z->buf_len);
+    z->buf_hdr = g_new0(uint32_t, page_count);
+
+    return z;
+}
+
+static void multifd_lz4_data_free(struct lz4_data *z)
+{
+    g_free(z->state);
+    g_free(z->buf);
+    g_free(z->buf_hdr);
+    g_free(z);
+}
+
+/* Multifd lz4 compression */
+
+static int multifd_lz4_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    struct lz4_data *z = multifd_lz4_data_new(true);
+
+    if (!z->buf) {
+        multifd_lz4_data_free(z);
+        error_setg(errp, "multifd %u: out of memory for lz4 buffer", p->id);
+        return -1;
+    }
+    p->compress_data = z;
+
+    /*
+     * Needs 3 IOVs: the packet header, the page lengths and the compressed
+     * data
+     */
+    p->iov = g_new0(struct iovec, 3);
+    return 0;
+}
+
+static void multifd_lz4_send_cleanup(MultiFDSendParams *p, Error **errp)
+{
+    multifd_lz4_data_free(p->compress_data);
+    p->compress_data = NULL;
+
+    g_free(p->iov);
+    p->iov = NULL;
+}
+
+static int multifd_lz4_send_prepare(MultiFDSendParams *p, Error **errp)
+{
+    MultiFDPages_t *pages = &p->data->u.ram;
+    struct lz4_data *z = p->compress_data;
+    uint32_t page_size = multifd_ram_page_size();
+    uint32_t hdr_len, out_len = 0;
+    uint32_t i;
+
+    if (!multifd_send_prepare_common(p)) {
+        goto out;
+    }
+
+    for (i = 0; i < pages->normal_num; i++) {
+        const char *src = (const char *)pages->block->host + pages->offset[i];
+        char *dst = (char *)z->buf + out_len;
+        int ret;
+
+        /*
+         * Limit the output to less than a page so that lz4 gives up on
+         * pages that do not compress instead of expanding them.
+         */
+        ret = LZ4_compress_fast_extState(z->state, src, dst, page_size,
+                                         page_size - 1, z->acceleration);
+        if (ret <= 0) {
+            memcpy(dst, src, page_size);
+            ret = page_size;
+        }
+        z->buf_hdr[i] = cpu_to_be32(ret);
+        out_len += ret;
+    }
+
+    hdr_len = pages->normal_num * sizeof(uint32_t);
+    p->iov[p->iovs_num].iov_base = z->buf_hdr;
+    p->iov[p->iovs_num].iov_len = hdr_len;
+    p->iovs_num++;
+    p->iov[p->iovs_num].iov_base = z->buf;
+    p->iov[p->iovs_num].iov_len = out_len;
+    p->iovs_num++;
+    p->next_packet_size = hdr_len + out_len;
+
+out:
+    p->flags |= MULTIFD_FLAG_LZ4;
+    multifd_send_fill_packet(p);
+    return 0;
+}
+
+static int multifd_lz4_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    struct lz4_data *z = multifd_lz4_data_new(false);
+
+    if (!z->buf) {
+        multifd_lz4_data_free(z);
+        error_setg(errp, "multifd %u: out of memory for lz4 buffer", p->id);
+        return -1;
+    }
+    p->compress_data = z;
+    return 0;
+}
+
+static void multifd_lz4_recv_cleanup(MultiFDRecvParams *p)
+{
+    multifd_lz4_data_free(p->compress_data);
+    p->compress_data = NULL;
+}
+
+static int multifd_lz4_recv(MultiFDRecvParams *p, Error **errp)
+{
+    struct lz4_data *z = p->compress_data;
+    uint32_t in_size = p->next_packet_size;
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    uint32_t hdr_len = p->normal_num * sizeof(uint32_t);
+    uint32_t page_size = multifd_ram_page_size();
+    uint32_t data_len = 0;
+    uint8_t *buf = z->buf;
+    int ret;
+    int i;
+
+    if (flags != MULTIFD_FLAG_LZ4) {
+        error_setg(errp, "multifd %u: flags received %x flags expected %x",
+                   p->id, flags, MULTIFD_FLAG_LZ4);
+        return -1;
+    }
+
+    multifd_recv_zero_page_process(p);
+
+    if (!p->normal_num) {
+        assert(in_size == 0);
+        return 0;
+    }
+
+    if (in_size < hdr_len) {
+        error_setg(errp, "multifd %u: packet size %u too small for %u pages",
+                   p->id, in_size, p->normal_num);
+        return -1;
+    }
+
+    ret = qio_channel_read_all(p->c, (void *)z->buf_hdr, hdr_len, errp);
+    if (ret != 0) {
+        return ret;
+    }
+
+    for (i = 0; i < p->normal_num; i++) {
+        z->buf_hdr[i] = be32_to_cpu(z->buf_hdr[i]);
+        if (z->buf_hdr[i] == 0 || z->buf_hdr[i] > page_size) {
+            error_setg(errp, "multifd %u: invalid compressed page length %u",
+                       p->id, z->buf_hdr[i]);
+            return -1;
+        }
+        data_len += z->buf_hdr[i];
+    }
+
+    if (in_size != hdr_len + data_len) {
+        error_setg(errp, "multifd %u: packet size received %u size expected %u",
+                   p->id, in_size, hdr_len + data_len);
+        return -1;
+    }
+
+    ret = qio_channel_read_all(p->c, (void *)buf, data_len, errp);
+    if (ret != 0) {
+        return ret;
+    }
+
+    for (i = 0; i < p->normal_num; i++) {
+        uint8_t *dst = p->host + p->normal[i];
+
+        ramblock_recv_bitmap_set_offset(p->block, p->normal[i]);
+
+        if (z->buf_hdr[i] == page_size) {
+            memcpy(dst, buf, page_size);
+        } else {
+            ret = LZ4_decompress_safe((const char *)buf, (char *)dst,
+                                      z->buf_hdr[i], page_size);
+            if (ret != page_size) {
+                error_setg(errp, "multifd %u: decompression of page %d "
+                           "failed with %d", p->id, i, ret);
+                return -1;
+            }
+        }
+        buf += z->buf_hdr[i];
+    }
+
+    return 0;
+}
+
+static const MultiFDMethods multifd_lz4_ops = {
+    .send_setup = multifd_lz4_send_setup,
+    .send_cleanup = multifd_lz4_send_cleanup,
+    .send_prepare = multifd_lz4_send_prepare,
+    .recv_setup = multifd_lz4_recv_setup,
+    .recv_cleanup = multifd_lz4_recv_cleanup,
+    .recv = multifd_lz4_recv
+};
+
+static void multifd_lz4_register(void)
+{
+    multifd_register_ops(MULTIFD_COMPRESSION_LZ4, &multifd_lz4_ops);
+}
+
+migration_init(multifd_lz4_register);
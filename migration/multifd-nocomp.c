@@ -69,7 +69,11 @@ static int multifd_nocomp_send_setup(MultiFDSendParams *p, Error **errp)
         p->write_flags |= QIO_CHANNEL_WRITE_FLAG_ZERO_COPY;
     }
 
-    if (!migrate_mapped_ram()) {
+    if (multifd_xbzrle_enabled()) {
+        /* The header, plus the lengths and data of the xbzrle deltas */
+        p->iov = g_new0(struct iovec, page_count + 3);
+        multifd_xbzrle_send_setup(p);
+    } else if (!migrate_mapped_ram()) {
         /* We need one extra place for the packet header */
         p->iov = g_new0(struct iovec, page_count + 1);
     } else {
@@ -81,6 +85,7 @@ static int multifd_nocomp_send_setup(MultiFDSendParams *p, Error **errp)
 
 static void multifd_nocomp_send_cleanup(MultiFDSendParams *p, Error **errp)
 {
+    multifd_xbzrle_send_cleanup(p);
     g_free(p->iov);
     p->iov = NULL;
 }
@@ -128,7 +133,13 @@ static int multifd_nocomp_send_prepare(MultiFDSendParams *p, Error **errp)
         multifd_ram_prepare_header(p);
     }
 
-    multifd_send_prepare_iovs(p);
+    if (multifd_xbzrle_enabled()) {
+        /* Checked by the destination in multifd_ram_unfill_packet() */
+        p->flags |= MULTIFD_FLAG_XBZRLE;
+    }
+    if (!multifd_xbzrle_enabled() || !multifd_send_xbzrle_prepare(p)) {
+        multifd_send_prepare_iovs(p);
+    }
     p->flags |= MULTIFD_FLAG_NOCOMP;
 
     multifd_send_fill_packet(p);
@@ -161,7 +172,9 @@ static void multifd_nocomp_recv_cleanup(MultiFDRecvParams *p)
 
 static int multifd_nocomp_recv(MultiFDRecvParams *p, Error **errp)
 {
+    uint32_t normal_size = p->normal_num * multifd_ram_page_size();
     uint32_t flags;
+    int ret;
 
     if (migrate_mapped_ram()) {
         return multifd_file_recv_data(p, errp);
@@ -177,16 +190,29 @@ static int multifd_nocomp_recv(MultiFDRecvParams *p, Error **errp)
 
     multifd_recv_zero_page_process(p);
 
-    if (!p->normal_num) {
-        return 0;
+    if (p->normal_num) {
+        for (int i = 0; i < p->normal_num; i++) {
+            p->iov[i].iov_base = p->host + p->normal[i];
+            p->iov[i].iov_len = multifd_ram_page_size();
+            ramblock_recv_bitmap_set_offset(p->block, p->normal[i]);
+        }
+        ret = qio_channel_readv_all(p->c, p->iov, p->normal_num, errp);
+        if (ret != 0) {
+            return ret;
+        }
     }
 
-    for (int i = 0; i < p->normal_num; i++) {
-        p->iov[i].iov_base = p->host + p->normal[i];
-        p->iov[i].iov_len = multifd_ram_page_size();
-        ramblock_recv_bitmap_set_offset(p->block, p->normal[i]);
+    if (p->xbzrle_num) {
+        if (p->next_packet_size < normal_size) {
+            error_setg(errp, "multifd %u: packet size %u too small for %u "
+                       "pages", p->id, p->next_packet_size, p->normal_num);
+            return -1;
+        }
+        return multifd_recv_xbzrle_process(p, p->next_packet_size - normal_size,
+                                           errp);
     }
-    return qio_channel_readv_all(p->c, p->iov, p->normal_num, errp);
+
+    return 0;
 }
 
 static void multifd_pages_reset(MultiFDPages_t *pages)
@@ -197,6 +223,8 @@ static void multifd_pages_reset(MultiFDPages_t *pages)
      */
     pages->num = 0;
     pages->normal_num = 0;
+    pages->raw_num = 0;
+    pages->xbzrle_num = 0;
     pages->block = NULL;
 }
 
@@ -204,11 +232,15 @@ void multifd_ram_fill_packet(MultiFDSendParams *p)
 {
     MultiFDPacket_t *packet = p->packet;
     MultiFDPages_t *pages = &p->data->u.ram;
-    uint32_t zero_num = pages->num - pages->normal_num;
+    uint32_t normal_num = pages->normal_num + pages->raw_num +
+                          pages->xbzrle_num;
+    uint32_t zero_num = pages->num - normal_num;
 
     packet->pages_alloc = cpu_to_be32(multifd_ram_page_count());
-    packet->normal_pages = cpu_to_be32(pages->normal_num);
+    packet->normal_pages = cpu_to_be32(normal_num);
     packet->zero_pages = cpu_to_be32(zero_num);
+    packet->raw_pages = cpu_to_be32(pages->raw_num);
+    packet->xbzrle_pages = cpu_to_be32(pages->xbzrle_num);
 
     if (pages->block) {
         pstrcpy(packet->ramblock, sizeof(packet->ramblock),
@@ -222,8 +254,7 @@ void multifd_ram_fill_packet(MultiFDSendParams *p)
         packet->offset[i] = cpu_to_be64(temp);
     }
 
-    trace_multifd_send_ram_fill(p->id, pages->normal_num,
-                                zero_num);
+    trace_multifd_send_ram_fill(p->id, normal_num, zero_num);
 }
 
 int multifd_ram_unfill_packet(MultiFDRecvParams *p, Error **errp)
@@ -232,6 +263,7 @@ int multifd_ram_unfill_packet(MultiFDRecvParams *p, Error **errp)
     uint32_t page_count = multifd_ram_page_count();
     uint32_t page_size = multifd_ram_page_size();
     uint32_t pages_per_packet = be32_to_cpu(packet->pages_alloc);
+    uint32_t normal_num;
     int i;
 
     if (pages_per_packet > page_count) {
@@ -240,23 +272,72 @@ int multifd_ram_unfill_packet(MultiFDRecvParams *p, Error **errp)
         return -1;
     }
 
-    p->normal_num = be32_to_cpu(packet->normal_pages);
-    if (p->normal_num > pages_per_packet) {
+    normal_num = be32_to_cpu(packet->normal_pages);
+    if (normal_num > pages_per_packet) {
         error_setg(errp, "multifd: received packet with %u non-zero pages, "
                    "which exceeds maximum expected pages %u",
-                   p->normal_num, pages_per_packet);
+                   normal_num, pages_per_packet);
         return -1;
     }
 
     p->zero_num = be32_to_cpu(packet->zero_pages);
-    if (p->zero_num > pages_per_packet - p->normal_num) {
+    if (p->zero_num > pages_per_packet - normal_num) {
         error_setg(errp,
                    "multifd: received packet with %u zero pages, expected maximum %u",
-                   p->zero_num, pages_per_packet - p->normal_num);
+                   p->zero_num, pages_per_packet - normal_num);
+        return -1;
+    }
+
+    /*
+     * Raw pages and xbzrle deltas change the layout of the payload, so both
+     * sides must agree on using them.  SYNC packets carry no pages and no
+     * such flags.
+     */
+    if (normal_num || p->zero_num) {
+        bool raw_pages = p->flags & MULTIFD_FLAG_RAW_PAGES;
+        bool xbzrle = p->flags & MULTIFD_FLAG_XBZRLE;
+
+        if (raw_pages != multifd_raw_page_enabled()) {
+            error_setg(errp, "multifd: multifd-compression-raw-threshold is "
+                       "set on the %s only",
+                       raw_pages ? "source" : "destination");
+            return -1;
+        }
+        if (xbzrle != multifd_xbzrle_enabled()) {
+            error_setg(errp, "multifd: xbzrle is enabled on the %s only",
+                       xbzrle ? "source" : "destination");
+            return -1;
+        }
+    }
+
+    p->raw_num = be32_to_cpu(packet->raw_pages);
+    if (p->raw_num && !(p->flags & MULTIFD_FLAG_RAW_PAGES)) {
+        error_setg(errp, "multifd: received packet with %u raw pages "
+                   "without the raw pages flag", p->raw_num);
+        return -1;
+    }
+    if (p->raw_num > normal_num) {
+        error_setg(errp,
+                   "multifd: received packet with %u raw pages, expected maximum %u",
+                   p->raw_num, normal_num);
         return -1;
     }
 
-    if (p->normal_num == 0 && p->zero_num == 0) {
+    p->xbzrle_num = be32_to_cpu(packet->xbzrle_pages);
+    if (p->xbzrle_num && !(p->flags & MULTIFD_FLAG_XBZRLE)) {
+        error_setg(errp, "multifd: received packet with %u xbzrle pages "
+                   "without the xbzrle flag", p->xbzrle_num);
+        return -1;
+    }
+    if (p->xbzrle_num > normal_num - p->raw_num) {
+        error_setg(errp,
+                   "multifd: received packet with %u xbzrle pages, expected maximum %u",
+                   p->xbzrle_num, normal_num - p->raw_num);
+        return -1;
+    }
+    p->normal_num = normal_num - p->raw_num - p->xbzrle_num;
+
+    if (normal_num == 0 && p->zero_num == 0) {
         return 0;
     }
 
@@ -282,9 +363,34 @@ int multifd_ram_unfill_packet(MultiFDRecvParams *p, Error **errp)
         p->normal[i] = offset;
     }
 
-    for (i = 0; i < p->zero_num; i++) {
+    for (i = 0; i < p->raw_num; i++) {
         uint64_t offset = be64_to_cpu(packet->offset[p->normal_num + i]);
 
+        if (offset > (p->block->used_length - page_size)) {
+            error_setg(errp, "multifd: offset too long %" PRIu64
+                       " (max " RAM_ADDR_FMT ")",
+                       offset, p->block->used_length);
+            return -1;
+        }
+        p->raw[i] = offset;
+    }
+
+    for (i = 0; i < p->xbzrle_num; i++) {
+        uint64_t offset = be64_to_cpu(packet->offset[p->normal_num +
+                                                     p->raw_num + i]);
+
+        if (offset > (p->block->used_length - page_size)) {
+            error_setg(errp, "multifd: offset too long %" PRIu64
+                       " (max " RAM_ADDR_FMT ")",
+                       offset, p->block->used_length);
+            return -1;
+        }
+        p->xbzrle[i] = offset;
+    }
+
+    for (i = 0; i < p->zero_num; i++) {
+        uint64_t offset = be64_to_cpu(packet->offset[normal_num + i]);
+
         if (offset > (p->block->used_length - page_size)) {
             error_setg(errp, "multifd: offset too long %" PRIu64
                        " (max " RAM_ADDR_FMT ")",
@@ -442,6 +548,7 @@ bool multifd_send_prepare_common(MultiFDSendParams *p)
     MultiFDPages_t *pages = &p->data->u.ram;
     multifd_ram_prepare_header(p);
     multifd_send_zero_page_detect(p);
+    multifd_send_raw_page_detect(p);
 
     if (!pages->normal_num) {
         p->next_packet_size = 0;
@@ -0,0 +1,198 @@
+/*
+ * Multifd incompressible page detection implementation.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include <math.h>
+#include "qapi/error.h"
+#include "system/ramblock.h"
+#include "migration.h"
+#include "migration-stats.h"
+#include "multifd.h"
+#include "options.h"
+
+/*
+ * Number of bytes sampled from each page.  The sample is taken as
+ * MULTIFD_RAW_SAMPLE_CHUNKS runs of contiguous bytes spread evenly over
+ * the page, so that a page which is only partially filled with random
+ * data is not mistaken for an incompressible one.
+ */
+#define MULTIFD_RAW_SAMPLE_CHUNKS   8
+#define MULTIFD_RAW_SAMPLE_CHUNK    64
+#define MULTIFD_RAW_SAMPLE_SIZE     \
+    (MULTIFD_RAW_SAMPLE_CHUNKS * MULTIFD_RAW_SAMPLE_CHUNK)
+
+bool multifd_raw_page_enabled(void)
+{
+    return migrate_multifd_compression() != MULTIFD_COMPRESSION_NONE &&
+           migrate_multifd_compression_raw_threshold() != 0;
+}
+
+static void swap_page_offset(ram_addr_t *pages_offset, int a, int b)
+{
+    ram_addr_t temp;
+
+    if (a == b) {
+        return;
+    }
+
+    temp = pages_offset[a];
+    pages_offset[a] = pages_offset[b];
+    pages_offset[b] = temp;
+}
+
+/*
+ * Estimate the Shannon entropy of a page from a sample of its bytes and
+ * return it as a percentage of the 8 bits per byte maximum.
+ */
+static unsigned int multifd_page_entropy(const uint8_t *page,
+                                         uint32_t page_size)
+{
+    uint16_t hist[256] = { 0 };
+    uint32_t stride = page_size / MULTIFD_RAW_SAMPLE_CHUNKS;
+    double entropy = 0;
+    int i, j;
+
+    for (i = 0; i < MULTIFD_RAW_SAMPLE_CHUNKS; i++) {
+        const uint8_t *chunk = page + i * stride;
+
+        for (j = 0; j < MULTIFD_RAW_SAMPLE_CHUNK; j++) {
+            hist[chunk[j]]++;
+        }
+    }
+
+    for (i = 0; i < ARRAY_SIZE(hist); i++) {
+        double p;
+
+        if (!hist[i]) {
+            continue;
+        }
+        p = (double)hist[i] / MULTIFD_RAW_SAMPLE_SIZE;
+        entropy -= p * log2(p);
+    }
+
+    return entropy * 100 / 8;
+}
+
+/**
+ * multifd_send_raw_page_detect: Find the normal pages that are not worth
+ * compressing.
+ *
+ * Must be called after multifd_send_zero_page_detect().  Sorts the
+ * compressible pages before the incompressible ones within the first
+ * p->pages->normal_num entries of p->pages->offset, then lowers
+ * p->pages->normal_num to the number of compressible pages and sets
+ * p->pages->raw_num to the number of incompressible pages.  Both numbers
+ * are added to the migration statistics, as the compression method is
+ * given every page that is not raw.
+ *
+ * @param p A pointer to the send params.
+ */
+void multifd_send_raw_page_detect(MultiFDSendParams *p)
+{
+    MultiFDPages_t *pages = &p->data->u.ram;
+    uint32_t page_size = multifd_ram_page_size();
+    unsigned int threshold;
+    RAMBlock *rb = pages->block;
+    int i = 0;
+    int j = pages->normal_num - 1;
+
+    pages->raw_num = 0;
+
+    /* Without a compression method, no page is compressed or raw */
+    if (migrate_multifd_compression() == MULTIFD_COMPRESSION_NONE) {
+        return;
+    }
+
+    if (!multifd_raw_page_enabled()) {
+        goto out;
+    }
+
+    /* Checked by the destination in multifd_ram_unfill_packet() */
+    p->flags |= MULTIFD_FLAG_RAW_PAGES;
+
+    if (!pages->normal_num) {
+        goto out;
+    }
+
+    threshold = migrate_multifd_compression_raw_threshold();
+
+    while (i <= j) {
+        if (multifd_page_entropy(rb->host + pages->offset[i],
+                                 page_size) < threshold) {
+            i++;
+            continue;
+        }
+
+        swap_page_offset(pages->offset, i, j);
+        j--;
+    }
+
+    pages->raw_num = pages->normal_num - i;
+    pages->normal_num = i;
+
+out:
+    qatomic_add(&mig_stats.multifd_compressed_pages, pages->normal_num);
+    qatomic_add(&mig_stats.multifd_raw_pages, pages->raw_num);
+}
+
+/**
+ * multifd_send_raw_page_write: Send the pages selected by
+ * multifd_send_raw_page_detect() uncompressed.
+ *
+ * The raw pages follow the data prepared by the compression method on the
+ * channel.  Their size is not part of p->next_packet_size; the receiver
+ * knows it from the number of raw pages in the packet.
+ *
+ * @param p A pointer to the send params.
+ * @param errp Pointer to an error.
+ *
+ * Returns the number of bytes written on success, -1 on failure.
+ */
+ssize_t multifd_send_raw_page_write(MultiFDSendParams *p, Error **errp)
+{
+    MultiFDPages_t *pages = &p->data->u.ram;
+    uint32_t page_size = multifd_ram_page_size();
+    int i;
+
+    for (i = 0; i < pages->raw_num; i++) {
+        ram_addr_t offset = pages->offset[pages->normal_num + i];
+
+        p->raw_iov[i].iov_base = pages->block->host + offset;
+        p->raw_iov[i].iov_len = page_size;
+    }
+
+    if (qio_channel_writev_all(p->c, p->raw_iov, pages->raw_num, errp)) {
+        return -1;
+    }
+
+    return (ssize_t)pages->raw_num * page_size;
+}
+
+/**
+ * multifd_recv_raw_page_process: Receive the uncompressed pages of a
+ * packet.
+ *
+ * Must be called after the compression method has consumed its part of
+ * the packet.
+ *
+ * @param p A pointer to the recv params.
+ * @param errp Pointer to an error.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int multifd_recv_raw_page_process(MultiFDRecvParams *p, Error **errp)
+{
+    uint32_t page_size = multifd_ram_page_size();
+
+    for (int i = 0; i < p->raw_num; i++) {
+        p->raw_iov[i].iov_base = p->host + p->raw[i];
+        p->raw_iov[i].iov_len = page_size;
+        ramblock_recv_bitmap_set_offset(p->block, p->raw[i]);
+    }
+
+    return qio_channel_readv_all(p->c, p->raw_iov, p->raw_num, errp);
+}
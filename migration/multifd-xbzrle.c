@@ -0,0 +1,296 @@
+/*
+ * Multifd XBZRLE delta encoding implementation.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/rcu.h"
+#include "qapi/error.h"
+#include "system/ramblock.h"
+#include "migration.h"
+#include "migration-stats.h"
+#include "multifd.h"
+#include "options.h"
+#include "page_cache.h"
+#include "ram.h"
+#include "xbzrle.h"
+
+/*
+ * With the xbzrle capability, the nocomp method sends the pages that hit
+ * the XBZRLE cache as deltas against the cached copy.  The deltas follow
+ * the full pages in the packet payload: one big endian 32-bit length per
+ * delta, then the deltas themselves.  A length of 0 means that the page
+ * did not change since it was cached.
+ *
+ * The cache is shared by all channels, its shards are locked around each
+ * lookup.  A page is sent by at most one channel between two multifd
+ * syncs, and the syncs also order the channels on the destination, so
+ * every delta applies on top of the copy that the destination has.
+ */
+typedef struct {
+    /* copies of the pages, as sent and as inserted in the cache */
+    uint8_t *pages_buf;
+    /* xbzrle deltas */
+    uint8_t *encoded_buf;
+    /* per-delta lengths */
+    uint32_t *encoded_len;
+    /* offsets of the pages sent as deltas */
+    ram_addr_t *xbzrle_offset;
+    /* a page full of zeros */
+    uint8_t *zero_page;
+} MultiFDXbzrleSend;
+
+typedef struct {
+    /* xbzrle deltas */
+    uint8_t *encoded_buf;
+    /* per-delta lengths */
+    uint32_t *encoded_len;
+} MultiFDXbzrleRecv;
+
+bool multifd_xbzrle_enabled(void)
+{
+    return migrate_xbzrle();
+}
+
+void multifd_xbzrle_send_setup(MultiFDSendParams *p)
+{
+    uint32_t page_size = multifd_ram_page_size();
+    uint32_t page_count = multifd_ram_page_count();
+    MultiFDXbzrleSend *x = g_new0(MultiFDXbzrleSend, 1);
+
+    x->pages_buf = g_malloc(page_count * page_size);
+    x->encoded_buf = g_malloc(page_count * page_size);
+    x->encoded_len = g_new0(uint32_t, page_count);
+    x->xbzrle_offset = g_new0(ram_addr_t, page_count);
+    x->zero_page = g_malloc0(page_size);
+    p->xbzrle_data = x;
+}
+
+void multifd_xbzrle_send_cleanup(MultiFDSendParams *p)
+{
+    MultiFDXbzrleSend *x = p->xbzrle_data;
+
+    if (!x) {
+        return;
+    }
+
+    g_free(x->pages_buf);
+    g_free(x->encoded_buf);
+    g_free(x->encoded_len);
+    g_free(x->xbzrle_offset);
+    g_free(x->zero_page);
+    g_free(x);
+    p->xbzrle_data = NULL;
+}
+
+/**
+ * multifd_send_xbzrle_prepare: Prepare the iovs of a packet with XBZRLE
+ *
+ * Must be called after multifd_send_zero_page_detect() and the packet
+ * header preparation.  Moves the pages sent as deltas after the other
+ * normal pages in p->pages->offset, updates p->pages->normal_num and
+ * p->pages->xbzrle_num, and fills p->iov and p->next_packet_size.
+ *
+ * @param p A pointer to the send params.
+ *
+ * Returns false if XBZRLE is not in use yet, in which case nothing was
+ * done.
+ */
+bool multifd_send_xbzrle_prepare(MultiFDSendParams *p)
+{
+    MultiFDPages_t *pages = &p->data->u.ram;
+    MultiFDXbzrleSend *x = p->xbzrle_data;
+    uint64_t generation = qatomic_read(&mig_stats.dirty_sync_count);
+    uint32_t page_size = multifd_ram_page_size();
+    uint32_t normal_num = 0, xbzrle_num = 0, out_len = 0;
+    uint64_t cache_miss = 0, encoded = 0, overflow = 0, bytes = 0;
+    RAMBlock *rb = pages->block;
+    PageCache *cache;
+    int i;
+
+    RCU_READ_LOCK_GUARD();
+
+    cache = xbzrle_multifd_cache();
+    if (!cache) {
+        return false;
+    }
+
+    /* Let the cache know about the pages sent as zero pages */
+    for (i = pages->normal_num; i < pages->num; i++) {
+        ram_addr_t addr = rb->offset + pages->offset[i];
+
+        cache_lock(cache, addr);
+        cache_insert(cache, addr, x->zero_page, generation);
+        cache_unlock(cache, addr);
+    }
+
+    for (i = 0; i < pages->normal_num; i++) {
+        ram_addr_t offset = pages->offset[i];
+        ram_addr_t addr = rb->offset + offset;
+        uint8_t *page = x->pages_buf + i * page_size;
+        uint8_t *cached;
+        int len;
+
+        /*
+         * Work on a copy: the guest may change the page under our feet,
+         * and the cache must hold exactly what is sent.
+         */
+        memcpy(page, rb->host + offset, page_size);
+
+        cache_lock(cache, addr);
+        if (!cache_is_cached(cache, addr, generation)) {
+            cache_insert(cache, addr, page, generation);
+            cache_unlock(cache, addr);
+            cache_miss++;
+            goto send_page;
+        }
+
+        encoded++;
+        cached = get_cached_data(cache, addr);
+        len = xbzrle_encode_buffer(cached, page, page_size,
+                                   x->encoded_buf + out_len, page_size);
+        if (len != 0) {
+            memcpy(cached, page, page_size);
+        }
+        cache_unlock(cache, addr);
+
+        if (len < 0) {
+            overflow++;
+            bytes += page_size;
+            goto send_page;
+        }
+
+        x->encoded_len[xbzrle_num] = cpu_to_be32(len);
+        x->xbzrle_offset[xbzrle_num] = offset;
+        xbzrle_num++;
+        out_len += len;
+        bytes += len + sizeof(uint32_t);
+        continue;
+
+send_page:
+        /* normal_num <= i, so this never overwrites an unvisited entry */
+        pages->offset[normal_num++] = offset;
+        p->iov[p->iovs_num].iov_base = page;
+        p->iov[p->iovs_num].iov_len = page_size;
+        p->iovs_num++;
+    }
+
+    memcpy(&pages->offset[normal_num], x->xbzrle_offset,
+           xbzrle_num * sizeof(ram_addr_t));
+    pages->normal_num = normal_num;
+    pages->xbzrle_num = xbzrle_num;
+    p->next_packet_size = normal_num * page_size;
+
+    if (xbzrle_num) {
+        p->iov[p->iovs_num].iov_base = x->encoded_len;
+        p->iov[p->iovs_num].iov_len = xbzrle_num * sizeof(uint32_t);
+        p->iovs_num++;
+        p->iov[p->iovs_num].iov_base = x->encoded_buf;
+        p->iov[p->iovs_num].iov_len = out_len;
+        p->iovs_num++;
+        p->next_packet_size += xbzrle_num * sizeof(uint32_t) + out_len;
+    }
+
+    qatomic_add(&xbzrle_counters.cache_miss, cache_miss);
+    qatomic_add(&xbzrle_counters.pages, encoded);
+    qatomic_add(&xbzrle_counters.overflow, overflow);
+    qatomic_add(&xbzrle_counters.bytes, bytes);
+
+    return true;
+}
+
+void multifd_xbzrle_recv_cleanup(MultiFDRecvParams *p)
+{
+    MultiFDXbzrleRecv *x = p->xbzrle_data;
+
+    if (!x) {
+        return;
+    }
+
+    g_free(x->encoded_buf);
+    g_free(x->encoded_len);
+    g_free(x);
+    p->xbzrle_data = NULL;
+}
+
+/**
+ * multifd_recv_xbzrle_process: Receive and apply the xbzrle deltas of a
+ * packet.
+ *
+ * @param p A pointer to the recv params.
+ * @param size Size of the deltas and of their lengths in the payload.
+ * @param errp Pointer to an error.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int multifd_recv_xbzrle_process(MultiFDRecvParams *p, uint32_t size,
+                                Error **errp)
+{
+    MultiFDXbzrleRecv *x = p->xbzrle_data;
+    uint32_t page_size = multifd_ram_page_size();
+    uint32_t hdr_len = p->xbzrle_num * sizeof(uint32_t);
+    uint32_t data_len = 0;
+    uint8_t *buf;
+    int ret;
+    int i;
+
+    if (!x) {
+        uint32_t page_count = multifd_ram_page_count();
+
+        x = g_new0(MultiFDXbzrleRecv, 1);
+        x->encoded_buf = g_malloc(page_count * page_size);
+        x->encoded_len = g_new0(uint32_t, page_count);
+        p->xbzrle_data = x;
+    }
+
+    if (size < hdr_len) {
+        error_setg(errp, "multifd %u: packet size %u too small for %u "
+                   "xbzrle pages", p->id, size, p->xbzrle_num);
+        return -1;
+    }
+
+    ret = qio_channel_read_all(p->c, (void *)x->encoded_len, hdr_len, errp);
+    if (ret != 0) {
+        return ret;
+    }
+
+    for (i = 0; i < p->xbzrle_num; i++) {
+        x->encoded_len[i] = be32_to_cpu(x->encoded_len[i]);
+        if (x->encoded_len[i] > page_size) {
+            error_setg(errp, "multifd %u: invalid xbzrle page length %u",
+                       p->id, x->encoded_len[i]);
+            return -1;
+        }
+        data_len += x->encoded_len[i];
+    }
+
+    if (size != hdr_len + data_len) {
+        error_setg(errp, "multifd %u: xbzrle size received %u size expected %u",
+                   p->id, size, hdr_len + data_len);
+        return -1;
+    }
+
+    ret = qio_channel_read_all(p->c, (void *)x->encoded_buf, data_len, errp);
+    if (ret != 0) {
+        return ret;
+    }
+
+    buf = x->encoded_buf;
+    for (i = 0; i < p->xbzrle_num; i++) {
+        uint32_t len = x->encoded_len[i];
+
+        ramblock_recv_bitmap_set_offset(p->block, p->xbzrle[i]);
+
+        if (len && xbzrle_decode_buffer(buf, len, p->host + p->xbzrle[i],
+                                        page_size) < 0) {
+            error_setg(errp, "multifd %u: failed to decode xbzrle page %d",
+                       p->id, i);
+            return -1;
+        }
+        buf += len;
+    }
+
+    return 0;
+}
@@ -24,9 +24,11 @@ static bool multifd_zero_page_enabled(void)
     return migrate_zero_page_detection() == ZERO_PAGE_DETECTION_MULTIFD;
 }
 
-static void swap_page_offset(ram_addr_t *pages_offset, int a, int b)
+static void swap_page_offset(ram_addr_t *pages_offset, bool *zero_map,
+                             int a, int b)
 {
     ram_addr_t temp;
+    bool zero;
 
     if (a == b) {
         return;
@@ -35,13 +37,33 @@ static void swap_page_offset(ram_addr_t *pages_offset, int a, int b)
     temp = pages_offset[a];
     pages_offset[a] = pages_offset[b];
     pages_offset[b] = temp;
+
+    zero = zero_map[a];
+    zero_map[a] = zero_map[b];
+    zero_map[b] = zero;
+}
+
+void multifd_send_zero_page_setup(MultiFDSendParams *p)
+{
+    uint32_t page_count = multifd_ram_page_count();
+
+    /* zero-page-detection may be changed while migrating */
+    p->zero_bufs = g_new0(const void *, page_count);
+    p->zero_map = g_new0(bool, page_count);
+}
+
+void multifd_send_zero_page_cleanup(MultiFDSendParams *p)
+{
+    g_clear_pointer(&p->zero_bufs, g_free);
+    g_clear_pointer(&p->zero_map, g_free);
 }
 
 /**
  * multifd_send_zero_page_detect: Perform zero page detection on all pages.
  *
  * Sorts normal pages before zero pages in p->pages->offset and updates
- * p->pages->normal_num.
+ * p->pages->normal_num.  All the pages of the packet are tested in a
+ * single buffer_is_zero_batch() call.
  *
  * @param p A pointer to the send params.
  */
@@ -49,7 +71,7 @@ void multifd_send_zero_page_detect(MultiFDSendParams *p)
 {
     MultiFDPages_t *pages = &p->data->u.ram;
     RAMBlock *rb = pages->block;
-    int i = 0;
+    int i;
     int j = pages->num - 1;
 
     if (!multifd_zero_page_enabled()) {
@@ -57,19 +79,26 @@ void multifd_send_zero_page_detect(MultiFDSendParams *p)
         goto out;
     }
 
+    for (i = 0; i < pages->num; i++) {
+        p->zero_bufs[i] = rb->host + pages->offset[i];
+    }
+    buffer_is_zero_batch(p->zero_bufs, pages->num, multifd_ram_page_size(),
+                         p->zero_map);
+
     /*
      * Sort the page offset array by moving all normal pages to
      * the left and all zero pages to the right of the array.
      */
+    i = 0;
     while (i <= j) {
         uint64_t offset = pages->offset[i];
 
-        if (!buffer_is_zero(rb->host + offset, multifd_ram_page_size())) {
+        if (!p->zero_map[i]) {
             i++;
             continue;
         }
 
-        swap_page_offset(pages->offset, i, j);
+        swap_page_offset(pages->offset, p->zero_map, i, j);
         ram_release_page(rb->idstr, offset);
         j--;
     }
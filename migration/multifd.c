@@ -549,6 +549,8 @@ static bool multifd_send_cleanup_channel(MultiFDSendParams *p, Error **errp)
     g_clear_pointer(&p->packet_device_state, g_free);
     g_free(p->packet);
     p->packet = NULL;
+    g_clear_pointer(&p->raw_iov, g_free);
+    multifd_send_zero_page_cleanup(p);
     multifd_send_state->ops->send_cleanup(p, errp);
     assert(!p->iov);
 
@@ -727,6 +729,16 @@ static void *multifd_send_thread(void *opaque)
                 break;
             }
 
+            if (!is_device_state && p->data->u.ram.raw_num) {
+                ssize_t raw_size = multifd_send_raw_page_write(p, &local_err);
+
+                if (raw_size < 0) {
+                    ret = -1;
+                    break;
+                }
+                total_size += raw_size;
+            }
+
             qatomic_add(&mig_stats.multifd_bytes, total_size);
 
             p->next_packet_size = 0;
@@ -946,6 +958,10 @@ bool multifd_send_setup(void)
             p->packet_device_state->hdr.magic = cpu_to_be32(MULTIFD_MAGIC);
             p->packet_device_state->hdr.version = cpu_to_be32(MULTIFD_VERSION);
         }
+        if (migrate_multifd_compression() != MULTIFD_COMPRESSION_NONE) {
+            p->raw_iov = g_new0(struct iovec, page_count);
+        }
+        multifd_send_zero_page_setup(p);
         p->name = g_strdup_printf(MIGRATION_THREAD_SRC_MULTIFD, i);
         p->write_flags = 0;
 
@@ -1128,6 +1144,10 @@ static void multifd_recv_cleanup_channel(MultiFDRecvParams *p)
     p->normal = NULL;
     g_free(p->zero);
     p->zero = NULL;
+    g_clear_pointer(&p->raw, g_free);
+    g_clear_pointer(&p->raw_iov, g_free);
+    g_clear_pointer(&p->xbzrle, g_free);
+    multifd_xbzrle_recv_cleanup(p);
     multifd_recv_state->ops->recv_cleanup(p);
 }
 
@@ -1277,6 +1297,8 @@ static void *multifd_recv_thread(void *opaque)
         size_t pkt_len;
 
         p->normal_num = 0;
+        p->raw_num = 0;
+        p->xbzrle_num = 0;
 
         if (use_packets) {
             struct iovec iov = {
@@ -1345,7 +1367,8 @@ static void *multifd_recv_thread(void *opaque)
                  * because older QEMUs (<9.0) still send data along with
                  * the SYNC packet.
                  */
-                has_data = p->normal_num || p->zero_num;
+                has_data = p->normal_num || p->zero_num || p->raw_num ||
+                           p->xbzrle_num;
             }
 
             qemu_mutex_unlock(&p->mutex);
@@ -1388,6 +1411,9 @@ static void *multifd_recv_thread(void *opaque)
                 ret = multifd_device_state_recv(p, &local_err);
             } else {
                 ret = multifd_recv_state->ops->recv(p, &local_err);
+                if (ret == 0 && p->raw_num) {
+                    ret = multifd_recv_raw_page_process(p, &local_err);
+                }
             }
             if (ret != 0) {
                 break;
@@ -1478,6 +1504,11 @@ int multifd_recv_setup(Error **errp)
         p->name = g_strdup_printf(MIGRATION_THREAD_DST_MULTIFD, i);
         p->normal = g_new0(ram_addr_t, page_count);
         p->zero = g_new0(ram_addr_t, page_count);
+        if (use_packets) {
+            p->raw = g_new0(ram_addr_t, page_count);
+            p->raw_iov = g_new0(struct iovec, page_count);
+            p->xbzrle = g_new0(ram_addr_t, page_count);
+        }
     }
 
     for (i = 0; i < thread_count; i++) {
@@ -66,6 +66,8 @@ MultiFDRecvData *multifd_get_recv_data(void);
 #define MULTIFD_FLAG_QPL (4 << 1)
 #define MULTIFD_FLAG_UADK (8 << 1)
 #define MULTIFD_FLAG_QATZIP (16 << 1)
+/* All single bits are taken, methods from here on use the remaining values */
+#define MULTIFD_FLAG_LZ4 (3 << 1)
 
 /*
  * If set it means that this packet contains device state
@@ -73,6 +75,19 @@ MultiFDRecvData *multifd_get_recv_data(void);
  */
 #define MULTIFD_FLAG_DEVICE_STATE (32 << 1)
 
+/*
+ * Set on RAM packets when multifd-compression-raw-threshold is in use, see
+ * MultiFDPacket_t.raw_pages.  The destination must have it set as well.
+ */
+#define MULTIFD_FLAG_RAW_PAGES (64 << 1)
+
+/*
+ * Set on RAM packets when multifd uses xbzrle, see
+ * MultiFDPacket_t.xbzrle_pages.  The destination must enable the xbzrle
+ * capability as well.
+ */
+#define MULTIFD_FLAG_XBZRLE (128 << 1)
+
 /* This value needs to be a multiple of qemu_target_page_size() */
 #define MULTIFD_PACKET_SIZE (512 * 1024)
 
@@ -94,12 +109,24 @@ typedef struct {
     uint64_t packet_num;
     /* zero pages */
     uint32_t zero_pages;
+    /*
+     * non zero pages sent without compression, part of normal_pages.
+     * Only used with MULTIFD_FLAG_RAW_PAGES.
+     */
+    uint32_t raw_pages;
+    /*
+     * non zero pages sent as xbzrle deltas, part of normal_pages.  Only
+     * used with MULTIFD_FLAG_XBZRLE.
+     */
+    uint32_t xbzrle_pages;
     uint32_t unused32[1];    /* Reserved for future use */
-    uint64_t unused64[3];    /* Reserved for future use */
+    uint64_t unused64[2];    /* Reserved for future use */
     char ramblock[256];
     /*
      * This array contains the pointers to:
-     *  - normal pages (initial normal_pages entries)
+     *  - normal pages (initial normal_pages entries, the last
+     *    raw_pages + xbzrle_pages of which are sent uncompressed and
+     *    as xbzrle deltas, in that order)
      *  - zero pages (following zero_pages entries)
      */
     uint64_t offset[];
@@ -120,6 +147,10 @@ typedef struct {
     uint32_t num;
     /* number of normal pages */
     uint32_t normal_num;
+    /* number of normal pages sent uncompressed, following normal_num */
+    uint32_t raw_num;
+    /* number of normal pages sent as xbzrle deltas, following raw_num */
+    uint32_t xbzrle_num;
     /*
      * Pointer to the ramblock.  NOTE: it's caller's responsibility to make
      * sure the pointer is always valid!
@@ -232,6 +263,13 @@ typedef struct {
     struct iovec *iov;
     /* number of iovs used */
     uint32_t iovs_num;
+    /* buffers for the pages sent uncompressed */
+    struct iovec *raw_iov;
+    /* pages tested by the zero page detection, and their results */
+    const void **zero_bufs;
+    bool *zero_map;
+    /* used for xbzrle encoding */
+    void *xbzrle_data;
     /* used for compression methods */
     void *compress_data;
 }  MultiFDSendParams;
@@ -291,6 +329,18 @@ typedef struct {
     ram_addr_t *zero;
     /* num of zero pages */
     uint32_t zero_num;
+    /* Pages that are not zero and were sent uncompressed */
+    ram_addr_t *raw;
+    /* num of uncompressed non zero pages */
+    uint32_t raw_num;
+    /* buffers to recv the uncompressed pages */
+    struct iovec *raw_iov;
+    /* Pages that are not zero and were sent as xbzrle deltas */
+    ram_addr_t *xbzrle;
+    /* num of xbzrle encoded pages */
+    uint32_t xbzrle_num;
+    /* used for xbzrle decoding */
+    void *xbzrle_data;
     /* used for de-compression methods */
     void *compress_data;
     /* Flags for the QIOChannel */
@@ -334,6 +384,12 @@ typedef struct {
      * p->next_packet_size with the amount of data currently present
      * in p->iov.
      *
+     * Compression methods should call multifd_send_prepare_common(),
+     * which may leave some of the pages out of p->data->u.ram.normal_num
+     * because they looked incompressible.  Those are sent raw by the
+     * core after p->iov and must not be accounted for in
+     * p->next_packet_size.
+     *
      * Must indicate whether this is a compression packet by setting
      * p->flags.
      *
@@ -371,7 +427,8 @@ typedef struct {
      * Must validate p->flags according to what was set at
      * send_prepare.
      *
-     * Must read the data from the QIOChannel p->c.
+     * Must read the data from the QIOChannel p->c.  The pages in
+     * p->raw are read by the core afterwards.
      */
     int (*recv)(MultiFDRecvParams *p, Error **errp);
 } MultiFDMethods;
@@ -380,7 +437,20 @@ void multifd_register_ops(int method, const MultiFDMethods *ops);
 void multifd_send_fill_packet(MultiFDSendParams *p);
 bool multifd_send_prepare_common(MultiFDSendParams *p);
 void multifd_send_zero_page_detect(MultiFDSendParams *p);
+void multifd_send_zero_page_setup(MultiFDSendParams *p);
+void multifd_send_zero_page_cleanup(MultiFDSendParams *p);
 void multifd_recv_zero_page_process(MultiFDRecvParams *p);
+bool multifd_raw_page_enabled(void);
+void multifd_send_raw_page_detect(MultiFDSendParams *p);
+ssize_t multifd_send_raw_page_write(MultiFDSendParams *p, Error **errp);
+int multifd_recv_raw_page_process(MultiFDRecvParams *p, Error **errp);
+bool multifd_xbzrle_enabled(void);
+void multifd_xbzrle_send_setup(MultiFDSendParams *p);
+void multifd_xbzrle_send_cleanup(MultiFDSendParams *p);
+bool multifd_send_xbzrle_prepare(MultiFDSendParams *p);
+void multifd_xbzrle_recv_cleanup(MultiFDRecvParams *p);
+int multifd_recv_xbzrle_process(MultiFDRecvParams *p, uint32_t size,
+                                Error **errp);
 
 void multifd_channel_connect(MultiFDSendParams *p, QIOChannel *ioc);
 bool multifd_send(MultiFDSendData **send_data);
@@ -66,6 +66,18 @@
 /* 0: means nocompress, 1: best speed, ... 20: best compress ratio */
 #define DEFAULT_MIGRATE_MULTIFD_ZSTD_LEVEL 1
 
+/* 1: best compress ratio, ... 65537: best speed */
+#define DEFAULT_MIGRATE_MULTIFD_LZ4_ACCELERATION 1
+#define MAX_MIGRATE_MULTIFD_LZ4_ACCELERATION 65537
+
+/* 0: compress every page, 1 ... 100: sampled entropy percentage */
+#define DEFAULT_MIGRATE_MULTIFD_COMPRESSION_RAW_THRESHOLD 0
+#define MAX_MIGRATE_MULTIFD_COMPRESSION_RAW_THRESHOLD 100
+
+/* 0: sync the dirty bitmap in the migration thread */
+#define DEFAULT_MIGRATE_DIRTY_SYNC_THREADS 0
+#define MAX_MIGRATE_DIRTY_SYNC_THREADS 64
+
 /* Background transfer rate for postcopy, 0 means unlimited, note
  * that page requests can still exceed this limit.
  */
@@ -146,6 +158,15 @@ const Property migration_properties[] = {
     DEFINE_PROP_UINT8("multifd-zstd-level", MigrationState,
                       parameters.multifd_zstd_level,
                       DEFAULT_MIGRATE_MULTIFD_ZSTD_LEVEL),
+    DEFINE_PROP_UINT32("multifd-lz4-acceleration", MigrationState,
+                      parameters.multifd_lz4_acceleration,
+                      DEFAULT_MIGRATE_MULTIFD_LZ4_ACCELERATION),
+    DEFINE_PROP_UINT8("multifd-compression-raw-threshold", MigrationState,
+                      parameters.multifd_compression_raw_threshold,
+                      DEFAULT_MIGRATE_MULTIFD_COMPRESSION_RAW_THRESHOLD),
+    DEFINE_PROP_UINT8("dirty-sync-threads", MigrationState,
+                      parameters.dirty_sync_threads,
+                      DEFAULT_MIGRATE_DIRTY_SYNC_THREADS),
     DEFINE_PROP_SIZE("xbzrle-cache-size", MigrationState,
                       parameters.xbzrle_cache_size,
                       DEFAULT_MIGRATE_XBZRLE_CACHE_SIZE),
@@ -695,8 +716,10 @@ bool migrate_caps_check(bool *old_caps, bool *new_caps, Error **errp)
     }
 
     if (new_caps[MIGRATION_CAPABILITY_MULTIFD]) {
-        if (new_caps[MIGRATION_CAPABILITY_XBZRLE]) {
-            error_setg(errp, "Multifd is not compatible with xbzrle");
+        if (new_caps[MIGRATION_CAPABILITY_XBZRLE] &&
+            migrate_multifd_compression()) {
+            error_setg(errp,
+                       "Multifd xbzrle only available for non-compressed migration");
             return false;
         }
     }
@@ -914,6 +937,27 @@ int migrate_multifd_zstd_level(void)
     return s->parameters.multifd_zstd_level;
 }
 
+int migrate_multifd_lz4_acceleration(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->parameters.multifd_lz4_acceleration;
+}
+
+uint8_t migrate_multifd_compression_raw_threshold(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->parameters.multifd_compression_raw_threshold;
+}
+
+uint8_t migrate_dirty_sync_threads(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->parameters.dirty_sync_threads;
+}
+
 uint8_t migrate_throttle_trigger_threshold(void)
 {
     MigrationState *s = migrate_get_current();
@@ -1041,7 +1085,9 @@ static void migrate_mark_all_params_present(MigrationParameters *p)
         &p->has_downtime_limit, &p->has_x_checkpoint_delay,
         &p->has_multifd_channels, &p->has_multifd_compression,
         &p->has_multifd_zlib_level, &p->has_multifd_qatzip_level,
-        &p->has_multifd_zstd_level, &p->has_xbzrle_cache_size,
+        &p->has_multifd_zstd_level, &p->has_multifd_lz4_acceleration,
+        &p->has_multifd_compression_raw_threshold,
+        &p->has_dirty_sync_threads, &p->has_xbzrle_cache_size,
         &p->has_max_postcopy_bandwidth, &p->has_max_cpu_throttle,
         &p->has_announce_initial, &p->has_announce_max, &p->has_announce_rounds,
         &p->has_announce_step, &p->has_block_bitmap_mapping,
@@ -1183,6 +1229,30 @@ bool migrate_params_check(MigrationParameters *params, Error **errp)
         return false;
     }
 
+    if (params->multifd_lz4_acceleration < 1 ||
+        params->multifd_lz4_acceleration >
+        MAX_MIGRATE_MULTIFD_LZ4_ACCELERATION) {
+        error_setg(errp, "Option multifd_lz4_acceleration expects "
+                   "a value between 1 and %d",
+                   MAX_MIGRATE_MULTIFD_LZ4_ACCELERATION);
+        return false;
+    }
+
+    if (params->multifd_compression_raw_threshold >
+        MAX_MIGRATE_MULTIFD_COMPRESSION_RAW_THRESHOLD) {
+        error_setg(errp, "Option multifd_compression_raw_threshold expects "
+                   "a value between 0 and %d",
+                   MAX_MIGRATE_MULTIFD_COMPRESSION_RAW_THRESHOLD);
+        return false;
+    }
+
+    if (params->dirty_sync_threads > MAX_MIGRATE_DIRTY_SYNC_THREADS) {
+        error_setg(errp, "Option dirty_sync_threads expects "
+                   "a value between 0 and %d",
+                   MAX_MIGRATE_DIRTY_SYNC_THREADS);
+        return false;
+    }
+
     if (params->xbzrle_cache_size < qemu_target_page_size() ||
         !is_power_of_2(params->xbzrle_cache_size)) {
         error_setg(errp, "Option xbzrle_cache_size expects "
@@ -1233,6 +1303,13 @@ bool migrate_params_check(MigrationParameters *params, Error **errp)
     }
 #endif
 
+    if (migrate_multifd() && migrate_xbzrle() &&
+        params->multifd_compression) {
+        error_setg(errp,
+                   "Multifd xbzrle only available for non-compressed migration");
+        return false;
+    }
+
     if (migrate_mapped_ram() &&
         (migrate_multifd_compression() || migrate_tls())) {
         error_setg(errp,
@@ -1336,6 +1413,16 @@ static void migrate_params_test_apply(MigrationParameters *params,
     if (params->has_multifd_zstd_level) {
         dest->multifd_zstd_level = params->multifd_zstd_level;
     }
+    if (params->has_multifd_lz4_acceleration) {
+        dest->multifd_lz4_acceleration = params->multifd_lz4_acceleration;
+    }
+    if (params->has_multifd_compression_raw_threshold) {
+        dest->multifd_compression_raw_threshold =
+            params->multifd_compression_raw_threshold;
+    }
+    if (params->has_dirty_sync_threads) {
+        dest->dirty_sync_threads = params->dirty_sync_threads;
+    }
     if (params->has_xbzrle_cache_size) {
         dest->xbzrle_cache_size = params->xbzrle_cache_size;
     }
@@ -1457,6 +1544,17 @@ static void migrate_params_apply(MigrationParameters *params)
     if (params->has_multifd_zstd_level) {
         s->parameters.multifd_zstd_level = params->multifd_zstd_level;
     }
+    if (params->has_multifd_lz4_acceleration) {
+        s->parameters.multifd_lz4_acceleration =
+            params->multifd_lz4_acceleration;
+    }
+    if (params->has_multifd_compression_raw_threshold) {
+        s->parameters.multifd_compression_raw_threshold =
+            params->multifd_compression_raw_threshold;
+    }
+    if (params->has_dirty_sync_threads) {
+        s->parameters.dirty_sync_threads = params->dirty_sync_threads;
+    }
     if (params->has_xbzrle_cache_size) {
         s->parameters.xbzrle_cache_size = params->xbzrle_cache_size;
     }
@@ -81,6 +81,9 @@ MultiFDCompression migrate_multifd_compression(void);
 int migrate_multifd_zlib_level(void);
 int migrate_multifd_qatzip_level(void);
 int migrate_multifd_zstd_level(void);
+int migrate_multifd_lz4_acceleration(void);
+uint8_t migrate_multifd_compression_raw_threshold(void);
+uint8_t migrate_dirty_sync_threads(void);
 uint8_t migrate_throttle_trigger_threshold(void);
 const char *migrate_tls_authz(void);
 const char *migrate_tls_creds(void);
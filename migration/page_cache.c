@@ -1,6 +1,6 @@
 /*
  * Page cache for QEMU
- * The cache is base on a hash of the page address
+ * The cache is a set-associative cache indexed by a hash of the page address
  *
  * Copyright 2012 Red Hat, Inc. and/or its affiliates
  *
@@ -17,25 +17,55 @@
 #include "qapi/qmp/qerror.h"
 #include "qapi/error.h"
 #include "qemu/host-utils.h"
+#include "qemu/rcu.h"
+#include "qemu/thread.h"
 #include "page_cache.h"
 #include "trace.h"
 
 /* the page in cache will not be replaced in two cycles */
 #define CACHED_PAGE_LIFETIME 2
 
+/* number of pages that an address may be cached in */
+#define PAGE_CACHE_WAYS 8
+
+/* maximum number of independently locked parts of the cache */
+#define PAGE_CACHE_MAX_SHARDS 64
+
 typedef struct CacheItem CacheItem;
 
 struct CacheItem {
     uint64_t it_addr;
     uint64_t it_age;
     uint8_t *it_data;
+    /* CLOCK reference bit, set on every hit */
+    bool it_ref;
 };
 
+typedef struct PageCacheShard {
+    QemuMutex lock;
+    uint64_t hits;
+    uint64_t evictions;
+} PageCacheShard;
+
+/*
+ * The cache is set-associative: an address hashes to a set of
+ * PAGE_CACHE_WAYS items and may be cached in any of them.  When the set
+ * is full, the victim is chosen with the CLOCK algorithm among the pages
+ * that are older than CACHED_PAGE_LIFETIME bitmap generations.
+ */
 struct PageCache {
+    struct rcu_head rcu;
     CacheItem *page_cache;
+    /* CLOCK hand of each set */
+    uint8_t *set_hand;
     size_t page_size;
     size_t max_num_items;
     size_t num_items;
+    size_t num_ways;
+    size_t num_sets;
+    /* set i is protected by shards[i & (num_shards - 1)] */
+    PageCacheShard *shards;
+    size_t num_shards;
 };
 
 PageCache *cache_init(uint64_t new_size, size_t page_size, Error **errp)
@@ -64,6 +94,9 @@ PageCache *cache_init(uint64_t new_size, size_t page_size, Error **errp)
     cache->page_size = page_size;
     cache->num_items = 0;
     cache->max_num_items = num_pages;
+    cache->num_ways = MIN(num_pages, PAGE_CACHE_WAYS);
+    cache->num_sets = num_pages / cache->num_ways;
+    cache->num_shards = MIN(cache->num_sets, PAGE_CACHE_MAX_SHARDS);
 
     trace_migration_pagecache_init(cache->max_num_items);
 
@@ -76,10 +109,24 @@ PageCache *cache_init(uint64_t new_size, size_t page_size, Error **errp)
         return NULL;
     }
 
+    cache->set_hand = g_try_malloc0(cache->num_sets);
+    if (!cache->set_hand) {
+        error_setg(errp, "Failed to allocate page cache");
+        g_free(cache->page_cache);
+        g_free(cache);
+        return NULL;
+    }
+
     for (i = 0; i < cache->max_num_items; i++) {
         cache->page_cache[i].it_data = NULL;
         cache->page_cache[i].it_age = 0;
         cache->page_cache[i].it_addr = -1;
+        cache->page_cache[i].it_ref = false;
+    }
+
+    cache->shards = g_new0(PageCacheShard, cache->num_shards);
+    for (i = 0; i < cache->num_shards; i++) {
+        qemu_mutex_init(&cache->shards[i].lock);
     }
 
     return cache;
@@ -98,62 +145,164 @@ void cache_fini(PageCache *cache)
 
     g_free(cache->page_cache);
     cache->page_cache = NULL;
+    g_free(cache->set_hand);
+
+    for (i = 0; i < cache->num_shards; i++) {
+        qemu_mutex_destroy(&cache->shards[i].lock);
+    }
+    g_free(cache->shards);
     g_free(cache);
 }
 
-static size_t cache_get_cache_pos(const PageCache *cache,
-                                  uint64_t address)
+void cache_fini_rcu(PageCache *cache)
 {
-    g_assert(cache->max_num_items);
-    return (address / cache->page_size) & (cache->max_num_items - 1);
+    call_rcu(cache, cache_fini, rcu);
 }
 
-static CacheItem *cache_get_by_addr(const PageCache *cache, uint64_t addr)
+static size_t cache_get_set(const PageCache *cache, uint64_t address)
 {
-    size_t pos;
+    g_assert(cache->num_sets);
+    return (address / cache->page_size) & (cache->num_sets - 1);
+}
 
+static CacheItem *cache_get_set_items(const PageCache *cache, size_t set)
+{
     g_assert(cache);
     g_assert(cache->page_cache);
 
-    pos = cache_get_cache_pos(cache, addr);
+    return &cache->page_cache[set * cache->num_ways];
+}
+
+static CacheItem *cache_get_by_addr(const PageCache *cache, uint64_t addr)
+{
+    CacheItem *items = cache_get_set_items(cache, cache_get_set(cache, addr));
+    size_t i;
+
+    for (i = 0; i < cache->num_ways; i++) {
+        if (items[i].it_addr == addr) {
+            return &items[i];
+        }
+    }
+    return NULL;
+}
+
+static PageCacheShard *cache_get_shard(const PageCache *cache, uint64_t addr)
+{
+    size_t set = cache_get_set(cache, addr);
+
+    return &cache->shards[set & (cache->num_shards - 1)];
+}
+
+void cache_lock(PageCache *cache, uint64_t addr)
+{
+    qemu_mutex_lock(&cache_get_shard(cache, addr)->lock);
+}
 
-    return &cache->page_cache[pos];
+void cache_unlock(PageCache *cache, uint64_t addr)
+{
+    qemu_mutex_unlock(&cache_get_shard(cache, addr)->lock);
+}
+
+void cache_get_stats(const PageCache *cache, uint64_t *hits,
+                     uint64_t *evictions)
+{
+    size_t i;
+
+    *hits = 0;
+    *evictions = 0;
+    for (i = 0; i < cache->num_shards; i++) {
+        *hits += qatomic_read(&cache->shards[i].hits);
+        *evictions += qatomic_read(&cache->shards[i].evictions);
+    }
 }
 
 uint8_t *get_cached_data(const PageCache *cache, uint64_t addr)
 {
-    return cache_get_by_addr(cache, addr)->it_data;
+    CacheItem *it = cache_get_by_addr(cache, addr);
+
+    return it ? it->it_data : NULL;
 }
 
 bool cache_is_cached(const PageCache *cache, uint64_t addr,
                      uint64_t current_age)
 {
+    PageCacheShard *shard = cache_get_shard(cache, addr);
     CacheItem *it;
 
     it = cache_get_by_addr(cache, addr);
 
-    if (it->it_addr == addr) {
+    if (it) {
         /* update the it_age when the cache hit */
         it->it_age = current_age;
+        it->it_ref = true;
+        /* Writers are serialized by the shard lock */
+        qatomic_set(&shard->hits, shard->hits + 1);
         return true;
     }
     return false;
 }
 
+/*
+ * Find the item of the set to store a new page in: a free one if any,
+ * otherwise the first page that the CLOCK hand finds unreferenced and
+ * old enough.  The hand clears the reference bits that it passes over,
+ * so a page that was hit gets a second chance.  Returns NULL if all the
+ * pages of the set are fresh.
+ */
+static CacheItem *cache_get_victim(PageCache *cache, size_t set,
+                                   uint64_t current_age)
+{
+    CacheItem *items = cache_get_set_items(cache, set);
+    size_t hand = cache->set_hand[set];
+    size_t i;
+
+    for (i = 0; i < cache->num_ways; i++) {
+        if (!items[i].it_data) {
+            return &items[i];
+        }
+    }
+
+    /* Two turns are enough to find a page whose bit was cleared */
+    for (i = 0; i < 2 * cache->num_ways; i++) {
+        CacheItem *it = &items[hand];
+
+        hand = (hand + 1) % cache->num_ways;
+        if (it->it_age + CACHED_PAGE_LIFETIME > current_age) {
+            /* the cache page is fresh, don't replace it */
+            continue;
+        }
+        if (it->it_ref) {
+            it->it_ref = false;
+            continue;
+        }
+        cache->set_hand[set] = hand;
+        return it;
+    }
+
+    cache->set_hand[set] = hand;
+    return NULL;
+}
+
 int cache_insert(PageCache *cache, uint64_t addr, const uint8_t *pdata,
                  uint64_t current_age)
 {
-
+    PageCacheShard *shard = cache_get_shard(cache, addr);
     CacheItem *it;
 
     /* actual update of entry */
     it = cache_get_by_addr(cache, addr);
 
-    if (it->it_data && it->it_addr != addr &&
-        it->it_age + CACHED_PAGE_LIFETIME > current_age) {
-        /* the cache page is fresh, don't replace it */
-        return -1;
+    if (!it) {
+        it = cache_get_victim(cache, cache_get_set(cache, addr), current_age);
+        if (!it) {
+            return -1;
+        }
+        if (it->it_data) {
+            qatomic_set(&shard->evictions, shard->evictions + 1);
+        }
+        it->it_ref = false;
     }
+
     /* allocate page */
     if (!it->it_data) {
         it->it_data = g_try_malloc(cache->page_size);
@@ -161,7 +310,7 @@ int cache_insert(PageCache *cache, uint64_t addr, const uint8_t *pdata,
             trace_migration_pagecache_insert();
             return -1;
         }
-        cache->num_items++;
+        qatomic_inc(&cache->num_items);
     }
 
     memcpy(it->it_data, pdata, cache->page_size);
@@ -1,6 +1,6 @@
 /*
  * Page cache for QEMU
- * The cache is base on a hash of the page address
+ * The cache is a set-associative cache indexed by a hash of the page address
  *
  * Copyright 2012 Red Hat, Inc. and/or its affiliates
  *
@@ -35,6 +35,50 @@ PageCache *cache_init(uint64_t cache_size, size_t page_size, Error **errp);
  */
 void cache_fini(PageCache *cache);
 
+/**
+ * cache_fini_rcu: free all cache resources after an RCU grace period
+ *
+ * For caches that are reached through an RCU-protected pointer; the
+ * pointer must have been updated before the call.
+ *
+ * @cache pointer to the PageCache struct
+ */
+void cache_fini_rcu(PageCache *cache);
+
+/**
+ * cache_lock: lock the part of the cache that holds an addr
+ *
+ * The cache may be used from several threads at once, provided that every
+ * access for an addr, including the use of the pointer returned by
+ * get_cached_data(), happens between cache_lock() and cache_unlock() for
+ * that addr.  A single user does not need to lock.
+ *
+ * @cache pointer to the PageCache struct
+ * @addr: page addr
+ */
+void cache_lock(PageCache *cache, uint64_t addr);
+
+/**
+ * cache_unlock: unlock the part of the cache that holds an addr
+ *
+ * @cache pointer to the PageCache struct
+ * @addr: page addr
+ */
+void cache_unlock(PageCache *cache, uint64_t addr);
+
+/**
+ * cache_get_stats: Get the statistics of the cache
+ *
+ * May be called concurrently with the other users of the cache, without
+ * any lock.
+ *
+ * @cache pointer to the PageCache struct
+ * @hits: set to the number of cache_is_cached() calls that found the page
+ * @evictions: set to the number of pages replaced by cache_insert()
+ */
+void cache_get_stats(const PageCache *cache, uint64_t *hits,
+                     uint64_t *evictions);
+
 /**
  * cache_is_cached: Checks to see if the page is cached
  *
@@ -61,6 +105,9 @@ uint8_t *get_cached_data(const PageCache *cache, uint64_t addr);
  * cache_insert: insert the page into the cache. the page cache
  * will dup the data on insert. the previous value will be overwritten
  *
+ * When the set of the page is full, the least recently hit page that has
+ * not been touched in the last two bitmap generations is evicted.
+ *
  * Returns -1 when the page isn't inserted into cache
  *
  * @cache pointer to the PageCache struct
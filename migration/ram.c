@@ -31,6 +31,7 @@
 #include "qemu/bitops.h"
 #include "qemu/bitmap.h"
 #include "qemu/madvise.h"
+#include "qemu/units.h"
 #include "qemu/main-loop.h"
 #include "xbzrle.h"
 #include "ram.h"
@@ -57,6 +58,7 @@
 #include "system/ramblock.h"
 #include "savevm.h"
 #include "qemu/iov.h"
+#include "block/thread-pool.h"
 #include "multifd.h"
 #include "system/runstate.h"
 #include "rdma.h"
@@ -150,9 +152,14 @@ static struct {
     uint8_t *encoded_buf;
     /* buffer for storing page content */
     uint8_t *current_buf;
-    /* Cache for XBZRLE, Protected by lock. */
+    /*
+     * Cache for XBZRLE, Protected by lock.  The multifd sender threads
+     * read it under RCU instead, see xbzrle_multifd_cache().
+     */
     PageCache *cache;
     QemuMutex lock;
+    /* Set once XBZRLE encoding has started, see RAMState.xbzrle_started */
+    bool started;
     /* it will store a page full of zeros */
     uint8_t *zero_target_page;
     /* buffer used for XBZRLE decoding */
@@ -173,6 +180,46 @@ static void XBZRLE_cache_unlock(void)
     }
 }
 
+/*
+ * Replace the XBZRLE cache, keeping the statistics of the old cache in
+ * xbzrle_counters.  Must be called with XBZRLE.lock held.
+ */
+static void xbzrle_cache_replace(PageCache *new_cache)
+{
+    PageCache *old_cache = qatomic_xchg(&XBZRLE.cache, new_cache);
+    uint64_t hits, evictions;
+
+    cache_get_stats(old_cache, &hits, &evictions);
+    qatomic_add(&xbzrle_counters.cache_hit, hits);
+    qatomic_add(&xbzrle_counters.cache_eviction, evictions);
+    cache_fini_rcu(old_cache);
+}
+
+/**
+ * xbzrle_cache_get_stats: get the hit and eviction counts of the cache
+ *
+ * Does not take XBZRLE.lock, which the migration thread may hold for a
+ * whole iteration.
+ *
+ * @hits: set to the number of cache hits
+ * @evictions: set to the number of pages evicted from the cache
+ */
+void xbzrle_cache_get_stats(int64_t *hits, int64_t *evictions)
+{
+    uint64_t cache_hits = 0, cache_evictions = 0;
+    PageCache *cache;
+
+    RCU_READ_LOCK_GUARD();
+
+    cache = qatomic_rcu_read(&XBZRLE.cache);
+    if (cache) {
+        cache_get_stats(cache, &cache_hits, &cache_evictions);
+    }
+    *hits = qatomic_read(&xbzrle_counters.cache_hit) + cache_hits;
+    *evictions = qatomic_read(&xbzrle_counters.cache_eviction) +
+                 cache_evictions;
+}
+
 /**
  * xbzrle_cache_resize: resize the xbzrle cache
  *
@@ -211,8 +258,7 @@ int xbzrle_cache_resize(uint64_t new_size, Error **errp)
             goto out;
         }
 
-        cache_fini(XBZRLE.cache);
-        XBZRLE.cache = new_cache;
+        xbzrle_cache_replace(new_cache);
     }
 out:
     XBZRLE_cache_unlock();
@@ -407,6 +453,8 @@ struct RAMState {
     uint64_t target_page_count;
     /* number of dirty bits in the bitmap */
     uint64_t migration_dirty_pages;
+    /* workers of the dirty bitmap sync, see dirty-sync-threads */
+    ThreadPool *sync_pool;
     /*
      * Protects:
      * - dirty/clear bitmap
@@ -602,10 +650,33 @@ void mig_throttle_counter_reset(void)
  */
 static void xbzrle_cache_zero_page(ram_addr_t current_addr)
 {
+    /*
+     * The multifd sender threads may be using the cache too when zero
+     * pages are detected here.
+     */
+    cache_lock(XBZRLE.cache, current_addr);
     /* We don't care if this fails to allocate a new cache page
      * as long as it updated an old one */
     cache_insert(XBZRLE.cache, current_addr, XBZRLE.zero_target_page,
                  qatomic_read(&mig_stats.dirty_sync_count));
+    cache_unlock(XBZRLE.cache, current_addr);
+}
+
+/**
+ * xbzrle_multifd_cache: get the XBZRLE cache from a multifd sender thread
+ *
+ * Returns the cache once XBZRLE encoding has started, NULL otherwise.
+ *
+ * Must be called within an RCU read-side critical section, which keeps
+ * the cache alive across a concurrent resize or cleanup.  Accesses to the
+ * cache must be done with cache_lock() held.
+ */
+PageCache *xbzrle_multifd_cache(void)
+{
+    if (!qatomic_read(&XBZRLE.started)) {
+        return NULL;
+    }
+    return qatomic_rcu_read(&XBZRLE.cache);
 }
 
 #define ENCODING_FLAG_XBZRLE 0x1
@@ -936,61 +1007,98 @@ bool ramblock_page_is_discarded(RAMBlock *rb, ram_addr_t start)
     return false;
 }
 
+/* start address and length is aligned at the start of a word? */
+static bool physical_memory_sync_is_aligned(RAMBlock *rb, ram_addr_t start,
+                                            ram_addr_t length)
+{
+    unsigned long word = BIT_WORD((start + rb->offset) >> TARGET_PAGE_BITS);
+
+    return ((word * BITS_PER_LONG) << TARGET_PAGE_BITS) ==
+           (start + rb->offset) &&
+           !(length & ((BITS_PER_LONG << TARGET_PAGE_BITS) - 1));
+}
+
+/*
+ * Move the dirty bits of a word-aligned range from the global dirty
+ * memory blocks @src to the migration bitmap of @rb.  Ranges that do not
+ * share a bitmap word can be handled concurrently.
+ */
+static uint64_t physical_memory_sync_dirty_words(RAMBlock *rb,
+                                                 unsigned long * const *src,
+                                                 ram_addr_t start,
+                                                 ram_addr_t length)
+{
+    unsigned long word = BIT_WORD((start + rb->offset) >> TARGET_PAGE_BITS);
+    uint64_t num_dirty = 0;
+    unsigned long *dest = rb->bmap;
+    int k;
+    int nr = BITS_TO_LONGS(length >> TARGET_PAGE_BITS);
+    unsigned long idx = (word * BITS_PER_LONG) / DIRTY_MEMORY_BLOCK_SIZE;
+    unsigned long offset = BIT_WORD((word * BITS_PER_LONG) %
+                                    DIRTY_MEMORY_BLOCK_SIZE);
+    unsigned long page = BIT_WORD(start >> TARGET_PAGE_BITS);
+
+    for (k = page; k < page + nr; k++) {
+        if (src[idx][offset]) {
+            unsigned long bits = qatomic_xchg(&src[idx][offset], 0);
+            unsigned long new_dirty;
+            new_dirty = ~dest[k];
+            dest[k] |= bits;
+            new_dirty &= bits;
+            num_dirty += ctpopl(new_dirty);
+        }
+
+        if (++offset >= BITS_TO_LONGS(DIRTY_MEMORY_BLOCK_SIZE)) {
+            offset = 0;
+            idx++;
+        }
+    }
+
+    return num_dirty;
+}
+
+/*
+ * Finish the sync of a word-aligned range once its dirty bits were moved
+ * by physical_memory_sync_dirty_words().
+ */
+static void physical_memory_sync_dirty_done(RAMBlock *rb, ram_addr_t start,
+                                            ram_addr_t length,
+                                            uint64_t num_dirty)
+{
+    if (num_dirty) {
+        physical_memory_dirty_bits_cleared(start, length);
+    }
+
+    if (rb->clear_bmap) {
+        /*
+         * Postpone the dirty bitmap clear to the point before we
+         * really send the pages, also we will split the clear
+         * dirty procedure into smaller chunks.
+         */
+        clear_bmap_set(rb, start >> TARGET_PAGE_BITS,
+                       length >> TARGET_PAGE_BITS);
+    } else {
+        /* Slow path - still do that in a huge chunk */
+        memory_region_clear_dirty_bitmap(rb->mr, start, length);
+    }
+}
+
 /* Called with RCU critical section */
 static uint64_t physical_memory_sync_dirty_bitmap(RAMBlock *rb,
                                                   ram_addr_t start,
                                                   ram_addr_t length)
 {
-    unsigned long word = BIT_WORD((start + rb->offset) >> TARGET_PAGE_BITS);
     uint64_t num_dirty = 0;
     unsigned long *dest = rb->bmap;
 
-    /* start address and length is aligned at the start of a word? */
-    if (((word * BITS_PER_LONG) << TARGET_PAGE_BITS) ==
-         (start + rb->offset) &&
-        !(length & ((BITS_PER_LONG << TARGET_PAGE_BITS) - 1))) {
-        int k;
-        int nr = BITS_TO_LONGS(length >> TARGET_PAGE_BITS);
+    if (physical_memory_sync_is_aligned(rb, start, length)) {
         unsigned long * const *src;
-        unsigned long idx = (word * BITS_PER_LONG) / DIRTY_MEMORY_BLOCK_SIZE;
-        unsigned long offset = BIT_WORD((word * BITS_PER_LONG) %
-                                        DIRTY_MEMORY_BLOCK_SIZE);
-        unsigned long page = BIT_WORD(start >> TARGET_PAGE_BITS);
 
         src = qatomic_rcu_read(
                 &ram_list.dirty_memory[DIRTY_MEMORY_MIGRATION])->blocks;
 
-        for (k = page; k < page + nr; k++) {
-            if (src[idx][offset]) {
-                unsigned long bits = qatomic_xchg(&src[idx][offset], 0);
-                unsigned long new_dirty;
-                new_dirty = ~dest[k];
-                dest[k] |= bits;
-                new_dirty &= bits;
-                num_dirty += ctpopl(new_dirty);
-            }
-
-            if (++offset >= BITS_TO_LONGS(DIRTY_MEMORY_BLOCK_SIZE)) {
-                offset = 0;
-                idx++;
-            }
-        }
-        if (num_dirty) {
-            physical_memory_dirty_bits_cleared(start, length);
-        }
-
-        if (rb->clear_bmap) {
-            /*
-             * Postpone the dirty bitmap clear to the point before we
-             * really send the pages, also we will split the clear
-             * dirty procedure into smaller chunks.
-             */
-            clear_bmap_set(rb, start >> TARGET_PAGE_BITS,
-                           length >> TARGET_PAGE_BITS);
-        } else {
-            /* Slow path - still do that in a huge chunk */
-            memory_region_clear_dirty_bitmap(rb->mr, start, length);
-        }
+        num_dirty = physical_memory_sync_dirty_words(rb, src, start, length);
+        physical_memory_sync_dirty_done(rb, start, length, num_dirty);
     } else {
         num_dirty = physical_memory_test_and_clear_dirty(
                         start + rb->offset,
@@ -1012,6 +1120,104 @@ static void ramblock_sync_dirty_bitmap(RAMState *rs, RAMBlock *rb)
     rs->num_dirty_pages_period += new_dirty_pages;
 }
 
+/* Guest RAM handled by each job of a parallel dirty bitmap sync */
+#define RAMBLOCK_SYNC_CHUNK_SIZE (1 * GiB)
+
+typedef struct RAMBlockSyncJob {
+    RAMBlock *rb;
+    unsigned long * const *src;
+    ram_addr_t start;
+    ram_addr_t length;
+    uint64_t num_dirty;
+} RAMBlockSyncJob;
+
+static int ramblock_sync_job_run(void *opaque)
+{
+    RAMBlockSyncJob *job = opaque;
+
+    job->num_dirty = physical_memory_sync_dirty_words(job->rb, job->src,
+                                                      job->start,
+                                                      job->length);
+    return 0;
+}
+
+/*
+ * Sync the dirty bitmap of all RAMBlocks, splitting the word-aligned ones
+ * into chunks that the workers of @pool merge concurrently.  The rest of
+ * the work, which calls into the memory API, stays in this thread.
+ *
+ * Called with RCU critical section and bitmap_mutex held; the RCU
+ * critical section keeps the dirty memory blocks alive for the workers.
+ */
+static void ramblock_sync_dirty_bitmap_parallel(RAMState *rs, ThreadPool *pool)
+{
+    g_autoptr(GPtrArray) jobs = g_ptr_array_new_with_free_func(g_free);
+    unsigned long * const *src;
+    RAMBlockSyncJob *job;
+    RAMBlock *block;
+    uint64_t num_dirty = 0;
+    guint i;
+
+    src = qatomic_rcu_read(
+            &ram_list.dirty_memory[DIRTY_MEMORY_MIGRATION])->blocks;
+
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        ram_addr_t start;
+
+        if (!physical_memory_sync_is_aligned(block, 0, block->used_length)) {
+            ramblock_sync_dirty_bitmap(rs, block);
+            continue;
+        }
+
+        for (start = 0; start < block->used_length;
+             start += RAMBLOCK_SYNC_CHUNK_SIZE) {
+            job = g_new0(RAMBlockSyncJob, 1);
+            job->rb = block;
+            job->src = src;
+            job->start = start;
+            job->length = MIN(block->used_length - start,
+                              RAMBLOCK_SYNC_CHUNK_SIZE);
+            g_ptr_array_add(jobs, job);
+            thread_pool_submit(pool, ramblock_sync_job_run, job, NULL);
+        }
+    }
+
+    thread_pool_wait(pool);
+
+    /* The jobs of a block are contiguous in the array */
+    for (i = 0; i < jobs->len; i++) {
+        job = g_ptr_array_index(jobs, i);
+        num_dirty += job->num_dirty;
+
+        if (i + 1 == jobs->len ||
+            ((RAMBlockSyncJob *)g_ptr_array_index(jobs, i + 1))->rb !=
+            job->rb) {
+            physical_memory_sync_dirty_done(job->rb, 0, job->rb->used_length,
+                                            num_dirty);
+            rs->migration_dirty_pages += num_dirty;
+            rs->num_dirty_pages_period += num_dirty;
+            num_dirty = 0;
+        }
+    }
+}
+
+/* Returns the worker pool for the dirty bitmap sync, or NULL if disabled */
+static ThreadPool *migration_bitmap_sync_pool(RAMState *rs)
+{
+    uint8_t threads = migrate_dirty_sync_threads();
+
+    if (!threads) {
+        return NULL;
+    }
+
+    if (!rs->sync_pool) {
+        rs->sync_pool = thread_pool_new();
+    }
+    thread_pool_set_max_threads(rs->sync_pool, threads);
+
+    return rs->sync_pool;
+}
+
 /**
  * ram_pagesize_summary: calculate all the pagesizes of a VM
  *
@@ -1040,14 +1246,27 @@ uint64_t ram_get_total_transferred_pages(void)
             xbzrle_counters.pages);
 }
 
+static void migration_update_dirty_rate_dist(uint64_t dirty_pages_rate)
+{
+    uint64_t rate_mib = dirty_pages_rate * TARGET_PAGE_SIZE / MiB;
+    int index = 0;
+
+    if (rate_mib) {
+        index = MIN(64 - clz64(rate_mib), DIRTY_RATE_DIST_BUCKETS - 1);
+    }
+    qatomic_inc(&mig_stats.dirty_rate_dist[index]);
+}
+
 static void migration_update_rates(RAMState *rs, int64_t end_time)
 {
     uint64_t page_count = rs->target_page_count - rs->target_page_count_prev;
+    uint64_t dirty_pages_rate;
 
     /* calculate period counters */
-    qatomic_set(&mig_stats.dirty_pages_rate,
-               rs->num_dirty_pages_period * 1000 /
-               (end_time - rs->time_last_bitmap_sync));
+    dirty_pages_rate = rs->num_dirty_pages_period * 1000 /
+                       (end_time - rs->time_last_bitmap_sync);
+    qatomic_set(&mig_stats.dirty_pages_rate, dirty_pages_rate);
+    migration_update_dirty_rate_dist(dirty_pages_rate);
 
     if (!page_count) {
         return;
@@ -1133,8 +1352,10 @@ static void migration_trigger_throttle(RAMState *rs)
 
 static void migration_bitmap_sync(RAMState *rs, bool last_stage)
 {
+    ThreadPool *pool = migration_bitmap_sync_pool(rs);
+    int64_t start_us = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
     RAMBlock *block;
-    int64_t end_time;
+    int64_t end_time, sync_us;
 
     qatomic_add(&mig_stats.dirty_sync_count, 1);
 
@@ -1147,8 +1368,12 @@ static void migration_bitmap_sync(RAMState *rs, bool last_stage)
 
     WITH_QEMU_LOCK_GUARD(&rs->bitmap_mutex) {
         WITH_RCU_READ_LOCK_GUARD() {
-            RAMBLOCK_FOREACH_NOT_IGNORED(block) {
-                ramblock_sync_dirty_bitmap(rs, block);
+            if (pool) {
+                ramblock_sync_dirty_bitmap_parallel(rs, pool);
+            } else {
+                RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+                    ramblock_sync_dirty_bitmap(rs, block);
+                }
             }
             qatomic_set(&mig_stats.dirty_bytes_last_sync, ram_bytes_remaining());
         }
@@ -1157,6 +1382,10 @@ static void migration_bitmap_sync(RAMState *rs, bool last_stage)
     memory_global_after_dirty_log_sync();
     trace_migration_bitmap_sync_end(rs->num_dirty_pages_period);
 
+    sync_us = qemu_clock_get_us(QEMU_CLOCK_REALTIME) - start_us;
+    qatomic_set(&mig_stats.dirty_sync_time_last, sync_us);
+    qatomic_add(&mig_stats.dirty_sync_time, sync_us);
+
     end_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
 
     /* more than 1 second = 1000 millisecons */
@@ -1402,6 +1631,7 @@ static int find_dirty_block(RAMState *rs, PageSearchStatus *pss)
             /* After the first round, enable XBZRLE. */
             if (migrate_xbzrle()) {
                 rs->xbzrle_started = true;
+                qatomic_set(&XBZRLE.started, true);
             }
         }
         /* Didn't find anything this time, but try again on the new block */
@@ -2422,6 +2652,7 @@ static void ram_state_cleanup(RAMState **rsp)
 {
     if (*rsp) {
         migration_page_queue_free(*rsp);
+        g_clear_pointer(&(*rsp)->sync_pool, thread_pool_free);
         qemu_mutex_destroy(&(*rsp)->bitmap_mutex);
         qemu_mutex_destroy(&(*rsp)->src_page_req_mutex);
         g_free(*rsp);
@@ -2433,11 +2664,11 @@ static void xbzrle_cleanup(void)
 {
     XBZRLE_cache_lock();
     if (XBZRLE.cache) {
-        cache_fini(XBZRLE.cache);
+        qatomic_set(&XBZRLE.started, false);
+        xbzrle_cache_replace(NULL);
         g_free(XBZRLE.encoded_buf);
         g_free(XBZRLE.current_buf);
         g_free(XBZRLE.zero_target_page);
-        XBZRLE.cache = NULL;
         XBZRLE.encoded_buf = NULL;
         XBZRLE.current_buf = NULL;
         XBZRLE.zero_target_page = NULL;
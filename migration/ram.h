@@ -33,6 +33,7 @@
 #include "exec/cpu-common.h"
 #include "system/ram_addr.h"
 #include "io/channel.h"
+#include "page_cache.h"
 
 /*
  * RAM_SAVE_FLAG_ZERO used to be named RAM_SAVE_FLAG_COMPRESS, it
@@ -75,6 +76,8 @@ extern XBZRLECacheStats xbzrle_counters;
 
 void ram_mig_init(void);
 int xbzrle_cache_resize(uint64_t new_size, Error **errp);
+PageCache *xbzrle_multifd_cache(void);
+void xbzrle_cache_get_stats(int64_t *hits, int64_t *evictions);
 uint64_t ram_bytes_remaining(void);
 uint64_t ram_bytes_total(void);
 void mig_throttle_counter_reset(void);
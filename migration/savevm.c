@@ -1631,6 +1631,9 @@ int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
 
         trace_vmstate_downtime_save("iterable", se->idstr, se->instance_id,
                                     end_ts_each - start_ts_each);
+        migration_downtime_record_save(MIGRATION_DOWNTIME_SECTION_ITERABLE,
+                                       se->idstr, se->instance_id,
+                                       end_ts_each - start_ts_each);
     }
 
     if (multifd_device_state) {
@@ -1690,6 +1693,9 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
         end_ts_each = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
         trace_vmstate_downtime_save("non-iterable", se->idstr, se->instance_id,
                                     end_ts_each - start_ts_each);
+        migration_downtime_record_save(MIGRATION_DOWNTIME_SECTION_NON_ITERABLE,
+                                       se->idstr, se->instance_id,
+                                       end_ts_each - start_ts_each);
     }
 
     if (!in_postcopy) {
@@ -1950,7 +1956,8 @@ static int loadvm_postcopy_handle_advise(MigrationIncomingState *mis,
         return -EINVAL;
     }
 
-    if (!postcopy_ram_supported_by_host(mis, errp)) {
+    if (migration_postcopy_is_blocked(errp) ||
+        !postcopy_ram_supported_by_host(mis, errp)) {
         postcopy_state_set(POSTCOPY_INCOMING_NONE);
         return -1;
     }
@@ -2663,6 +2670,9 @@ qemu_loadvm_section_start_full(QEMUFile *f, uint8_t type, Error **errp)
         end_ts = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
         trace_vmstate_downtime_load("non-iterable", se->idstr,
                                     se->instance_id, end_ts - start_ts);
+        migration_downtime_record_load(MIGRATION_DOWNTIME_SECTION_NON_ITERABLE,
+                                       se->idstr, se->instance_id,
+                                       end_ts - start_ts);
     }
 
     if (!check_section_footer(f, se)) {
@@ -2715,6 +2725,9 @@ qemu_loadvm_section_part_end(QEMUFile *f, uint8_t type, Error **errp)
         end_ts = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
         trace_vmstate_downtime_load("iterable", se->idstr,
                                     se->instance_id, end_ts - start_ts);
+        migration_downtime_record_load(MIGRATION_DOWNTIME_SECTION_ITERABLE,
+                                       se->idstr, se->instance_id,
+                                       end_ts - start_ts);
     }
 
     if (!check_section_footer(f, se)) {
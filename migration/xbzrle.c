@@ -15,10 +15,156 @@
 #include "qemu/host-utils.h"
 #include "xbzrle.h"
 
-#if defined(CONFIG_AVX512BW_OPT)
+#if defined(CONFIG_AVX2_OPT) || defined(CONFIG_AVX512BW_OPT)
 #include <immintrin.h>
 #include "host/cpuinfo.h"
+#elif defined(HOST_AARCH64)
+#include <arm_neon.h>
+#endif
+
+#if defined(CONFIG_AVX2_OPT) || defined(HOST_AARCH64)
+/*
+ * Encoder shared by the vector implementations.  @eq_mask compares 64
+ * bytes of the old and new buffers and returns a mask with bit N set if
+ * byte N is unchanged; the runs are then found with ctz64 on that mask.
+ */
+static inline int QEMU_ALWAYS_INLINE
+xbzrle_encode_buffer_mask(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                          uint8_t *dst, int dlen,
+                          uint64_t (*eq_mask)(const uint8_t *, const uint8_t *))
+{
+    uint32_t zrun_len = 0, nzrun_len = 0;
+    int d = 0, i = 0;
+    uint8_t *nzrun_start = NULL;
+
+    while (i < slen) {
+        int count = MIN(slen - i, 64);
+        uint64_t comp = 0;
+        int j = 0;
+
+        if (count == 64) {
+            comp = eq_mask(old_buf + i, new_buf + i);
+        } else {
+            for (int k = 0; k < count; k++) {
+                comp |= (uint64_t)(old_buf[i + k] == new_buf[i + k]) << k;
+            }
+        }
+
+        while (j < count) {
+            int num;
 
+            if (comp & 1) {
+                num = MIN(ctz64(~comp), count - j);
+                if (nzrun_len) {
+                    /* overflow */
+                    if (d + 2 > dlen) {
+                        return -1;
+                    }
+                    d += uleb128_encode_small(dst + d, nzrun_len);
+                    /* overflow */
+                    if (d + nzrun_len > dlen) {
+                        return -1;
+                    }
+                    memcpy(dst + d, nzrun_start, nzrun_len);
+                    d += nzrun_len;
+                    nzrun_len = 0;
+                }
+                zrun_len += num;
+            } else {
+                num = MIN(ctz64(comp), count - j);
+                if (!nzrun_len) {
+                    /* overflow */
+                    if (d + 2 > dlen) {
+                        return -1;
+                    }
+                    d += uleb128_encode_small(dst + d, zrun_len);
+                    zrun_len = 0;
+                    nzrun_start = new_buf + i + j;
+                }
+                nzrun_len += num;
+            }
+            comp = num < 64 ? comp >> num : 0;
+            j += num;
+        }
+        i += count;
+    }
+
+    if (nzrun_len) {
+        /* overflow */
+        if (d + 2 > dlen) {
+            return -1;
+        }
+        d += uleb128_encode_small(dst + d, nzrun_len);
+        /* overflow */
+        if (d + nzrun_len > dlen) {
+            return -1;
+        }
+        memcpy(dst + d, nzrun_start, nzrun_len);
+        d += nzrun_len;
+    }
+    return d;
+}
+#endif
+
+#if defined(CONFIG_AVX2_OPT)
+static inline uint64_t __attribute__((target("avx2")))
+xbzrle_eq_mask_avx2(const uint8_t *old_buf, const uint8_t *new_buf)
+{
+    __m256i old0 = _mm256_loadu_si256((const __m256i *)old_buf);
+    __m256i old1 = _mm256_loadu_si256((const __m256i *)(old_buf + 32));
+    __m256i new0 = _mm256_loadu_si256((const __m256i *)new_buf);
+    __m256i new1 = _mm256_loadu_si256((const __m256i *)(new_buf + 32));
+    uint32_t lo = _mm256_movemask_epi8(_mm256_cmpeq_epi8(old0, new0));
+    uint32_t hi = _mm256_movemask_epi8(_mm256_cmpeq_epi8(old1, new1));
+
+    return lo | ((uint64_t)hi << 32);
+}
+
+static int __attribute__((target("avx2")))
+xbzrle_encode_buffer_avx2(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                          uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_buffer_mask(old_buf, new_buf, slen, dst, dlen,
+                                     xbzrle_eq_mask_avx2);
+}
+#endif
+
+#if defined(HOST_AARCH64)
+static inline uint64_t
+xbzrle_eq_mask_neon(const uint8_t *old_buf, const uint8_t *new_buf)
+{
+    static const uint8_t weights[16] = {
+        1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128
+    };
+    uint8x16_t w = vld1q_u8(weights);
+    uint8x16_t c0, c1, c2, c3;
+
+    c0 = vandq_u8(vceqq_u8(vld1q_u8(old_buf), vld1q_u8(new_buf)), w);
+    c1 = vandq_u8(vceqq_u8(vld1q_u8(old_buf + 16),
+                           vld1q_u8(new_buf + 16)), w);
+    c2 = vandq_u8(vceqq_u8(vld1q_u8(old_buf + 32),
+                           vld1q_u8(new_buf + 32)), w);
+    c3 = vandq_u8(vceqq_u8(vld1q_u8(old_buf + 48),
+                           vld1q_u8(new_buf + 48)), w);
+
+    /* Fold each group of 8 weighted bytes into one byte of the mask */
+    c0 = vpaddq_u8(c0, c1);
+    c2 = vpaddq_u8(c2, c3);
+    c0 = vpaddq_u8(c0, c2);
+    c0 = vpaddq_u8(c0, c0);
+
+    return vgetq_lane_u64(vreinterpretq_u64_u8(c0), 0);
+}
+
+static int xbzrle_encode_buffer_neon(uint8_t *old_buf, uint8_t *new_buf,
+                                     int slen, uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_buffer_mask(old_buf, new_buf, slen, dst, dlen,
+                                     xbzrle_eq_mask_neon);
+}
+#endif
+
+#if defined(CONFIG_AVX512BW_OPT)
 static int __attribute__((target("avx512bw")))
 xbzrle_encode_buffer_avx512(uint8_t *old_buf, uint8_t *new_buf, int slen,
                             uint8_t *dst, int dlen)
@@ -136,20 +282,66 @@ xbzrle_encode_buffer_avx512(uint8_t *old_buf, uint8_t *new_buf, int slen,
     }
     return d;
 }
+#endif
 
 static int xbzrle_encode_buffer_int(uint8_t *old_buf, uint8_t *new_buf,
                                     int slen, uint8_t *dst, int dlen);
 
-static int (*accel_func)(uint8_t *, uint8_t *, int, uint8_t *, int);
+typedef int (*xbzrle_encode_fn)(uint8_t *, uint8_t *, int, uint8_t *, int);
 
-static void __attribute__((constructor)) init_accel(void)
+/* Ordered from slowest to fastest; index 0 is the portable encoder */
+static const xbzrle_encode_fn accel_table[] = {
+    xbzrle_encode_buffer_int,
+#if defined(CONFIG_AVX2_OPT)
+    xbzrle_encode_buffer_avx2,
+#endif
+#if defined(CONFIG_AVX512BW_OPT)
+    xbzrle_encode_buffer_avx512,
+#endif
+#if defined(HOST_AARCH64)
+    xbzrle_encode_buffer_neon,
+#endif
+};
+
+static xbzrle_encode_fn accel_func;
+static unsigned accel_index;
+
+static unsigned best_accel(void)
 {
+#if defined(CONFIG_AVX2_OPT) || defined(CONFIG_AVX512BW_OPT)
     unsigned info = cpuinfo_init();
+    unsigned index = ARRAY_SIZE(accel_table) - 1;
+
+#ifdef CONFIG_AVX512BW_OPT
     if (info & CPUINFO_AVX512BW) {
-        accel_func = xbzrle_encode_buffer_avx512;
-    } else {
-        accel_func = xbzrle_encode_buffer_int;
+        return index;
     }
+    index--;
+#endif
+#ifdef CONFIG_AVX2_OPT
+    if (info & CPUINFO_AVX2) {
+        return index;
+    }
+#endif
+    return 0;
+#else
+    return ARRAY_SIZE(accel_table) - 1;
+#endif
+}
+
+static void __attribute__((constructor)) init_accel(void)
+{
+    accel_index = best_accel();
+    accel_func = accel_table[accel_index];
+}
+
+bool test_xbzrle_encode_next_accel(void)
+{
+    if (accel_index != 0) {
+        accel_func = accel_table[--accel_index];
+        return true;
+    }
+    return false;
 }
 
 int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
@@ -158,9 +350,6 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
     return accel_func(old_buf, new_buf, slen, dst, dlen);
 }
 
-#define xbzrle_encode_buffer xbzrle_encode_buffer_int
-#endif
-
 /*
   page = zrun nzrun
        | zrun nzrun page
@@ -171,8 +360,8 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
 
   length = uleb128 encoded integer
  */
-int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
-                         uint8_t *dst, int dlen)
+static int xbzrle_encode_buffer_int(uint8_t *old_buf, uint8_t *new_buf,
+                                    int slen, uint8_t *dst, int dlen)
 {
     uint32_t zrun_len = 0, nzrun_len = 0;
     int d = 0, i = 0;
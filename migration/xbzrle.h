@@ -19,4 +19,11 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
 
 int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen);
 
+/*
+ * For use from tests and benchmarks: switch xbzrle_encode_buffer() to the
+ * next slower encoder available on this host.  Returns false once the
+ * portable encoder is in use.
+ */
+bool test_xbzrle_encode_next_accel(void);
+
 #endif
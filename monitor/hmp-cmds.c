@@ -208,6 +208,13 @@ void hmp_info_iothreads(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "  poll-shrink=%" PRId64 "\n", value->poll_shrink);
         monitor_printf(mon, "  aio-max-batch=%" PRId64 "\n",
                        value->aio_max_batch);
+        if (value->io_uring_sqpoll) {
+            monitor_printf(mon, "  io-uring-sqpoll: submissions=%" PRIu64
+                           " syscalls-avoided=%" PRIu64 " wakeups=%" PRIu64
+                           "\n", value->io_uring_sqpoll->submissions,
+                           value->io_uring_sqpoll->syscalls_avoided,
+                           value->io_uring_sqpoll->wakeups);
+        }
     }
 
     qapi_free_IOThreadInfoList(info_list);
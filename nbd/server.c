@@ -42,6 +42,19 @@
  */
 #define NBD_MAX_BLOCK_STATUS_EXTENTS (1 * MiB / 8)
 
+/*
+ * NBD_ZERO_COPY_MIN_LEN: read payloads shorter than this are copied to the
+ * socket even if the export uses MSG_ZEROCOPY, because pinning the pages
+ * and collecting the completion costs more than copying a few pages.
+ */
+#define NBD_ZERO_COPY_MIN_LEN (64 * KiB)
+
+/*
+ * NBD_ZERO_COPY_REAP_MS: how often buffers of completed zero copy writes
+ * are freed while no new requests come in.
+ */
+#define NBD_ZERO_COPY_REAP_MS 10
+
 static int system_errno_to_nbd_errno(int err)
 {
     switch (err) {
@@ -83,6 +96,12 @@ struct NBDRequestData {
     NBDClient *client;
     uint8_t *data;
     bool complete;
+
+    /* @data may have been sent with MSG_ZEROCOPY (NBD_CMD_READ only) */
+    bool zero_copy;
+    /* Number of zero copy writes on the socket that may reference @data */
+    ssize_t zero_copy_seq;
+    QSIMPLEQ_ENTRY(NBDRequestData) zero_copy_next;
 };
 
 struct NBDExport {
@@ -99,6 +118,7 @@ struct NBDExport {
     Notifier eject_notifier;
 
     bool allocation_depth;
+    bool zero_copy;
     BdrvDirtyBitmap **export_bitmaps;
     size_t nr_export_bitmaps;
 };
@@ -152,6 +172,16 @@ struct NBDClient {
     NBDMode mode;
     NBDMetaContexts contexts; /* Negotiated meta contexts */
 
+    /* Send read payloads with MSG_ZEROCOPY, see nbd_client_enable_zero_copy */
+    bool zero_copy;
+    /*
+     * Requests whose buffers the kernel may still reference, in the order
+     * in which they were sent.  Protected by lock.
+     */
+    QSIMPLEQ_HEAD(, NBDRequestData) zero_copy_reqs;
+    /* Frees zero_copy_reqs of an idle client, runs in the main loop */
+    QEMUTimer *zero_copy_timer;
+
     uint32_t opt; /* Current option being negotiated */
     uint32_t optlen; /* remaining length of data in ioc for the option being
                         negotiated now */
@@ -1556,6 +1586,52 @@ static int coroutine_fn nbd_receive_request(NBDClient *client, NBDRequest *reque
 
 #define MAX_NBD_REQUESTS 16
 
+static void nbd_request_free(NBDRequestData *req)
+{
+    if (req->data) {
+        qemu_vfree(req->data);
+    }
+    g_free(req);
+}
+
+/*
+ * Once the socket has been shut down the kernel does not need the payload
+ * any more; pages that are still in flight stay pinned until it is done
+ * with them, so the buffers can be freed immediately.
+ */
+static void nbd_client_free_zero_copy_reqs(NBDClient *client)
+{
+    NBDRequestData *req;
+
+    while ((req = QSIMPLEQ_FIRST(&client->zero_copy_reqs))) {
+        QSIMPLEQ_REMOVE_HEAD(&client->zero_copy_reqs, zero_copy_next);
+        nbd_request_free(req);
+    }
+}
+
+/*
+ * Free the buffers of requests whose zero copy writes have completed.
+ * Runs in export AioContext with client->lock held.
+ */
+static void nbd_client_reap_zero_copy(NBDClient *client)
+{
+    NBDRequestData *req;
+    Error *local_err = NULL;
+
+    if (qio_channel_socket_poll_zero_copy(client->sioc, &local_err) < 0) {
+        /* Keep the buffers until the client goes away */
+        trace_nbd_client_zero_copy_error(error_get_pretty(local_err));
+        error_free(local_err);
+        return;
+    }
+
+    while ((req = QSIMPLEQ_FIRST(&client->zero_copy_reqs)) &&
+           req->zero_copy_seq <= client->sioc->zero_copy_sent) {
+        QSIMPLEQ_REMOVE_HEAD(&client->zero_copy_reqs, zero_copy_next);
+        nbd_request_free(req);
+    }
+}
+
 /* Runs in export AioContext and main loop thread */
 void nbd_client_get(NBDClient *client)
 {
@@ -1583,6 +1659,8 @@ void nbd_client_put(NBDClient *client)
             blk_exp_unref(&client->exp->common);
         }
         g_free(client->contexts.bitmaps);
+        timer_free(client->zero_copy_timer);
+        nbd_client_free_zero_copy_reqs(client);
         qemu_mutex_destroy(&client->lock);
         g_free(client);
     }
@@ -1613,6 +1691,79 @@ static bool nbd_client_put_nonzero(NBDClient *client)
     return true;
 }
 
+static void nbd_client_put_bh(void *opaque)
+{
+    nbd_client_put(opaque);
+}
+
+/*
+ * Make sure that the buffers of requests that were sent with zero copy are
+ * freed even if the client stops sending requests.  The timer holds a
+ * reference to the client while it is pending.
+ *
+ * Runs in export AioContext and main loop thread with client->lock held.
+ */
+static void nbd_client_arm_zero_copy_timer(NBDClient *client)
+{
+    if (!client->zero_copy_timer || client->closing ||
+        QSIMPLEQ_EMPTY(&client->zero_copy_reqs) ||
+        timer_pending(client->zero_copy_timer)) {
+        return;
+    }
+
+    nbd_client_get(client);
+    timer_mod(client->zero_copy_timer,
+              qemu_clock_get_ms(QEMU_CLOCK_REALTIME) + NBD_ZERO_COPY_REAP_MS);
+}
+
+/* Runs in export AioContext */
+static void nbd_client_zero_copy_timer_cb(void *opaque)
+{
+    NBDClient *client = opaque;
+
+    WITH_QEMU_LOCK_GUARD(&client->lock) {
+        /* The timer is freed while the export changes AioContext */
+        if (client->zero_copy_timer) {
+            nbd_client_reap_zero_copy(client);
+            nbd_client_arm_zero_copy_timer(client);
+        }
+    }
+
+    if (!nbd_client_put_nonzero(client)) {
+        aio_bh_schedule_oneshot(qemu_get_aio_context(), nbd_client_put_bh,
+                                client);
+    }
+}
+
+/* Runs in main loop thread */
+static void nbd_client_new_zero_copy_timer(NBDClient *client,
+                                           AioContext *ctx)
+{
+    WITH_QEMU_LOCK_GUARD(&client->lock) {
+        client->zero_copy_timer = aio_timer_new(ctx, QEMU_CLOCK_REALTIME,
+                                                SCALE_MS,
+                                                nbd_client_zero_copy_timer_cb,
+                                                client);
+        nbd_client_arm_zero_copy_timer(client);
+    }
+}
+
+/* Runs in main loop thread */
+static void nbd_client_free_zero_copy_timer(NBDClient *client)
+{
+    bool pending;
+
+    WITH_QEMU_LOCK_GUARD(&client->lock) {
+        pending = timer_pending(client->zero_copy_timer);
+        timer_free(client->zero_copy_timer);
+        client->zero_copy_timer = NULL;
+    }
+
+    if (pending) {
+        nbd_client_put(client);
+    }
+}
+
 static void client_close(NBDClient *client, bool negotiated)
 {
     assert(qemu_in_main_thread());
@@ -1655,10 +1806,14 @@ static void nbd_request_put(NBDRequestData *req)
 {
     NBDClient *client = req->client;
 
-    if (req->data) {
-        qemu_vfree(req->data);
+    if (req->zero_copy && req->data) {
+        req->zero_copy_seq = client->sioc->zero_copy_queued;
+        QSIMPLEQ_INSERT_TAIL(&client->zero_copy_reqs, req, zero_copy_next);
+        nbd_client_reap_zero_copy(client);
+        nbd_client_arm_zero_copy_timer(client);
+    } else {
+        nbd_request_free(req);
     }
-    g_free(req);
 
     client->nb_requests--;
 
@@ -1686,17 +1841,27 @@ static void blk_aio_attached(AioContext *ctx, void *opaque)
             assert(client->recv_coroutine == NULL);
             assert(client->send_coroutine == NULL);
         }
+        if (client->zero_copy) {
+            nbd_client_new_zero_copy_timer(client, ctx);
+        }
     }
 }
 
 static void blk_aio_detach(void *opaque)
 {
     NBDExport *exp = opaque;
+    NBDClient *client, *next;
 
     assert(qemu_in_main_thread());
 
     trace_nbd_blk_aio_detach(exp->name, exp->common.ctx);
 
+    QTAILQ_FOREACH_SAFE(client, &exp->clients, next, next) {
+        if (client->zero_copy) {
+            nbd_client_free_zero_copy_timer(client);
+        }
+    }
+
     exp->common.ctx = NULL;
 }
 
@@ -1933,6 +2098,7 @@ static int nbd_export_create(BlockExport *blk_exp, BlockExportOptions *exp_args,
     }
 
     exp->allocation_depth = arg->allocation_depth;
+    exp->zero_copy = arg->zero_copy;
 
     /*
      * We need to inhibit request queuing in the block layer to ensure we can
@@ -2051,6 +2217,60 @@ static int coroutine_fn nbd_co_send_iov(NBDClient *client, struct iovec *iov,
     return ret;
 }
 
+/*
+ * Like nbd_co_send_iov(), but the last element of @iov is the payload of a
+ * read reply, which is sent with MSG_ZEROCOPY if the client uses it.  The
+ * kernel may then reference the payload after this function returns, until
+ * the data has been acknowledged; nbd_request_put() does not free it
+ * before that.
+ */
+static int coroutine_fn nbd_co_send_iov_payload(NBDClient *client,
+                                                struct iovec *iov,
+                                                unsigned niov, Error **errp)
+{
+    bool zero_copy = false;
+    int ret;
+
+    g_assert(qemu_in_coroutine());
+    qemu_co_mutex_lock(&client->send_lock);
+    client->send_coroutine = qemu_coroutine_self();
+
+    if (client->zero_copy && iov[niov - 1].iov_len >= NBD_ZERO_COPY_MIN_LEN) {
+        /*
+         * Bound the memory pinned by zero copy writes that the kernel has
+         * not completed yet, including those of requests still in flight.
+         * zero_copy_queued only changes under send_lock.
+         */
+        WITH_QEMU_LOCK_GUARD(&client->lock) {
+            nbd_client_reap_zero_copy(client);
+            zero_copy = client->sioc->zero_copy_queued -
+                        client->sioc->zero_copy_sent < MAX_NBD_REQUESTS;
+        }
+    }
+
+    if (!zero_copy) {
+        ret = qio_channel_writev_all(client->ioc, iov, niov, errp);
+    } else {
+        /* The reply headers live on the stack and must be copied */
+        ret = qio_channel_writev_all(client->ioc, iov, niov - 1, errp);
+        if (ret == 0) {
+            /*
+             * Once RLIMIT_MEMLOCK is exhausted, the rest of the payload is
+             * copied instead of failing the request.
+             */
+            ret = qio_channel_writev_full_all(
+                client->ioc, &iov[niov - 1], 1, NULL, 0,
+                QIO_CHANNEL_WRITE_FLAG_ZERO_COPY |
+                QIO_CHANNEL_WRITE_FLAG_ZERO_COPY_FALLBACK, errp);
+        }
+    }
+
+    client->send_coroutine = NULL;
+    qemu_co_mutex_unlock(&client->send_lock);
+
+    return ret < 0 ? -EIO : 0;
+}
+
 static inline void set_be_simple_reply(NBDSimpleReply *reply, uint64_t error,
                                        uint64_t cookie)
 {
@@ -2082,6 +2302,9 @@ static int coroutine_fn nbd_co_send_simple_reply(NBDClient *client,
                                    nbd_err_lookup(nbd_err), len);
     set_be_simple_reply(&reply, nbd_err, request->cookie);
 
+    if (len) {
+        return nbd_co_send_iov_payload(client, iov, 2, errp);
+    }
     return nbd_co_send_iov(client, iov, 2, errp);
 }
 
@@ -2163,7 +2386,7 @@ static int coroutine_fn nbd_co_send_chunk_read(NBDClient *client,
                  NBD_REPLY_TYPE_OFFSET_DATA, request);
     stq_be_p(&chunk.offset, offset);
 
-    return nbd_co_send_iov(client, iov, 3, errp);
+    return nbd_co_send_iov_payload(client, iov, 3, errp);
 }
 
 static int coroutine_fn nbd_co_send_chunk_error(NBDClient *client,
@@ -3147,6 +3370,7 @@ static coroutine_fn void nbd_trip(void *opaque)
                                      error_get_pretty(export_err), &local_err);
         error_free(export_err);
     } else {
+        req->zero_copy = client->zero_copy && request.type == NBD_CMD_READ;
         ret = nbd_handle_request(client, &request, req->data, &local_err);
     }
     if (request.contexts && request.contexts != &client->contexts) {
@@ -3213,6 +3437,29 @@ static void nbd_client_receive_next_request(NBDClient *client)
     }
 }
 
+/*
+ * Send read payloads with MSG_ZEROCOPY if the export asks for it.  This
+ * saves copying the payload into socket buffers; with cache.direct=on the
+ * data then goes from the disk to the NIC without being copied by the CPU.
+ * TLS needs to encrypt the data anyway, so it does not use zero copy.
+ */
+static void nbd_client_enable_zero_copy(NBDClient *client)
+{
+    Error *local_err = NULL;
+
+    if (!client->exp->zero_copy || client->ioc != QIO_CHANNEL(client->sioc)) {
+        return;
+    }
+
+    if (qio_channel_socket_set_zero_copy(client->sioc, &local_err) < 0) {
+        trace_nbd_client_zero_copy_error(error_get_pretty(local_err));
+        error_free(local_err);
+        return;
+    }
+    client->zero_copy = true;
+    nbd_client_new_zero_copy_timer(client, client->exp->common.ctx);
+}
+
 static void nbd_handshake_timer_cb(void *opaque)
 {
     QIOChannel *ioc = opaque;
@@ -3255,6 +3502,7 @@ static coroutine_fn void nbd_co_client_start(void *opaque)
     }
 
     timer_free(handshake_timer);
+    nbd_client_enable_zero_copy(client);
     WITH_QEMU_LOCK_GUARD(&client->lock) {
         nbd_client_receive_next_request(client);
     }
@@ -3278,6 +3526,7 @@ void nbd_client_new(QIOChannelSocket *sioc,
 
     client = g_new0(NBDClient, 1);
     qemu_mutex_init(&client->lock);
+    QSIMPLEQ_INIT(&client->zero_copy_reqs);
     client->refcount = 1;
     client->tlscreds = tlscreds;
     if (tlscreds) {
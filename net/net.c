@@ -48,6 +48,7 @@
 #include "qemu/iov.h"
 #include "qemu/qemu-print.h"
 #include "qemu/main-loop.h"
+#include "qemu/aio-wait.h"
 #include "qemu/option.h"
 #include "qemu/keyval.h"
 #include "qapi/error.h"
@@ -385,6 +386,9 @@ NetClientState *qemu_get_peer(NetClientState *nc, int queue_index)
 static void qemu_cleanup_net_client(NetClientState *nc,
                                     bool remove_from_net_clients)
 {
+    /* Packets handed to another thread still point to @nc */
+    AIO_WAIT_WHILE(NULL, qatomic_read(&nc->send_deferred) > 0);
+
     if (remove_from_net_clients) {
         QTAILQ_REMOVE(&net_clients, nc, next);
     }
@@ -618,6 +622,32 @@ int qemu_set_vnet_be(NetClientState *nc, bool is_be)
 #endif
 }
 
+bool qemu_can_set_aio_context(NetClientState *nc)
+{
+    return nc && nc->info->set_aio_context;
+}
+
+void qemu_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    if (!nc || !nc->info->set_aio_context) {
+        return;
+    }
+
+    nc->info->set_aio_context(nc, ctx);
+    qatomic_set(&nc->ctx, ctx);
+}
+
+/* The AioContext that packets between @nc and its peer go through */
+static AioContext *qemu_net_client_get_aio_context(NetClientState *nc)
+{
+    AioContext *ctx = qatomic_read(&nc->ctx);
+
+    if (!ctx && nc->peer) {
+        ctx = qatomic_read(&nc->peer->ctx);
+    }
+    return ctx;
+}
+
 int qemu_can_receive_packet(NetClientState *nc)
 {
     if (nc->receive_disabled) {
@@ -726,11 +756,63 @@ void qemu_flush_queued_packets(NetClientState *nc)
     qemu_flush_or_purge_queued_packets(nc, false);
 }
 
+typedef struct NetDeferredPacket {
+    NetClientState *sender;
+    unsigned flags;
+    int size;
+    uint8_t buf[];
+} NetDeferredPacket;
+
+static ssize_t qemu_send_packet_async_with_flags(NetClientState *sender,
+                                                 unsigned flags,
+                                                 const uint8_t *buf, int size,
+                                                 NetPacketSent *sent_cb);
+static void qemu_send_deferred_packet_bh(void *opaque);
+
+static void qemu_send_packet_defer(NetClientState *sender, AioContext *ctx,
+                                   unsigned flags, const uint8_t *buf,
+                                   int size)
+{
+    NetDeferredPacket *pkt = g_malloc(sizeof(*pkt) + size);
+
+    pkt->sender = sender;
+    pkt->flags = flags;
+    pkt->size = size;
+    memcpy(pkt->buf, buf, size);
+
+    qatomic_inc(&sender->send_deferred);
+    aio_bh_schedule_oneshot(ctx, qemu_send_deferred_packet_bh, pkt);
+}
+
+/* Context: BH in the AioContext of the sender when the packet was sent */
+static void qemu_send_deferred_packet_bh(void *opaque)
+{
+    NetDeferredPacket *pkt = opaque;
+    NetClientState *sender = pkt->sender;
+    AioContext *ctx = qemu_net_client_get_aio_context(sender);
+
+    /* The client may have moved to another thread in the meantime */
+    if (!ctx) {
+        ctx = qemu_get_aio_context();
+    }
+    if (ctx != qemu_get_current_aio_context()) {
+        qemu_send_packet_defer(sender, ctx, pkt->flags, pkt->buf, pkt->size);
+    } else {
+        qemu_send_packet_async_with_flags(sender, pkt->flags, pkt->buf,
+                                          pkt->size, NULL);
+    }
+
+    g_free(pkt);
+    qatomic_dec(&sender->send_deferred);
+    aio_wait_kick();
+}
+
 static ssize_t qemu_send_packet_async_with_flags(NetClientState *sender,
                                                  unsigned flags,
                                                  const uint8_t *buf, int size,
                                                  NetPacketSent *sent_cb)
 {
+    AioContext *ctx = qemu_net_client_get_aio_context(sender);
     NetQueue *queue;
     int ret;
 
@@ -743,6 +825,16 @@ static ssize_t qemu_send_packet_async_with_flags(NetClientState *sender,
         return size;
     }
 
+    /*
+     * The queues and the backend of a client that is processed in an
+     * IOThread may only be used from there.  Packets without a completion
+     * callback, e.g. announcements from the main loop, are sent from there.
+     */
+    if (!sent_cb && ctx && ctx != qemu_get_current_aio_context()) {
+        qemu_send_packet_defer(sender, ctx, flags, buf, size);
+        return size;
+    }
+
     /* Let filters handle the packet first */
     ret = filter_receive(sender, NET_FILTER_DIRECTION_TX,
                          sender, flags, buf, size, sent_cb);
@@ -43,6 +43,7 @@ typedef struct NetSocketState {
     IOHandler *send_fn;           /* differs between SOCK_STREAM/SOCK_DGRAM */
     bool read_poll;               /* waiting to receive data? */
     bool write_poll;              /* waiting to transmit data? */
+    AioContext *ctx;              /* NULL when polled from the main loop */
 } NetSocketState;
 
 static void net_socket_accept(void *opaque);
@@ -50,10 +51,14 @@ static void net_socket_writable(void *opaque);
 
 static void net_socket_update_fd_handler(NetSocketState *s)
 {
-    qemu_set_fd_handler(s->fd,
-                        s->read_poll ? s->send_fn : NULL,
-                        s->write_poll ? net_socket_writable : NULL,
-                        s);
+    IOHandler *fd_read = s->read_poll ? s->send_fn : NULL;
+    IOHandler *fd_write = s->write_poll ? net_socket_writable : NULL;
+
+    if (s->ctx) {
+        aio_set_fd_handler(s->ctx, s->fd, fd_read, fd_write, NULL, NULL, s);
+    } else {
+        qemu_set_fd_handler(s->fd, fd_read, fd_write, s);
+    }
 }
 
 static void net_socket_read_poll(NetSocketState *s, bool enable)
@@ -322,11 +327,33 @@ static void net_socket_cleanup(NetClientState *nc)
     }
 }
 
+static void net_socket_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    NetSocketState *s = DO_UPCAST(NetSocketState, nc, nc);
+
+    /* Until it is connected, the main loop waits for the connection */
+    if (s->ctx == ctx || s->fd < 0 || !s->send_fn) {
+        s->ctx = ctx;
+        return;
+    }
+
+    /* Unregister from the old context before polling from the new one */
+    if (s->ctx) {
+        aio_set_fd_handler(s->ctx, s->fd, NULL, NULL, NULL, NULL, NULL);
+    } else {
+        qemu_set_fd_handler(s->fd, NULL, NULL, NULL);
+    }
+
+    s->ctx = ctx;
+    net_socket_update_fd_handler(s);
+}
+
 static NetClientInfo net_dgram_socket_info = {
     .type = NET_CLIENT_DRIVER_SOCKET,
     .size = sizeof(NetSocketState),
     .receive = net_socket_receive_dgram,
     .cleanup = net_socket_cleanup,
+    .set_aio_context = net_socket_set_aio_context,
 };
 
 static NetSocketState *net_socket_fd_init_dgram(NetClientState *peer,
@@ -418,6 +445,7 @@ static NetClientInfo net_socket_info = {
     .size = sizeof(NetSocketState),
     .receive = net_socket_receive,
     .cleanup = net_socket_cleanup,
+    .set_aio_context = net_socket_set_aio_context,
 };
 
 static NetSocketState *net_socket_fd_init_stream(NetClientState *peer,
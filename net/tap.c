@@ -83,6 +83,8 @@ typedef struct TAPState {
     VHostNetState *vhost_net;
     unsigned host_vnet_hdr_len;
     Notifier exit;
+    /* NULL when polled from the main loop */
+    AioContext *ctx;
 } TAPState;
 
 static void launch_script(const char *setup_script, const char *ifname,
@@ -108,10 +110,14 @@ static char *tap_parse_script(const char *script_arg, const char *default_path)
 
 static void tap_update_fd_handler(TAPState *s)
 {
-    qemu_set_fd_handler(s->fd,
-                        s->read_poll && s->enabled ? tap_send : NULL,
-                        s->write_poll && s->enabled ? tap_writable : NULL,
-                        s);
+    IOHandler *fd_read = s->read_poll && s->enabled ? tap_send : NULL;
+    IOHandler *fd_write = s->write_poll && s->enabled ? tap_writable : NULL;
+
+    if (s->ctx) {
+        aio_set_fd_handler(s->ctx, s->fd, fd_read, fd_write, NULL, NULL, s);
+    } else {
+        qemu_set_fd_handler(s->fd, fd_read, fd_write, s);
+    }
 }
 
 static void tap_read_poll(TAPState *s, bool enable)
@@ -378,6 +384,26 @@ int tap_get_fd(NetClientState *nc)
     return s->fd;
 }
 
+static void tap_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    TAPState *s = DO_UPCAST(TAPState, nc, nc);
+
+    if (s->ctx == ctx || s->fd < 0) {
+        s->ctx = ctx;
+        return;
+    }
+
+    /* Unregister from the old context before polling from the new one */
+    if (s->ctx) {
+        aio_set_fd_handler(s->ctx, s->fd, NULL, NULL, NULL, NULL, NULL);
+    } else {
+        qemu_set_fd_handler(s->fd, NULL, NULL, NULL);
+    }
+
+    s->ctx = ctx;
+    tap_update_fd_handler(s);
+}
+
 /*
  * tap_get_vhost_net() can return NULL if a tap net-device backend is
  * created with 'vhost=off' option, 'vhostforce=off' or no vhost or
@@ -410,6 +436,7 @@ static NetClientInfo net_tap_info = {
     .set_vnet_be = tap_set_vnet_be,
     .set_steering_ebpf = tap_set_steering_ebpf,
     .get_vhost_net = tap_get_vhost_net,
+    .set_aio_context = tap_set_aio_context,
 };
 
 static TAPState *net_tap_fd_init(NetClientState *peer,
@@ -71,6 +71,7 @@
 #define QEMU_NBD_OPT_SELINUX_LABEL   266
 #define QEMU_NBD_OPT_TLSHOSTNAME     267
 #define QEMU_NBD_OPT_HANDSHAKE_LIMIT 268
+#define QEMU_NBD_OPT_ZERO_COPY       269
 
 #define MBR_SIZE 512
 
@@ -104,6 +105,7 @@ static void usage(const char *name)
 "  -x, --export-name=NAME    expose export by name (default is empty string)\n"
 "  -D, --description=TEXT    export a human-readable description\n"
 "      --handshake-limit=N   limit client's handshake to N seconds (default 10)\n"
+"      --zero-copy           send read data with MSG_ZEROCOPY\n"
 "\n"
 "Exposing part of the image:\n"
 "  -o, --offset=OFFSET       offset into the image\n"
@@ -573,6 +575,7 @@ int main(int argc, char **argv)
         { "description", required_argument, NULL, 'D' },
         { "handshake-limit", required_argument, NULL,
           QEMU_NBD_OPT_HANDSHAKE_LIMIT },
+        { "zero-copy", no_argument, NULL, QEMU_NBD_OPT_ZERO_COPY },
         { "tls-creds", required_argument, NULL, QEMU_NBD_OPT_TLSCREDS },
         { "tls-hostname", required_argument, NULL, QEMU_NBD_OPT_TLSHOSTNAME },
         { "tls-authz", required_argument, NULL, QEMU_NBD_OPT_TLSAUTHZ },
@@ -601,6 +604,7 @@ int main(int argc, char **argv)
     const char *export_description = NULL;
     BlockDirtyBitmapOrStrList *bitmaps = NULL;
     bool alloc_depth = false;
+    bool zero_copy = false;
     const char *tlscredsid = NULL;
     const char *tlshostname = NULL;
     bool imageOpts = false;
@@ -826,6 +830,9 @@ int main(int argc, char **argv)
                 exit(EXIT_FAILURE);
             }
             break;
+        case QEMU_NBD_OPT_ZERO_COPY:
+            zero_copy = true;
+            break;
         }
     }
 
@@ -836,7 +843,8 @@ int main(int argc, char **argv)
         }
         if (export_name || export_description || dev_offset ||
             opts.device || disconnect || fmt || sn_id_or_name || bitmaps ||
-            alloc_depth || seen_aio || seen_discard || seen_cache) {
+            alloc_depth || zero_copy || seen_aio || seen_discard ||
+            seen_cache) {
             error_report("List mode is incompatible with per-device settings");
             exit(EXIT_FAILURE);
         }
@@ -1189,6 +1197,8 @@ int main(int argc, char **argv)
             .bitmaps              = bitmaps,
             .has_allocation_depth = alloc_depth,
             .allocation_depth     = alloc_depth,
+            .has_zero_copy        = zero_copy,
+            .zero_copy            = zero_copy,
         },
     };
     blk_exp_add(export_opts, &error_fatal);
@@ -235,6 +235,11 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                one-insn-per-tb=on|off (one guest instruction per TCG translation block)\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
+    "                tb-cache=path (persistent TCG translation cache file)\n"
+    "                translate-threads=n (TCG threads translating ahead of the vCPUs, default 0)\n"
+    "                tier-threshold=n (re-translate TCG code executed n times, default 0)\n"
+    "                jmp-cache-size=n (maximum TCG jump cache entries per vCPU, default 65536)\n"
+    "                victim-tlb-size=n (TCG victim TLB entries per MMU mode, default 8)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
     "                eager-split-size=n (KVM Eager Page Split chunk size, default 0, disabled. ARM only)\n"
     "                notify-vmexit=run|internal-error|disable,notify-window=n (enable notify VM exit and set notify window, x86 only)\n"
@@ -278,6 +283,51 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``tb-cache=path``
+        Load translated code from the file at ``path`` on startup, and
+        save code translated during the run to it when QEMU exits.  The
+        file is only reused by the same QEMU binary on the same host CPU
+        with the same guest CPU configuration, and each cached block is
+        only used if the guest code it was translated from is unchanged.
+        Currently this requires an x86-64 Linux host and ``split-wx=off``.
+
+        The file contains host code that QEMU runs without checking it,
+        so it must be treated like the QEMU binary itself: never use a
+        file that an untrusted user, or the guest, could have written.
+        QEMU ignores the file unless it is owned by the user running
+        QEMU and is not writable by its group or by other users, and it
+        creates the file with mode 0600.
+
+    ``translate-threads=n``
+        Start ``n`` threads that translate the targets of direct jumps
+        in newly translated code, so that vCPUs find them translated
+        already instead of stopping to translate them.  The default is
+        0, which disables translation ahead of time.
+
+    ``tier-threshold=n``
+        Count the executions of each translation block, and translate
+        it again once it has run ``n`` times.  The new translation does
+        not count its executions, and takes in the code of a block it
+        jumps to further down the same page, so that the optimizer can
+        work across the jump.  Counting is disabled with icount and
+        with plugins that instrument translations.  The default is 0,
+        which disables counting.
+
+    ``jmp-cache-size=n``
+        Each vCPU looks up the destinations of indirect jumps in a jump
+        cache of 4096 entries, which grows while it misses often and
+        shrinks again when it is no longer needed.  This sets the size
+        up to which it may grow, a power of 2 between 4096 and 65536.
+        The default is 65536; 4096 keeps the size fixed.
+
+    ``victim-tlb-size=n``
+        Entries evicted from the softmmu TLB are kept in a victim TLB,
+        which is searched before walking the guest page tables.  This
+        sets its size for each MMU mode, a power of 2 between 8 and
+        1024.  Entries are grouped in sets of 8, picked by a hash of
+        the page address.  The default is 8, a single fully associative
+        set.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefore taking advantage of
@@ -6387,7 +6437,7 @@ SRST
 
             CN=laptop.example.com,O=Example Home,L=London,ST=London,C=GB
 
-    ``-object iothread,id=id,poll-max-ns=poll-max-ns,poll-grow=poll-grow,poll-shrink=poll-shrink,aio-max-batch=aio-max-batch``
+    ``-object iothread,id=id,poll-max-ns=poll-max-ns,poll-grow=poll-grow,poll-shrink=poll-shrink,aio-max-batch=aio-max-batch,io-uring-sqpoll=on|off,io-uring-sqpoll-idle=ms,io-uring-sqpoll-cpu=cpu``
         Creates a dedicated event loop thread that devices can be
         assigned to. This is known as an IOThread. By default device
         emulation happens in vCPU threads or the main event loop thread.
@@ -6427,8 +6477,19 @@ SRST
         in a batch for the AIO engine, 0 means that the engine will use
         its default.
 
-        The IOThread parameters can be modified at run-time using the
-        ``qom-set`` command (where ``iothread1`` is the IOThread's
+        The ``io-uring-sqpoll`` parameter lets a kernel thread poll the
+        IOThread's io_uring submission queue (``IORING_SETUP_SQPOLL``),
+        so that submitting I/O requests does not need a system call.
+        This costs a host CPU while the kernel thread is polling and is
+        meant for hosts with CPUs to spare. ``io-uring-sqpoll-idle`` is
+        the number of milliseconds without requests after which the
+        kernel thread goes to sleep and ``io-uring-sqpoll-cpu`` binds it
+        to a host CPU. The ``query-iothreads`` QMP command reports how
+        many system calls were avoided. These parameters can only be set
+        when the IOThread is created.
+
+        The other IOThread parameters can be modified at run-time using
+        the ``qom-set`` command (where ``iothread1`` is the IOThread's
         ``id``):
 
         ::
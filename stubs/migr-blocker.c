@@ -19,3 +19,12 @@ int migrate_add_blocker_modes(Error **reasonp, unsigned modes, Error **errp)
 void migrate_del_blocker(Error **reasonp)
 {
 }
+
+int migrate_add_postcopy_blocker(Error **reasonp, Error **errp)
+{
+    return 0;
+}
+
+void migrate_del_postcopy_blocker(Error **reasonp)
+{
+}
@@ -2641,7 +2641,14 @@ void tcg_gen_exit_tb(const TranslationBlock *tb, unsigned idx)
      * This requires coordination with targets that do not use
      * the translator_loop.
      */
-    uintptr_t val = (uintptr_t)tcg_splitwx_to_rx((void *)tb) + idx;
+    uintptr_t val;
+
+    if (tb && idx <= TB_EXIT_IDXMAX && (tcg_ctx->goto_tb_skip & (1 << idx))) {
+        /* The goto_tb was left out; return to the main loop instead.  */
+        tb = NULL;
+        idx = 0;
+    }
+    val = (uintptr_t)tcg_splitwx_to_rx((void *)tb) + idx;
 
     if (tb == NULL) {
         tcg_debug_assert(idx == 0);
@@ -2665,6 +2672,20 @@ void tcg_gen_goto_tb(unsigned idx)
     tcg_debug_assert(!(tcg_ctx->gen_tb->cflags & CF_NO_GOTO_TB));
     /* We only support two chained exits.  */
     tcg_debug_assert(idx <= TB_EXIT_IDXMAX);
+
+    /* Make room for the code of the destination, when building a trace.  */
+    if (unlikely(idx == tcg_ctx->trace_slot)) {
+        tcg_ctx->trace_slot = -1;
+        if (tcg_ctx->trace_dest) {
+            tcg_ctx->trace_op = tcg_last_op();
+            tcg_ctx->goto_tb_skip |= 1 << idx;
+            return;
+        }
+    }
+    if (tcg_ctx->goto_tb_skip & (1 << idx)) {
+        return;
+    }
+    tcg_ctx->goto_tb_used |= 1 << idx;
 #ifdef CONFIG_DEBUG_TCG
     /* Verify that we haven't seen this numbered exit before.  */
     tcg_debug_assert((tcg_ctx->goto_tb_issue_mask & (1 << idx)) == 0);
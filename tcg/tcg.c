@@ -249,6 +249,8 @@ unsigned int tcg_max_ctxs;
 TCGv_env tcg_env;
 const void *tcg_code_gen_epilogue;
 uintptr_t tcg_splitwx_diff;
+uintptr_t tcg_cache_text_start, tcg_cache_text_end;
+size_t tcg_prologue_size;
 
 #ifndef CONFIG_TCG_INTERPRETER
 tcg_prologue_fn *tcg_qemu_tb_exec;
@@ -391,6 +393,76 @@ static bool tcg_resolve_relocs(TCGContext *s)
     return true;
 }
 
+#ifdef TCG_TARGET_CACHE_RELOCS
+/*
+ * Note that the host address TARGET has been embedded at PTR, for the
+ * persistent TB cache.  References within the TB itself move with it;
+ * anything that cannot be expressed relative to QEMU's text or to the
+ * prologue makes the TB uncacheable.
+ */
+static void tcg_cache_reloc(TCGContext *s, const tcg_insn_unit *ptr,
+                            TCGCacheRelocType type, uintptr_t target)
+{
+    uintptr_t tb_start = (uintptr_t)tcg_splitwx_to_rx(s->code_buf);
+    uintptr_t prologue = (uintptr_t)tcg_qemu_tb_exec;
+    TCGCacheReloc *r;
+
+    if (!s->cache_record) {
+        return;
+    }
+    if (type == TCG_CACHE_RELOC_PC32 &&
+        target - tb_start <= tcg_current_code_size(s)) {
+        return;
+    }
+    if (s->nb_cache_relocs == TCG_MAX_CACHE_RELOCS) {
+        s->cache_tainted = true;
+        return;
+    }
+
+    r = &s->cache_relocs[s->nb_cache_relocs];
+    if (target - tcg_cache_text_start <
+        tcg_cache_text_end - tcg_cache_text_start) {
+        r->base = TCG_CACHE_BASE_TEXT;
+        r->addend = target - tcg_cache_text_start;
+    } else if (target - prologue < tcg_prologue_size) {
+        r->base = TCG_CACHE_BASE_PROLOGUE;
+        r->addend = target - prologue;
+    } else {
+        s->cache_tainted = true;
+        return;
+    }
+    r->offset = tcg_ptr_byte_diff(ptr, s->code_buf);
+    r->type = type;
+    r->pad = 0;
+    s->nb_cache_relocs++;
+}
+
+/*
+ * Return true if VAL points into QEMU's text or data, the brk heap that
+ * follows them, or the code_gen_buffer.  A TB that embeds such a value
+ * as a plain constant is only valid in the process that generated it.
+ */
+static bool tcg_cache_host_addr(uintptr_t val)
+{
+    uintptr_t end = tcg_cache_text_end;
+
+#ifdef CONFIG_LINUX
+    end = MAX(end, (uintptr_t)sbrk(0));
+#endif
+    return val - tcg_cache_text_start < end - tcg_cache_text_start ||
+           in_code_gen_buffer((const void *)val);
+}
+#endif
+
+bool tcg_cache_supported(void)
+{
+#ifdef TCG_TARGET_CACHE_RELOCS
+    return tcg_splitwx_diff == 0;
+#else
+    return false;
+#endif
+}
+
 static void set_jmp_reset_offset(TCGContext *s, int which)
 {
     /*
@@ -1874,6 +1946,7 @@ void tcg_prologue_init(void)
     }
 
     prologue_size = tcg_current_code_size(s);
+    tcg_prologue_size = prologue_size;
     perf_report_prologue(s->code_gen_ptr, prologue_size);
 
 #ifndef CONFIG_TCG_INTERPRETER
@@ -1947,6 +2020,11 @@ void tcg_func_start(TCGContext *s)
 #ifdef CONFIG_DEBUG_TCG
     s->goto_tb_issue_mask = 0;
 #endif
+    s->trace_slot = -1;
+    s->trace_dest = false;
+    s->trace_op = NULL;
+    s->goto_tb_used = 0;
+    s->goto_tb_skip = 0;
 
     QTAILQ_INIT(&s->ops);
     QTAILQ_INIT(&s->free_ops);
@@ -3467,6 +3545,20 @@ void tcg_remove_ops_after(TCGOp *op)
     }
 }
 
+void tcg_move_ops_after(TCGOp *at, TCGOp *op)
+{
+    TCGContext *s = tcg_ctx;
+
+    while (true) {
+        TCGOp *last = tcg_last_op();
+        if (last == op) {
+            return;
+        }
+        QTAILQ_REMOVE(&s->ops, last, link);
+        QTAILQ_INSERT_AFTER(&s->ops, at, last, link);
+    }
+}
+
 static TCGOp *tcg_op_alloc(TCGOpcode opc, unsigned nargs)
 {
     TCGContext *s = tcg_ctx;
@@ -6632,6 +6724,8 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb, uint64_t pc_start)
     s->code_buf = tcg_splitwx_to_rw(tb->tc.ptr);
     s->code_ptr = s->code_buf;
     s->data_gen_ptr = NULL;
+    s->cache_tainted = false;
+    s->nb_cache_relocs = 0;
 
     QSIMPLEQ_INIT(&s->ldst_labels);
     s->pool_labels = NULL;
@@ -30,6 +30,9 @@
 #define TCG_TARGET_NB_REGS   32
 #define MAX_CODE_GEN_BUFFER_SIZE  (2 * GiB)
 
+/* Host addresses in generated code are reported via tcg_cache_reloc. */
+#define TCG_TARGET_CACHE_RELOCS
+
 typedef enum {
     TCG_REG_EAX = 0,
     TCG_REG_ECX,
@@ -0,0 +1,91 @@
+/*
+ * QEMU xbzrle_encode_buffer speed benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "../migration/xbzrle.h"
+
+#define XBZRLE_PAGE_SIZE 4096
+#define XBZRLE_PAGES 256
+
+/*
+ * Dirty a percentage of each page in runs of 1 to 64 bytes, which is what
+ * write-heavy guests tend to leave behind between two iterations.
+ */
+static void dirty_pages(uint8_t *old_buf, uint8_t *new_buf, int percent)
+{
+    GRand *rand = g_rand_new_with_seed(percent);
+    size_t len = XBZRLE_PAGES * XBZRLE_PAGE_SIZE;
+    size_t target = len * percent / 100;
+    size_t dirty = 0;
+
+    memcpy(new_buf, old_buf, len);
+    while (dirty < target) {
+        size_t pos = g_rand_int_range(rand, 0, len);
+        size_t run = g_rand_int_range(rand, 1, 65);
+
+        for (size_t i = pos; i < MIN(pos + run, len); i++) {
+            new_buf[i] = ~old_buf[i];
+        }
+        dirty += run;
+    }
+    g_rand_free(rand);
+}
+
+static void test(const void *opaque)
+{
+    size_t len = XBZRLE_PAGES * XBZRLE_PAGE_SIZE;
+    uint8_t *old_buf = g_malloc(len);
+    uint8_t *new_buf = g_malloc(len);
+    uint8_t *dst = g_malloc(XBZRLE_PAGE_SIZE);
+    static const int percents[] = { 0, 1, 5, 25 };
+    int accel_index = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        old_buf[i] = i * 31;
+    }
+
+    do {
+        if (accel_index != 0) {
+            g_test_message("%s", "");  /* gnu_printf Werror for simple "" */
+        }
+        for (int p = 0; p < ARRAY_SIZE(percents); p++) {
+            double total = 0.0;
+
+            dirty_pages(old_buf, new_buf, percents[p]);
+
+            g_test_timer_start();
+            do {
+                for (int i = 0; i < XBZRLE_PAGES; i++) {
+                    size_t off = i * XBZRLE_PAGE_SIZE;
+
+                    xbzrle_encode_buffer(old_buf + off, new_buf + off,
+                                         XBZRLE_PAGE_SIZE, dst,
+                                         XBZRLE_PAGE_SIZE);
+                }
+                total += len;
+            } while (g_test_timer_elapsed() < 0.5);
+
+            total /= MiB;
+            g_test_message("xbzrle_encode_buffer #%d: %2d%% dirty %8.0f MB/sec",
+                           accel_index, percents[p],
+                           total / g_test_timer_last());
+        }
+        accel_index++;
+    } while (test_xbzrle_encode_next_accel());
+
+    g_free(old_buf);
+    g_free(new_buf);
+    g_free(dst);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_data_func("/migration/xbzrle/speed", NULL, test);
+    return g_test_run();
+}
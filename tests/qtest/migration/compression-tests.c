@@ -53,6 +53,28 @@ static void test_multifd_postcopy_tcp_zstd(char *name, MigrateCommon *args)
 }
 #endif /* CONFIG_ZSTD */
 
+#ifdef CONFIG_LZ4
+static void *
+migrate_hook_start_precopy_tcp_multifd_lz4(QTestState *from,
+                                           QTestState *to)
+{
+    migrate_set_parameter_int(from, "multifd-lz4-acceleration", 4);
+    migrate_set_parameter_int(to, "multifd-lz4-acceleration", 4);
+
+    return migrate_hook_start_precopy_tcp_multifd_common(from, to, "lz4");
+}
+
+static void test_multifd_tcp_lz4(char *name, MigrateCommon *args)
+{
+    args->listen_uri = "defer";
+    args->start_hook = migrate_hook_start_precopy_tcp_multifd_lz4;
+
+    args->start.caps[MIGRATION_CAPABILITY_MULTIFD] = true;
+
+    test_precopy_common(args);
+}
+#endif /* CONFIG_LZ4 */
+
 #ifdef CONFIG_QATZIP
 static void *
 migrate_hook_start_precopy_tcp_multifd_qatzip(QTestState *from,
@@ -140,6 +162,29 @@ static void test_precopy_unix_xbzrle(char *name, MigrateCommon *args)
     test_precopy_common(args);
 }
 
+static void *
+migrate_hook_start_precopy_tcp_multifd_xbzrle(QTestState *from,
+                                              QTestState *to)
+{
+    migrate_set_parameter_int(from, "xbzrle-cache-size", 33554432);
+
+    return migrate_hook_start_precopy_tcp_multifd_common(from, to, "none");
+}
+
+static void test_multifd_tcp_xbzrle(char *name, MigrateCommon *args)
+{
+    args->listen_uri = "defer";
+    args->start_hook = migrate_hook_start_precopy_tcp_multifd_xbzrle;
+    /* See test_precopy_unix_xbzrle() */
+    args->iterations = 2;
+    args->live = true;
+
+    args->start.caps[MIGRATION_CAPABILITY_MULTIFD] = true;
+    args->start.caps[MIGRATION_CAPABILITY_XBZRLE] = true;
+
+    test_precopy_common(args);
+}
+
 static void *
 migrate_hook_start_precopy_tcp_multifd_zlib(QTestState *from,
                                             QTestState *to)
@@ -164,6 +209,31 @@ static void test_multifd_tcp_zlib(char *name, MigrateCommon *args)
     test_precopy_common(args);
 }
 
+static void *
+migrate_hook_start_precopy_tcp_multifd_zlib_raw(QTestState *from,
+                                                QTestState *to)
+{
+    /*
+     * A threshold of 1% sends nearly every non-zero page of the guest
+     * uncompressed, which exercises the raw page path of the packets.
+     */
+    migrate_set_parameter_int(from, "multifd-compression-raw-threshold", 1);
+    /* The destination only needs to know that raw pages are in use */
+    migrate_set_parameter_int(to, "multifd-compression-raw-threshold", 1);
+
+    return migrate_hook_start_precopy_tcp_multifd_common(from, to, "zlib");
+}
+
+static void test_multifd_tcp_zlib_raw(char *name, MigrateCommon *args)
+{
+    args->listen_uri = "defer";
+    args->start_hook = migrate_hook_start_precopy_tcp_multifd_zlib_raw;
+
+    args->start.caps[MIGRATION_CAPABILITY_MULTIFD] = true;
+
+    test_precopy_common(args);
+}
+
 static void migration_test_add_compression_smoke(MigrationTestEnv *env)
 {
     migration_test_add("/migration/multifd/tcp/plain/zlib",
@@ -180,6 +250,11 @@ void migration_test_add_compression(MigrationTestEnv *env)
         return;
     }
 
+    migration_test_add("/migration/multifd/tcp/plain/zlib/raw",
+                       test_multifd_tcp_zlib_raw);
+    migration_test_add("/migration/multifd/tcp/plain/xbzrle",
+                       test_multifd_tcp_xbzrle);
+
 #ifdef CONFIG_ZSTD
     migration_test_add("/migration/multifd/tcp/plain/zstd",
                        test_multifd_tcp_zstd);
@@ -189,6 +264,11 @@ void migration_test_add_compression(MigrationTestEnv *env)
     }
 #endif
 
+#ifdef CONFIG_LZ4
+    migration_test_add("/migration/multifd/tcp/plain/lz4",
+                       test_multifd_tcp_lz4);
+#endif
+
 #ifdef CONFIG_QATZIP
     migration_test_add("/migration/multifd/tcp/plain/qatzip",
                        test_multifd_tcp_qatzip);
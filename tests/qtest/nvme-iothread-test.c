@@ -0,0 +1,233 @@
+/*
+ * QTest testcase for NVMe I/O queues processed in IOThreads
+ *
+ * A small polling driver creates an I/O queue pair whose completion queue
+ * is much shorter than its submission queue, so that completions have to
+ * wait for the guest to free completion queue entries.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/cutils.h"
+#include "libqtest.h"
+#include "libqos/libqos-pc.h"
+#include "libqos/pci.h"
+#include "block/nvme.h"
+
+#define NVME_DEVFN          QPCI_DEVFN(4, 0)
+#define NVME_ADMIN_QSIZE    8
+#define NVME_IO_SQ_SIZE     16
+#define NVME_IO_CQ_SIZE     4
+#define NVME_IO_REQS        (NVME_IO_SQ_SIZE - 1)
+#define NVME_BLOCK_SIZE     512
+#define NVME_TIMEOUT_US     (10 * G_USEC_PER_SEC)
+
+typedef struct TestQueue {
+    uint16_t qid;
+    uint16_t size;
+    uint64_t sq_addr;
+    uint64_t cq_addr;
+    uint16_t sq_tail;
+    uint16_t cq_head;
+    uint8_t phase;
+} TestQueue;
+
+typedef struct TestNvme {
+    QOSState *qs;
+    QPCIDevice *dev;
+    QPCIBar bar;
+    TestQueue admin;
+    TestQueue io;
+    uint16_t cid;
+} TestNvme;
+
+static void nvme_wait_ready(TestNvme *t, bool ready)
+{
+    gint64 deadline = g_get_monotonic_time() + NVME_TIMEOUT_US;
+
+    while (NVME_CSTS_RDY(qpci_io_readl(t->dev, t->bar, NVME_REG_CSTS)) !=
+           ready) {
+        g_assert_cmpint(g_get_monotonic_time(), <, deadline);
+        g_usleep(1000);
+    }
+}
+
+static void nvme_init_queue(TestNvme *t, TestQueue *q, uint16_t qid,
+                            uint16_t sq_size, uint16_t cq_size)
+{
+    q->qid = qid;
+    q->size = cq_size;
+    q->sq_addr = guest_alloc(&t->qs->alloc, sq_size * sizeof(NvmeCmd));
+    q->cq_addr = guest_alloc(&t->qs->alloc, cq_size * sizeof(NvmeCqe));
+    q->sq_tail = 0;
+    q->cq_head = 0;
+    q->phase = 1;
+    qtest_memset(t->qs->qts, q->cq_addr, 0, cq_size * sizeof(NvmeCqe));
+}
+
+static void nvme_submit(TestNvme *t, TestQueue *q, uint16_t sq_size,
+                        NvmeCmd *cmd)
+{
+    cmd->cid = cpu_to_le16(t->cid++);
+    qtest_memwrite(t->qs->qts, q->sq_addr + q->sq_tail * sizeof(*cmd),
+                   cmd, sizeof(*cmd));
+    q->sq_tail = (q->sq_tail + 1) % sq_size;
+}
+
+static void nvme_ring_sq(TestNvme *t, TestQueue *q)
+{
+    qpci_io_writel(t->dev, t->bar, 0x1000 + (2 * q->qid) * 4, q->sq_tail);
+}
+
+/* Wait for the next completion and release its entry to the controller. */
+static void nvme_reap(TestNvme *t, TestQueue *q, NvmeCqe *cqe)
+{
+    gint64 deadline = g_get_monotonic_time() + NVME_TIMEOUT_US;
+    uint64_t addr = q->cq_addr + q->cq_head * sizeof(*cqe);
+
+    for (;;) {
+        qtest_memread(t->qs->qts, addr, cqe, sizeof(*cqe));
+        if ((le16_to_cpu(cqe->status) & 1) == q->phase) {
+            break;
+        }
+        g_assert_cmpint(g_get_monotonic_time(), <, deadline);
+        g_usleep(1000);
+    }
+
+    g_assert_cmphex(le16_to_cpu(cqe->status) >> 1, ==, NVME_SUCCESS);
+
+    q->cq_head = (q->cq_head + 1) % q->size;
+    if (!q->cq_head) {
+        q->phase = !q->phase;
+    }
+    qpci_io_writel(t->dev, t->bar, 0x1000 + (2 * q->qid + 1) * 4,
+                   q->cq_head);
+}
+
+static void nvme_admin(TestNvme *t, NvmeCmd *cmd)
+{
+    NvmeCqe cqe;
+
+    nvme_submit(t, &t->admin, NVME_ADMIN_QSIZE, cmd);
+    nvme_ring_sq(t, &t->admin);
+    nvme_reap(t, &t->admin, &cqe);
+}
+
+static void nvme_start(TestNvme *t, bool iothread)
+{
+    NvmeCmd cmd;
+    uint32_t cc = 0;
+
+    t->qs = qtest_pc_boot("-object iothread,id=iothread0 "
+                          "-drive id=drv0,if=none,file=null-co://,"
+                          "file.read-zeroes=on,format=raw "
+                          "-device \"{'driver': 'nvme', 'addr': '04.0', "
+                          "'drive': 'drv0', 'serial': 'foo', "
+                          "'max_ioqpairs': 1%s}\"",
+                          iothread ? ", 'iothread-vq-mapping': "
+                                     "[{'iothread': 'iothread0'}]" : "");
+    t->dev = qpci_device_find(t->qs->pcibus, NVME_DEVFN);
+    g_assert(t->dev);
+    qpci_device_enable(t->dev);
+    t->bar = qpci_iomap(t->dev, 0, NULL);
+    t->cid = 0;
+
+    nvme_init_queue(t, &t->admin, 0, NVME_ADMIN_QSIZE, NVME_ADMIN_QSIZE);
+    qpci_io_writel(t->dev, t->bar, NVME_REG_AQA,
+                   (NVME_ADMIN_QSIZE - 1) << AQA_ACQS_SHIFT |
+                   (NVME_ADMIN_QSIZE - 1) << AQA_ASQS_SHIFT);
+    qpci_io_writeq(t->dev, t->bar, NVME_REG_ASQ, t->admin.sq_addr);
+    qpci_io_writeq(t->dev, t->bar, NVME_REG_ACQ, t->admin.cq_addr);
+
+    NVME_SET_CC_IOSQES(cc, ctz32(sizeof(NvmeCmd)));
+    NVME_SET_CC_IOCQES(cc, ctz32(sizeof(NvmeCqe)));
+    NVME_SET_CC_EN(cc, 1);
+    qpci_io_writel(t->dev, t->bar, NVME_REG_CC, cc);
+    nvme_wait_ready(t, true);
+
+    /* A completion queue shorter than the submission queue, no interrupts */
+    nvme_init_queue(t, &t->io, 1, NVME_IO_SQ_SIZE, NVME_IO_CQ_SIZE);
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.opcode = NVME_ADM_CMD_CREATE_CQ;
+    cmd.dptr.prp1 = cpu_to_le64(t->io.cq_addr);
+    cmd.cdw10 = cpu_to_le32((NVME_IO_CQ_SIZE - 1) << 16 | t->io.qid);
+    cmd.cdw11 = cpu_to_le32(NVME_CQ_PC);
+    nvme_admin(t, &cmd);
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.opcode = NVME_ADM_CMD_CREATE_SQ;
+    cmd.dptr.prp1 = cpu_to_le64(t->io.sq_addr);
+    cmd.cdw10 = cpu_to_le32((NVME_IO_SQ_SIZE - 1) << 16 | t->io.qid);
+    cmd.cdw11 = cpu_to_le32(t->io.qid << 16 | NVME_SQ_PC);
+    nvme_admin(t, &cmd);
+}
+
+static void nvme_stop(TestNvme *t)
+{
+    qpci_io_writel(t->dev, t->bar, NVME_REG_CC, 0);
+    nvme_wait_ready(t, false);
+    qpci_iounmap(t->dev, t->bar);
+    g_free(t->dev);
+    qtest_shutdown(t->qs);
+}
+
+/*
+ * Fill the submission queue with reads.  Only NVME_IO_CQ_SIZE - 1 of them
+ * can complete before the guest frees completion queue entries, so each
+ * completion queue head doorbell write has to restart the deferred ones.
+ */
+static void test_io(const void *data)
+{
+    bool iothread = GPOINTER_TO_INT(data);
+    TestNvme t;
+    uint64_t buf[NVME_IO_REQS];
+    uint8_t block[NVME_BLOCK_SIZE];
+    NvmeCqe cqe;
+    int round, i;
+
+    nvme_start(&t, iothread);
+
+    for (i = 0; i < NVME_IO_REQS; i++) {
+        buf[i] = guest_alloc(&t.qs->alloc, NVME_BLOCK_SIZE);
+    }
+
+    for (round = 0; round < 4; round++) {
+        for (i = 0; i < NVME_IO_REQS; i++) {
+            NvmeCmd cmd = {
+                .opcode = NVME_CMD_READ,
+                .nsid = cpu_to_le32(1),
+                .dptr.prp1 = cpu_to_le64(buf[i]),
+                .cdw10 = cpu_to_le32(round * NVME_IO_REQS + i),
+            };
+
+            qtest_memset(t.qs->qts, buf[i], 0xaa, NVME_BLOCK_SIZE);
+            nvme_submit(&t, &t.io, NVME_IO_SQ_SIZE, &cmd);
+        }
+        nvme_ring_sq(&t, &t.io);
+
+        for (i = 0; i < NVME_IO_REQS; i++) {
+            nvme_reap(&t, &t.io, &cqe);
+            g_assert_cmpuint(le16_to_cpu(cqe.sq_id), ==, t.io.qid);
+        }
+
+        for (i = 0; i < NVME_IO_REQS; i++) {
+            qtest_memread(t.qs->qts, buf[i], block, sizeof(block));
+            g_assert(buffer_is_zero(block, sizeof(block)));
+        }
+    }
+
+    nvme_stop(&t);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_data_func("/nvme/io/main-loop", GINT_TO_POINTER(false),
+                        test_io);
+    qtest_add_data_func("/nvme/io/iothread", GINT_TO_POINTER(true), test_io);
+
+    return g_test_run();
+}
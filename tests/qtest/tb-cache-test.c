@@ -0,0 +1,261 @@
+/*
+ * QTest testcase for the persistent TCG translation block cache
+ *
+ * The firmware of the PC machine is run once to record a cache file,
+ * which is then replayed, damaged or used with a different CPU
+ * configuration.  "info jit" tells how many entries were loaded and
+ * how many TBs were taken from the cache.
+ *
+ * The cache is only supported on x86-64 Linux hosts, so the test is
+ * only built there.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+
+/* Layout of the file header, see accel/tcg/tb-cache.c */
+#define TB_CACHE_MAGIC          "QEMUTBC"
+#define TB_CACHE_HEADER_SIZE    48
+#define TB_CACHE_FP_OFFSET      16
+#define TB_CACHE_ENTRY_SIZE     56
+
+typedef struct TBCacheStats {
+    uint64_t hits;
+    uint64_t lookups;
+    unsigned loaded;
+    unsigned recorded;
+} TBCacheStats;
+
+static void tb_cache_stats(QTestState *qts, TBCacheStats *st)
+{
+    g_autofree char *out = qtest_hmp(qts, "info jit");
+    const char *p;
+
+    p = strstr(out, "TB cache hits");
+    g_assert(p);
+    g_assert_cmpint(sscanf(p, "TB cache hits %" SCNu64 "/%" SCNu64,
+                           &st->hits, &st->lookups), ==, 2);
+    p = strstr(out, "TB cache entries");
+    g_assert(p);
+    g_assert_cmpint(sscanf(p, "TB cache entries %u loaded, %u recorded",
+                           &st->loaded, &st->recorded), ==, 2);
+}
+
+static QTestState *tb_cache_start(const char *path, const char *extra)
+{
+    return qtest_initf("-M pc -accel tcg,tb-cache=%s %s", path, extra);
+}
+
+/*
+ * Run the guest until @done returns true for the statistics read
+ * into @st.
+ */
+static void tb_cache_wait(QTestState *qts, TBCacheStats *st,
+                          bool (*done)(const TBCacheStats *st))
+{
+    time_t start = time(NULL);
+
+    for (;;) {
+        tb_cache_stats(qts, st);
+        if (done(st)) {
+            return;
+        }
+        g_assert_cmpint(time(NULL) - start, <, 60);
+        g_usleep(10000);
+    }
+}
+
+static bool tb_cache_has_recorded(const TBCacheStats *st)
+{
+    return st->recorded > 0;
+}
+
+static bool tb_cache_has_hits(const TBCacheStats *st)
+{
+    return st->hits > 0;
+}
+
+/* Run QEMU once with @path, and check that the cache was not loaded. */
+static void tb_cache_record(const char *path, const char *extra)
+{
+    QTestState *qts = tb_cache_start(path, extra);
+    TBCacheStats st;
+
+    tb_cache_wait(qts, &st, tb_cache_has_recorded);
+    g_assert_cmpuint(st.loaded, ==, 0);
+    g_assert_cmpuint(st.hits, ==, 0);
+    qtest_quit(qts);
+}
+
+/* Run QEMU once with @path, and check that the cache is used. */
+static void tb_cache_replay(const char *path, const char *extra)
+{
+    QTestState *qts = tb_cache_start(path, extra);
+    TBCacheStats st;
+
+    tb_cache_wait(qts, &st, tb_cache_has_hits);
+    g_assert_cmpuint(st.loaded, >, 0);
+    qtest_quit(qts);
+}
+
+static char *tb_cache_read(const char *path, gsize *len)
+{
+    char *data;
+
+    g_assert(g_file_get_contents(path, &data, len, NULL));
+    g_assert_cmpuint(*len, >, TB_CACHE_HEADER_SIZE + TB_CACHE_ENTRY_SIZE);
+    g_assert_cmpmem(data, sizeof(TB_CACHE_MAGIC),
+                    TB_CACHE_MAGIC, sizeof(TB_CACHE_MAGIC));
+    return data;
+}
+
+static void tb_cache_write(const char *path, const char *data, gsize len)
+{
+    g_assert(g_file_set_contents_full(path, data, len,
+                                      G_FILE_SET_CONTENTS_CONSISTENT, 0600,
+                                      NULL));
+}
+
+typedef struct TBCacheTest {
+    char *dir;
+    char *path;
+} TBCacheTest;
+
+static void tb_cache_test_init(TBCacheTest *t)
+{
+    t->dir = g_dir_make_tmp("qtest-tb-cache-XXXXXX", NULL);
+    g_assert(t->dir);
+    t->path = g_build_filename(t->dir, "tb.cache", NULL);
+}
+
+static void tb_cache_test_cleanup(TBCacheTest *t)
+{
+    unlink(t->path);
+    rmdir(t->dir);
+    g_free(t->path);
+    g_free(t->dir);
+}
+
+static void test_round_trip(void)
+{
+    TBCacheTest t;
+    g_autofree char *data = NULL;
+    gsize len;
+
+    tb_cache_test_init(&t);
+    tb_cache_record(t.path, "");
+    data = tb_cache_read(t.path, &len);
+    tb_cache_replay(t.path, "");
+    tb_cache_test_cleanup(&t);
+}
+
+/*
+ * Damage a recorded file with @damage.  QEMU must ignore it, still
+ * start, and replace it with a good file on exit.
+ */
+static void tb_cache_test_damaged(void (*damage)(char *data, gsize *len))
+{
+    TBCacheTest t;
+    g_autofree char *data = NULL;
+    gsize len;
+
+    tb_cache_test_init(&t);
+    tb_cache_record(t.path, "");
+    data = tb_cache_read(t.path, &len);
+    damage(data, &len);
+    tb_cache_write(t.path, data, len);
+
+    tb_cache_record(t.path, "");
+    tb_cache_replay(t.path, "");
+    tb_cache_test_cleanup(&t);
+}
+
+static void damage_truncate(char *data, gsize *len)
+{
+    *len = TB_CACHE_HEADER_SIZE + TB_CACHE_ENTRY_SIZE / 2;
+}
+
+static void damage_magic(char *data, gsize *len)
+{
+    data[0] ^= 0xff;
+}
+
+static void damage_entry(char *data, gsize *len)
+{
+    memset(data + TB_CACHE_HEADER_SIZE, 0xff, TB_CACHE_ENTRY_SIZE);
+}
+
+/* A file written by another build has a different fingerprint.  */
+static void damage_fingerprint(char *data, gsize *len)
+{
+    data[TB_CACHE_FP_OFFSET] ^= 0xff;
+}
+
+static void test_truncated(void)
+{
+    tb_cache_test_damaged(damage_truncate);
+}
+
+static void test_bad_magic(void)
+{
+    tb_cache_test_damaged(damage_magic);
+}
+
+static void test_bad_entry(void)
+{
+    tb_cache_test_damaged(damage_entry);
+}
+
+static void test_stale_build(void)
+{
+    tb_cache_test_damaged(damage_fingerprint);
+}
+
+/*
+ * The file is executable input, so QEMU must ignore it when other users
+ * can write it.  Saving it again makes it private.
+ */
+static void test_untrusted(void)
+{
+    TBCacheTest t;
+
+    tb_cache_test_init(&t);
+    tb_cache_record(t.path, "");
+    g_assert_cmpint(chmod(t.path, 0622), ==, 0);
+    tb_cache_record(t.path, "");
+    tb_cache_replay(t.path, "");
+    tb_cache_test_cleanup(&t);
+}
+
+static void test_cpu_mismatch(void)
+{
+    TBCacheTest t;
+
+    tb_cache_test_init(&t);
+    tb_cache_record(t.path, "-cpu qemu64");
+    tb_cache_record(t.path, "-cpu qemu64,model-id=tb-cache-test");
+    tb_cache_replay(t.path, "-cpu qemu64,model-id=tb-cache-test");
+    tb_cache_test_cleanup(&t);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    if (!qtest_has_accel("tcg")) {
+        g_test_skip("No TCG accelerator available");
+        return g_test_run();
+    }
+
+    qtest_add_func("tb-cache/round-trip", test_round_trip);
+    qtest_add_func("tb-cache/truncated", test_truncated);
+    qtest_add_func("tb-cache/bad-magic", test_bad_magic);
+    qtest_add_func("tb-cache/bad-entry", test_bad_entry);
+    qtest_add_func("tb-cache/stale-build", test_stale_build);
+    qtest_add_func("tb-cache/untrusted", test_untrusted);
+    qtest_add_func("tb-cache/cpu-mismatch", test_cpu_mismatch);
+
+    return g_test_run();
+}
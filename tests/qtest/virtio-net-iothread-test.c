@@ -0,0 +1,254 @@
+/*
+ * QTest testcase for virtio-net queue pairs processed in IOThreads
+ *
+ * A socket netdev is moved to the IOThread together with the queue pair.
+ * RSS is reconfigured from the main loop while packets are received, and
+ * self-announcements are sent from the main loop to the IOThread's backend.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/iov.h"
+#include "libqtest.h"
+#include "libqos/libqos-pc.h"
+#include "libqos/virtio-pci.h"
+#include "qobject/qdict.h"
+#include "hw/virtio/virtio-net.h"
+
+#ifndef ETH_P_RARP
+#define ETH_P_RARP 0x8035
+#endif
+
+#define VIRTIO_NET_SLOT     4
+#define VIRTIO_NET_TIMEOUT_US (30 * 1000 * 1000)
+#define VNET_HDR_SIZE       sizeof(struct virtio_net_hdr_mrg_rxbuf)
+#define RSS_TEST_ROUNDS     64
+
+typedef struct TestNet {
+    QOSState *qs;
+    QVirtioPCIDevice *dev;
+    QVirtQueue *rx;
+    QVirtQueue *ctrl;
+    int sv[2];
+} TestNet;
+
+static void test_net_start(TestNet *t, bool iothread)
+{
+    QVirtioDevice *vdev;
+    QPCIAddress addr = { .devfn = QPCI_DEVFN(VIRTIO_NET_SLOT, 0) };
+    uint64_t features;
+
+    g_assert_cmpint(socketpair(PF_UNIX, SOCK_STREAM, 0, t->sv), !=, -1);
+
+    t->qs = qtest_pc_boot("-object iothread,id=iothread0 "
+                          "-netdev socket,fd=%d,id=hs0 "
+                          "-device \"{'driver': 'virtio-net-pci', "
+                          "'addr': '%02x.0', 'netdev': 'hs0', 'rss': true%s}\"",
+                          t->sv[1], VIRTIO_NET_SLOT,
+                          iothread ? ", 'iothread-vq-mapping': "
+                                     "[{'iothread': 'iothread0'}]" : "");
+
+    t->dev = virtio_pci_new(t->qs->pcibus, &addr);
+    g_assert(t->dev);
+    vdev = &t->dev->vdev;
+    qvirtio_pci_device_enable(t->dev);
+    qvirtio_start_device(vdev);
+
+    features = qvirtio_get_features(vdev);
+    features &= ~(QVIRTIO_F_BAD_FEATURE |
+                  (1ull << VIRTIO_RING_F_INDIRECT_DESC) |
+                  (1ull << VIRTIO_RING_F_EVENT_IDX));
+    qvirtio_set_features(vdev, features);
+
+    /* One queue pair, so the control virtqueue is the third one */
+    t->rx = qvirtqueue_setup(vdev, &t->qs->alloc, 0);
+    t->ctrl = qvirtqueue_setup(vdev, &t->qs->alloc, 2);
+    qvirtio_set_driver_ok(vdev);
+}
+
+static void test_net_stop(TestNet *t)
+{
+    qvirtio_pci_device_disable(t->dev);
+    g_free(t->dev->pdev);
+    g_free(t->dev);
+    qtest_shutdown(t->qs);
+    close(t->sv[0]);
+    close(t->sv[1]);
+}
+
+/*
+ * Queue a VIRTIO_NET_CTRL_MQ_RSS_CONFIG command that steers everything to
+ * queue pair 0 through an indirection table of @table_len entries.  The ack
+ * byte is written to *@ack_addr.
+ */
+static uint32_t rss_config(TestNet *t, uint64_t req_addr, uint16_t table_len,
+                           uint8_t key_seed, uint64_t *ack_addr)
+{
+    QTestState *qts = t->qs->qts;
+    g_autoptr(GByteArray) cmd = g_byte_array_new();
+    uint8_t hdr[] = { VIRTIO_NET_CTRL_MQ, VIRTIO_NET_CTRL_MQ_RSS_CONFIG };
+    uint32_t hash_types = cpu_to_le32(VIRTIO_NET_RSS_HASH_TYPE_IPv4);
+    uint16_t mask = cpu_to_le16(table_len - 1);
+    uint16_t queue = cpu_to_le16(0);
+    uint16_t max_tx_vq = cpu_to_le16(1);
+    uint8_t key[VIRTIO_NET_RSS_MAX_KEY_SIZE + 1];
+    uint32_t free_head;
+    int i;
+
+    key[0] = VIRTIO_NET_RSS_MAX_KEY_SIZE;
+    for (i = 1; i < sizeof(key); i++) {
+        key[i] = key_seed + i;
+    }
+
+    g_byte_array_append(cmd, hdr, sizeof(hdr));
+    g_byte_array_append(cmd, (uint8_t *)&hash_types, sizeof(hash_types));
+    g_byte_array_append(cmd, (uint8_t *)&mask, sizeof(mask));
+    /* unclassified_queue, then the indirection table */
+    for (i = 0; i <= table_len; i++) {
+        g_byte_array_append(cmd, (uint8_t *)&queue, sizeof(queue));
+    }
+    g_byte_array_append(cmd, (uint8_t *)&max_tx_vq, sizeof(max_tx_vq));
+    g_byte_array_append(cmd, key, sizeof(key));
+
+    qtest_memwrite(qts, req_addr, cmd->data, cmd->len);
+    *ack_addr = req_addr + cmd->len;
+    qtest_writeb(qts, *ack_addr, 0xff);
+
+    free_head = qvirtqueue_add(qts, t->ctrl, req_addr, cmd->len, false, true);
+    qvirtqueue_add(qts, t->ctrl, *ack_addr, 1, true, false);
+    qvirtqueue_kick(qts, &t->dev->vdev, t->ctrl, free_head);
+
+    return free_head;
+}
+
+/*
+ * Change the RSS configuration from the main loop while the queue pair
+ * receives packets, so that the receive path and the control virtqueue
+ * handler overlap.
+ */
+static void test_rss_rx(const void *data)
+{
+    bool iothread = GPOINTER_TO_INT(data);
+    TestNet t;
+    QTestState *qts;
+    uint8_t frame[] = {
+        /* Ethernet: broadcast, IPv4 */
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0x52, 0x54, 0x00, 0x12, 0x34, 0x56,
+        0x08, 0x00,
+        /* IPv4: UDP from 10.0.2.2 to 10.0.2.15 */
+        0x45, 0x00, 0x00, 0x21, 0x00, 0x00, 0x00, 0x00,
+        0x40, 0x11, 0x00, 0x00, 10, 0, 2, 2, 10, 0, 2, 15,
+        /* UDP: the source port is changed below to vary the hash */
+        0x04, 0x00, 0x16, 0x2e, 0x00, 0x0d, 0x00, 0x00,
+        'T', 'E', 'S', 'T', 0,
+    };
+    uint8_t buffer[sizeof(frame)];
+    int len = htonl(sizeof(frame));
+    struct iovec iov[] = {
+        {
+            .iov_base = &len,
+            .iov_len = sizeof(len),
+        }, {
+            .iov_base = frame,
+            .iov_len = sizeof(frame),
+        },
+    };
+    uint64_t rx_addr, ctrl_addr, ack_addr;
+    int i, ret;
+
+    test_net_start(&t, iothread);
+    qts = t.qs->qts;
+
+    if (!(t.dev->vdev.features & (1ull << VIRTIO_NET_F_RSS))) {
+        g_test_skip("VIRTIO_NET_F_RSS not negotiated");
+        test_net_stop(&t);
+        return;
+    }
+
+    rx_addr = guest_alloc(&t.qs->alloc, 128);
+    ctrl_addr = guest_alloc(&t.qs->alloc, 512);
+
+    for (i = 0; i < RSS_TEST_ROUNDS; i++) {
+        uint32_t rx_head, ctrl_head;
+
+        rx_head = qvirtqueue_add(qts, t.rx, rx_addr, 128, true, false);
+        qvirtqueue_kick(qts, &t.dev->vdev, t.rx, rx_head);
+
+        frame[35] = i;
+        frame[sizeof(frame) - 1] = i;
+        ret = iov_send(t.sv[0], iov, 2, 0, sizeof(len) + sizeof(frame));
+        g_assert_cmpint(ret, ==, sizeof(len) + sizeof(frame));
+
+        /* Switch between a one entry and a full size indirection table */
+        ctrl_head = rss_config(&t, ctrl_addr,
+                               i % 2 ? 1 : VIRTIO_NET_RSS_MAX_TABLE_LEN,
+                               i, &ack_addr);
+
+        qvirtio_wait_used_elem(qts, &t.dev->vdev, t.ctrl, ctrl_head, NULL,
+                               VIRTIO_NET_TIMEOUT_US);
+        g_assert_cmpint(qtest_readb(qts, ack_addr), ==, VIRTIO_NET_OK);
+
+        qvirtio_wait_used_elem(qts, &t.dev->vdev, t.rx, rx_head, NULL,
+                               VIRTIO_NET_TIMEOUT_US);
+        qtest_memread(qts, rx_addr + VNET_HDR_SIZE, buffer, sizeof(frame));
+        g_assert_cmpmem(buffer, sizeof(buffer), frame, sizeof(frame));
+    }
+
+    guest_free(&t.qs->alloc, ctrl_addr);
+    guest_free(&t.qs->alloc, rx_addr);
+    test_net_stop(&t);
+}
+
+/*
+ * Self-announcements are sent from the main loop.  With the queue pair in
+ * an IOThread they must still reach the backend.
+ */
+static void test_announce_self(const void *data)
+{
+    bool iothread = GPOINTER_TO_INT(data);
+    uint8_t buffer[60];
+    uint16_t proto;
+    TestNet t;
+    QDict *rsp;
+    int len, ret, i;
+
+    test_net_start(&t, iothread);
+
+    rsp = qtest_qmp(t.qs->qts, "{ 'execute': 'announce-self', "
+                    "'arguments': { 'initial': 20, 'max': 100, "
+                    "'rounds': 3, 'step': 10 } }");
+    g_assert(!qdict_haskey(rsp, "error"));
+    qobject_unref(rsp);
+
+    for (i = 0; i < 3; i++) {
+        ret = recv(t.sv[0], &len, sizeof(len), MSG_WAITALL);
+        g_assert_cmpint(ret, ==, sizeof(len));
+        len = ntohl(len);
+        g_assert_cmpint(len, ==, sizeof(buffer));
+
+        ret = recv(t.sv[0], buffer, len, MSG_WAITALL);
+        g_assert_cmpint(ret, ==, len);
+        memcpy(&proto, &buffer[12], sizeof(proto));
+        g_assert_cmphex(proto, ==, htons(ETH_P_RARP));
+    }
+
+    test_net_stop(&t);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_data_func("/virtio-net/iothread/rss-rx/main-loop",
+                        GINT_TO_POINTER(false), test_rss_rx);
+    qtest_add_data_func("/virtio-net/iothread/rss-rx/iothread",
+                        GINT_TO_POINTER(true), test_rss_rx);
+    qtest_add_data_func("/virtio-net/iothread/announce-self/main-loop",
+                        GINT_TO_POINTER(false), test_announce_self);
+    qtest_add_data_func("/virtio-net/iothread/announce-self/iothread",
+                        GINT_TO_POINTER(true), test_announce_self);
+
+    return g_test_run();
+}
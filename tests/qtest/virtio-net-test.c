@@ -9,6 +9,7 @@
 
 #include "qemu/osdep.h"
 #include "libqtest-single.h"
+#include "qemu/bswap.h"
 #include "qemu/iov.h"
 #include "qemu/module.h"
 #include "qobject/qdict.h"
@@ -261,6 +262,131 @@ static void announce_self(void *obj, void *data, QGuestAllocator *t_alloc)
     };
 }
 
+#define RSS_TEST_ROUNDS 64
+
+/*
+ * Queue a VIRTIO_NET_CTRL_MQ_RSS_CONFIG command that steers everything to
+ * queue pair 0 through an indirection table of @table_len entries.  The ack
+ * byte is written to *@ack_addr.
+ */
+static uint32_t rss_config(QVirtioDevice *dev, QVirtQueue *vq,
+                           uint64_t req_addr, uint16_t table_len,
+                           uint8_t key_seed, uint64_t *ack_addr)
+{
+    QTestState *qts = global_qtest;
+    GByteArray *cmd = g_byte_array_new();
+    uint8_t hdr[] = { VIRTIO_NET_CTRL_MQ, VIRTIO_NET_CTRL_MQ_RSS_CONFIG };
+    uint32_t hash_types = cpu_to_le32(VIRTIO_NET_RSS_HASH_TYPE_IPv4);
+    uint16_t mask = cpu_to_le16(table_len - 1);
+    uint16_t queue = cpu_to_le16(0);
+    uint16_t max_tx_vq = cpu_to_le16(1);
+    uint8_t key[VIRTIO_NET_RSS_MAX_KEY_SIZE + 1];
+    uint32_t free_head;
+    int i;
+
+    key[0] = VIRTIO_NET_RSS_MAX_KEY_SIZE;
+    for (i = 1; i < sizeof(key); i++) {
+        key[i] = key_seed + i;
+    }
+
+    g_byte_array_append(cmd, hdr, sizeof(hdr));
+    g_byte_array_append(cmd, (uint8_t *)&hash_types, sizeof(hash_types));
+    g_byte_array_append(cmd, (uint8_t *)&mask, sizeof(mask));
+    /* unclassified_queue, then the indirection table */
+    for (i = 0; i <= table_len; i++) {
+        g_byte_array_append(cmd, (uint8_t *)&queue, sizeof(queue));
+    }
+    g_byte_array_append(cmd, (uint8_t *)&max_tx_vq, sizeof(max_tx_vq));
+    g_byte_array_append(cmd, key, sizeof(key));
+
+    memwrite(req_addr, cmd->data, cmd->len);
+    *ack_addr = req_addr + cmd->len;
+    writeb(*ack_addr, 0xff);
+
+    free_head = qvirtqueue_add(qts, vq, req_addr, cmd->len, false, true);
+    qvirtqueue_add(qts, vq, *ack_addr, 1, true, false);
+    qvirtqueue_kick(qts, dev, vq, free_head);
+
+    g_byte_array_unref(cmd);
+    return free_head;
+}
+
+/*
+ * Change the RSS configuration while packets are being received, so that the
+ * receive path and the control virtqueue handler overlap.
+ */
+static void rss_rx_test(void *obj, void *data, QGuestAllocator *t_alloc)
+{
+    QVirtioNet *net_if = obj;
+    QVirtioDevice *dev = net_if->vdev;
+    QVirtQueue *rx = net_if->queues[0];
+    QVirtQueue *ctrl = net_if->queues[net_if->n_queues - 1];
+    QTestState *qts = global_qtest;
+    uint8_t frame[] = {
+        /* Ethernet: broadcast, IPv4 */
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0x52, 0x54, 0x00, 0x12, 0x34, 0x56,
+        0x08, 0x00,
+        /* IPv4: UDP from 10.0.2.2 to 10.0.2.15 */
+        0x45, 0x00, 0x00, 0x21, 0x00, 0x00, 0x00, 0x00,
+        0x40, 0x11, 0x00, 0x00, 10, 0, 2, 2, 10, 0, 2, 15,
+        /* UDP: the source port is changed below to vary the hash */
+        0x04, 0x00, 0x16, 0x2e, 0x00, 0x0d, 0x00, 0x00,
+        'T', 'E', 'S', 'T', 0,
+    };
+    uint8_t buffer[sizeof(frame)];
+    int len = htonl(sizeof(frame));
+    struct iovec iov[] = {
+        {
+            .iov_base = &len,
+            .iov_len = sizeof(len),
+        }, {
+            .iov_base = frame,
+            .iov_len = sizeof(frame),
+        },
+    };
+    uint64_t rx_addr, ctrl_addr, ack_addr;
+    int *sv = data;
+    int i, ret;
+
+    if (!(dev->features & (1ull << VIRTIO_NET_F_RSS))) {
+        g_test_skip("VIRTIO_NET_F_RSS not negotiated");
+        return;
+    }
+
+    rx_addr = guest_alloc(t_alloc, 128);
+    ctrl_addr = guest_alloc(t_alloc, 512);
+
+    for (i = 0; i < RSS_TEST_ROUNDS; i++) {
+        uint32_t rx_head, ctrl_head;
+
+        rx_head = qvirtqueue_add(qts, rx, rx_addr, 128, true, false);
+        qvirtqueue_kick(qts, dev, rx, rx_head);
+
+        frame[35] = i;
+        frame[sizeof(frame) - 1] = i;
+        ret = iov_send(sv[0], iov, 2, 0, sizeof(len) + sizeof(frame));
+        g_assert_cmpint(ret, ==, sizeof(len) + sizeof(frame));
+
+        /* Switch between a one entry and a full size indirection table */
+        ctrl_head = rss_config(dev, ctrl, ctrl_addr,
+                               i % 2 ? 1 : VIRTIO_NET_RSS_MAX_TABLE_LEN,
+                               i, &ack_addr);
+
+        qvirtio_wait_used_elem(qts, dev, ctrl, ctrl_head, NULL,
+                               QVIRTIO_NET_TIMEOUT_US);
+        g_assert_cmpint(readb(ack_addr), ==, VIRTIO_NET_OK);
+
+        qvirtio_wait_used_elem(qts, dev, rx, rx_head, NULL,
+                               QVIRTIO_NET_TIMEOUT_US);
+        memread(rx_addr + VNET_HDR_SIZE, buffer, sizeof(frame));
+        g_assert_cmpmem(buffer, sizeof(buffer), frame, sizeof(frame));
+    }
+
+    guest_free(t_alloc, ctrl_addr);
+    guest_free(t_alloc, rx_addr);
+}
+
 static void virtio_net_test_cleanup(void *sockets)
 {
     int *sv = sockets;
@@ -285,6 +411,12 @@ static void *virtio_net_test_setup(GString *cmd_line, void *arg)
     return sv;
 }
 
+static void *virtio_net_test_setup_rss(GString *cmd_line, void *arg)
+{
+    g_string_append(cmd_line, " -global virtio-net-device.rss=on ");
+    return virtio_net_test_setup(cmd_line, arg);
+}
+
 #endif /* _WIN32 */
 
 static void large_tx(void *obj, void *data, QGuestAllocator *t_alloc)
@@ -328,6 +460,8 @@ static void register_virtio_net_test(void)
     qos_add_test("basic", "virtio-net", send_recv_test, &opts);
     qos_add_test("rx_stop_cont", "virtio-net", stop_cont_test, &opts);
     qos_add_test("announce-self", "virtio-net", announce_self, &opts);
+    opts.before = virtio_net_test_setup_rss;
+    qos_add_test("rss_rx", "virtio-net", rss_rx_test, &opts);
 #endif
 
     /* These tests do not need a loopback backend.  */
@@ -0,0 +1,91 @@
+/*
+ * Fault in the part of a trace that tier-up folded in
+ *
+ * Run with a low -tier-threshold, so that hot_store() is re-translated
+ * with the TB after its branch folded in.  The store in that second part
+ * then faults, and the handler makes the page writable and returns.  The
+ * store must be restarted on its own, without running again anything that
+ * comes before it in the trace.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <assert.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define CALLS 10000
+
+/* Each access is a guest memory access that must happen exactly once */
+static volatile unsigned before, taken, after, faults;
+static int *page;
+static int pagesize;
+
+static void __attribute__((noinline)) hot_store(int *p, unsigned i)
+{
+    before++;
+    if (i & 1) {
+        taken++;
+    }
+    /* Both ways of the branch lead to a TB further down the page */
+    *(volatile int *)p = i;
+    after++;
+}
+
+static void segv_handler(int sig, siginfo_t *info, void *puc)
+{
+    int ret;
+
+    assert(info->si_addr == page);
+    faults++;
+    ret = mprotect(page, pagesize, PROT_READ | PROT_WRITE);
+    assert(ret == 0);
+}
+
+static void fault_once(unsigned i)
+{
+    int ret;
+
+    ret = mprotect(page, pagesize, PROT_READ);
+    assert(ret == 0);
+    hot_store(page, i);
+    assert(*page == i);
+}
+
+int main(void)
+{
+    struct sigaction sa = {
+        .sa_sigaction = segv_handler,
+        .sa_flags = SA_SIGINFO,
+    };
+    int scratch;
+    unsigned i;
+    int ret;
+
+    pagesize = getpagesize();
+    page = mmap(NULL, pagesize, PROT_READ, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    assert(page != MAP_FAILED);
+    ret = sigaction(SIGSEGV, &sa, NULL);
+    assert(ret == 0);
+
+    /* Get both ways through hot_store() hot enough to be re-translated */
+    for (i = 0; i < CALLS; i++) {
+        hot_store(&scratch, i);
+    }
+
+    fault_once(CALLS);
+    fault_once(CALLS + 1);
+
+    assert(faults == 2);
+    assert(before == CALLS + 2);
+    assert(taken == CALLS / 2 + 1);
+    assert(after == CALLS + 2);
+
+    ret = munmap(page, pagesize);
+    assert(ret == 0);
+
+    printf("PASS\n");
+    return 0;
+}
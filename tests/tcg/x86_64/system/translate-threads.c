@@ -0,0 +1,83 @@
+/*
+ * Self-modifying code with helper translation threads
+ *
+ * Run with translate-threads=N and a small tb-size.  Every iteration
+ * rewrites a block whose direct jump points alternately at two other
+ * blocks, so the helpers are translating jump targets that the guest
+ * has just overwritten.  The generated code soon fills the code buffer,
+ * which forces tb_flush() while translation jobs are in flight.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <minilib.h>
+
+#define ITERATIONS  100000
+#define TARGET_A    64
+#define TARGET_B    128
+
+__attribute__((aligned(4096)))
+static uint8_t code[4096];
+
+/* add $imm, %eax */
+static int emit_add(uint8_t *p, uint32_t imm)
+{
+    p[0] = 0x05;
+    p[1] = imm;
+    p[2] = imm >> 8;
+    p[3] = imm >> 16;
+    p[4] = imm >> 24;
+    return 5;
+}
+
+/* xor %eax, %eax; add $imm, %eax; jmp target */
+static void emit_head(uint32_t imm, int target)
+{
+    uint8_t *p = code;
+    int32_t rel;
+
+    *p++ = 0x31;
+    *p++ = 0xc0;
+    p += emit_add(p, imm);
+
+    rel = target - (p + 5 - code);
+    *p++ = 0xe9;
+    *p++ = rel;
+    *p++ = rel >> 8;
+    *p++ = rel >> 16;
+    *p++ = rel >> 24;
+}
+
+/* add $imm, %eax; ret */
+static void emit_tail(int offset, uint32_t imm)
+{
+    uint8_t *p = code + offset;
+
+    p += emit_add(p, imm);
+    *p = 0xc3;
+}
+
+int main(void)
+{
+    uint32_t (*fn)(void) = (uint32_t (*)(void))code;
+    uint32_t i, ret;
+
+    for (i = 0; i < ITERATIONS; i++) {
+        int target = i & 1 ? TARGET_B : TARGET_A;
+
+        emit_tail(target, i * 3);
+        emit_head(i, target);
+        asm volatile("" : : : "memory");
+
+        ret = fn();
+        if (ret != i * 4) {
+            ml_printf("FAIL: iteration %d returned %x, expected %x\n",
+                      i, ret, i * 4);
+            return 1;
+        }
+    }
+
+    ml_printf("PASS: %d iterations\n", ITERATIONS);
+    return 0;
+}
@@ -58,13 +58,49 @@ static void test_1(void)
     }
 }
 
+static void test_batch_1(void)
+{
+    enum { BATCH_PAGES = 64, BATCH_PAGE_SIZE = 4096 };
+    const void *bufs[BATCH_PAGES];
+    bool zero[BATCH_PAGES];
+    size_t i, o, n;
+
+    for (i = 0; i < BATCH_PAGES; i++) {
+        bufs[i] = buffer + i * BATCH_PAGE_SIZE;
+    }
+
+    n = buffer_is_zero_batch(bufs, BATCH_PAGES, BATCH_PAGE_SIZE, zero);
+    g_assert_cmpint(n, ==, BATCH_PAGES);
+    for (i = 0; i < BATCH_PAGES; i++) {
+        g_assert(zero[i]);
+    }
+
+    /* Mark every third page, at an offset that varies from page to page */
+    for (i = 0; i < BATCH_PAGES; i += 3) {
+        o = (i * 997) % BATCH_PAGE_SIZE;
+        buffer[i * BATCH_PAGE_SIZE + o] = 1;
+    }
+    n = buffer_is_zero_batch(bufs, BATCH_PAGES, BATCH_PAGE_SIZE, zero);
+    g_assert_cmpint(n, ==, BATCH_PAGES - DIV_ROUND_UP(BATCH_PAGES, 3));
+    for (i = 0; i < BATCH_PAGES; i++) {
+        g_assert(zero[i] == (i % 3 != 0));
+        g_assert(zero[i] == buffer_is_zero(bufs[i], BATCH_PAGE_SIZE));
+    }
+    for (i = 0; i < BATCH_PAGES; i += 3) {
+        o = (i * 997) % BATCH_PAGE_SIZE;
+        buffer[i * BATCH_PAGE_SIZE + o] = 0;
+    }
+}
+
 static void test_2(void)
 {
     if (g_test_perf()) {
         test_1();
+        test_batch_1();
     } else {
         do {
             test_1();
+            test_batch_1();
         } while (test_buffer_is_zero_next_accel());
     }
 }
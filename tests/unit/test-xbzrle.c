@@ -173,6 +173,62 @@ static void test_encode_decode(void)
     }
 }
 
+#define XBZRLE_ACCEL_PAGES 256
+
+static void test_encode_accel(void)
+{
+    uint8_t *old_buf = g_malloc0(XBZRLE_ACCEL_PAGES * XBZRLE_PAGE_SIZE);
+    uint8_t *new_buf = g_malloc0(XBZRLE_ACCEL_PAGES * XBZRLE_PAGE_SIZE);
+    uint8_t *expected = g_malloc(XBZRLE_ACCEL_PAGES * XBZRLE_PAGE_SIZE);
+    uint8_t *compressed = g_malloc(XBZRLE_PAGE_SIZE);
+    int expected_len[XBZRLE_ACCEL_PAGES];
+    int i, j;
+
+    for (i = 0; i < XBZRLE_ACCEL_PAGES; i++) {
+        uint8_t *page = new_buf + i * XBZRLE_PAGE_SIZE;
+        int diff_len = g_test_rand_int_range(1, XBZRLE_PAGE_SIZE / 4);
+        int start = g_test_rand_int_range(0, XBZRLE_PAGE_SIZE - diff_len);
+
+        /* Changed and unchanged bytes interleaved at random */
+        for (j = start; j < start + diff_len; j++) {
+            if (g_test_rand_bit()) {
+                page[j] = g_test_rand_int_range(1, 256);
+            }
+        }
+    }
+
+    /* Whichever encoder is active first is the reference */
+    for (i = 0; i < XBZRLE_ACCEL_PAGES; i++) {
+        expected_len[i] =
+            xbzrle_encode_buffer(old_buf + i * XBZRLE_PAGE_SIZE,
+                                 new_buf + i * XBZRLE_PAGE_SIZE,
+                                 XBZRLE_PAGE_SIZE,
+                                 expected + i * XBZRLE_PAGE_SIZE,
+                                 XBZRLE_PAGE_SIZE);
+    }
+
+    /* All other encoders must produce the same stream */
+    while (test_xbzrle_encode_next_accel()) {
+        for (i = 0; i < XBZRLE_ACCEL_PAGES; i++) {
+            int dlen = xbzrle_encode_buffer(old_buf + i * XBZRLE_PAGE_SIZE,
+                                            new_buf + i * XBZRLE_PAGE_SIZE,
+                                            XBZRLE_PAGE_SIZE, compressed,
+                                            XBZRLE_PAGE_SIZE);
+
+            g_assert(dlen == expected_len[i]);
+            if (dlen > 0) {
+                g_assert(memcmp(compressed, expected + i * XBZRLE_PAGE_SIZE,
+                                dlen) == 0);
+            }
+        }
+    }
+
+    g_free(old_buf);
+    g_free(new_buf);
+    g_free(expected);
+    g_free(compressed);
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -185,6 +241,8 @@ int main(int argc, char **argv)
     g_test_add_func("/xbzrle/encode_decode_overflow",
                     test_encode_decode_overflow);
     g_test_add_func("/xbzrle/encode_decode", test_encode_decode);
+    /* Must come last, it leaves the portable encoder selected */
+    g_test_add_func("/xbzrle/encode_accel", test_encode_accel);
 
     return g_test_run();
 }
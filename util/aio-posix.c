@@ -748,7 +748,7 @@ bool aio_context_setup(AioContext *ctx, Error **errp)
             need_io_uring = true;
             return true;
         }
-        if (need_io_uring) {
+        if (need_io_uring || ctx->io_uring_sqpoll) {
             error_propagate(errp, local_err);
             return false;
         }
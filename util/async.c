@@ -446,10 +446,12 @@ ThreadPoolAio *aio_get_thread_pool(AioContext *ctx)
 #ifdef CONFIG_LINUX_AIO
 LinuxAioState *aio_setup_linux_aio(AioContext *ctx, Error **errp)
 {
-    if (!ctx->linux_aio) {
+    if (!ctx->linux_aio && !ctx->linux_aio_failed) {
         ctx->linux_aio = laio_init(errp);
         if (ctx->linux_aio) {
             laio_attach_aio_context(ctx->linux_aio, ctx);
+        } else {
+            ctx->linux_aio_failed = true;
         }
     }
     return ctx->linux_aio;
@@ -550,6 +552,12 @@ static void co_schedule_bh_cb(void *opaque)
 }
 
 AioContext *aio_context_new(Error **errp)
+{
+    return aio_context_new_params(NULL, errp);
+}
+
+AioContext *aio_context_new_params(const AioContextParams *params,
+                                   Error **errp)
 {
     ERRP_GUARD();
     int ret;
@@ -571,6 +579,17 @@ AioContext *aio_context_new(Error **errp)
     QSLIST_INIT(&ctx->bh_list);
     QSIMPLEQ_INIT(&ctx->bh_slice_list);
 
+    if (params && params->io_uring_sqpoll) {
+#ifdef CONFIG_LINUX_IO_URING
+        ctx->io_uring_sqpoll = true;
+        ctx->io_uring_sqpoll_idle = params->io_uring_sqpoll_idle;
+        ctx->io_uring_sqpoll_cpu = params->io_uring_sqpoll_cpu;
+#else
+        error_setg(errp, "io_uring SQPOLL is not supported in this build");
+        goto fail;
+#endif
+    }
+
     ret = event_notifier_init(&ctx->notifier, false);
     if (ret < 0) {
         error_setg_errno(errp, -ret, "Failed to initialize event notifier");
@@ -599,6 +618,7 @@ AioContext *aio_context_new(Error **errp)
                            aio_context_notifier_poll_ready);
 #ifdef CONFIG_LINUX_AIO
     ctx->linux_aio = NULL;
+    ctx->linux_aio_failed = false;
 #endif
 
     ctx->thread_pool = NULL;
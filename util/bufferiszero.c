@@ -110,6 +110,35 @@ bool buffer_is_zero_ge256(const void *buf, size_t len)
     return buffer_is_zero_accel(buf, len);
 }
 
+size_t buffer_is_zero_batch(const void * const *bufs, size_t n, size_t len,
+                            bool *zero)
+{
+    biz_accel_fn accel = buffer_is_zero_accel;
+    size_t count = 0;
+
+    assert(len >= 256);
+
+    for (size_t i = 0; i < n; i++) {
+        const char *buf = bufs[i];
+
+        /*
+         * Start loading the cachelines sampled from the next buffer while
+         * this one is being scanned.
+         */
+        if (i + 1 < n) {
+            const char *next = bufs[i + 1];
+
+            __builtin_prefetch(next);
+            __builtin_prefetch(next + len / 2);
+            __builtin_prefetch(next + len - 1);
+        }
+
+        zero[i] = buffer_is_zero_sample3(buf, len) && accel(buf, len);
+        count += zero[i];
+    }
+    return count;
+}
+
 bool test_buffer_is_zero_next_accel(void)
 {
     if (accel_index != 0) {
@@ -46,7 +46,9 @@
 #include "qemu/osdep.h"
 #include <poll.h>
 #include "qapi/error.h"
+#include "qemu/bitmap.h"
 #include "qemu/defer-call.h"
+#include "qemu/lockable.h"
 #include "qemu/rcu_queue.h"
 #include "aio-posix.h"
 #include "trace.h"
@@ -77,6 +79,27 @@ static inline int pfd_events_from_poll(int poll_events)
            (poll_events & POLLERR ? G_IO_ERR : 0);
 }
 
+/*
+ * Account for a submission with SQPOLL. Called right before liburing would
+ * enter the kernel (without SQPOLL) to submit sqes and/or wait for @wait_nr
+ * cqes.
+ */
+static void sqpoll_account_submit(AioContext *ctx, unsigned wait_nr)
+{
+    struct io_uring *ring = &ctx->fdmon_io_uring;
+
+    if (!ctx->io_uring_sqpoll || !io_uring_sq_ready(ring)) {
+        return;
+    }
+
+    qatomic_inc(&ctx->io_uring_sqpoll_submissions);
+    if (qatomic_read(ring->sq.kflags) & IORING_SQ_NEED_WAKEUP) {
+        qatomic_inc(&ctx->io_uring_sqpoll_wakeups);
+    } else if (wait_nr == 0) {
+        qatomic_inc(&ctx->io_uring_sqpoll_syscalls_avoided);
+    }
+}
+
 /*
  * Returns an sqe for submitting a request. Only called from the AioContext
  * thread.
@@ -91,6 +114,20 @@ static struct io_uring_sqe *get_sqe(AioContext *ctx)
         return sqe;
     }
 
+    if (ctx->io_uring_sqpoll) {
+        /*
+         * The kernel thread consumes sqes asynchronously, so submitting does
+         * not necessarily free any. Wait until it has caught up.
+         */
+        do {
+            sqpoll_account_submit(ctx, 0);
+            io_uring_submit(ring);
+            io_uring_sqring_wait(ring);
+            sqe = io_uring_get_sqe(ring);
+        } while (!sqe);
+        return sqe;
+    }
+
     /* No free sqes left, submit pending sqes first */
     do {
         ret = io_uring_submit(ring);
@@ -335,6 +372,7 @@ static void fdmon_io_uring_gsource_prepare(AioContext *ctx)
 {
     fill_sq_ring(ctx);
     if (io_uring_sq_ready(&ctx->fdmon_io_uring)) {
+        sqpoll_account_submit(ctx, 0);
         while (io_uring_submit(&ctx->fdmon_io_uring) == -EINTR) {
             /* Keep trying if syscall was interrupted */
         }
@@ -404,6 +442,7 @@ static int fdmon_io_uring_wait(AioContext *ctx, AioHandlerList *ready_list,
     }
 
     fill_sq_ring(ctx);
+    sqpoll_account_submit(ctx, wait_nr);
 
     /*
      * Loop to handle signals in both cases:
@@ -441,6 +480,385 @@ static bool fdmon_io_uring_need_wait(AioContext *ctx)
     return false;
 }
 
+#ifdef HAVE_IO_URING_REGISTER_SPARSE
+/*
+ * Registered buffers and files
+ *
+ * Memory areas and file descriptors are registered with every io_uring at the
+ * same index, so that users can look up the index once and use it in any
+ * AioContext. The kernel limits registered buffers to 1 GiB, so memory areas
+ * are split into chunks of that size that take up consecutive indices.
+ *
+ * Registration happens from the main loop while the AioContexts keep running.
+ * Unlike submitting sqes, io_uring_register(2) may be called from any thread.
+ */
+#define FIXED_BUF_CHUNK_BITS 30
+
+enum {
+    FIXED_BUFS  = 1024, /* registered buffer table size */
+    FIXED_FILES = 64,   /* registered file table size */
+};
+
+typedef struct {
+    void *host;
+    size_t size;
+    unsigned refcnt;
+    int index; /* of the first chunk, or -1 if registration failed */
+} FixedBufRegion;
+
+typedef struct {
+    struct rcu_head rcu;
+    unsigned nr;
+    FixedBufRegion regions[];
+} FixedBufRegions;
+
+/* Protects everything below, except for RCU readers of fixed_buf_regions */
+static QemuMutex fixed_lock;
+static QLIST_HEAD(, AioContext) fixed_contexts =
+    QLIST_HEAD_INITIALIZER(fixed_contexts);
+static FixedBufRegions *fixed_buf_regions;
+static DECLARE_BITMAP(fixed_bufs_used, FIXED_BUFS);
+static DECLARE_BITMAP(fixed_files_used, FIXED_FILES);
+static int fixed_files[FIXED_FILES];
+
+static void __attribute__((constructor)) fixed_init(void)
+{
+    qemu_mutex_init(&fixed_lock);
+}
+
+static unsigned fixed_buf_chunks(size_t size)
+{
+    return DIV_ROUND_UP(size, (size_t)1 << FIXED_BUF_CHUNK_BITS);
+}
+
+/* Register @host, or clear the chunks at @index if @host is NULL */
+static int fixed_buf_update(struct io_uring *ring, int index, void *host,
+                            size_t size)
+{
+    unsigned nr = fixed_buf_chunks(size);
+    g_autofree struct iovec *iov = g_new0(struct iovec, nr);
+    unsigned i;
+    int ret;
+
+    for (i = 0; host && i < nr; i++) {
+        size_t offset = (size_t)i << FIXED_BUF_CHUNK_BITS;
+
+        iov[i].iov_base = host + offset;
+        iov[i].iov_len = MIN(size - offset, (size_t)1 << FIXED_BUF_CHUNK_BITS);
+    }
+
+    ret = io_uring_register_buffers_update_tag(ring, index, iov, NULL, nr);
+    return ret < 0 ? ret : 0;
+}
+
+/* Register @fd at @index in all io_urings, or clear @index if @fd is -1 */
+static int fixed_file_update_all(int index, int fd)
+{
+    AioContext *ctx, *undo;
+    int ret;
+
+    QLIST_FOREACH(ctx, &fixed_contexts, io_uring_fixed_next) {
+        ret = io_uring_register_files_update(&ctx->fdmon_io_uring, index,
+                                             &fd, 1);
+        if (ret < 0 && fd != -1) {
+            QLIST_FOREACH(undo, &fixed_contexts, io_uring_fixed_next) {
+                if (undo == ctx) {
+                    break;
+                }
+                fd = -1;
+                io_uring_register_files_update(&undo->fdmon_io_uring, index,
+                                               &fd, 1);
+            }
+            return ret;
+        }
+    }
+    return 0;
+}
+
+/* Replace fixed_buf_regions with @regions, called with fixed_lock held */
+static void fixed_buf_regions_publish(FixedBufRegions *regions)
+{
+    FixedBufRegions *old = fixed_buf_regions;
+
+    qatomic_rcu_set(&fixed_buf_regions, regions);
+    if (old) {
+        g_free_rcu(old, rcu);
+    }
+}
+
+static FixedBufRegions *fixed_buf_regions_copy(unsigned extra)
+{
+    unsigned nr = fixed_buf_regions ? fixed_buf_regions->nr : 0;
+    FixedBufRegions *regions;
+
+    regions = g_malloc0(sizeof(*regions) +
+                        (nr + extra) * sizeof(regions->regions[0]));
+    regions->nr = nr;
+    if (nr) {
+        memcpy(regions->regions, fixed_buf_regions->regions,
+               nr * sizeof(regions->regions[0]));
+    }
+    return regions;
+}
+
+static FixedBufRegion *fixed_buf_region_find(FixedBufRegions *regions,
+                                             void *host, size_t size)
+{
+    unsigned i;
+
+    for (i = 0; regions && i < regions->nr; i++) {
+        if (regions->regions[i].host == host &&
+            regions->regions[i].size == size) {
+            return &regions->regions[i];
+        }
+    }
+    return NULL;
+}
+
+void aio_register_fixed_buf(void *host, size_t size)
+{
+    unsigned nr = fixed_buf_chunks(size);
+    FixedBufRegions *regions;
+    FixedBufRegion *region;
+    AioContext *ctx, *undo;
+    unsigned long index;
+    int ret = 0;
+
+    QEMU_LOCK_GUARD(&fixed_lock);
+
+    regions = fixed_buf_regions_copy(1);
+    region = fixed_buf_region_find(regions, host, size);
+    if (region) {
+        region->refcnt++;
+        fixed_buf_regions_publish(regions);
+        return;
+    }
+
+    index = bitmap_find_next_zero_area(fixed_bufs_used, FIXED_BUFS, 0, nr, 0);
+    if (index + nr > FIXED_BUFS) {
+        ret = -ENOSPC;
+    }
+
+    QLIST_FOREACH(ctx, &fixed_contexts, io_uring_fixed_next) {
+        if (ret < 0) {
+            break;
+        }
+        ret = fixed_buf_update(&ctx->fdmon_io_uring, index, host, size);
+        if (ret < 0) {
+            QLIST_FOREACH(undo, &fixed_contexts, io_uring_fixed_next) {
+                if (undo == ctx) {
+                    break;
+                }
+                fixed_buf_update(&undo->fdmon_io_uring, index, NULL, size);
+            }
+        }
+    }
+
+    region = &regions->regions[regions->nr++];
+    *region = (FixedBufRegion) {
+        .host = host,
+        .size = size,
+        .refcnt = 1,
+        .index = -1,
+    };
+    if (ret == 0) {
+        bitmap_set(fixed_bufs_used, index, nr);
+        region->index = index;
+    }
+    trace_fdmon_io_uring_register_fixed_buf(host, size, region->index, ret);
+    fixed_buf_regions_publish(regions);
+}
+
+void aio_unregister_fixed_buf(void *host, size_t size)
+{
+    FixedBufRegions *regions;
+    FixedBufRegion *region;
+    AioContext *ctx;
+
+    QEMU_LOCK_GUARD(&fixed_lock);
+
+    regions = fixed_buf_regions_copy(0);
+    region = fixed_buf_region_find(regions, host, size);
+    assert(region);
+
+    if (--region->refcnt == 0) {
+        if (region->index >= 0) {
+            QLIST_FOREACH(ctx, &fixed_contexts, io_uring_fixed_next) {
+                fixed_buf_update(&ctx->fdmon_io_uring, region->index, NULL,
+                                 size);
+            }
+            bitmap_clear(fixed_bufs_used, region->index,
+                         fixed_buf_chunks(size));
+        }
+        *region = regions->regions[--regions->nr];
+    }
+    fixed_buf_regions_publish(regions);
+}
+
+int aio_fixed_buf_index(const void *buf, size_t len)
+{
+    AioContext *ctx = qemu_get_current_aio_context();
+    FixedBufRegions *regions;
+    uintptr_t start = (uintptr_t)buf;
+    unsigned i;
+
+    if (!ctx->io_uring_fixed) {
+        return -1;
+    }
+
+    RCU_READ_LOCK_GUARD();
+
+    regions = qatomic_rcu_read(&fixed_buf_regions);
+    for (i = 0; regions && i < regions->nr; i++) {
+        FixedBufRegion *region = &regions->regions[i];
+        uintptr_t host = (uintptr_t)region->host;
+        size_t offset = start - host;
+
+        if (region->index < 0 || start < host || len > region->size ||
+            offset > region->size - len) {
+            continue;
+        }
+
+        /* Buffers that straddle two chunks cannot use fixed operations */
+        if (offset >> FIXED_BUF_CHUNK_BITS !=
+            (offset + len - 1) >> FIXED_BUF_CHUNK_BITS) {
+            return -1;
+        }
+        return region->index + (offset >> FIXED_BUF_CHUNK_BITS);
+    }
+    return -1;
+}
+
+int aio_register_fixed_file(int fd)
+{
+    unsigned long index;
+    int ret;
+
+    QEMU_LOCK_GUARD(&fixed_lock);
+
+    index = find_first_zero_bit(fixed_files_used, FIXED_FILES);
+    if (QLIST_EMPTY(&fixed_contexts)) {
+        /* No io_uring has a registered file table to put @fd in */
+        ret = -ENODEV;
+    } else if (index >= FIXED_FILES) {
+        ret = -ENOSPC;
+    } else {
+        ret = fixed_file_update_all(index, fd);
+    }
+
+    trace_fdmon_io_uring_register_fixed_file(fd, ret < 0 ? -1 : (int)index,
+                                             ret);
+    if (ret < 0) {
+        return -1;
+    }
+
+    set_bit(index, fixed_files_used);
+    fixed_files[index] = fd;
+    return index;
+}
+
+void aio_unregister_fixed_file(int index)
+{
+    if (index < 0) {
+        return;
+    }
+
+    QEMU_LOCK_GUARD(&fixed_lock);
+
+    assert(test_bit(index, fixed_files_used));
+    fixed_file_update_all(index, -1);
+    clear_bit(index, fixed_files_used);
+}
+
+/*
+ * Set up the registered buffer and file tables of a new io_uring. If this
+ * fails, the io_uring cannot use the indices that the other io_urings use and
+ * requests in this AioContext just don't use registered buffers and files.
+ */
+static void fixed_setup(AioContext *ctx)
+{
+    struct io_uring *ring = &ctx->fdmon_io_uring;
+    FixedBufRegions *regions;
+    unsigned long i;
+
+    QEMU_LOCK_GUARD(&fixed_lock);
+
+    if (io_uring_register_buffers_sparse(ring, FIXED_BUFS) < 0) {
+        return;
+    }
+    if (io_uring_register_files_sparse(ring, FIXED_FILES) < 0) {
+        goto fail_bufs;
+    }
+
+    regions = fixed_buf_regions;
+    for (i = 0; regions && i < regions->nr; i++) {
+        FixedBufRegion *region = &regions->regions[i];
+
+        if (region->index >= 0 &&
+            fixed_buf_update(ring, region->index, region->host,
+                             region->size) < 0) {
+            goto fail;
+        }
+    }
+
+    for (i = find_first_bit(fixed_files_used, FIXED_FILES); i < FIXED_FILES;
+         i = find_next_bit(fixed_files_used, FIXED_FILES, i + 1)) {
+        if (io_uring_register_files_update(ring, i, &fixed_files[i], 1) < 0) {
+            goto fail;
+        }
+    }
+
+    ctx->io_uring_fixed = true;
+    QLIST_INSERT_HEAD(&fixed_contexts, ctx, io_uring_fixed_next);
+    return;
+
+fail:
+    io_uring_unregister_files(ring);
+fail_bufs:
+    io_uring_unregister_buffers(ring);
+}
+
+static void fixed_destroy(AioContext *ctx)
+{
+    QEMU_LOCK_GUARD(&fixed_lock);
+
+    if (ctx->io_uring_fixed) {
+        QLIST_REMOVE(ctx, io_uring_fixed_next);
+        ctx->io_uring_fixed = false;
+    }
+}
+#else /* !HAVE_IO_URING_REGISTER_SPARSE */
+void aio_register_fixed_buf(void *host, size_t size)
+{
+}
+
+void aio_unregister_fixed_buf(void *host, size_t size)
+{
+}
+
+int aio_fixed_buf_index(const void *buf, size_t len)
+{
+    return -1;
+}
+
+int aio_register_fixed_file(int fd)
+{
+    return -1;
+}
+
+void aio_unregister_fixed_file(int index)
+{
+}
+
+static void fixed_setup(AioContext *ctx)
+{
+}
+
+static void fixed_destroy(AioContext *ctx)
+{
+}
+#endif /* !HAVE_IO_URING_REGISTER_SPARSE */
+
 static const FDMonOps fdmon_io_uring_ops = {
     .update = fdmon_io_uring_update,
     .wait = fdmon_io_uring_wait,
@@ -452,20 +870,49 @@ static const FDMonOps fdmon_io_uring_ops = {
     .add_sqe = fdmon_io_uring_add_sqe,
 };
 
+bool aio_context_get_sqpoll_stats(AioContext *ctx,
+                                  AioContextSqpollStats *stats)
+{
+    if (!ctx->io_uring_sqpoll) {
+        return false;
+    }
+
+    *stats = (AioContextSqpollStats) {
+        .submissions = qatomic_read(&ctx->io_uring_sqpoll_submissions),
+        .syscalls_avoided =
+            qatomic_read(&ctx->io_uring_sqpoll_syscalls_avoided),
+        .wakeups = qatomic_read(&ctx->io_uring_sqpoll_wakeups),
+    };
+    return true;
+}
+
 bool fdmon_io_uring_setup(AioContext *ctx, Error **errp)
 {
+    struct io_uring_params params = {};
     int ret;
 
     ctx->io_uring_fd_tag = NULL;
 
-    ret = io_uring_queue_init(FDMON_IO_URING_ENTRIES, &ctx->fdmon_io_uring, 0);
+    if (ctx->io_uring_sqpoll) {
+        params.flags |= IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = ctx->io_uring_sqpoll_idle;
+        if (ctx->io_uring_sqpoll_cpu >= 0) {
+            params.flags |= IORING_SETUP_SQ_AFF;
+            params.sq_thread_cpu = ctx->io_uring_sqpoll_cpu;
+        }
+    }
+
+    ret = io_uring_queue_init_params(FDMON_IO_URING_ENTRIES,
+                                     &ctx->fdmon_io_uring, &params);
     if (ret != 0) {
-        error_setg_errno(errp, -ret, "Failed to initialize io_uring");
+        error_setg_errno(errp, -ret, "Failed to initialize io_uring%s",
+                         ctx->io_uring_sqpoll ? " with SQPOLL" : "");
         return false;
     }
 
     QSLIST_INIT(&ctx->submit_list);
     QSIMPLEQ_INIT(&ctx->cqe_handler_ready_list);
+    fixed_setup(ctx);
     ctx->fdmon_ops = &fdmon_io_uring_ops;
     ctx->io_uring_fd_tag = g_source_add_unix_fd(&ctx->source,
             ctx->fdmon_io_uring.ring_fd, G_IO_IN);
@@ -480,6 +927,7 @@ void fdmon_io_uring_destroy(AioContext *ctx)
         return;
     }
 
+    fixed_destroy(ctx);
     io_uring_queue_exit(&ctx->fdmon_io_uring);
 
     /* Move handlers due to be removed onto the deleted list */